@@ -0,0 +1,151 @@
+// Replays an allocation trace recorded with vuk::DeviceTracingResource and reports allocator behaviour
+// Runs without a GPU: the trace is replayed either on a vuk::DeviceNullResource, which simulates device memory,
+// or on a real allocator stack of a Context created on a vuk::NullDevice
+//
+// usage: vuk_allocation_replay <trace file> [--stack null|vk|superframe] [--repeat N]
+
+#include "vuk/NullDevice.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
+#include "vuk/resources/DeviceNullResource.hpp"
+#include "vuk/resources/DeviceTracingResource.hpp"
+#include "vuk/resources/DeviceVkResource.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace {
+	const char* usage_names[] = { "GPUonly", "CPUonly", "CPUtoGPU", "GPUtoCPU" };
+
+	enum class Stack { eNull, eVk, eSuperFrame };
+
+	void print_report(int run, const vuk::ReplayReport& report) {
+		printf("run %d: %llu frames, %llu allocations (%llu failed), %llu deallocations in %.3f ms (%.0f ops/s)\n",
+		       run,
+		       (unsigned long long)report.frames,
+		       (unsigned long long)report.allocations,
+		       (unsigned long long)report.failed_allocations,
+		       (unsigned long long)report.deallocations,
+		       report.seconds * 1000.0,
+		       report.operations_per_second());
+		printf("  peak live objects: %llu, peak buffer bytes: %llu\n", (unsigned long long)report.peak_live_objects, (unsigned long long)report.peak_buffer_bytes);
+	}
+
+	void replay_null(const vuk::AllocationTrace& trace, int repetitions) {
+		for (int i = 0; i < repetitions; i++) {
+			vuk::DeviceNullResource null_resource;
+			print_report(i, vuk::replay_trace(trace, null_resource));
+		}
+
+		// memory behaviour is deterministic, so measure it on a separate run where we can look at the state before the leftovers are freed
+		vuk::DeviceNullResource null_resource;
+		std::array<vuk::NullMemoryStats, 4> at_end = {};
+		vuk::replay_trace(trace, null_resource, [&](uint64_t) -> vuk::DeviceResource& {
+			at_end = null_resource.get_memory_stats();
+			return null_resource;
+		});
+		auto stats = null_resource.get_memory_stats();
+		for (size_t i = 0; i < stats.size(); i++) {
+			if (stats[i].peak_bytes == 0) {
+				continue;
+			}
+			printf("%-8s peak: %llu bytes, at last frame boundary: %llu bytes in %llu allocations, fragmentation %.1f%%\n",
+			       usage_names[i],
+			       (unsigned long long)stats[i].peak_bytes,
+			       (unsigned long long)at_end[i].allocated_bytes,
+			       (unsigned long long)at_end[i].allocation_count,
+			       at_end[i].fragmentation() * 100.f);
+		}
+	}
+
+	void replay_on_device(const vuk::AllocationTrace& trace, int repetitions, Stack stack) {
+		for (int i = 0; i < repetitions; i++) {
+			vuk::NullDevice null_device;
+			vuk::Context ctx(null_device.get_context_create_parameters());
+			auto& vk_resource = ctx.get_vk_resource();
+			std::vector<vuk::HeapMemoryStats> at_end;
+			auto sample = [&] {
+				at_end = vk_resource.get_memory_stats().heaps;
+			};
+
+			vuk::ReplayReport report;
+			if (stack == Stack::eVk) {
+				report = vuk::replay_trace(trace, vk_resource, [&](uint64_t) -> vuk::DeviceResource& {
+					sample();
+					return vk_resource;
+				});
+			} else {
+				vuk::DeviceSuperFrameResource sfr(ctx, 3);
+				report = vuk::replay_trace(trace, sfr.get_next_frame(), [&](uint64_t) -> vuk::DeviceResource& {
+					sample();
+					ctx.next_frame();
+					return sfr.get_next_frame();
+				});
+			}
+			print_report(i, report);
+			for (size_t h = 0; h < at_end.size(); h++) {
+				auto& heap = at_end[h];
+				float fragmentation = heap.usage == 0 ? 0.f : 1.f - (float)heap.allocated_bytes / (float)heap.usage;
+				printf("  heap %zu at last frame boundary: %llu bytes in %llu allocations, %llu bytes of blocks, fragmentation %.1f%%\n",
+				       h,
+				       (unsigned long long)heap.allocated_bytes,
+				       (unsigned long long)heap.allocation_count,
+				       (unsigned long long)heap.usage,
+				       fragmentation * 100.f);
+			}
+		}
+	}
+} // namespace
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <trace file> [--stack null|vk|superframe] [--repeat N]\n", argv[0]);
+		return 1;
+	}
+	Stack stack = Stack::eNull;
+	int repetitions = 1;
+	for (int i = 2; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if (arg == "--stack" && i + 1 < argc) {
+			std::string_view name = argv[++i];
+			if (name == "null") {
+				stack = Stack::eNull;
+			} else if (name == "vk") {
+				stack = Stack::eVk;
+			} else if (name == "superframe") {
+				stack = Stack::eSuperFrame;
+			} else {
+				fprintf(stderr, "unknown stack %s\n", argv[i]);
+				return 1;
+			}
+		} else if (arg == "--repeat" && i + 1 < argc) {
+			repetitions = std::max(atoi(argv[++i]), 1);
+		} else {
+			fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::ifstream file(argv[1], std::ios::binary);
+	if (!file) {
+		fprintf(stderr, "could not open %s\n", argv[1]);
+		return 1;
+	}
+	auto trace = vuk::AllocationTrace::deserialize(file);
+	if (!trace) {
+		fprintf(stderr, "%s is not a valid allocation trace\n", argv[1]);
+		return 1;
+	}
+
+	printf("%zu events\n", trace->events.size());
+	if (stack == Stack::eNull) {
+		replay_null(*trace, repetitions);
+	} else {
+		replay_on_device(*trace, repetitions, stack);
+	}
+	return 0;
+}
@@ -0,0 +1,640 @@
+// Headless micro-benchmarks of the CPU paths of vuk - runs without a GPU or window
+// Benchmarks that need a Context run it on a vuk::NullDevice, so they measure vuk and not the driver
+//
+// Results are written to stdout as JSON, progress goes to stderr
+// With --compare, the results are compared to a baseline written by an earlier run, and the exit code is 1 if any benchmark regressed
+//
+// usage: vuk_cpu_benchmarks [--filter <substring>] [--min-time <ms>] [--samples N] [--compare <baseline.json>] [--threshold <percent>]
+
+#include "../src/Cache.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/Descriptor.hpp"
+#include "vuk/NullDevice.hpp"
+#include "vuk/PipelineInstance.hpp"
+#include "vuk/RenderGraph.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
+#include "vuk/resources/DeviceLinearResource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	/// runs `iterations` operations and returns the seconds spent in the measured part
+	using BenchmarkFn = std::function<double(uint64_t iterations)>;
+
+	struct Benchmark {
+		std::string name;
+		BenchmarkFn fn;
+	};
+
+	struct BenchmarkResult {
+		std::string name;
+		uint64_t iterations;
+		double ns_per_op;     // median over the samples
+		double min_ns_per_op; // best sample
+	};
+
+	template<class F>
+	double time_seconds(F&& f) {
+		auto start = clock_type::now();
+		f();
+		return std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+
+	// prevent the compiler from optimizing away the benchmarked computation
+	template<class T>
+	void do_not_optimize(const T& value) {
+		static const void* volatile sink;
+		sink = &value;
+	}
+
+	vuk::Buffer fake_buffer(uint64_t i) {
+		vuk::Buffer buf;
+		buf.buffer = reinterpret_cast<VkBuffer>(uintptr_t(0x1000 + i));
+		buf.size = 1024;
+		buf.memory_usage = vuk::MemoryUsage::eGPUonly;
+		return buf;
+	}
+
+	std::vector<vuk::Name> make_names(std::string_view prefix, size_t count) {
+		std::vector<vuk::Name> names;
+		names.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			names.emplace_back(std::string(prefix) + std::to_string(i));
+		}
+		return names;
+	}
+
+	// Name
+
+	void add_name_benchmarks(std::vector<Benchmark>& benchmarks) {
+		benchmarks.push_back({ "name/intern_existing", [](uint64_t iterations) {
+			                      static std::vector<std::string> strings = [] {
+				                      std::vector<std::string> strings;
+				                      for (size_t i = 0; i < 1024; i++) {
+					                      strings.push_back("existing_resource_" + std::to_string(i));
+					                      vuk::Name{ strings.back() };
+				                      }
+				                      return strings;
+			                      }();
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      vuk::Name n{ std::string_view(strings[i % strings.size()]) };
+					                      do_not_optimize(n);
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "name/intern_new", [](uint64_t iterations) {
+			                      // interned names are never freed, so every sample needs fresh strings
+			                      static uint64_t counter = 0;
+			                      std::vector<std::string> strings;
+			                      strings.reserve(iterations);
+			                      for (uint64_t i = 0; i < iterations; i++) {
+				                      strings.push_back("new_resource_" + std::to_string(counter++));
+			                      }
+			                      return time_seconds([&] {
+				                      for (auto& s : strings) {
+					                      vuk::Name n{ std::string_view(s) };
+					                      do_not_optimize(n);
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "name/append_existing", [](uint64_t iterations) {
+			                      vuk::Name base = "appended_resource";
+			                      base.append("+");
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      auto n = base.append("+");
+					                      do_not_optimize(n);
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "name/hash", [](uint64_t iterations) {
+			                      auto names = make_names("hashed_resource_", 1024);
+			                      size_t h = 0;
+			                      auto seconds = time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      h ^= std::hash<vuk::Name>{}(names[i % names.size()]);
+				                      }
+			                      });
+			                      do_not_optimize(h);
+			                      return seconds;
+		                      } });
+	}
+
+	// Cache<T>::acquire
+
+	vuk::Sampler create_fake_sampler(void*, const vuk::SamplerCreateInfo&) {
+		static uint64_t id = 0;
+		return vuk::Sampler{ { ++id }, reinterpret_cast<VkSampler>(uintptr_t(id)) };
+	}
+
+	void destroy_fake_sampler(void*, const vuk::Sampler&) {}
+
+	void add_cache_benchmarks(std::vector<Benchmark>& benchmarks) {
+		benchmarks.push_back({ "cache/acquire_hit", [](uint64_t iterations) {
+			                      vuk::Cache<vuk::Sampler> cache(nullptr, create_fake_sampler, destroy_fake_sampler);
+			                      std::vector<vuk::SamplerCreateInfo> cis(256);
+			                      for (size_t i = 0; i < cis.size(); i++) {
+				                      cis[i].mipLodBias = (float)i;
+				                      cache.acquire(cis[i], 0);
+			                      }
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      auto& s = cache.acquire(cis[i % cis.size()], i);
+					                      do_not_optimize(s);
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "cache/acquire_miss", [](uint64_t iterations) {
+			                      vuk::Cache<vuk::Sampler> cache(nullptr, create_fake_sampler, destroy_fake_sampler);
+			                      std::vector<vuk::SamplerCreateInfo> cis(iterations);
+			                      for (uint64_t i = 0; i < iterations; i++) {
+				                      cis[i].mipLodBias = (float)i;
+				                      cis[i].maxAnisotropy = (float)(i >> 20);
+			                      }
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      auto& s = cache.acquire(cis[i], 0);
+					                      do_not_optimize(s);
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "cache/collect_1k", [](uint64_t iterations) {
+			                      vuk::Cache<vuk::Sampler> cache(nullptr, create_fake_sampler, destroy_fake_sampler);
+			                      std::vector<vuk::SamplerCreateInfo> cis(1024);
+			                      for (size_t i = 0; i < cis.size(); i++) {
+				                      cis[i].mipLodBias = (float)i;
+				                      cache.acquire(cis[i], 0);
+			                      }
+			                      // nothing is old enough to be collected, this measures the walk over the entries
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      cache.collect(0, 16);
+				                      }
+			                      });
+		                      } });
+	}
+
+	// create info hashing
+
+	template<class T>
+	BenchmarkFn hash_benchmark(std::vector<T> values) {
+		return [values = std::move(values)](uint64_t iterations) {
+			size_t h = 0;
+			auto seconds = time_seconds([&] {
+				for (uint64_t i = 0; i < iterations; i++) {
+					h ^= std::hash<T>{}(values[i % values.size()]);
+				}
+			});
+			do_not_optimize(h);
+			return seconds;
+		};
+	}
+
+	void add_hash_benchmarks(std::vector<Benchmark>& benchmarks) {
+		{
+			std::vector<vuk::GraphicsPipelineInstanceCreateInfo> gpcis(64);
+			for (size_t i = 0; i < gpcis.size(); i++) {
+				auto& gpci = gpcis[i];
+				gpci.base = reinterpret_cast<vuk::PipelineBaseInfo*>(uintptr_t(0x1000 + i));
+				gpci.extended_size = 64;
+				for (size_t j = 0; j < 64; j++) {
+					gpci.inline_data[j] = std::byte(i + j);
+				}
+			}
+			benchmarks.push_back({ "hash/graphics_pipeline_instance", hash_benchmark(std::move(gpcis)) });
+		}
+		{
+			std::vector<vuk::SamplerCreateInfo> scis(64);
+			for (size_t i = 0; i < scis.size(); i++) {
+				scis[i].mipLodBias = (float)i;
+			}
+			benchmarks.push_back({ "hash/sampler", hash_benchmark(std::move(scis)) });
+		}
+		{
+			std::vector<vuk::ImageCreateInfo> icis(64);
+			for (size_t i = 0; i < icis.size(); i++) {
+				icis[i].extent = { (uint32_t)i + 1, 256, 1 };
+				icis[i].format = vuk::Format::eR8G8B8A8Unorm;
+				icis[i].usage = vuk::ImageUsageFlagBits::eSampled | vuk::ImageUsageFlagBits::eTransferDst;
+			}
+			benchmarks.push_back({ "hash/image", hash_benchmark(std::move(icis)) });
+		}
+		{
+			std::vector<vuk::ImageViewCreateInfo> ivcis(64);
+			for (size_t i = 0; i < ivcis.size(); i++) {
+				ivcis[i].image = reinterpret_cast<VkImage>(uintptr_t(0x1000 + i));
+				ivcis[i].format = vuk::Format::eR8G8B8A8Unorm;
+				ivcis[i].subresourceRange = { .aspectMask = vuk::ImageAspectFlagBits::eColor, .levelCount = 1, .layerCount = 1 };
+			}
+			benchmarks.push_back({ "hash/image_view", hash_benchmark(std::move(ivcis)) });
+		}
+		{
+			std::vector<vuk::DescriptorSetLayoutAllocInfo> dslais(64);
+			for (size_t i = 0; i < dslais.size(); i++) {
+				dslais[i].descriptor_counts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = (uint32_t)i;
+				dslais[i].layout = reinterpret_cast<VkDescriptorSetLayout>(uintptr_t(0x1000 + i));
+			}
+			benchmarks.push_back({ "hash/descriptor_set_layout_alloc_info", hash_benchmark(std::move(dslais)) });
+		}
+	}
+
+	// Compiler::compile on synthetic graphs
+
+	// a chain of passes, each reading and writing the result of the previous one
+	std::shared_ptr<vuk::RenderGraph> make_chain_graph(size_t passes) {
+		static std::vector<vuk::Name> names;
+		if (names.size() < passes + 1) {
+			names = make_names("chain_", passes + 1);
+		}
+		auto rg = std::make_shared<vuk::RenderGraph>("chain");
+		rg->attach_buffer(names[0], fake_buffer(0), vuk::eNone);
+		for (size_t i = 0; i < passes; i++) {
+			rg->add_pass({ .name = names[i + 1], .resources = { vuk::Resource{ names[i], vuk::Resource::Type::eBuffer, vuk::eComputeRW, names[i + 1] } } });
+		}
+		return rg;
+	}
+
+	// a producer and passes - 1 consumers, each consumer writes its own buffer
+	std::shared_ptr<vuk::RenderGraph> make_fan_out_graph(size_t passes) {
+		static std::vector<vuk::Name> names;
+		static std::vector<vuk::Name> out_names;
+		if (names.size() < passes) {
+			names = make_names("fan_out_", passes);
+			out_names = make_names("fan_out_written_", passes);
+		}
+		auto rg = std::make_shared<vuk::RenderGraph>("fan_out");
+		rg->attach_buffer("source", fake_buffer(0), vuk::eNone);
+		rg->add_pass({ .name = "produce", .resources = { vuk::Resource{ "source", vuk::Resource::Type::eBuffer, vuk::eTransferWrite, "source+" } } });
+		for (size_t i = 1; i < passes; i++) {
+			rg->attach_buffer(names[i], fake_buffer(i), vuk::eNone);
+			rg->add_pass({ .name = out_names[i],
+			               .resources = { vuk::Resource{ "source+", vuk::Resource::Type::eBuffer, vuk::eComputeRead },
+			                              vuk::Resource{ names[i], vuk::Resource::Type::eBuffer, vuk::eComputeWrite, out_names[i] } } });
+		}
+		return rg;
+	}
+
+	// a stack of subgraphs, each consuming the result of the one below it through a Future
+	std::shared_ptr<vuk::RenderGraph> make_nested_graph(size_t depth, size_t passes_per_level) {
+		static std::vector<vuk::Name> names;
+		static std::vector<vuk::Name> graph_names;
+		if (names.size() < passes_per_level + 1) {
+			names = make_names("nested_", passes_per_level + 1);
+		}
+		if (graph_names.size() < depth) {
+			graph_names = make_names("level_", depth);
+		}
+		std::shared_ptr<vuk::RenderGraph> below;
+		for (size_t level = 0; level < depth; level++) {
+			auto rg = std::make_shared<vuk::RenderGraph>(graph_names[level]);
+			if (below) {
+				rg->attach_in(names[0], vuk::Future{ below, names[passes_per_level] });
+			} else {
+				rg->attach_buffer(names[0], fake_buffer(0), vuk::eNone);
+			}
+			for (size_t i = 0; i < passes_per_level; i++) {
+				rg->add_pass({ .name = names[i + 1], .resources = { vuk::Resource{ names[i], vuk::Resource::Type::eBuffer, vuk::eComputeRW, names[i + 1] } } });
+			}
+			below = std::move(rg);
+		}
+		return below;
+	}
+
+	BenchmarkFn compile_benchmark(std::function<std::shared_ptr<vuk::RenderGraph>()> make_graph) {
+		return [make_graph = std::move(make_graph)](uint64_t iterations) {
+			vuk::Compiler compiler;
+			double seconds = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				// building the graph is not measured
+				auto rg = make_graph();
+				seconds += time_seconds([&] {
+					auto result = compiler.compile(std::span{ &rg, 1 }, {});
+					if (!result) {
+						fprintf(stderr, "compilation failed: %s\n", result.error().what());
+						exit(2);
+					}
+				});
+			}
+			return seconds;
+		};
+	}
+
+	void add_compile_benchmarks(std::vector<Benchmark>& benchmarks) {
+		for (size_t passes : { 10, 100, 1000, 10000 }) {
+			benchmarks.push_back({ "compile/chain_" + std::to_string(passes), compile_benchmark([passes] { return make_chain_graph(passes); }) });
+		}
+		for (size_t passes : { 10, 100, 1000, 10000 }) {
+			benchmarks.push_back({ "compile/fan_out_" + std::to_string(passes), compile_benchmark([passes] { return make_fan_out_graph(passes); }) });
+		}
+		for (size_t depth : { 4, 32, 256 }) {
+			benchmarks.push_back({ "compile/nested_" + std::to_string(depth) + "x4", compile_benchmark([depth] { return make_nested_graph(depth, 4); }) });
+		}
+	}
+
+	// allocators - on a Context running on a NullDevice
+
+	void add_allocator_benchmarks(std::vector<Benchmark>& benchmarks, vuk::Context& ctx) {
+		for (VkDeviceSize size : { 256, 65536 }) {
+			benchmarks.push_back({ "linear/frame_buffer_" + std::to_string(size), [&ctx, size](uint64_t iterations) {
+				                      vuk::DeviceSuperFrameResource sfr(ctx, 3);
+				                      vuk::BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = size, .alignment = 16 };
+				                      return time_seconds([&] {
+					                      auto* frame = &sfr.get_next_frame();
+					                      for (uint64_t i = 0; i < iterations; i++) {
+						                      // recycling frames is part of the cost of frame allocation
+						                      if (i % 4096 == 4095) {
+							                      ctx.next_frame();
+							                      frame = &sfr.get_next_frame();
+						                      }
+						                      vuk::Buffer buf;
+						                      if (!frame->allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW())) {
+							                      fprintf(stderr, "buffer allocation failed\n");
+							                      exit(2);
+						                      }
+						                      do_not_optimize(buf);
+					                      }
+				                      });
+			                      } });
+		}
+		benchmarks.push_back({ "linear/frame_buffer_256_8_threads", [&ctx](uint64_t iterations) {
+			                      // the threads allocate from the same frame, in batches so that frames are recycled as in the single threaded case
+			                      // starting the threads is part of the measurement, a batch is large enough for it not to dominate
+			                      const uint64_t num_threads = 8;
+			                      const uint64_t batch_size = num_threads * 4096;
+			                      vuk::DeviceSuperFrameResource sfr(ctx, 3);
+			                      vuk::BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = 256, .alignment = 16 };
+			                      double seconds = 0;
+			                      for (uint64_t done = 0; done < iterations;) {
+				                      ctx.next_frame();
+				                      auto& frame = sfr.get_next_frame();
+				                      auto per_thread = (std::min(iterations - done, batch_size) + num_threads - 1) / num_threads;
+				                      seconds += time_seconds([&] {
+					                      std::vector<std::thread> threads;
+					                      for (uint64_t t = 0; t < num_threads; t++) {
+						                      threads.emplace_back([&] {
+							                      for (uint64_t i = 0; i < per_thread; i++) {
+								                      vuk::Buffer buf;
+								                      if (!frame.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW())) {
+									                      fprintf(stderr, "buffer allocation failed\n");
+									                      exit(2);
+								                      }
+								                      do_not_optimize(buf);
+							                      }
+						                      });
+					                      }
+					                      for (auto& t : threads) {
+						                      t.join();
+					                      }
+				                      });
+				                      done += per_thread * num_threads;
+			                      }
+			                      return seconds;
+		                      } });
+		benchmarks.push_back({ "linear/linear_resource_buffer_256", [&ctx](uint64_t iterations) {
+			                      double seconds = 0;
+			                      vuk::BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eCPUtoGPU, .size = 256, .alignment = 16 };
+			                      for (uint64_t done = 0; done < iterations;) {
+				                      vuk::DeviceLinearResource linear(ctx.get_vk_resource());
+				                      auto batch = std::min<uint64_t>(iterations - done, 4096);
+				                      seconds += time_seconds([&] {
+					                      for (uint64_t i = 0; i < batch; i++) {
+						                      vuk::Buffer buf;
+						                      if (!linear.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW())) {
+							                      fprintf(stderr, "buffer allocation failed\n");
+							                      exit(2);
+						                      }
+						                      do_not_optimize(buf);
+					                      }
+				                      });
+				                      done += batch;
+			                      }
+			                      return seconds;
+		                      } });
+	}
+
+	// descriptor set building - on a Context running on a NullDevice
+
+	void add_descriptor_benchmarks(std::vector<Benchmark>& benchmarks, vuk::Context& ctx) {
+		static vuk::DescriptorSetLayoutAllocInfo layout_info = [] {
+			vuk::DescriptorSetLayoutAllocInfo layout_info{};
+			layout_info.descriptor_counts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = 4;
+			layout_info.descriptor_counts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] = 1;
+			layout_info.layout = reinterpret_cast<VkDescriptorSetLayout>(uintptr_t(0x1000));
+			return layout_info;
+		}();
+		auto make_set_binding = [](uint64_t variant) {
+			vuk::SetBinding sb;
+			sb.layout_info = &layout_info;
+			sb.bindings[0].type = vuk::DescriptorType::eUniformBuffer;
+			sb.bindings[0].buffer = VkDescriptorBufferInfo{ fake_buffer(0).buffer, 256 * (variant % 64), 256 };
+			sb.used.set(0);
+			for (uint32_t i = 1; i < 5; i++) {
+				sb.bindings[i].type = vuk::DescriptorType::eStorageBuffer;
+				sb.bindings[i].buffer = VkDescriptorBufferInfo{ fake_buffer(i).buffer, 0, VK_WHOLE_SIZE };
+				sb.used.set(i);
+			}
+			return sb;
+		};
+
+		benchmarks.push_back({ "descriptor/build_with_value", [&ctx, make_set_binding](uint64_t iterations) {
+			                      auto& resource = ctx.get_vk_resource();
+			                      auto sb = make_set_binding(0);
+			                      return time_seconds([&] {
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      sb.bindings[0].buffer.offset = 256 * (i % 64);
+					                      auto final_sb = sb.finalize(sb.used);
+					                      vuk::DescriptorSet ds;
+					                      if (!resource.allocate_descriptor_sets_with_value(std::span{ &ds, 1 }, std::span{ &final_sb, 1 }, VUK_HERE_AND_NOW())) {
+						                      fprintf(stderr, "descriptor set allocation failed\n");
+						                      exit(2);
+					                      }
+					                      resource.deallocate_descriptor_sets(std::span{ &ds, 1 });
+				                      }
+			                      });
+		                      } });
+		benchmarks.push_back({ "descriptor/frame_allocate", [&ctx](uint64_t iterations) {
+			                      vuk::DeviceSuperFrameResource sfr(ctx, 3);
+			                      return time_seconds([&] {
+				                      auto* frame = &sfr.get_next_frame();
+				                      for (uint64_t i = 0; i < iterations; i++) {
+					                      if (i % 1024 == 1023) {
+						                      ctx.next_frame();
+						                      frame = &sfr.get_next_frame();
+					                      }
+					                      vuk::DescriptorSet ds;
+					                      if (!frame->allocate_descriptor_sets(std::span{ &ds, 1 }, std::span{ &layout_info, 1 }, VUK_HERE_AND_NOW())) {
+						                      fprintf(stderr, "descriptor set allocation failed\n");
+						                      exit(2);
+					                      }
+					                      do_not_optimize(ds);
+				                      }
+			                      });
+		                      } });
+	}
+
+	// running and reporting
+
+	BenchmarkResult run_benchmark(const Benchmark& benchmark, double min_time, unsigned samples) {
+		// find an iteration count where a sample takes long enough to be measured reliably
+		uint64_t iterations = 1;
+		double target = min_time / samples;
+		for (;;) {
+			double seconds = benchmark.fn(iterations);
+			if (seconds >= target || iterations >= (1ull << 30)) {
+				break;
+			}
+			double scale = seconds > 0 ? 1.4 * target / seconds : 100.0;
+			iterations = std::max(iterations + 1, (uint64_t)(iterations * std::min(scale, 100.0)));
+		}
+
+		std::vector<double> ns_per_op;
+		for (unsigned i = 0; i < samples; i++) {
+			ns_per_op.push_back(benchmark.fn(iterations) * 1e9 / iterations);
+		}
+		std::sort(ns_per_op.begin(), ns_per_op.end());
+		return { benchmark.name, iterations, ns_per_op[ns_per_op.size() / 2], ns_per_op.front() };
+	}
+
+	void write_json(FILE* out, const std::vector<BenchmarkResult>& results) {
+		fprintf(out, "{\n  \"benchmarks\": [\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			auto& r = results[i];
+			fprintf(out,
+			        "    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f }%s\n",
+			        r.name.c_str(),
+			        (unsigned long long)r.iterations,
+			        r.ns_per_op,
+			        r.min_ns_per_op,
+			        i + 1 < results.size() ? "," : "");
+		}
+		fprintf(out, "  ]\n}\n");
+	}
+
+	// reads back the ns_per_op of the benchmarks written by write_json()
+	std::optional<std::unordered_map<std::string, double>> read_baseline(const char* path) {
+		std::ifstream file(path);
+		if (!file) {
+			return {};
+		}
+		std::stringstream ss;
+		ss << file.rdbuf();
+		std::string json = ss.str();
+
+		std::unordered_map<std::string, double> baseline;
+		size_t pos = 0;
+		while ((pos = json.find('{', pos + 1)) != std::string::npos) {
+			auto end = json.find('}', pos);
+			if (end == std::string::npos) {
+				break;
+			}
+			std::string_view object = std::string_view(json).substr(pos, end - pos);
+			auto name_key = object.find("\"name\"");
+			auto value_key = object.find("\"ns_per_op\"");
+			if (name_key == std::string_view::npos || value_key == std::string_view::npos) {
+				continue;
+			}
+			auto name_begin = object.find('"', object.find(':', name_key)) + 1;
+			auto name_end = object.find('"', name_begin);
+			auto value_begin = object.find(':', value_key) + 1;
+			baseline[std::string(object.substr(name_begin, name_end - name_begin))] = strtod(object.data() + value_begin, nullptr);
+		}
+		return baseline;
+	}
+
+	bool compare(const std::vector<BenchmarkResult>& results, const std::unordered_map<std::string, double>& baseline, double threshold) {
+		bool regressed = false;
+		fprintf(stderr, "\n%-48s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+		for (auto& r : results) {
+			auto it = baseline.find(r.name);
+			if (it == baseline.end()) {
+				fprintf(stderr, "%-48s %14s %14.1f %9s\n", r.name.c_str(), "-", r.ns_per_op, "new");
+				continue;
+			}
+			double change = it->second > 0 ? (r.ns_per_op - it->second) / it->second * 100.0 : 0.0;
+			bool is_regression = change > threshold;
+			regressed |= is_regression;
+			fprintf(stderr, "%-48s %14.1f %14.1f %+8.1f%%%s\n", r.name.c_str(), it->second, r.ns_per_op, change, is_regression ? "  REGRESSION" : "");
+		}
+		return regressed;
+	}
+} // namespace
+
+int main(int argc, char** argv) {
+	std::string_view filter;
+	double min_time = 0.5;
+	unsigned samples = 5;
+	const char* baseline_path = nullptr;
+	double threshold = 10.0;
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (arg == "--min-time" && i + 1 < argc) {
+			min_time = std::max(atof(argv[++i]), 1.0) / 1000.0;
+		} else if (arg == "--samples" && i + 1 < argc) {
+			samples = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--compare" && i + 1 < argc) {
+			baseline_path = argv[++i];
+		} else if (arg == "--threshold" && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		} else {
+			fprintf(stderr,
+			        "usage: %s [--filter <substring>] [--min-time <ms>] [--samples N] [--compare <baseline.json>] [--threshold <percent>]\n",
+			        argv[0]);
+			return 1;
+		}
+	}
+
+	std::optional<std::unordered_map<std::string, double>> baseline;
+	if (baseline_path) {
+		baseline = read_baseline(baseline_path);
+		if (!baseline) {
+			fprintf(stderr, "could not read baseline %s\n", baseline_path);
+			return 1;
+		}
+	}
+
+	vuk::NullDevice null_device;
+	vuk::Context ctx(null_device.get_context_create_parameters());
+
+	std::vector<Benchmark> benchmarks;
+	add_name_benchmarks(benchmarks);
+	add_cache_benchmarks(benchmarks);
+	add_hash_benchmarks(benchmarks);
+	add_compile_benchmarks(benchmarks);
+	add_allocator_benchmarks(benchmarks, ctx);
+	add_descriptor_benchmarks(benchmarks, ctx);
+
+	std::vector<BenchmarkResult> results;
+	for (auto& benchmark : benchmarks) {
+		if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		fprintf(stderr, "%-48s", benchmark.name.c_str());
+		auto& r = results.emplace_back(run_benchmark(benchmark, min_time, samples));
+		fprintf(stderr, " %12.1f ns/op (min %.1f, %llu iterations)\n", r.ns_per_op, r.min_ns_per_op, (unsigned long long)r.iterations);
+	}
+
+	write_json(stdout, results);
+
+	if (baseline && compare(results, *baseline, threshold)) {
+		return 1;
+	}
+	return 0;
+}
@@ -1,12 +1,7 @@
 #include "bench_runner.hpp"
 
-/* 01_triangle
- * In this example we will draw a bufferless triangle, the "Hello world" of graphics programming
- * For this, we will need to define our pipeline, and then submit a draw.
- *
- * These examples are powered by the example framework, which hides some of the code required, as that would be repeated for each example.
- * Furthermore it allows launching individual examples and all examples with the example same code.
- * Check out the framework (example_runner_*) files if interested!
+/* draw_overhead
+ * Measures the GPU time of issuing a number of draws in one call versus in separate calls, with the pipeline bound once
  */
 
 namespace {
@@ -22,26 +17,25 @@ namespace {
 
 	vuk::Bench<V1, V2> x{
 		// The display name of this example
-		.base = { .name = "Dependent vs. non-dependent texture fetch",
+		.base = { .name = "Draw overhead",
 		          // Setup code, ran once in the beginning
 		          .setup =
 		              [](vuk::BenchRunner& runner, vuk::Allocator& frame_allocator) {
 		                // Pipelines are created by filling out a vuk::PipelineCreateInfo
 		                // In this case, we only need the shaders, we don't care about the rest of the state
 		                vuk::PipelineBaseCreateInfo pci;
-		                pci.add_glsl(util::read_entire_file("../../examples/triangle.vert"), "triangle.vert");
-		                pci.add_glsl(util::read_entire_file("../../examples/triangle.frag"), "triangle.frag");
+		                pci.add_glsl(util::read_entire_file(VUK_EX_PATH_TO_ROOT "examples/triangle.vert"), VUK_EX_PATH_TO_ROOT "examples/triangle.vert");
+		                pci.add_glsl(util::read_entire_file(VUK_EX_PATH_TO_ROOT "examples/triangle.frag"), VUK_EX_PATH_TO_ROOT "examples/triangle.frag");
 		                // The pipeline is stored with a user give name for simplicity
 		                runner.context->create_named_pipeline("triangle", pci);
 		              },
 		          .gui =
 		              [](vuk::BenchRunner& runner, vuk::Allocator& frame_allocator) {
 		              } },
-		.cases = { { "Dependent, small image",
+		.cases = { { "Single draw call",
 		             [](vuk::BenchRunner& runner, vuk::Allocator& frame_allocator, vuk::Query start, vuk::Query end, auto&& parameters) {
-		               auto ptc = ifc.begin();
 		               vuk::RenderGraph rg;
-		               rg.add_pass({ .resources = { "_final"_image(vuk::eColorWrite) }, .execute = [start, end, parameters](vuk::CommandBuffer& command_buffer) {
+		               rg.add_pass({ .resources = { "_final"_image >> vuk::eColorWrite }, .execute = [start, end, parameters](vuk::CommandBuffer& command_buffer) {
 			                            vuk::TimedScope _{ command_buffer, start, end };
 			                            command_buffer.set_viewport(0, vuk::Rect2D::framebuffer());
 			                            command_buffer
@@ -51,11 +45,10 @@ namespace {
 		                            } });
 		               return rg;
 		             } },
-		           { "Non-dependent, small image",
+		           { "Separate draw calls",
 		             [](vuk::BenchRunner& runner, vuk::Allocator& frame_allocator, vuk::Query start, vuk::Query end, auto&& parameters) {
-		               auto ptc = ifc.begin();
 		               vuk::RenderGraph rg;
-		               rg.add_pass({ .resources = { "_final"_image(vuk::eColorWrite) }, .execute = [start, end, parameters](vuk::CommandBuffer& command_buffer) {
+		               rg.add_pass({ .resources = { "_final"_image >> vuk::eColorWrite }, .execute = [start, end, parameters](vuk::CommandBuffer& command_buffer) {
 			                            vuk::TimedScope _{ command_buffer, start, end };
 			                            command_buffer.set_viewport(0, vuk::Rect2D::framebuffer());
 			                            command_buffer.set_scissor(0, vuk::Rect2D::framebuffer()).bind_graphics_pipeline("triangle");
@@ -197,6 +197,8 @@ namespace {
 			      vuk::PipelineBaseCreateInfo pci;
 			      pci.add_glsl(util::read_entire_file((root / "examples/baby_renderer.vert").generic_string()), (root / "examples/baby_renderer.vert").generic_string());
 			      pci.add_glsl(util::read_entire_file((root / "examples/triangle_tinted_tex.frag").generic_string()), (root / "examples/triangle_tinted_tex.frag").generic_string());
+			      // the tint changes per draw - with a dynamic binding, only the offset into the scratch ring changes
+			      pci.set_binding_dynamic(0, 3);
 			      pipe2 = runner.context->get_pipeline(pci);
 		      }
 
@@ -119,6 +119,7 @@ namespace vuk {
 		ici.tiling = attachment.tiling;
 		ici.mipLevels = attachment.level_count;
 		ici.usage = attachment.usage;
+		ici.sharingMode = attachment.sharing_mode;
 		assert(attachment.extent.sizing == Sizing::eAbsolute);
 		ici.extent = static_cast<vuk::Extent3D>(attachment.extent.extent);
 
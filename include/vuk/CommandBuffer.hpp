@@ -10,8 +10,10 @@
 #include "vuk/Types.hpp"
 #include "vuk/vuk_fwd.hpp"
 
+#include <memory>
 #include <optional>
 #include <utility>
+#include <vector>
 
 namespace vuk {
 	class Context;
@@ -151,6 +153,7 @@ namespace vuk {
 	struct PassInfo;
 	struct Query;
 	class Allocator;
+	class CommandStream;
 
 	class CommandBuffer {
 	protected:
@@ -164,6 +167,7 @@ namespace vuk {
 
 		struct RenderPassInfo {
 			VkRenderPass render_pass;
+			VkFramebuffer framebuffer;
 			uint32_t subpass;
 			Extent2D extent;
 			SampleCountFlagBits samples;
@@ -222,11 +226,87 @@ namespace vuk {
 		DescriptorSetStrategyFlags ds_strategy_flags = {};
 		Bitset<VUK_MAX_SETS> sets_used = {};
 		VkDescriptorSetLayout set_layouts_used[VUK_MAX_SETS] = {};
+		VkDescriptorSet descriptor_sets_used[VUK_MAX_SETS] = {};
 		Bitset<VUK_MAX_SETS> sets_to_bind = {};
 		SetBinding set_bindings[VUK_MAX_SETS] = {};
 		Bitset<VUK_MAX_SETS> persistent_sets_to_bind = {};
 		std::pair<VkDescriptorSet, VkDescriptorSetLayout> persistent_sets[VUK_MAX_SETS] = {};
 
+		// Shadow of the state bound in the underlying VkCommandBuffer - calls that would bind the same values again are elided
+		struct BoundState {
+			VkPipeline pipelines[3] = {}; // per PipeType
+			VkDescriptorSet sets[3][VUK_MAX_SETS] = {};
+			VkPipelineLayout set_layouts[3][VUK_MAX_SETS] = {};
+			VkBuffer vertex_buffers[VUK_MAX_ATTRIBUTES] = {};
+			VkDeviceSize vertex_buffer_offsets[VUK_MAX_ATTRIBUTES] = {};
+			VkBuffer index_buffer = VK_NULL_HANDLE;
+			VkDeviceSize index_buffer_offset = 0;
+			VkIndexType index_type = VK_INDEX_TYPE_MAX_ENUM;
+			Bitset<VUK_MAX_VIEWPORTS> set_viewports = {};
+			VkViewport viewports[VUK_MAX_VIEWPORTS];
+			Bitset<VUK_MAX_SCISSORS> set_scissors = {};
+			VkRect2D scissors[VUK_MAX_SCISSORS];
+			VkPipelineLayout push_constant_layout = VK_NULL_HANDLE;
+			fixed_vector<VkPushConstantRange, VUK_MAX_PUSHCONSTANT_RANGES> push_constant_ranges;
+			unsigned char push_constants[VUK_MAX_PUSHCONSTANT_SIZE];
+		} bound_state;
+		uint64_t elided_calls = 0;
+
+		// Dirty tracking - while nothing relevant changed, draws and dispatches reuse what the previous one resolved
+		// Set when state that goes into a pipeline changes, per PipeType - while clear, binding the current pipeline again skips building and looking
+		// up the pipeline create info
+		bool pipeline_state_dirty[3] = { true, true, true };
+		// Set when the bindings of a set change - while clear, binding the set again reuses the descriptor set last allocated for it
+		Bitset<VUK_MAX_SETS> set_bindings_dirty = {};
+		struct ResolvedSet {
+			VkDescriptorSet descriptor_set;
+			VkDescriptorSetLayout layout;
+			bool reusable; // false if the descriptors hold offsets that would otherwise be dynamic
+		};
+		ResolvedSet resolved_sets[VUK_MAX_SETS] = {};
+		// Samplers recently resolved by bind_sampler, to skip the sampler cache when they are bound again
+		static constexpr size_t num_recent_samplers = 4;
+		std::pair<SamplerCreateInfo, Sampler> recent_samplers[num_recent_samplers] = {};
+		size_t next_recent_sampler = 0;
+
+		// Scratch ring - map_scratch_buffer suballocates from the current chunk, and binds it with a dynamic offset
+		static constexpr size_t scratch_ring_chunk_size = 64 * 1024;
+		Buffer scratch_ring = {};
+		size_t scratch_ring_used = 0;
+		uint32_t dynamic_offsets[VUK_MAX_SETS][VUK_MAX_BINDINGS] = {};
+
+		// Secondary command buffers
+		// Set while recording into secondary command buffers, which are executed in this primary command buffer
+		VkCommandBuffer primary_command_buffer = VK_NULL_HANDLE;
+		CommandPool command_pool = {};
+		std::vector<std::unique_ptr<CommandBuffer>> children;
+		std::vector<CommandPool> child_command_pools;
+		// Sets used by the parent of a forked command buffer - bound again before they are first used
+		Bitset<VUK_MAX_SETS> sets_to_rebind = {};
+		// Pass statistics query begun around the pass by the rendergraph - ended on fork, as the secondaries don't inherit queries
+		PassStatisticsQueryPool* statistics_query_pool = nullptr;
+		uint32_t statistics_query_index = 0;
+
+		// Draw merging - the last draw is held back while it can still be extended by the next one
+		bool draw_merging = false;
+		struct PendingDraw {
+			bool indexed;
+			uint32_t count; // vertices or indices
+			uint32_t instance_count;
+			uint32_t first; // first vertex or index
+			int32_t vertex_offset;
+			uint32_t first_instance;
+		};
+		std::optional<PendingDraw> pending_draw;
+
+		// Command stream - set while the pass is recorded to be replayed, commands are appended to the stream, and translated into stream_target later
+		CommandStream* stream = nullptr;
+		VkCommandBuffer stream_target = VK_NULL_HANDLE;
+		// Cleared when the recording refers to per-frame objects, or went around the stream - such recordings can't be replayed in later frames
+		bool replayable = true;
+		// Set while the pass is recorded to be replayed - the descriptor sets the pass binds are allocated for the recording, and the pipelines are kept in it
+		RecordedPass* recording = nullptr;
+
 		// for rendergraph
 		CommandBuffer(ExecutableRenderGraph& rg, Context& ctx, Allocator& allocator, VkCommandBuffer cb);
 		CommandBuffer(ExecutableRenderGraph& rg, Context& ctx, Allocator& allocator, VkCommandBuffer cb, std::optional<RenderPassInfo> ongoing);
@@ -237,9 +317,32 @@ namespace vuk {
 			return ctx;
 		}
 
+		/// @brief Retrieve the underlying VkCommandBuffer
+		/// While the pass is recorded to be replayed (Pass::content_key), or a draw is held back for merging, commands recorded through the CommandBuffer
+		/// reach it later - use bind_*_state to record into the VkCommandBuffer directly.
 		VkCommandBuffer get_underlying() const {
-			return command_buffer;
+			return stream ? stream_target : command_buffer;
+		}
+		/// @brief Number of bind, dynamic state and push constant calls skipped so far because they would not have changed the bound state
+		uint64_t get_elided_call_count() const {
+			return elided_calls;
 		}
+		/// @brief Forget the state bound in the underlying VkCommandBuffer, forcing the next calls to be recorded
+		/// Call this after binding pipelines, descriptor sets, buffers or dynamic state directly through the VkCommandBuffer.
+		void invalidate_bound_state();
+		/// @brief Fork child command buffers, to record the rest of the pass on multiple threads
+		///
+		/// Each child records into its own secondary command buffer, and starts out with the state of this command buffer: pipeline, fixed-function and
+		/// dynamic state, push constants, descriptor sets and vertex and index buffers bound through the CommandBuffer. The children can be recorded
+		/// concurrently, each by a single thread, and this command buffer must not be used until join. Within a render pass, the pass must set
+		/// Pass::use_secondary_command_buffers.
+		/// @param count Number of children to fork
+		/// @return the children, valid until join - empty if the command buffer is in an error state
+		std::vector<CommandBuffer*> fork(size_t count);
+		/// @brief Execute the secondary command buffers of the children, in the order they were returned from fork, and release the children
+		/// Recording into the children must have finished - synchronizing with the recording threads is up to the caller.
+		CommandBuffer& join();
+
 		/// @brief Retrieve information about the current renderpass
 		const RenderPassInfo& get_ongoing_render_pass() const;
 		/// @brief Retrieve Buffer attached to given name
@@ -270,6 +373,15 @@ namespace vuk {
 		/// The default strategy is taken from the context when entering a new Pass
 		CommandBuffer& set_descriptor_set_strategy(DescriptorSetStrategyFlags ds_strategy_flags);
 
+		/// @brief Merge consecutive draws that continue the instance range of the previous draw into one draw
+		/// @param enabled Merging is off by default, and is inherited by forked command buffers
+		///
+		/// Draws are merged if they use the same vertices (or indices and vertex offset), nothing was recorded between them, and the first instance of a
+		/// draw is the end of the instance range of the previous one. Merged draws see the same gl_InstanceIndex as unmerged ones, but gl_BaseInstance is
+		/// the first instance of the first draw merged - shaders that read gl_BaseInstance (or compute the instance relative to it) see different values.
+		/// The last draw is held back until another command is recorded, bind_*_state is called or the pass ends.
+		CommandBuffer& set_draw_merging(bool enabled);
+
 		/// @brief Set mask of dynamic state in CommandBuffer
 		/// @param dynamic_state_flags Mask of states (flag set = dynamic, flag clear = static)
 		CommandBuffer& set_dynamic_state(DynamicStateFlags dynamic_state_flags);
@@ -458,6 +570,8 @@ namespace vuk {
 		CommandBuffer& bind_sampler(unsigned set, unsigned binding, SamplerCreateInfo sampler_create_info);
 
 		/// @brief Allocate some CPUtoGPU memory and bind it as a buffer. Return a pointer to the mapped memory.
+		/// The memory is suballocated from a ring owned by the command buffer. If the pipeline declares the binding dynamic
+		/// (PipelineBaseCreateInfo::set_binding_dynamic), only the dynamic offset changes between allocations and the descriptor set is reused.
 		/// @param set The set bind index to be used
 		/// @param binding The descriptor binding to bind the buffer to
 		/// @param size Amount of memory to allocate
@@ -686,6 +800,8 @@ namespace vuk {
 
 		// explicit command buffer access
 
+		// the state bound through these is not tracked, so they invalidate the bound state
+
 		/// @brief Bind all pending compute state and return a raw VkCommandBuffer for direct access
 		[[nodiscard]] VkCommandBuffer bind_compute_state();
 		/// @brief Bind all pending graphics state and return a raw VkCommandBuffer for direct access
@@ -701,6 +817,35 @@ namespace vuk {
 		[[nodiscard]] bool _bind_graphics_pipeline_state();
 		[[nodiscard]] bool _bind_ray_tracing_pipeline_state();
 
+		void _bind_pipeline(PipeType pipe_type, VkPipeline pipeline);
+		void _bind_descriptor_set(PipeType pipe_type, VkPipelineLayout layout, uint32_t index, VkDescriptorSet set, std::span<const uint32_t> dynamic_offsets);
+		uint32_t _collect_dynamic_offsets(unsigned set, const DescriptorSetLayoutCreateInfo& dslci, uint32_t* dst);
+		void _push_constants(VkPipelineLayout layout, const VkPushConstantRange& pcr);
+		void _mark_pipeline_state_dirty(bool graphics_only);
+		void _set_vertex_input(const VertexInputAttributeDescription& viad);
+		void _set_vertex_binding(unsigned binding, uint32_t stride);
+		void _set_descriptor_binding(unsigned set, unsigned binding, const DescriptorBinding& db);
+		void _flush_dynamic_state(DynamicStateFlags to_dynamic);
+
+		Result<VkCommandBuffer> _begin_secondary(CommandPool pool);
+		Result<void> _record_into_secondary();
+		Result<void> _execute_secondary();
+		void _inherit_state(const CommandBuffer& parent);
+		void _restore_bound_state();
+
+		// function pointers that commands are recorded with - those of the Context, or those of the command stream
+		// records the held back draw first, so that every command recorded through them keeps its order
+		const auto& _pfns();
+		void _draw(const PendingDraw& draw);
+		void _flush_draws();
+		void _begin_stream(CommandStream& stream);
+		void _begin_recording(RecordedPass& recording);
+		void _flush_stream();
+		void _end_stream();
+		// recordings are keyed on the resources of the pass - referring to any other object makes the recording not replayable
+		void _track_buffer(const Buffer& buffer);
+		void _track_image_view(ImageView image_view);
+
 		CommandBuffer& specialize_constants(uint32_t constant_id, void* data, size_t size);
 	};
 
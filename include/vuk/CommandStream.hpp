@@ -0,0 +1,118 @@
+#pragma once
+
+#include "vuk/Context.hpp"
+#include "vuk/Descriptor.hpp"
+#include "vuk/Hash.hpp"
+#include "vuk/PipelineInstance.hpp"
+
+#include <cstddef>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+namespace vuk {
+	/// @brief Compact CPU-side recording of Vulkan commands, translated into a VkCommandBuffer later
+	///
+	/// A CommandBuffer recording into a stream appends one packed record per command instead of calling into the driver. Arrays passed to the command
+	/// (viewports, copy regions, barriers, push constant data, ...) are copied into the record, so the stream is self-contained.
+	/// Translation replays the records into a VkCommandBuffer unchanged and can happen on any thread - the render graph uses this to replay recorded passes.
+	/// Handles in the stream refer to objects of the Context that recorded it - they are only meaningful while those objects are alive.
+	class CommandStream {
+	public:
+		/// @brief Handle to pass as the VkCommandBuffer to the recording functions
+		VkCommandBuffer handle() noexcept {
+			return reinterpret_cast<VkCommandBuffer>(this);
+		}
+
+		/// @brief Function pointers that append to the stream whose handle() is passed as the command buffer
+		/// Only the vkCmd* functions recorded by CommandBuffer are set, except vkCmdBuildAccelerationStructuresKHR.
+		static const ContextCreateParameters::FunctionPointers& get_recording_functions();
+
+		/// @brief Number of commands in the stream
+		size_t size() const noexcept {
+			return command_count;
+		}
+		bool empty() const noexcept {
+			return command_count == 0;
+		}
+		/// @brief Drop the commands, keeping the memory for the next recording
+		void clear() noexcept;
+		/// @brief The encoded commands, for saving the stream for offline analysis
+		std::span<const std::byte> get_data() const noexcept {
+			return data;
+		}
+
+		/// @brief Record the commands of the stream into a VkCommandBuffer
+		/// Only one thread may translate into the same command buffer (or command buffers of the same pool) at a time.
+		void translate(Context& ctx, VkCommandBuffer command_buffer) const;
+		/// @brief Write a listing of the commands, one per line
+		void dump(std::ostream& os) const;
+
+		/// @cond INTERNAL
+		std::byte* begin_record(uint32_t op, size_t max_payload_size);
+		void end_record(std::byte* payload_end);
+		/// @endcond
+
+	private:
+		std::vector<std::byte> data;
+		size_t record_begin = 0;
+		size_t command_count = 0;
+	};
+
+	/// @brief Commands kept for a pass with a content key, together with what keeps the handles in them valid across frames
+	///
+	/// The descriptor sets bound by the commands are allocated for the recording and released only after it is dropped. The pipelines are acquired
+	/// again on every replay, so that they are not collected from the caches while the recording is in use.
+	struct RecordedPass {
+		CommandStream stream;
+		/// @brief Descriptor sets bound by the commands - owned by the recording
+		std::vector<DescriptorSet> descriptor_sets;
+
+		struct GraphicsPipeline {
+			GraphicsPipelineInstanceCreateInfo create_info;
+			std::vector<std::byte> extended_data; // copy of the extended data, if it is not inline
+			VkPipeline pipeline;
+		};
+		struct ComputePipeline {
+			ComputePipelineInstanceCreateInfo create_info;
+			VkPipeline pipeline;
+		};
+		struct RayTracingPipeline {
+			RayTracingPipelineInstanceCreateInfo create_info;
+			VkPipeline pipeline;
+		};
+		/// @brief Pipelines bound by the commands, with the handles they were recorded with
+		std::vector<GraphicsPipeline> graphics_pipelines;
+		std::vector<ComputePipeline> compute_pipelines;
+		std::vector<RayTracingPipeline> ray_tracing_pipelines;
+
+		/// @brief Acquire the pipelines bound by the commands again, which marks them as used in this frame
+		/// @return false if a pipeline could not be acquired or has changed since it was recorded - the recording can't be replayed then
+		bool acquire_pipelines(Allocator& allocator) const;
+	};
+
+	/// @brief Identifies the recording of a pass - compared in full, so that a recording is only replayed for the same pass and resources
+	struct RecordedPassKey {
+		uint64_t content_key = 0;
+		QualifiedName pass;
+		uint32_t domain = 0;
+		/// @brief Handles, offsets and sizes of everything the commands can refer to through the render graph
+		std::vector<uint64_t> objects;
+
+		bool operator==(const RecordedPassKey&) const = default;
+	};
+} // namespace vuk
+
+namespace std {
+	template<>
+	struct hash<vuk::RecordedPassKey> {
+		size_t operator()(vuk::RecordedPassKey const& x) const noexcept {
+			size_t h = 0;
+			hash_combine(h, x.content_key, x.pass, x.domain);
+			for (auto& object : x.objects) {
+				hash_combine(h, object);
+			}
+			return h;
+		}
+	};
+} // namespace std
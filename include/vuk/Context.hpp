@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string_view>
@@ -56,11 +57,18 @@ namespace vuk {
 		/// @brief Allow vuk to load missing required and optional function pointers dynamically
 		/// If this is false, then you must fill in all required function pointers
 		bool allow_dynamic_loading_of_vk_function_pointers = true;
+		/// @brief Set if VK_EXT_memory_budget was enabled on the device - heap budgets will be queried from the driver instead of estimated
+		bool memory_budget_enabled = false;
 	};
 
 	/// @brief Abstraction of a device queue in Vulkan
 	struct Queue {
-		Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts);
+		Queue(PFN_vkQueueSubmit fn1,
+		      PFN_vkQueueSubmit2KHR fn2,
+		      VkQueue queue,
+		      uint32_t queue_family_index,
+		      TimelineSemaphore ts,
+		      const struct InstrumentationCallbacks* instrumentation = nullptr);
 		~Queue();
 
 		Queue(const Queue&) = delete;
@@ -114,6 +122,7 @@ namespace vuk {
 		VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR };
 		VkPhysicalDeviceAccelerationStructurePropertiesKHR as_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
 		size_t min_buffer_alignment;
+		bool memory_budget_enabled;
 
 		// Debug functions
 		
@@ -216,6 +225,33 @@ namespace vuk {
 		/// @brief Retrieve results from `TimestampQueryPool`s and make them available to retrieve_timestamp and retrieve_duration
 		Result<void> make_timestamp_results_available(std::span<const TimestampQueryPool> pools);
 
+		/// @brief Measure every pass executed from now on with pipeline statistics queries (and occlusion queries inside render passes)
+		/// Requires the pipelineStatisticsQuery feature to be enabled on the device. Passes on transfer queues and passes that fork are not measured.
+		void set_pass_statistics_enabled(bool enabled);
+		bool pass_statistics_enabled() const;
+		/// @brief Retrieve the statistics of the passes whose queries have completed since the last call
+		/// Results are read back without blocking in next_frame, so they arrive a few frames after the passes were executed.
+		std::vector<PassStatistics> retrieve_pass_statistics();
+		/// @brief Acquire query pools to measure passes with - called by vuk while recording
+		PassStatisticsQueryPool acquire_pass_statistics_query_pool(VkQueryPipelineStatisticFlags statistic_flags);
+		/// @brief Return query pools acquired with acquire_pass_statistics_query_pool - called by vuk after recording
+		/// @param recorded If the queries were recorded into command buffers - their results will be read back once available
+		void release_pass_statistics_query_pool(PassStatisticsQueryPool&& pool, bool recorded);
+
+		/// @brief Retrieve the commands kept for a pass with a content key - called by vuk while recording
+		/// @return The recording, or nullptr if none was kept for the key or it has expired
+		std::shared_ptr<const RecordedPass> acquire_recorded_pass(const RecordedPassKey& key);
+		/// @brief Keep the commands recorded for a pass with a content key, to replay them in later frames - called by vuk after recording
+		/// Recordings expire after a number of frames. The descriptor sets of a recording are released that many frames after it is dropped, once no
+		/// command buffer replaying it can be in flight.
+		void store_recorded_pass(RecordedPassKey key, RecordedPass recording);
+		/// @brief Release the descriptor sets of a recording that is not kept - called by vuk after recording
+		void discard_recorded_pass(RecordedPass recording);
+		/// @brief Drop the commands kept for passes with a content key, so that every pass is recorded again
+		/// Called by DeviceSuperFrameResource when its caches are destroyed or collected. Call this when objects bound by such passes outside of the render
+		/// graph resources are destroyed.
+		void invalidate_recorded_passes();
+
 		// Caches
 
 		/// @brief Acquire a cached sampler
@@ -231,6 +267,33 @@ namespace vuk {
 		Unique<PersistentDescriptorSet> create_persistent_descriptorset(Allocator& allocator, const PipelineBaseInfo& base, unsigned set, unsigned num_descriptors);
 		Unique<PersistentDescriptorSet> create_persistent_descriptorset(Allocator& allocator, const PersistentDescriptorSetCreateInfo&);
 
+		// Instrumentation
+
+		/// @brief Set the callbacks used to report CPU zones, counters and frame marks to a profiler
+		/// Only called if vuk was built with VUK_INSTRUMENTATION. Must not be changed while other threads are using the Context.
+		void set_instrumentation_callbacks(const struct InstrumentationCallbacks& callbacks);
+		/// @brief Retrieve the instrumentation callbacks - the pointer is stable for the lifetime of the Context
+		const struct InstrumentationCallbacks* get_instrumentation_callbacks() const;
+		/// @brief Set the TraceRecorder that submissions and frames are reported to, or nullptr - set by TraceRecorder::begin_capture
+		void set_trace_recorder(struct TraceRecorder* recorder);
+		/// @brief Retrieve the TraceRecorder that is currently capturing, or nullptr
+		struct TraceRecorder* get_trace_recorder() const;
+
+		// Render graph compilation
+
+		/// @brief Set the layout promotion thresholds used when render graphs are compiled through this Context, to suit the device - by default nothing is promoted
+		/// Must not be changed while other threads are compiling through the Context.
+		void set_layout_promotion_options(const LayoutPromotionOptions& options);
+		/// @brief Retrieve the layout promotion thresholds - the pointer is stable for the lifetime of the Context
+		const LayoutPromotionOptions* get_layout_promotion_options() const;
+
+		// Statistics
+
+		/// @brief Retrieve the statistics of the last completed frame (the frame ended by the last call to next_frame)
+		FrameStats get_frame_stats() const;
+		/// @brief Retrieve the counters of the frame in progress - incremented by vuk, the reference is stable for the lifetime of the Context
+		struct FrameStatCounters& get_frame_stat_counters();
+
 		// Misc.
 
 		/// @brief Descriptor set strategy to use by default, can be overridden on the CommandBuffer
@@ -342,6 +405,8 @@ namespace vuk {
 	Result<SingleSwapchainRenderBundle> acquire_one(Context& ctx, SwapchainRef swapchain, VkSemaphore present_ready, VkSemaphore render_complete);
 	Result<SingleSwapchainRenderBundle> execute_submit(Allocator& allocator, ExecutableRenderGraph&& rg, SingleSwapchainRenderBundle&& bundle);
 	Result<VkResult> present_to_one(Context& ctx, SingleSwapchainRenderBundle&& bundle);
+	/// @brief Present a bundle acquired with acquire_one(Allocator&, SwapchainRef) - its semaphores are reused once the frame of the allocator is recycled
+	Result<VkResult> present_to_one(Allocator& allocator, SingleSwapchainRenderBundle&& bundle);
 	Result<VkResult> present(Allocator& allocator, Compiler& compiler, SwapchainRef swapchain, Future&& future, RenderGraphCompileOptions = {});
 
 	struct SampledImage make_sampled_image(ImageView iv, SamplerCreateInfo sci);
@@ -134,6 +134,8 @@ namespace vuk {
 			switch (type) {
 			case DescriptorType::eUniformBuffer:
 			case DescriptorType::eStorageBuffer:
+			case DescriptorType::eUniformBufferDynamic:
+			case DescriptorType::eStorageBufferDynamic:
 				return memcmp(&buffer, &o.buffer, sizeof(VkDescriptorBufferInfo)) == 0;
 			case DescriptorType::eStorageImage:
 			case DescriptorType::eSampledImage:
@@ -154,6 +156,10 @@ namespace vuk {
 				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 			case DescriptorType::eStorageBuffer:
 				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			case DescriptorType::eUniformBufferDynamic:
+				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			case DescriptorType::eStorageBufferDynamic:
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
 			case DescriptorType::eStorageImage:
 				return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 			case DescriptorType::eSampledImage:
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "vuk/Types.hpp"
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+namespace vuk {
+	/// @brief Work done by vuk during one frame, readable from Context::get_frame_stats after Context::next_frame
+	///
+	/// The counters are always collected - counting is a relaxed atomic add at the places where the work happens.
+	/// Work is attributed to the frame in which it happened on the host, not when it executes on the device.
+	struct FrameStats {
+		/// @brief Frame the statistics were collected in
+		uint64_t absolute_frame = 0;
+
+		// Render graph
+
+		/// @brief Passes of the render graphs executed
+		uint64_t passes_compiled = 0;
+		/// @brief Passes recorded into command buffers
+		uint64_t passes_recorded = 0;
+		/// @brief Recorded passes whose commands were replayed from an earlier frame, because their content key was unchanged
+		uint64_t passes_replayed = 0;
+		/// @brief Barriers emitted between passes
+		uint64_t image_barriers = 0;
+		uint64_t memory_barriers = 0;
+		/// @brief Barriers on a range of a buffer
+		uint64_t buffer_barriers = 0;
+		/// @brief Render pass instances begun
+		uint64_t render_passes = 0;
+		/// @brief Pipeline, descriptor set, vertex/index buffer, viewport, scissor and push constant calls skipped by CommandBuffer, because they would
+		/// not have changed the bound state
+		uint64_t redundant_binds_elided = 0;
+		/// @brief Submissions made to queues
+		uint64_t submits = 0;
+		/// @brief Command buffers submitted to queues
+		uint64_t command_buffers = 0;
+
+		// Descriptors
+
+		uint64_t descriptor_sets_allocated = 0;
+		uint64_t descriptor_sets_written = 0;
+
+		// Caches
+
+		/// @brief Lookups into the caches of the Context and frame allocators that found an existing object
+		uint64_t cache_hits = 0;
+		/// @brief Lookups that had to create a new object
+		uint64_t cache_misses = 0;
+		/// @brief Graphics, compute and ray tracing pipelines created
+		uint64_t pipelines_created = 0;
+
+		// Resources
+
+		/// @brief Bytes bump-allocated from linear buffer allocators, per MemoryUsage - use get_bytes_allocated
+		std::array<uint64_t, 4> bytes_allocated = {};
+		uint64_t images_created = 0;
+		uint64_t image_views_created = 0;
+
+		// Synchronization
+
+		/// @brief Times the host blocked waiting for the device
+		uint64_t host_waits = 0;
+
+		static constexpr size_t memory_usage_index(MemoryUsage usage) noexcept {
+			return (size_t)usage - 1;
+		}
+
+		uint64_t get_bytes_allocated(MemoryUsage usage) const noexcept {
+			return bytes_allocated[memory_usage_index(usage)];
+		}
+	};
+
+	/// @cond INTERNAL
+	struct FrameStatCounter {
+		std::atomic<uint64_t> value = 0;
+
+		void operator+=(uint64_t v) noexcept {
+			value.fetch_add(v, std::memory_order_relaxed);
+		}
+
+		uint64_t take() noexcept {
+			return value.exchange(0, std::memory_order_relaxed);
+		}
+	};
+
+	/// @brief Counters of the frame in progress, incremented from any thread
+	struct FrameStatCounters {
+		FrameStatCounter passes_compiled;
+		FrameStatCounter passes_recorded;
+		FrameStatCounter passes_replayed;
+		FrameStatCounter image_barriers;
+		FrameStatCounter memory_barriers;
+		FrameStatCounter buffer_barriers;
+		FrameStatCounter render_passes;
+		FrameStatCounter redundant_binds_elided;
+		FrameStatCounter submits;
+		FrameStatCounter command_buffers;
+		FrameStatCounter descriptor_sets_allocated;
+		FrameStatCounter descriptor_sets_written;
+		FrameStatCounter cache_hits;
+		FrameStatCounter cache_misses;
+		FrameStatCounter pipelines_created;
+		std::array<FrameStatCounter, 4> bytes_allocated;
+		FrameStatCounter images_created;
+		FrameStatCounter image_views_created;
+		FrameStatCounter host_waits;
+
+		FrameStatCounter& get_bytes_allocated(MemoryUsage usage) noexcept {
+			return bytes_allocated[FrameStats::memory_usage_index(usage)];
+		}
+
+		/// @brief Move the counts into a FrameStats, starting the next frame from zero
+		FrameStats take(uint64_t absolute_frame) noexcept {
+			FrameStats stats;
+			stats.absolute_frame = absolute_frame;
+			stats.passes_compiled = passes_compiled.take();
+			stats.passes_recorded = passes_recorded.take();
+			stats.passes_replayed = passes_replayed.take();
+			stats.image_barriers = image_barriers.take();
+			stats.memory_barriers = memory_barriers.take();
+			stats.buffer_barriers = buffer_barriers.take();
+			stats.render_passes = render_passes.take();
+			stats.redundant_binds_elided = redundant_binds_elided.take();
+			stats.submits = submits.take();
+			stats.command_buffers = command_buffers.take();
+			stats.descriptor_sets_allocated = descriptor_sets_allocated.take();
+			stats.descriptor_sets_written = descriptor_sets_written.take();
+			stats.cache_hits = cache_hits.take();
+			stats.cache_misses = cache_misses.take();
+			stats.pipelines_created = pipelines_created.take();
+			for (size_t i = 0; i < bytes_allocated.size(); i++) {
+				stats.bytes_allocated[i] = bytes_allocated[i].take();
+			}
+			stats.images_created = images_created.take();
+			stats.image_views_created = image_views_created.take();
+			stats.host_waits = host_waits.take();
+			return stats;
+		}
+	};
+	/// @endcond
+} // namespace vuk
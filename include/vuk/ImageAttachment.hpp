@@ -18,6 +18,8 @@ namespace vuk {
 		Format format = Format::eUndefined;
 		Samples sample_count = Samples::eInfer;
 		bool allow_srgb_unorm_mutable = false;
+		/// @brief Concurrent images are created shared by all queue families, so using them on another queue needs no queue family ownership transfer
+		SharingMode sharing_mode = SharingMode::eExclusive;
 		ImageViewCreateFlags image_view_flags = {};
 		ImageViewType view_type = ImageViewType::eInfer;
 		ComponentMapping components;
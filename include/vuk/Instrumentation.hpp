@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace vuk {
+	/// @brief Static description of an instrumented zone in vuk
+	/// Zones are described by objects with static storage duration, so profilers can keep and key on pointers to them.
+	struct InstrumentationZone {
+		const char* name;
+		const char* function;
+		const char* file;
+		uint32_t line;
+	};
+
+	/// @brief Callbacks to forward the CPU activity of vuk to a profiler, set on the Context
+	///
+	/// Any of the callbacks can be left unset. Callbacks can be invoked from any thread that uses vuk.
+	/// The calls are only made if vuk was built with VUK_INSTRUMENTATION, otherwise they are compiled out.
+	struct InstrumentationCallbacks {
+		/// @brief A zone begins on the calling thread
+		/// @param zone Static description of the zone
+		/// @param detail Additional name of this instance of the zone (such as the name of the pass), or nullptr - valid until the zone ends
+		/// @return Pointer passed to end_zone when the zone ends
+		void* (*begin_zone)(void* user_data, const InstrumentationZone& zone, const char* detail) = nullptr;
+		/// @brief The last zone begun on the calling thread ends
+		void (*end_zone)(void* user_data, void* zone_data) = nullptr;
+		/// @brief A counter has been sampled - name has static storage duration
+		void (*counter)(void* user_data, const char* name, double value) = nullptr;
+		/// @brief A frame has ended (Context::next_frame has been called)
+		void (*frame_mark)(void* user_data, uint64_t absolute_frame) = nullptr;
+
+		void* user_data = nullptr;
+	};
+
+	/// @cond INTERNAL
+	struct InstrumentationScope {
+		InstrumentationScope(const InstrumentationCallbacks* callbacks, const InstrumentationZone& zone, const char* detail) noexcept {
+			if (callbacks && callbacks->begin_zone) {
+				this->callbacks = callbacks;
+				zone_data = callbacks->begin_zone(callbacks->user_data, zone, detail);
+			}
+		}
+
+		~InstrumentationScope() {
+			if (callbacks && callbacks->end_zone) {
+				callbacks->end_zone(callbacks->user_data, zone_data);
+			}
+		}
+
+		InstrumentationScope(const InstrumentationScope&) = delete;
+		InstrumentationScope& operator=(const InstrumentationScope&) = delete;
+
+		const InstrumentationCallbacks* callbacks = nullptr;
+		void* zone_data = nullptr;
+	};
+
+	inline void instrumentation_counter(const InstrumentationCallbacks* callbacks, const char* name, double value) noexcept {
+		if (callbacks && callbacks->counter) {
+			callbacks->counter(callbacks->user_data, name, value);
+		}
+	}
+
+	inline void instrumentation_frame_mark(const InstrumentationCallbacks* callbacks, uint64_t absolute_frame) noexcept {
+		if (callbacks && callbacks->frame_mark) {
+			callbacks->frame_mark(callbacks->user_data, absolute_frame);
+		}
+	}
+	/// @endcond
+} // namespace vuk
+
+/// @cond INTERNAL
+#define VUK_INSTRUMENTATION_CONCAT_IMPL(a, b) a##b
+#define VUK_INSTRUMENTATION_CONCAT(a, b)      VUK_INSTRUMENTATION_CONCAT_IMPL(a, b)
+
+#if VUK_INSTRUMENTATION
+// begin a zone that lasts until the end of the enclosing scope
+#define VUK_ZONE_DETAIL(callbacks, name, detail)                                                                                                               \
+	static const ::vuk::InstrumentationZone VUK_INSTRUMENTATION_CONCAT(_vuk_zone_, __LINE__){ name, __func__, __FILE__, __LINE__ };                           \
+	::vuk::InstrumentationScope VUK_INSTRUMENTATION_CONCAT(_vuk_zone_scope_, __LINE__)(callbacks, VUK_INSTRUMENTATION_CONCAT(_vuk_zone_, __LINE__), detail)
+#define VUK_ZONE(callbacks, name)                       VUK_ZONE_DETAIL(callbacks, name, nullptr)
+#define VUK_COUNTER(callbacks, name, value)             ::vuk::instrumentation_counter(callbacks, name, (double)(value))
+#define VUK_FRAME_MARK(callbacks, absolute_frame)       ::vuk::instrumentation_frame_mark(callbacks, absolute_frame)
+#else
+#define VUK_ZONE_DETAIL(callbacks, name, detail)
+#define VUK_ZONE(callbacks, name)
+#define VUK_COUNTER(callbacks, name, value)
+#define VUK_FRAME_MARK(callbacks, absolute_frame)
+#endif
+/// @endcond
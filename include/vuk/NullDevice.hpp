@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vuk/Context.hpp"
+
+namespace vuk {
+	/// @brief Counters of the work a NullDevice has been given
+	struct NullDeviceStats {
+		uint64_t submits = 0;
+		uint64_t command_buffers_submitted = 0;
+		/// @brief Commands recorded into command buffers that have been ended
+		uint64_t commands = 0;
+		uint64_t draws = 0;
+		uint64_t dispatches = 0;
+		uint64_t barriers = 0;
+		uint64_t pipelines_created = 0;
+		uint64_t descriptor_sets_allocated = 0;
+		uint64_t descriptor_writes = 0;
+		/// @brief Size of the device memory currently allocated
+		uint64_t device_memory_bytes = 0;
+	};
+
+	/// @brief Vulkan device that executes nothing, for measuring and testing the CPU side of vuk without a GPU
+	///
+	/// Creating a Context with the parameters from get_context_create_parameters() results in a Context where every Vulkan function is a stub.
+	/// Object creation returns fake handles and device memory is backed by host memory. Submissions complete immediately, and of the recorded commands
+	/// only buffer copies, fills and updates are carried out (on submission), so buffer contents can be inspected.
+	/// The NullDevice must outlive the Contexts created from it.
+	struct NullDevice {
+		NullDevice();
+		~NullDevice();
+
+		NullDevice(const NullDevice&) = delete;
+		NullDevice& operator=(const NullDevice&) = delete;
+
+		/// @brief Parameters to create a Context on this device - with a graphics, a compute and a transfer queue
+		ContextCreateParameters get_context_create_parameters();
+
+		NullDeviceStats get_stats();
+		void reset_stats();
+
+	private:
+		struct NullDeviceImpl* impl;
+	};
+} // namespace vuk
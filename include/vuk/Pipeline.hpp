@@ -67,6 +67,14 @@ namespace vuk {
 			variable_count_max[set] = max_descriptors;
 		}
 
+		// uniform and storage buffer bindings that take a dynamic offset
+		Bitset<VUK_MAX_SETS * VUK_MAX_BINDINGS> dynamic_buffer_bindings = {};
+		/// @brief Make a uniform or storage buffer binding dynamic (eUniformBufferDynamic or eStorageBufferDynamic)
+		/// Memory from CommandBuffer::map_scratch_buffer is then bound by changing only the dynamic offset, keeping the descriptor set unchanged
+		void set_binding_dynamic(unsigned set, unsigned binding, bool dynamic = true) noexcept {
+			dynamic_buffer_bindings.set(set * VUK_MAX_BINDINGS + binding, dynamic);
+		}
+
 		vuk::fixed_vector<DescriptorSetLayoutCreateInfo, VUK_MAX_SETS> explicit_set_layouts = {};
 	};
 
@@ -125,7 +133,8 @@ namespace vuk {
 	public:
 		static vuk::fixed_vector<vuk::DescriptorSetLayoutCreateInfo, VUK_MAX_SETS> build_descriptor_layouts(const Program&, const PipelineBaseCreateInfoBase&);
 		bool operator==(const PipelineBaseCreateInfo& o) const noexcept {
-			return shaders == o.shaders && binding_flags == o.binding_flags && variable_count_max == o.variable_count_max && defines == o.defines;
+			return shaders == o.shaders && binding_flags == o.binding_flags && variable_count_max == o.variable_count_max &&
+			       dynamic_buffer_bindings == o.dynamic_buffer_bindings && defines == o.defines;
 		}
 	};
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "vuk/Name.hpp"
+
 #include <stdint.h>
 
 namespace vuk {
@@ -29,6 +31,50 @@ namespace vuk {
 		TimestampQueryPool* pool = nullptr;
 		Query query;
 	};
+
+	/// @brief GPU work done by a pass, as counted by pipeline statistics and occlusion queries
+	/// Counters that were not measured for the pass are 0.
+	struct PipelineStatistics {
+		uint64_t vertex_shader_invocations = 0;
+		uint64_t clipping_invocations = 0;
+		uint64_t clipping_primitives = 0;
+		uint64_t fragment_shader_invocations = 0;
+		uint64_t compute_shader_invocations = 0;
+		/// @brief Samples that passed the depth and stencil tests - only measured for passes inside a render pass
+		uint64_t samples_passed = 0;
+	};
+
+	/// @brief GPU timestamps written around a pass while a TraceRecorder is capturing
+	struct PassTimestamps {
+		Name name;
+		Query begin;
+		Query end;
+	};
+
+	/// @brief Pipeline statistics measured around a pass
+	struct PassStatistics {
+		Name pass;
+		/// @brief Frame in which the pass was recorded
+		uint64_t absolute_frame;
+		/// @brief If the pass was measured with an occlusion query
+		bool occlusion_measured;
+		PipelineStatistics statistics;
+	};
+
+	/// @brief Query pools used to measure pipeline statistics around the passes of a command buffer recording
+	struct PassStatisticsQueryPool {
+		static constexpr uint32_t num_queries = 32;
+
+		VkQueryPool statistics = VK_NULL_HANDLE;
+		VkQueryPool occlusion = VK_NULL_HANDLE;
+		VkQueryPipelineStatisticFlags statistic_flags = 0;
+		uint32_t count = 0;
+		uint64_t absolute_frame = 0;
+		Name passes[num_queries];
+		bool occlusion_used[num_queries] = {};
+		// queries ended early because the pass forked - not reported
+		bool interrupted[num_queries] = {};
+	};
 } // namespace vuk
 
 namespace std {
@@ -6,6 +6,7 @@
 #include "vuk/Image.hpp"
 #include "vuk/ImageAttachment.hpp"
 #include "vuk/MapProxy.hpp"
+#include "vuk/Query.hpp"
 #include "vuk/Result.hpp"
 #include "vuk/Swapchain.hpp"
 #include "vuk/vuk_fwd.hpp"
@@ -26,6 +27,12 @@ namespace vuk {
 
 		struct BufferResource {
 			Name name;
+			Subrange::Buffer subrange = {};
+
+			/// @brief Restrict the access to a range of bytes of the buffer
+			BufferResource operator[](Subrange::Buffer range) const {
+				return { name, range };
+			}
 
 			BufferResourceInputOnly operator>>(Access ba);
 		};
@@ -34,6 +41,12 @@ namespace vuk {
 
 		struct ImageResource {
 			Name name;
+			Subrange::Image subrange = {};
+
+			/// @brief Restrict the access to a range of mip levels and array layers of the image
+			ImageResource operator[](Subrange::Image range) const {
+				return { name, range };
+			}
 
 			ImageResourceInputOnly operator>>(Access ia);
 		};
@@ -41,6 +54,7 @@ namespace vuk {
 		struct ImageResourceInputOnly {
 			Name name;
 			Access ba;
+			Subrange::Image subrange = {};
 
 			Resource operator>>(Name output);
 			operator Resource();
@@ -49,6 +63,7 @@ namespace vuk {
 		struct BufferResourceInputOnly {
 			Name name;
 			Access ba;
+			Subrange::Buffer subrange = {};
 
 			Resource operator>>(Name output);
 			operator Resource();
@@ -64,6 +79,14 @@ namespace vuk {
 		struct RenderGraph* foreign = nullptr;
 		int32_t reference = 0;
 		bool promoted_to_general = false;
+		/// @brief Mip levels and array layers of the image accessed, relative to the attachment
+		/// Accesses to disjoint subranges of the same image are not synchronized against each other, the compiler tracks the state of each part of the
+		/// image and splits or merges them as needed. Ignored for framebuffer attachments, which always access the whole attachment.
+		Subrange::Image image_subrange = {};
+		/// @brief Bytes of the buffer accessed, relative to the bound buffer
+		/// Accesses to disjoint ranges of the same buffer are not synchronized against each other. Accesses to a range are synchronized with buffer
+		/// memory barriers covering only the overlap, accesses to the whole buffer with global memory barriers.
+		Subrange::Buffer buffer_subrange = {};
 
 		Resource(Name n, Type t, Access ia) : name{ Name{}, n }, type(t), ia(ia) {}
 		Resource(Name n, Type t, Access ia, Name out_name) : name{ Name{}, n }, type(t), ia(ia), out_name{ Name{}, out_name } {}
@@ -86,6 +109,20 @@ namespace vuk {
 		std::vector<Resource> resources;
 
 		std::function<void(CommandBuffer&)> execute;
+		/// @brief Record the pass into secondary command buffers - required for CommandBuffer::fork inside a render pass
+		/// Other passes in the same render pass are recorded into secondary command buffers as well, and pipeline statistics are not measured for them.
+		bool use_secondary_command_buffers = false;
+		/// @brief When nonzero, the commands recorded by execute are kept and replayed in later frames instead of calling execute again, as long as the
+		/// key and the resources resolved for the pass stay the same. Change the key when anything else the pass records changes.
+		/// Passes that allocate per-frame objects while recording (descriptor sets, scratch memory, forked command buffers), or that refer to objects which
+		/// are not resources of the pass (other buffers and image views, persistent descriptor sets, acceleration structures) are recorded every frame.
+		uint64_t content_key = 0;
+		/// @brief The pass only depends on its resources and parameter_hash - while they are unchanged since the pass last ran, the pass is skipped and its
+		/// outputs refer to the results it left in its images and buffers. Resources are compared by the images and buffers they are attached to.
+		/// Only skipped if every resource is attached with a concrete image or buffer, the inputs are attached or written by pure passes, and the outputs
+		/// are not written again in the graph.
+		bool pure = false;
+		uint64_t parameter_hash = 0;
 		std::byte* arguments; // internal use
 		PassType type = PassType::eUserPass;
 	};
@@ -166,6 +203,18 @@ namespace vuk {
 		/// @param initial Access to the resource prior to this rendergraph
 		void attach_image_from_allocator(Name name, ImageAttachment image_attachment, Allocator allocator, Access initial = eNone);
 
+		/// @brief Attach a history resource, whose images persist across executions of render graphs
+		///
+		/// The image written under `name` in one execution can be read as `name@prev` in the next one, `name@prev2` in the one after that, up to
+		/// `history_length`. The images are rotated instead of copied and their layouts are carried over between executions.
+		/// Images that have not been written yet (the first executions, or after the attachment changed) have undefined contents.
+		/// @param name Name of the resource to attach to - the older images are attached to `name@prev`, `name@prev2`, ...
+		/// @param image_attachment Fully specified ImageAttachment describing the images
+		/// @param resource DeviceSuperFrameResource keeping the images alive, see DeviceSuperFrameResource::acquire_history_images
+		/// @param history_length Number of previous images kept
+		/// @return An error if the images could not be allocated
+		Result<void> attach_history(Name name, ImageAttachment image_attachment, DeviceSuperFrameResource& resource, uint32_t history_length = 1);
+
 		/// @brief Attach an image to the given name
 		/// @param name Name of the resource to attach to
 		/// @param image_attachment ImageAttachment to attach
@@ -246,6 +295,74 @@ namespace vuk {
 	/// @brief Inference target is the same size as the source
 	BufferRule same_size_as(Name inference_source);
 
+	/// @brief Wall time spent in each phase of compiling and linking, in seconds - phases that did not run are 0
+	struct CompilePhaseTimes {
+		/// @brief Inlining subgraphs, resolving names and merging diverged passes
+		double inlining = 0;
+		/// @brief Building and terminating the resource use links
+		double link_building = 0;
+		/// @brief Collecting and checking the use chains
+		double chain_collection = 0;
+		/// @brief Ordering passes and fixing up subchains
+		double scheduling = 0;
+		double queue_inference = 0;
+		double partitioning = 0;
+		double resource_linking = 0;
+		double render_pass_assignment = 0;
+		/// @brief Counting the layout transitions of image chains and promoting them to GENERAL
+		double layout_promotion = 0;
+		// link only
+		double barrier_generation = 0;
+		double render_pass_merge = 0;
+		/// @brief Culling waits, assigning passes to batches and building the waits
+		double batching = 0;
+		double render_pass_building = 0;
+	};
+
+	/// @brief Outcome of reordering passes, comparing the scheduled order with the reordered one - only filled if RenderGraphCompileOptions::reorder_passes
+	struct PassReorderReport {
+		/// @brief Passes that changed position
+		size_t passes_moved = 0;
+		/// @brief Neighbouring passes rendering to the same attachments, whose render passes can be merged
+		size_t merge_candidates_before = 0;
+		size_t merge_candidates_after = 0;
+		/// @brief Neighbouring passes that do not use any resource in common
+		size_t resource_switches_before = 0;
+		size_t resource_switches_after = 0;
+	};
+
+	/// @brief Timings and sizes of the last Compiler::compile or Compiler::link
+	struct CompileStats {
+		CompilePhaseTimes phase_times;
+		/// @brief Wall time of the whole call, in seconds
+		double total_time = 0;
+
+		size_t passes = 0;
+		/// @brief Pure passes skipped because their inputs did not change since they last ran
+		size_t passes_memoized = 0;
+		size_t resources = 0;
+		size_t chains = 0;
+		/// @brief Image chains kept in the GENERAL layout, see LayoutPromotionOptions
+		size_t chains_promoted_to_general = 0;
+		/// @brief Image chains allocated with concurrent sharing, see RenderGraphCompileOptions::concurrent_sharing
+		size_t chains_shared_concurrently = 0;
+		/// @brief Barriers recorded into the passes (link only)
+		size_t image_barriers = 0;
+		/// @brief Mip level and array layer pairs transitioned by the image barriers (link only)
+		size_t image_barrier_subresources = 0;
+		size_t memory_barriers = 0;
+		/// @brief Barriers on a range of a buffer (link only)
+		size_t buffer_barriers = 0;
+		/// @brief Render passes with attachments before merging
+		size_t render_passes_before_merge = 0;
+		/// @brief Render passes with attachments left after merging (link only)
+		size_t render_passes_after_merge = 0;
+		PassReorderReport reordering;
+		/// @brief Bytes taken from the compiler arena - allocations that do not fit into the arena go to the heap
+		size_t arena_bytes_used = 0;
+		size_t arena_capacity = 0;
+	};
+
 	struct Compiler {
 		Compiler();
 		~Compiler();
@@ -278,6 +395,9 @@ namespace vuk {
 		/// @brief Dump the pass dependency graph in graphviz format
 		std::string dump_graph();
 
+		/// @brief Retrieve the phase timings and sizes of the last compile or link
+		const CompileStats& get_compile_stats() const;
+
 	private:
 		struct RGCImpl* impl;
 
@@ -297,6 +417,7 @@ namespace vuk {
 		std::vector<VkCommandBuffer> command_buffers;
 		std::vector<FutureBase*> future_signals;
 		std::vector<SwapchainRef> used_swapchains;
+		std::vector<PassTimestamps> pass_timestamps;
 	};
 
 	struct SubmitBatch {
@@ -324,6 +445,10 @@ namespace vuk {
 		Result<struct AttachmentInfo, RenderGraphException> get_resource_image(const NameReference&, struct PassInfo*);
 
 		Result<bool, RenderGraphException> is_resource_image_in_general_layout(const NameReference&, struct PassInfo* pass_info);
+		/// @brief Check if the buffer lies within one of the buffer resources of the pass
+		bool is_resource_buffer(const Buffer& buffer, struct PassInfo* pass_info);
+		/// @brief Check if the image view is the view of one of the image resources of the pass
+		bool is_resource_image_view(ImageView image_view, struct PassInfo* pass_info);
 
 		QualifiedName resolve_name(Name, struct PassInfo*) const noexcept;
 
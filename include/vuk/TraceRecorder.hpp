@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vuk/Config.hpp"
+#include "vuk/Name.hpp"
+#include "vuk/Query.hpp"
+#include "vuk/Types.hpp"
+
+#include <chrono>
+#include <iosfwd>
+#include <span>
+#include <utility>
+
+namespace vuk {
+	class Context;
+
+	/// @brief Captures CPU and GPU activity over a range of frames and writes it as a Chrome trace event JSON file (viewable in Perfetto or chrome://tracing)
+	///
+	/// While capturing, the recorder collects
+	/// - CPU zones and counters, through the instrumentation callbacks of the Context (only if vuk was built with VUK_INSTRUMENTATION)
+	/// - every queue submission, with its host time and the timeline values it waits on, drawn as flow arrows between submits
+	/// - per-pass GPU timestamps, drawn on one track per queue
+	///
+	/// GPU timestamps are placed on the host timeline using VK_EXT_calibrated_timestamps when the extension is enabled on the device,
+	/// otherwise by assuming that GPU work starts no earlier than it was submitted.
+	/// Per-pass timestamps require render graphs to be executed with a frame allocator (DeviceFrameResource), which makes the results available
+	/// once the frame is recycled.
+	struct TraceRecorder {
+		TraceRecorder(Context& ctx);
+		~TraceRecorder();
+
+		TraceRecorder(const TraceRecorder&) = delete;
+		TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+		/// @brief Start capturing - while capturing, the recorder wraps the instrumentation callbacks of the Context
+		/// Must not be called while other threads are using the Context.
+		void begin_capture();
+		/// @brief Stop capturing and restore the previous instrumentation callbacks
+		void end_capture();
+		bool is_capturing() const;
+
+		/// @brief Write the events captured so far as Chrome trace event JSON
+		/// GPU passes whose timestamps are not yet available are left out - write after the captured frames have been recycled.
+		void write_json(std::ostream& os);
+		/// @brief Discard the events captured so far
+		void clear();
+
+		/// @brief Record a queue submission - called by vuk while capturing
+		/// @param domain Queue submitted to
+		/// @param signal_value Timeline value signalled by the submission
+		/// @param waits Queues and timeline values the submission waits on
+		/// @param passes Timestamps written around the passes of the submission
+		/// @param submit_begin Host time the submission to the queue started
+		/// @param submit_end Host time the submission to the queue returned
+		void record_submit(DomainFlagBits domain,
+		                   uint64_t signal_value,
+		                   std::span<const std::pair<DomainFlagBits, uint64_t>> waits,
+		                   std::span<const PassTimestamps> passes,
+		                   std::chrono::steady_clock::time_point submit_begin,
+		                   std::chrono::steady_clock::time_point submit_end);
+		/// @brief Record the end of a frame - called by vuk while capturing
+		void record_frame(uint64_t absolute_frame);
+
+	private:
+		struct TraceRecorderImpl* impl;
+	};
+} // namespace vuk
@@ -1092,8 +1092,35 @@ namespace vuk {
 		}
 	};
 
+	/// @brief Control when image chains are kept in the GENERAL layout for all their uses, instead of transitioning between optimal layouts
+	/// Whether GENERAL costs performance compared to the optimal layouts depends on the device - on some, images in GENERAL lose compression. The
+	/// defaults promote nothing, a device profile opts in through Context::set_layout_promotion_options.
+	/// Chains used as framebuffer attachments or presented are never promoted.
+	struct LayoutPromotionOptions {
+		/// @brief Promote chains with more layout transitions than this - UINT32_MAX disables the threshold
+		uint32_t max_layout_transitions = UINT32_MAX;
+		/// @brief Promote chains that go from storage to sampled use and back, or from sampled to storage use and back
+		bool promote_storage_sampled_alternation = false;
+	};
+
 	/// @brief Control compilation options when compiling the rendergraph
 	struct RenderGraphCompileOptions {
+		/// @brief Callbacks to report the compilation phases to - when compiled through a Context, the Context callbacks are used if not set
+		const struct InstrumentationCallbacks* instrumentation = nullptr;
+		/// @brief Reorder independent passes after scheduling, so that passes using the same resources run next to each other
+		/// Passes rendering to the same attachments are placed next to each other first, so that their render passes can be merged. The outcome is
+		/// reported in CompileStats::reordering.
+		bool reorder_passes = false;
+		/// @brief Thresholds for promoting image chains to the GENERAL layout - when compiled through a Context, the Context options are used if not set,
+		/// otherwise the defaults of LayoutPromotionOptions, which promote nothing
+		const LayoutPromotionOptions* layout_promotion = nullptr;
+		/// @brief Create images allocated by the render graph with concurrent sharing when their chain moves between queues, so that no queue family
+		/// ownership transfers are needed
+		/// Images used as framebuffer attachments may lose compression when shared concurrently, so they need more queue crossings to be selected.
+		/// Images attached with ImageAttachment::sharing_mode set to eConcurrent skip ownership transfers regardless of this option.
+		bool concurrent_sharing = false;
+		/// @brief Queue crossings a chain of a framebuffer attachment needs before it is shared concurrently - other images need one
+		uint32_t concurrent_sharing_attachment_crossings = 2;
 	};
 
 	
@@ -9,6 +9,10 @@ VUK_Y(vkSetDebugUtilsObjectNameEXT)
 VUK_Y(vkCmdBeginDebugUtilsLabelEXT)
 VUK_Y(vkCmdEndDebugUtilsLabelEXT)
 
+// VK_EXT_calibrated_timestamps
+VUK_Y(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+VUK_X(vkGetCalibratedTimestampsEXT)
+
 // VK_KHR_ray_tracing
 VUK_X(vkCmdBuildAccelerationStructuresKHR)
 VUK_X(vkGetAccelerationStructureBuildSizesKHR)
@@ -15,6 +15,8 @@ VUK_X(vkCmdUpdateBuffer)
 VUK_X(vkCmdResolveImage)
 VUK_X(vkCmdPipelineBarrier)
 VUK_X(vkCmdWriteTimestamp)
+VUK_X(vkCmdBeginQuery)
+VUK_X(vkCmdEndQuery)
 VUK_X(vkCmdDraw)
 VUK_X(vkCmdDrawIndexed)
 VUK_X(vkCmdDrawIndexedIndirect)
@@ -65,6 +67,7 @@ VUK_X(vkCreateRenderPass)
 VUK_X(vkCmdBeginRenderPass)
 VUK_X(vkCmdNextSubpass)
 VUK_X(vkCmdEndRenderPass)
+VUK_X(vkCmdExecuteCommands)
 VUK_X(vkDestroyRenderPass)
 
 VUK_X(vkCreateSampler)
@@ -84,6 +87,7 @@ VUK_X(vkDestroyPipelineLayout)
 
 VUK_X(vkCreateFence)
 VUK_X(vkWaitForFences)
+VUK_X(vkResetFences)
 VUK_X(vkDestroyFence)
 
 VUK_X(vkCreateSemaphore)
@@ -111,6 +115,7 @@ VUK_X(vkDestroyImage)
 
 // 1.1
 VUK_Y(vkGetPhysicalDeviceProperties2)
+VUK_Y(vkGetPhysicalDeviceMemoryProperties2)
 
 // 1.2 
 VUK_X(vkGetBufferDeviceAddress)
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "vuk/Allocator.hpp"
+#include "vuk/ImageAttachment.hpp"
+#include "vuk/Name.hpp"
 #include "vuk/resources/DeviceNestedResource.hpp"
 #include "vuk/resources/DeviceVkResource.hpp"
 
+#include <array>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace vuk {
 	struct DeviceSuperFrameResource;
@@ -119,6 +124,7 @@ namespace vuk {
 
 		friend struct DeviceSuperFrameResource;
 		friend struct DeviceSuperFrameResourceImpl;
+		friend void record_semaphore_waited(Allocator& allocator, VkSemaphore semaphore);
 
 		DeviceFrameResource(VkDevice device, DeviceSuperFrameResource& upstream);
 	};
@@ -142,6 +148,55 @@ namespace vuk {
 		DeviceMultiFrameResource(VkDevice device, DeviceSuperFrameResource& upstream, uint32_t frame_lifetime);
 	};
 
+	/// @brief Descriptor pool usage of a recycled frame, and the pool capacity that was reserved for it
+	///
+	/// Descriptor counts are indexed by descriptor type, same as DescriptorSetLayoutAllocInfo::descriptor_counts
+	struct DescriptorPoolStats {
+		std::array<uint32_t, 12> descriptors_used = {};
+		std::array<uint32_t, 12> descriptor_capacity = {};
+		uint32_t sets_used = 0;
+		uint32_t set_capacity = 0;
+		/// @brief Number of pools that had to be allocated in addition to the first pool of the frame
+		uint32_t overflow_pools = 0;
+		/// @brief Number of reset pools kept for reuse by the DeviceSuperFrameResource
+		uint32_t recycled_pools = 0;
+
+		/// @brief Fraction of the reserved descriptors that were used, over all descriptor types
+		float utilization() const {
+			uint64_t used = 0;
+			uint64_t capacity = 0;
+			for (size_t i = 0; i < descriptors_used.size(); i++) {
+				used += descriptors_used[i];
+				capacity += descriptor_capacity[i];
+			}
+			return capacity == 0 ? 1.f : (float)used / (float)capacity;
+		}
+	};
+
+	/// @brief Images of a history resource, kept alive across frames by a DeviceSuperFrameResource - see RenderGraph::attach_history
+	///
+	/// The images are used round-robin: every execution of a render graph the history is attached to moves the current image one slot further,
+	/// so the image written in one execution is read as the previous image in the next one.
+	struct HistoryImages {
+		/// @brief Attachment the images were created for
+		ImageAttachment attachment;
+		std::vector<Unique<Image>> images;
+		std::vector<Unique<ImageView>> image_views;
+		/// @brief Use of each image at the end of the last render graph that used it
+		std::vector<QueueResourceUse> last_uses;
+		/// @brief Number of executed render graphs the history was attached to
+		uint64_t executions = 0;
+		/// @brief Frame the history was last attached in
+		uint64_t last_attached_frame = 0;
+		/// @brief Guards last_uses and executions, which are updated when render graphs using the history execute
+		std::mutex mutex;
+
+		/// @brief Index of the image that is `age` executions old in the next execution
+		size_t slot(uint32_t age) const noexcept {
+			return (size_t)((executions + images.size() - age % images.size()) % images.size());
+		}
+	};
+
 	/// @brief DeviceSuperFrameResource is an allocator that gives out DeviceFrameResource allocators, and manages their resources
 	///
 	/// DeviceSuperFrameResource models resource lifetimes that span multiple frames - these can be allocated directly from this resource
@@ -152,10 +207,21 @@ namespace vuk {
 		DeviceSuperFrameResource(Context& ctx, uint64_t frames_in_flight);
 		DeviceSuperFrameResource(DeviceResource& upstream, uint64_t frames_in_flight);
 
+		/// @brief Allocate binary semaphores, reusing semaphores from recycled frames when possible
+		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
+
 		void deallocate_semaphores(std::span<const VkSemaphore> src) override;
 
+		/// @brief Allocate fences, reusing (reset) fences from recycled frames when possible
+		Result<void, AllocateException> allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) override;
+
 		void deallocate_fences(std::span<const VkFence> src) override;
 
+		/// @brief Allocate command buffers, reusing command buffers that were reset together with their recycled pool when possible
+		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
+		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
+		                                                         SourceLocationAtFrame loc) override;
+
 		void deallocate_command_buffers(std::span<const CommandBufferAllocation> src) override;
 
 		Result<void, AllocateException>
@@ -190,6 +256,9 @@ namespace vuk {
 
 		void deallocate_timestamp_queries(std::span<const TimestampQuery> src) override; // noop
 
+		/// @brief Allocate timeline semaphores, reusing timeline semaphores from recycled frames when possible
+		Result<void, AllocateException> allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) override;
+
 		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
 
 		void deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) override;
@@ -214,6 +283,21 @@ namespace vuk {
 
 		void force_collect();
 
+		/// @brief Get the images backing the history resource `name`, allocating them if needed
+		///
+		/// The images are allocated again (and the contents are lost) if `attachment` or `count` differs from the previous call.
+		/// Histories that have not been acquired for 16 frames are deallocated.
+		/// @param name Name of the history resource
+		/// @param attachment Fully specified ImageAttachment describing the images
+		/// @param count Number of images to keep
+		Result<HistoryImages*, AllocateException>
+		acquire_history_images(Name name, const ImageAttachment& attachment, uint32_t count, SourceLocationAtFrame loc = VUK_HERE_AND_NOW());
+
+		/// @brief Retrieve descriptor pool usage of the most recently recycled frame
+		///
+		/// Frame descriptor pools are sized from the peak usage of recently recycled frames
+		DescriptorPoolStats get_descriptor_pool_stats();
+
 		virtual ~DeviceSuperFrameResource();
 
 		const uint64_t frames_in_flight;
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "vuk/Allocator.hpp"
+
+#include <array>
+
+namespace vuk {
+	/// @brief Simulated memory usage of a DeviceNullResource for a single MemoryUsage
+	struct NullMemoryStats {
+		uint64_t allocated_bytes = 0;
+		uint64_t peak_bytes = 0;
+		uint64_t allocation_count = 0;
+		/// @brief End of the highest live allocation in the simulated address space
+		uint64_t address_span = 0;
+
+		/// @brief Fraction of the address span that is not covered by live allocations
+		float fragmentation() const {
+			return address_span == 0 ? 0.f : 1.f - (float)allocated_bytes / (float)address_span;
+		}
+	};
+
+	/// @brief Device resource that does not talk to a device - it hands out fake handles.
+	///
+	/// Buffer and image memory is placed into simulated address spaces (one for each MemoryUsage), to measure peak memory and fragmentation.
+	/// Host-visible buffers are backed by host memory, so they can be written to.
+	/// Useful for running allocator stacks and allocation traces without a GPU.
+	struct DeviceNullResource final : DeviceResource {
+		/// @param ctx Context to return from get_context() - if nullptr, get_context() must not be called
+		DeviceNullResource(Context* ctx = nullptr);
+		~DeviceNullResource();
+
+		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
+		void deallocate_semaphores(std::span<const VkSemaphore> src) override;
+
+		Result<void, AllocateException> allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) override;
+		void deallocate_fences(std::span<const VkFence> src) override;
+
+		Result<void, AllocateException> allocate_command_buffers(std::span<CommandBufferAllocation> dst,
+		                                                         std::span<const CommandBufferAllocationCreateInfo> cis,
+		                                                         SourceLocationAtFrame loc) override;
+		void deallocate_command_buffers(std::span<const CommandBufferAllocation> dst) override;
+
+		Result<void, AllocateException>
+		allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_command_pools(std::span<const CommandPool> src) override;
+
+		Result<void, AllocateException> allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_buffers(std::span<const Buffer> src) override;
+
+		Result<void, AllocateException>
+		allocate_framebuffers(std::span<VkFramebuffer> dst, std::span<const FramebufferCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_framebuffers(std::span<const VkFramebuffer> src) override;
+
+		Result<void, AllocateException> allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_images(std::span<const Image> src) override;
+
+		Result<void, AllocateException>
+		allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_image_views(std::span<const ImageView> src) override;
+
+		Result<void, AllocateException> allocate_persistent_descriptor_sets(std::span<PersistentDescriptorSet> dst,
+		                                                                    std::span<const PersistentDescriptorSetCreateInfo> cis,
+		                                                                    SourceLocationAtFrame loc) override;
+		void deallocate_persistent_descriptor_sets(std::span<const PersistentDescriptorSet> src) override;
+
+		Result<void, AllocateException>
+		allocate_descriptor_sets_with_value(std::span<DescriptorSet> dst, std::span<const SetBinding> cis, SourceLocationAtFrame loc) override;
+		Result<void, AllocateException>
+		allocate_descriptor_sets(std::span<DescriptorSet> dst, std::span<const DescriptorSetLayoutAllocInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_descriptor_sets(std::span<const DescriptorSet> src) override;
+
+		Result<void, AllocateException>
+		allocate_descriptor_pools(std::span<VkDescriptorPool> dst, std::span<const VkDescriptorPoolCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) override;
+
+		Result<void, AllocateException>
+		allocate_timestamp_query_pools(std::span<TimestampQueryPool> dst, std::span<const VkQueryPoolCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_timestamp_query_pools(std::span<const TimestampQueryPool> src) override;
+
+		Result<void, AllocateException>
+		allocate_timestamp_queries(std::span<TimestampQuery> dst, std::span<const TimestampQueryCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_timestamp_queries(std::span<const TimestampQuery> src) override;
+
+		Result<void, AllocateException> allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) override;
+		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
+
+		Result<void, AllocateException> allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
+		                                                                 std::span<const VkAccelerationStructureCreateInfoKHR> cis,
+		                                                                 SourceLocationAtFrame loc) override;
+		void deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) override;
+
+		void deallocate_swapchains(std::span<const VkSwapchainKHR> src) override;
+
+		Result<void, AllocateException> allocate_graphics_pipelines(std::span<GraphicsPipelineInfo> dst,
+		                                                            std::span<const GraphicsPipelineInstanceCreateInfo> cis,
+		                                                            SourceLocationAtFrame loc) override;
+		void deallocate_graphics_pipelines(std::span<const GraphicsPipelineInfo> src) override;
+
+		Result<void, AllocateException>
+		allocate_compute_pipelines(std::span<ComputePipelineInfo> dst, std::span<const ComputePipelineInstanceCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_compute_pipelines(std::span<const ComputePipelineInfo> src) override;
+
+		Result<void, AllocateException> allocate_ray_tracing_pipelines(std::span<RayTracingPipelineInfo> dst,
+		                                                               std::span<const RayTracingPipelineInstanceCreateInfo> cis,
+		                                                               SourceLocationAtFrame loc) override;
+		void deallocate_ray_tracing_pipelines(std::span<const RayTracingPipelineInfo> src) override;
+
+		Result<void, AllocateException>
+		allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_render_passes(std::span<const VkRenderPass> src) override;
+
+		Context& get_context() override;
+
+		/// @brief Retrieve the simulated memory usage, indexed by MemoryUsage - 1
+		std::array<NullMemoryStats, 4> get_memory_stats();
+
+		Context* ctx;
+
+	private:
+		struct DeviceNullResourceImpl* impl;
+	};
+} // namespace vuk
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "vuk/Buffer.hpp"
+#include "vuk/Image.hpp"
+#include "vuk/resources/DeviceNestedResource.hpp"
+
+#include <functional>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+namespace vuk {
+	enum class TraceEventKind : uint8_t { eFrame, eSemaphore, eFence, eTimelineSemaphore, eBuffer, eImage };
+
+	/// @brief A single recorded allocation, deallocation or frame boundary
+	struct AllocationTraceEvent {
+		TraceEventKind kind;
+		bool deallocation = false;
+		/// @brief Identifies the object across its allocation and deallocation - for eFrame, the absolute frame that begins
+		uint64_t id = 0;
+		/// @brief Only valid for buffer allocations
+		BufferCreateInfo buffer = {};
+		/// @brief Only valid for image allocations - pointer members are not recorded
+		ImageCreateInfo image = {};
+	};
+
+	/// @brief Sequence of allocation events, which can be stored in a compact binary form and replayed on any DeviceResource
+	struct AllocationTrace {
+		std::vector<AllocationTraceEvent> events;
+
+		/// @brief Write the trace in binary form
+		void serialize(std::ostream& os) const;
+		/// @brief Read a trace written by serialize()
+		/// @return The trace, or nothing if the data is not a valid trace
+		static std::optional<AllocationTrace> deserialize(std::istream& is);
+	};
+
+	/// @brief Device resource that records the allocations and deallocations passing through it into an AllocationTrace
+	///
+	/// Semaphores, fences, timeline semaphores, buffers and images are recorded - other kinds are forwarded without being recorded.
+	struct DeviceTracingResource : DeviceNestedResource {
+		DeviceTracingResource(DeviceResource& upstream);
+		~DeviceTracingResource();
+
+		Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override;
+		void deallocate_semaphores(std::span<const VkSemaphore> src) override;
+
+		Result<void, AllocateException> allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) override;
+		void deallocate_fences(std::span<const VkFence> src) override;
+
+		Result<void, AllocateException> allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) override;
+		void deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) override;
+
+		Result<void, AllocateException> allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_buffers(std::span<const Buffer> src) override;
+
+		Result<void, AllocateException> allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) override;
+		void deallocate_images(std::span<const Image> src) override;
+
+		/// @brief Record the start of a new frame
+		/// Frames are also recorded when an allocation is made for a later frame than the last one recorded
+		void next_frame(uint64_t absolute_frame);
+
+		/// @brief Retrieve a copy of the events recorded so far
+		AllocationTrace get_trace();
+		/// @brief Discard the events recorded so far - objects that are still alive will be recorded when they are deallocated
+		void clear_trace();
+
+	private:
+		struct DeviceTracingResourceImpl* impl;
+	};
+
+	/// @brief Results of replaying an AllocationTrace
+	struct ReplayReport {
+		uint64_t allocations = 0;
+		uint64_t deallocations = 0;
+		uint64_t frames = 0;
+		uint64_t failed_allocations = 0;
+		/// @brief Wall time spent in the allocation and deallocation calls
+		double seconds = 0;
+		/// @brief Highest total size of buffers requested and alive at the same time
+		uint64_t peak_buffer_bytes = 0;
+		/// @brief Highest number of buffers and images alive at the same time
+		uint64_t peak_live_objects = 0;
+
+		double operations_per_second() const {
+			return seconds > 0 ? (allocations + deallocations) / seconds : 0;
+		}
+	};
+
+	/// @brief Replay the allocations and deallocations of a trace on a DeviceResource
+	/// Objects still alive at the end of the trace are deallocated, this is not included in the report.
+	/// @param trace Trace to replay
+	/// @param resource DeviceResource to replay on
+	/// @param on_frame If provided, invoked for every frame boundary in the trace - returns the DeviceResource to replay the frame on
+	ReplayReport replay_trace(const AllocationTrace& trace, DeviceResource& resource, std::function<DeviceResource&(uint64_t absolute_frame)> on_frame = {});
+} // namespace vuk
@@ -3,7 +3,46 @@
 #include "vuk/Allocator.hpp"
 #include "vuk/Config.hpp"
 
+#include <array>
+#include <functional>
+#include <vector>
+
 namespace vuk {
+	/// @brief Memory usage of a device memory heap
+	struct HeapMemoryStats {
+		/// @brief Bytes of this heap used by the process - reported by the driver if VK_EXT_memory_budget is enabled, estimated otherwise
+		uint64_t usage = 0;
+		/// @brief Bytes of this heap the process can use before allocations start failing or degrading performance
+		uint64_t budget = 0;
+		/// @brief Bytes allocated from this heap through the DeviceVkResource
+		uint64_t allocated_bytes = 0;
+		uint64_t allocation_count = 0;
+	};
+
+	/// @brief Memory allocated through the DeviceVkResource with a given MemoryUsage, or from a given source location
+	struct AllocationStats {
+		uint64_t bytes = 0;
+		uint64_t count = 0;
+	};
+
+	struct AllocationSiteStats {
+		source_location location;
+		AllocationStats stats;
+	};
+
+	/// @brief Point in time view of the device memory held by a DeviceVkResource
+	struct MemoryStatsSnapshot {
+		/// @brief Indexed by memory heap index
+		std::vector<HeapMemoryStats> heaps;
+		/// @brief Indexed by MemoryUsage - 1
+		std::array<AllocationStats, 4> usages = {};
+		/// @brief Allocation sites with live allocations, largest first
+		std::vector<AllocationSiteStats> sites;
+	};
+
+	/// @brief Invoked when the usage of a heap crosses the threshold fraction of its budget. above is true if the usage rose above the threshold.
+	using MemoryBudgetCallback = std::function<void(uint32_t heap_index, const HeapMemoryStats& stats, bool above)>;
+
 	/// @brief Device resource that performs direct allocation from the resources from the Vulkan runtime.
 	struct DeviceVkResource final : DeviceResource {
 		DeviceVkResource(Context& ctx);
@@ -109,6 +148,19 @@ namespace vuk {
 			return *ctx;
 		}
 
+		/// @brief Take a snapshot of heap budgets and of the memory allocated through this resource
+		MemoryStatsSnapshot get_memory_stats();
+
+		/// @brief Register a callback to be invoked when the usage of any heap crosses threshold * budget
+		/// @param threshold Fraction of the heap budget
+		/// @return Identifier of the callback, for removal
+		uint64_t add_memory_budget_callback(float threshold, MemoryBudgetCallback callback);
+
+		void remove_memory_budget_callback(uint64_t id);
+
+		/// @brief Refresh heap budgets from the driver and evaluate budget callbacks. Called by Context::next_frame().
+		void update_memory_budget(uint64_t absolute_frame);
+
 		Context* ctx;
 		VkDevice device;
 
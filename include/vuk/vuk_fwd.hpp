@@ -5,8 +5,13 @@
 namespace vuk {
 	class Context;
 	class Allocator;
+	struct DeviceSuperFrameResource;
+	struct HistoryImages;
 
 	class CommandBuffer;
+	class CommandStream;
+	struct RecordedPass;
+	struct RecordedPassKey;
 
 	struct Swapchain;
 	using SwapchainRef = Swapchain*;
@@ -59,6 +64,10 @@ namespace vuk {
 	struct TimestampQuery;
 	struct TimestampQueryPool;
 	struct TimestampQueryCreateInfo;
+	struct PassStatistics;
+	struct PassStatisticsQueryPool;
+	struct FrameStats;
+	struct FrameStatCounters;
 
 	struct CommandBufferAllocationCreateInfo;
 	struct CommandBufferAllocation;
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace vuk {
+	/// @brief Lock-free append-only list - many threads can push concurrently, consumed in bulk by a single thread
+	///
+	/// Producers claim slots with an atomic increment on the newest chunk, when it fills up a new chunk of twice the capacity is published with a CAS.
+	/// Consumption (for_each_chunk(), clear()) must not race with producers. Clearing retains the largest chunk, so steady state pushes don't allocate.
+	template<class T>
+	struct AppendList {
+		static constexpr size_t initial_capacity = 64;
+
+		AppendList() = default;
+		AppendList(const AppendList&) = delete;
+		AppendList& operator=(const AppendList&) = delete;
+
+		~AppendList() {
+			free_chain(head.load(std::memory_order_relaxed));
+		}
+
+		void push(const T& value) {
+			Chunk* c = head.load(std::memory_order_acquire);
+			while (true) {
+				if (c) {
+					size_t index = c->count.fetch_add(1, std::memory_order_relaxed);
+					if (index < c->capacity) {
+						c->data[index] = value;
+						return;
+					}
+				}
+				// current chunk is full (or we have none) - try to publish a new one with our value in it
+				Chunk* new_chunk = new Chunk(c ? c->capacity * 2 : initial_capacity);
+				new_chunk->data[0] = value;
+				new_chunk->count.store(1, std::memory_order_relaxed);
+				new_chunk->next = c;
+				if (head.compare_exchange_strong(c, new_chunk, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					return;
+				}
+				// somebody else published first, c now points to their chunk
+				delete new_chunk;
+			}
+		}
+
+		void push(std::span<const T> values) {
+			for (auto& v : values) {
+				push(v);
+			}
+		}
+
+		/// @brief Invoke f with a span of the elements of each chunk, newest chunk first
+		template<class F>
+		void for_each_chunk(F&& f) {
+			for (Chunk* c = head.load(std::memory_order_acquire); c != nullptr; c = c->next) {
+				size_t size = std::min(c->count.load(std::memory_order_relaxed), c->capacity);
+				if (size > 0) {
+					f(std::span<T>(c->data.get(), size));
+				}
+			}
+		}
+
+		template<class F>
+		void for_each(F&& f) {
+			for_each_chunk([&](std::span<T> chunk) {
+				for (auto& v : chunk) {
+					f(v);
+				}
+			});
+		}
+
+		size_t size() {
+			size_t size = 0;
+			for_each_chunk([&](std::span<T> chunk) { size += chunk.size(); });
+			return size;
+		}
+
+		bool empty() {
+			return size() == 0;
+		}
+
+		/// @brief Drop all elements, keeping only the newest (largest) chunk for reuse
+		void clear() {
+			Chunk* c = head.load(std::memory_order_acquire);
+			if (!c) {
+				return;
+			}
+			free_chain(c->next);
+			c->next = nullptr;
+			c->count.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		struct Chunk {
+			Chunk(size_t capacity) : capacity(capacity), data(new T[capacity]) {}
+
+			std::atomic<size_t> count = 0;
+			const size_t capacity;
+			std::unique_ptr<T[]> data;
+			Chunk* next = nullptr;
+		};
+
+		static void free_chain(Chunk* c) {
+			while (c) {
+				auto next = c->next;
+				delete c;
+				c = next;
+			}
+		}
+
+		std::atomic<Chunk*> head = nullptr;
+	};
+} // namespace vuk
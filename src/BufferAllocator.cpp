@@ -1,5 +1,8 @@
 #include "BufferAllocator.hpp"
 #include "vuk/Allocator.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/Result.hpp"
 #include "vuk/SourceLocation.hpp"
 #include <iostream>
@@ -39,6 +42,7 @@ namespace vuk {
 		}
 
 		if (best_fit_index == -1) { // no allocation suitable, allocate new one
+			VUK_ZONE(upstream->get_context().get_instrumentation_callbacks(), "Linear buffer allocator grow");
 			Buffer alloc;
 			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size * num_blocks };
 			auto result = upstream->allocate_buffers(std::span{ &alloc, 1 }, std::span{ &bci, 1 }, source);
@@ -134,6 +138,7 @@ namespace vuk {
 		b.size = size;
 		b.mapped_ptr = b.mapped_ptr != nullptr ? b.mapped_ptr + offset : nullptr;
 		b.device_address = b.device_address != 0 ? b.device_address + offset : 0;
+		upstream->get_context().get_frame_stat_counters().get_bytes_allocated(mem_usage) += size;
 
 		return { expected_value, b };
 	}
@@ -217,6 +222,7 @@ namespace vuk {
 		}
 		
 		if (!blocks[block_index].buffer) {
+			VUK_ZONE(upstream->get_context().get_instrumentation_callbacks(), "Buffer sub-allocator grow");
 			BufferCreateInfo bci{ .mem_usage = mem_usage, .size = block_size, .alignment = 256 };
 			auto result = upstream->allocate_buffers(std::span{ &blocks[block_index].buffer, 1 }, std::span{ &bci, 1 }, source);
 			if (!result) {
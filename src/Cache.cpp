@@ -1,5 +1,6 @@
 #include "Cache.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/PipelineInstance.hpp"
 
 #include <plf_colony.h>
@@ -15,6 +16,12 @@ namespace vuk {
 		std::shared_mutex cache_mtx;
 	};
 
+	static void count_lookup(FrameStatCounters* frame_stats, bool hit) {
+		if (frame_stats) {
+			(hit ? frame_stats->cache_hits : frame_stats->cache_misses) += 1;
+		}
+	}
+
 	template<class T>
 	Cache<T>::Cache(void* allocator, create_fn create, destroy_fn destroy) : impl(new CacheImpl<T>()), create(create), destroy(destroy), allocator(allocator) {}
 
@@ -29,10 +36,12 @@ namespace vuk {
 	T& Cache<T>::acquire(const create_info_t<T>& ci, uint64_t current_frame) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			it->second.last_use_frame = current_frame;
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			std::unique_lock ulock(impl->cache_mtx);
 			auto pit = impl->pool.emplace(create(allocator, ci));
 			typename Cache::LRUEntry entry{ &*pit, current_frame };
@@ -70,12 +79,14 @@ namespace vuk {
 	ShaderModule& Cache<ShaderModule>::acquire(const create_info_t<ShaderModule>& ci) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			if (it->second.load_cnt.load(std::memory_order_relaxed) == 0) { // perform a relaxed load to skip the atomic_wait path
 				std::atomic_wait(&it->second.load_cnt, 0);
 			}
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			std::unique_lock ulock(impl->cache_mtx);
 			typename Cache::LRUEntry entry{ nullptr, INT64_MAX };
 			it = impl->lru_map.emplace(ci, entry).first;
@@ -92,9 +103,11 @@ namespace vuk {
 	PipelineBaseInfo& Cache<PipelineBaseInfo>::acquire(const create_info_t<PipelineBaseInfo>& ci) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			std::unique_lock ulock(impl->cache_mtx);
 			auto pit = impl->pool.emplace(create(allocator, ci));
 			typename Cache::LRUEntry entry{ &*pit, INT64_MAX };
@@ -107,9 +120,11 @@ namespace vuk {
 	DescriptorSetLayoutAllocInfo& Cache<DescriptorSetLayoutAllocInfo>::acquire(const create_info_t<DescriptorSetLayoutAllocInfo>& ci) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			std::unique_lock ulock(impl->cache_mtx);
 			auto pit = impl->pool.emplace(create(allocator, ci));
 			typename Cache::LRUEntry entry{ &*pit, INT64_MAX };
@@ -122,9 +137,11 @@ namespace vuk {
 	VkPipelineLayout& Cache<VkPipelineLayout>::acquire(const create_info_t<VkPipelineLayout>& ci) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			std::unique_lock ulock(impl->cache_mtx);
 			auto pit = impl->pool.emplace(create(allocator, ci));
 			typename Cache::LRUEntry entry{ &*pit, INT64_MAX };
@@ -137,6 +154,7 @@ namespace vuk {
 	GraphicsPipelineInfo& Cache<GraphicsPipelineInfo>::acquire(const create_info_t<GraphicsPipelineInfo>& ci, uint64_t current_frame) {
 		std::shared_lock _(impl->cache_mtx);
 		if (auto it = impl->lru_map.find(ci); it != impl->lru_map.end()) {
+			count_lookup(frame_stats, true);
 			it->second.last_use_frame = current_frame;
 			if (it->second.load_cnt.load(std::memory_order_relaxed) == 0) { // perform a relaxed load to skip the atomic_wait path
 				std::atomic_wait(&it->second.load_cnt, 0);
@@ -144,6 +162,7 @@ namespace vuk {
 			return *it->second.ptr;
 		} else {
 			_.unlock();
+			count_lookup(frame_stats, false);
 			auto ci_copy = ci;
 			if (!ci_copy.is_inline()) {
 				ci_copy.extended_data = new std::byte[ci_copy.extended_size];
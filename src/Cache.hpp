@@ -270,5 +270,7 @@ namespace vuk {
 		destroy_fn destroy;
 
 		void* allocator;
+		/// @brief Counters to report hits and misses to, or nullptr
+		struct FrameStatCounters* frame_stats = nullptr;
 	};
 } // namespace vuk
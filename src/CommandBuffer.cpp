@@ -1,7 +1,10 @@
 #include "vuk/CommandBuffer.hpp"
 #include "RenderGraphUtil.hpp"
 #include "vuk/AllocatorHelpers.hpp"
+#include "vuk/CommandStream.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/RenderGraph.hpp"
 
 #include <cmath>
@@ -69,6 +72,48 @@ namespace vuk {
 	    ongoing_render_pass(ongoing),
 	    ds_strategy_flags(ctx.default_descriptor_set_strategy) {}
 
+	const auto& CommandBuffer::_pfns() {
+		if (pending_draw) {
+			_flush_draws();
+		}
+		return stream ? CommandStream::get_recording_functions() : static_cast<const ContextCreateParameters::FunctionPointers&>(ctx);
+	}
+
+	void CommandBuffer::_draw(const PendingDraw& draw) {
+		if (!draw_merging) {
+			if (draw.indexed) {
+				_pfns().vkCmdDrawIndexed(command_buffer, draw.count, draw.instance_count, draw.first, draw.vertex_offset, draw.first_instance);
+			} else {
+				_pfns().vkCmdDraw(command_buffer, draw.count, draw.instance_count, draw.first, draw.first_instance);
+			}
+			return;
+		}
+		// every command in between went through _pfns, which recorded the held back draw - a draw still held back directly precedes this one
+		if (pending_draw && pending_draw->indexed == draw.indexed && pending_draw->count == draw.count && pending_draw->first == draw.first &&
+		    pending_draw->vertex_offset == draw.vertex_offset && pending_draw->first_instance + pending_draw->instance_count == draw.first_instance) {
+			pending_draw->instance_count += draw.instance_count;
+			return;
+		}
+		if (pending_draw) {
+			_flush_draws();
+		}
+		pending_draw = draw;
+	}
+
+	void CommandBuffer::_flush_draws() {
+		if (!pending_draw) {
+			return;
+		}
+		auto draw = *pending_draw;
+		pending_draw.reset();
+		auto& pfns = _pfns();
+		if (draw.indexed) {
+			pfns.vkCmdDrawIndexed(command_buffer, draw.count, draw.instance_count, draw.first, draw.vertex_offset, draw.first_instance);
+		} else {
+			pfns.vkCmdDraw(command_buffer, draw.count, draw.instance_count, draw.first, draw.first_instance);
+		}
+	}
+
 	const CommandBuffer::RenderPassInfo& CommandBuffer::get_ongoing_render_pass() const {
 		return ongoing_render_pass.value();
 	}
@@ -132,33 +177,62 @@ namespace vuk {
 		return *this;
 	}
 
+	CommandBuffer& CommandBuffer::set_draw_merging(bool enabled) {
+		if (!enabled) {
+			_flush_draws();
+		}
+		draw_merging = enabled;
+		return *this;
+	}
+
 	CommandBuffer& CommandBuffer::set_dynamic_state(DynamicStateFlags flags) {
 		VUK_EARLY_RET();
 
 		// determine which states change to dynamic now - those states need to be flushed into the command buffer
 		DynamicStateFlags not_enabled = DynamicStateFlags{ ~dynamic_state_flags.m_mask }; // has invalid bits, but doesn't matter
-		auto to_dynamic = not_enabled & flags;
+		_flush_dynamic_state(not_enabled & flags);
+		// pipelines bound with static viewports or scissors overwrite the dynamic values
+		if (!(flags & DynamicStateFlagBits::eViewport)) {
+			bound_state.set_viewports.reset();
+		}
+		if (!(flags & DynamicStateFlagBits::eScissor)) {
+			bound_state.set_scissors.reset();
+		}
+		if (flags != dynamic_state_flags) {
+			_mark_pipeline_state_dirty(true);
+		}
+		dynamic_state_flags = flags;
+		return *this;
+	}
+
+	void CommandBuffer::_flush_dynamic_state(DynamicStateFlags to_dynamic) {
 		if (to_dynamic & DynamicStateFlagBits::eViewport && viewports.size() > 0) {
-			ctx.vkCmdSetViewport(command_buffer, 0, (uint32_t)viewports.size(), viewports.data());
+			_pfns().vkCmdSetViewport(command_buffer, 0, (uint32_t)viewports.size(), viewports.data());
+			for (unsigned i = 0; i < viewports.size(); i++) {
+				bound_state.viewports[i] = viewports[i];
+				bound_state.set_viewports.set(i, true);
+			}
 		}
 		if (to_dynamic & DynamicStateFlagBits::eScissor && scissors.size() > 0) {
-			ctx.vkCmdSetScissor(command_buffer, 0, (uint32_t)scissors.size(), scissors.data());
+			_pfns().vkCmdSetScissor(command_buffer, 0, (uint32_t)scissors.size(), scissors.data());
+			for (unsigned i = 0; i < scissors.size(); i++) {
+				bound_state.scissors[i] = scissors[i];
+				bound_state.set_scissors.set(i, true);
+			}
 		}
 		if (to_dynamic & DynamicStateFlagBits::eLineWidth) {
-			ctx.vkCmdSetLineWidth(command_buffer, line_width);
+			_pfns().vkCmdSetLineWidth(command_buffer, line_width);
 		}
 		if (to_dynamic & DynamicStateFlagBits::eDepthBias && rasterization_state) {
-			ctx.vkCmdSetDepthBias(
+			_pfns().vkCmdSetDepthBias(
 			    command_buffer, rasterization_state->depthBiasConstantFactor, rasterization_state->depthBiasClamp, rasterization_state->depthBiasSlopeFactor);
 		}
 		if (to_dynamic & DynamicStateFlagBits::eBlendConstants && blend_constants) {
-			ctx.vkCmdSetBlendConstants(command_buffer, blend_constants.value().data());
+			_pfns().vkCmdSetBlendConstants(command_buffer, blend_constants.value().data());
 		}
 		if (to_dynamic & DynamicStateFlagBits::eDepthBounds && depth_stencil_state) {
-			ctx.vkCmdSetDepthBounds(command_buffer, depth_stencil_state->minDepthBounds, depth_stencil_state->maxDepthBounds);
+			_pfns().vkCmdSetDepthBounds(command_buffer, depth_stencil_state->minDepthBounds, depth_stencil_state->maxDepthBounds);
 		}
-		dynamic_state_flags = flags;
-		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::set_viewport(unsigned index, Viewport vp) {
@@ -166,11 +240,22 @@ namespace vuk {
 		if (viewports.size() < (index + 1)) {
 			assert(index + 1 <= VUK_MAX_VIEWPORTS);
 			viewports.resize(index + 1);
+			_mark_pipeline_state_dirty(true);
+		}
+		// static viewports are part of the pipeline
+		if (!(dynamic_state_flags & DynamicStateFlagBits::eViewport) && memcmp(&viewports[index], &vp, sizeof(VkViewport)) != 0) {
+			_mark_pipeline_state_dirty(true);
 		}
 		viewports[index] = vp;
 
 		if (dynamic_state_flags & DynamicStateFlagBits::eViewport) {
-			ctx.vkCmdSetViewport(command_buffer, index, 1, &viewports[index]);
+			if (bound_state.set_viewports.test(index) && memcmp(&bound_state.viewports[index], &viewports[index], sizeof(VkViewport)) == 0) {
+				elided_calls++;
+				return *this;
+			}
+			_pfns().vkCmdSetViewport(command_buffer, index, 1, &viewports[index]);
+			bound_state.viewports[index] = viewports[index];
+			bound_state.set_viewports.set(index, true);
 		}
 		return *this;
 	}
@@ -214,37 +299,56 @@ namespace vuk {
 		if (scissors.size() < (index + 1)) {
 			assert(index + 1 <= VUK_MAX_SCISSORS);
 			scissors.resize(index + 1);
+			_mark_pipeline_state_dirty(true);
+		}
+		if (!(dynamic_state_flags & DynamicStateFlagBits::eScissor) && memcmp(&scissors[index], &vp, sizeof(VkRect2D)) != 0) {
+			_mark_pipeline_state_dirty(true);
 		}
 		scissors[index] = vp;
 		if (dynamic_state_flags & DynamicStateFlagBits::eScissor) {
-			ctx.vkCmdSetScissor(command_buffer, index, 1, &scissors[index]);
+			if (bound_state.set_scissors.test(index) && memcmp(&bound_state.scissors[index], &scissors[index], sizeof(VkRect2D)) == 0) {
+				elided_calls++;
+				return *this;
+			}
+			_pfns().vkCmdSetScissor(command_buffer, index, 1, &scissors[index]);
+			bound_state.scissors[index] = scissors[index];
+			bound_state.set_scissors.set(index, true);
 		}
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::set_rasterization(PipelineRasterizationStateCreateInfo state) {
 		VUK_EARLY_RET();
+		if (rasterization_state != state) {
+			_mark_pipeline_state_dirty(true);
+		}
 		rasterization_state = state;
 		if (state.depthBiasEnable && (dynamic_state_flags & DynamicStateFlagBits::eDepthBias)) {
-			ctx.vkCmdSetDepthBias(command_buffer, state.depthBiasConstantFactor, state.depthBiasClamp, state.depthBiasSlopeFactor);
+			_pfns().vkCmdSetDepthBias(command_buffer, state.depthBiasConstantFactor, state.depthBiasClamp, state.depthBiasSlopeFactor);
 		}
 		if (state.lineWidth != line_width && (dynamic_state_flags & DynamicStateFlagBits::eLineWidth)) {
-			ctx.vkCmdSetLineWidth(command_buffer, state.lineWidth);
+			_pfns().vkCmdSetLineWidth(command_buffer, state.lineWidth);
 		}
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::set_depth_stencil(PipelineDepthStencilStateCreateInfo state) {
 		VUK_EARLY_RET();
+		if (depth_stencil_state != state) {
+			_mark_pipeline_state_dirty(true);
+		}
 		depth_stencil_state = state;
 		if (state.depthBoundsTestEnable && (dynamic_state_flags & DynamicStateFlagBits::eDepthBounds)) {
-			ctx.vkCmdSetDepthBounds(command_buffer, state.minDepthBounds, state.maxDepthBounds);
+			_pfns().vkCmdSetDepthBounds(command_buffer, state.minDepthBounds, state.maxDepthBounds);
 		}
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::set_conservative(PipelineRasterizationConservativeStateCreateInfo state) {
 		VUK_EARLY_RET();
+		if (conservative_state != state) {
+			_mark_pipeline_state_dirty(true);
+		}
 		conservative_state = state;
 		return *this;
 	}
@@ -273,6 +377,9 @@ namespace vuk {
 	CommandBuffer& CommandBuffer::broadcast_color_blend(PipelineColorBlendAttachmentState state) {
 		VUK_EARLY_RET();
 		assert(ongoing_render_pass);
+		if (!broadcast_color_blend_attachment_0 || !set_color_blend_attachments.test(0) || color_blend_attachments[0] != state) {
+			_mark_pipeline_state_dirty(true);
+		}
 		color_blend_attachments[0] = state;
 		set_color_blend_attachments.set(0, true);
 		broadcast_color_blend_attachment_0 = true;
@@ -291,6 +398,9 @@ namespace vuk {
 		auto it = std::find(ongoing_render_pass->color_attachment_names.begin(), ongoing_render_pass->color_attachment_names.end(), resolved_name);
 		assert(it != ongoing_render_pass->color_attachment_names.end() && "Color attachment name not found.");
 		auto idx = std::distance(ongoing_render_pass->color_attachment_names.begin(), it);
+		if (broadcast_color_blend_attachment_0 || !set_color_blend_attachments.test(idx) || color_blend_attachments[idx] != state) {
+			_mark_pipeline_state_dirty(true);
+		}
 		set_color_blend_attachments.set(idx, true);
 		color_blend_attachments[idx] = state;
 		broadcast_color_blend_attachment_0 = false;
@@ -304,9 +414,13 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::set_blend_constants(std::array<float, 4> constants) {
 		VUK_EARLY_RET();
+		// static blend constants are part of the pipeline
+		if (!blend_constants || (!(dynamic_state_flags & DynamicStateFlagBits::eBlendConstants) && *blend_constants != constants)) {
+			_mark_pipeline_state_dirty(true);
+		}
 		blend_constants = constants;
 		if (dynamic_state_flags & DynamicStateFlagBits::eBlendConstants) {
-			ctx.vkCmdSetBlendConstants(command_buffer, constants.data());
+			_pfns().vkCmdSetBlendConstants(command_buffer, constants.data());
 		}
 		return *this;
 	}
@@ -349,6 +463,7 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::bind_vertex_buffer(unsigned binding, const Buffer& buf, unsigned first_attribute, Packed format) {
 		VUK_EARLY_RET();
+		_track_buffer(buf);
 		assert(binding < VUK_MAX_ATTRIBUTES && "Vertex buffer binding must be smaller than VUK_MAX_ATTRIBUTES.");
 		uint32_t location = first_attribute;
 		uint32_t offset = 0;
@@ -361,22 +476,22 @@ namespace vuk {
 				viad.format = f.format;
 				viad.location = location;
 				viad.offset = offset;
-				attribute_descriptions[viad.location] = viad;
-				VUK_SB_SET(set_attribute_descriptions, viad.location, true);
+				_set_vertex_input(viad);
 				offset += f.size;
 				location++;
 			}
 		}
 
-		VkVertexInputBindingDescription vibd;
-		vibd.binding = binding;
-		vibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		vibd.stride = offset;
-		binding_descriptions[binding] = vibd;
-		VUK_SB_SET(set_binding_descriptions, binding, true);
+		_set_vertex_binding(binding, offset);
 
 		if (buf.buffer) {
-			ctx.vkCmdBindVertexBuffers(command_buffer, binding, 1, &buf.buffer, &buf.offset);
+			if (bound_state.vertex_buffers[binding] == buf.buffer && bound_state.vertex_buffer_offsets[binding] == buf.offset) {
+				elided_calls++;
+				return *this;
+			}
+			_pfns().vkCmdBindVertexBuffers(command_buffer, binding, 1, &buf.buffer, &buf.offset);
+			bound_state.vertex_buffers[binding] = buf.buffer;
+			bound_state.vertex_buffer_offsets[binding] = buf.offset;
 		}
 		return *this;
 	}
@@ -393,21 +508,21 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::bind_vertex_buffer(unsigned binding, const Buffer& buf, std::span<VertexInputAttributeDescription> viads, uint32_t stride) {
 		VUK_EARLY_RET();
+		_track_buffer(buf);
 		assert(binding < VUK_MAX_ATTRIBUTES && "Vertex buffer binding must be smaller than VUK_MAX_ATTRIBUTES.");
 		for (auto& viad : viads) {
-			attribute_descriptions[viad.location] = viad;
-			VUK_SB_SET(set_attribute_descriptions, viad.location, true);
+			_set_vertex_input(viad);
 		}
-
-		VkVertexInputBindingDescription vibd;
-		vibd.binding = binding;
-		vibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		vibd.stride = stride;
-		binding_descriptions[binding] = vibd;
-		VUK_SB_SET(set_binding_descriptions, binding, true);
+		_set_vertex_binding(binding, stride);
 
 		if (buf.buffer) {
-			ctx.vkCmdBindVertexBuffers(command_buffer, binding, 1, &buf.buffer, &buf.offset);
+			if (bound_state.vertex_buffers[binding] == buf.buffer && bound_state.vertex_buffer_offsets[binding] == buf.offset) {
+				elided_calls++;
+				return *this;
+			}
+			_pfns().vkCmdBindVertexBuffers(command_buffer, binding, 1, &buf.buffer, &buf.offset);
+			bound_state.vertex_buffers[binding] = buf.buffer;
+			bound_state.vertex_buffer_offsets[binding] = buf.offset;
 		}
 		return *this;
 	}
@@ -424,7 +539,15 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::bind_index_buffer(const Buffer& buf, IndexType type) {
 		VUK_EARLY_RET();
-		ctx.vkCmdBindIndexBuffer(command_buffer, buf.buffer, buf.offset, (VkIndexType)type);
+		_track_buffer(buf);
+		if (bound_state.index_buffer == buf.buffer && bound_state.index_buffer_offset == buf.offset && bound_state.index_type == (VkIndexType)type) {
+			elided_calls++;
+			return *this;
+		}
+		_pfns().vkCmdBindIndexBuffer(command_buffer, buf.buffer, buf.offset, (VkIndexType)type);
+		bound_state.index_buffer = buf.buffer;
+		bound_state.index_buffer_offset = buf.offset;
+		bound_state.index_type = (VkIndexType)type;
 		return *this;
 	}
 
@@ -440,6 +563,9 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::set_primitive_topology(PrimitiveTopology topo) {
 		VUK_EARLY_RET();
+		if (topology != topo) {
+			_mark_pipeline_state_dirty(true);
+		}
 		topology = topo;
 		return *this;
 	}
@@ -447,6 +573,8 @@ namespace vuk {
 	CommandBuffer& CommandBuffer::bind_persistent(unsigned set, PersistentDescriptorSet& pda) {
 		VUK_EARLY_RET();
 		assert(set < VUK_MAX_SETS);
+		// the contents of persistent descriptor sets are not tracked by the recording
+		replayable = false;
 		persistent_sets_to_bind.set(set, true);
 		persistent_sets[set] = { pda.backing_set, pda.set_layout };
 		return *this;
@@ -464,7 +592,12 @@ namespace vuk {
 	CommandBuffer& CommandBuffer::specialize_constants(uint32_t constant_id, void* data, size_t size) {
 		VUK_EARLY_RET();
 		auto v = spec_map_entries.emplace(constant_id, SpecEntry{ size == sizeof(double) });
-		memcpy(&v.first->second.data, data, size);
+		auto& entry = v.first->second;
+		if (v.second || entry.is_double != (size == sizeof(double)) || memcmp(&entry.data, data, size) != 0) {
+			_mark_pipeline_state_dirty(false);
+		}
+		entry.is_double = size == sizeof(double);
+		memcpy(&entry.data, data, size);
 		return *this;
 	}
 
@@ -472,10 +605,11 @@ namespace vuk {
 		VUK_EARLY_RET();
 		assert(set < VUK_MAX_SETS);
 		assert(binding < VUK_MAX_BINDINGS);
-		sets_to_bind.set(set, true);
-		set_bindings[set].bindings[binding].type = DescriptorType::eUniformBuffer; // just means buffer
-		set_bindings[set].bindings[binding].buffer = VkDescriptorBufferInfo{ buffer.buffer, buffer.offset, buffer.size };
-		set_bindings[set].used.set(binding);
+		DescriptorBinding db;
+		db.type = DescriptorType::eUniformBuffer; // just means buffer
+		db.buffer = VkDescriptorBufferInfo{ buffer.buffer, buffer.offset, buffer.size };
+		_track_buffer(buffer);
+		_set_descriptor_binding(set, binding, db);
 		return *this;
 	}
 
@@ -513,6 +647,7 @@ namespace vuk {
 			bind_image(set, binding, ia.image_view, layout);
 		} else {
 			assert(ia.image);
+			replayable = false;
 			auto res = allocate_image_view(*allocator, ia);
 			if (!res) {
 				current_error = std::move(res);
@@ -529,8 +664,8 @@ namespace vuk {
 		assert(set < VUK_MAX_SETS);
 		assert(binding < VUK_MAX_BINDINGS);
 		assert(image_view.payload != VK_NULL_HANDLE);
-		sets_to_bind.set(set, true);
-		auto& db = set_bindings[set].bindings[binding];
+		_track_image_view(image_view);
+		auto db = set_bindings[set].bindings[binding];
 		// if previous descriptor was not an image, we reset the DescriptorImageInfo
 		if (db.type != DescriptorType::eStorageImage && db.type != DescriptorType::eSampledImage && db.type != DescriptorType::eSampler &&
 		    db.type != DescriptorType::eCombinedImageSampler) {
@@ -540,7 +675,7 @@ namespace vuk {
 		db.image.dii.imageLayout = (VkImageLayout)layout;
 		// if it was just a sampler, we upgrade to combined (has both image and sampler) - otherwise just image
 		db.type = db.type == DescriptorType::eSampler ? DescriptorType::eCombinedImageSampler : DescriptorType::eSampledImage;
-		set_bindings[set].used.set(binding);
+		_set_descriptor_binding(set, binding, db);
 		return *this;
 	}
 
@@ -548,17 +683,28 @@ namespace vuk {
 		VUK_EARLY_RET();
 		assert(set < VUK_MAX_SETS);
 		assert(binding < VUK_MAX_BINDINGS);
-		sets_to_bind.set(set, true);
-		auto& db = set_bindings[set].bindings[binding];
+		auto db = set_bindings[set].bindings[binding];
 		// if previous descriptor was not an image, we reset the DescriptorImageInfo
 		if (db.type != DescriptorType::eStorageImage && db.type != DescriptorType::eSampledImage && db.type != DescriptorType::eSampler &&
 		    db.type != DescriptorType::eCombinedImageSampler) {
 			db.image = { {}, {}, {} };
 		}
-		db.image.set_sampler(ctx.acquire_sampler(sci, ctx.get_frame_count()));
+		// samplers bound again are resolved without going to the sampler cache
+		Sampler sampler;
+		auto it = std::find_if(std::begin(recent_samplers), std::end(recent_samplers), [&](auto& recent) {
+			return recent.second.payload != VK_NULL_HANDLE && recent.first == sci;
+		});
+		if (it != std::end(recent_samplers)) {
+			sampler = it->second;
+		} else {
+			sampler = ctx.acquire_sampler(sci, ctx.get_frame_count());
+			recent_samplers[next_recent_sampler] = { sci, sampler };
+			next_recent_sampler = (next_recent_sampler + 1) % num_recent_samplers;
+		}
+		db.image.set_sampler(sampler);
 		// if it was just an image, we upgrade to combined (has both image and sampler) - otherwise just sampler
 		db.type = db.type == DescriptorType::eSampledImage ? DescriptorType::eCombinedImageSampler : DescriptorType::eSampler;
-		set_bindings[set].used.set(binding);
+		_set_descriptor_binding(set, binding, db);
 		return *this;
 	}
 
@@ -566,28 +712,45 @@ namespace vuk {
 		if (!current_error) {
 			return nullptr;
 		}
+		assert(set < VUK_MAX_SETS);
+		assert(binding < VUK_MAX_BINDINGS);
 
-		auto res = allocate_buffer(*allocator, { MemoryUsage::eCPUtoGPU, size, 1 });
-		if (!res) {
-			current_error = std::move(res);
-			return nullptr;
-		} else {
-			auto& buf = res->get();
-			bind_buffer(set, binding, buf);
-			return buf.mapped_ptr;
+		// suballocate from the scratch ring, starting a new chunk when the current one is full - large requests get a chunk of their own
+		replayable = false;
+		auto alignment = ctx.min_buffer_alignment;
+		size_t offset = (scratch_ring_used + alignment - 1) / alignment * alignment;
+		if (!scratch_ring || offset + size > scratch_ring.size) {
+			auto res = allocate_buffer(*allocator, { MemoryUsage::eCPUtoGPU, std::max(size, scratch_ring_chunk_size), alignment });
+			if (!res) {
+				current_error = std::move(res);
+				return nullptr;
+			}
+			scratch_ring = res->get();
+			offset = 0;
 		}
+		scratch_ring_used = offset + size;
+
+		// the descriptor only depends on the chunk and the size, the position in the chunk is the dynamic offset
+		DescriptorBinding db;
+		db.type = DescriptorType::eUniformBufferDynamic; // just means buffer with a dynamic offset
+		db.buffer = VkDescriptorBufferInfo{ scratch_ring.buffer, 0, size };
+		dynamic_offsets[set][binding] = (uint32_t)(scratch_ring.offset + offset);
+		_set_descriptor_binding(set, binding, db);
+		return scratch_ring.mapped_ptr + offset;
 	}
 
 	CommandBuffer& CommandBuffer::bind_acceleration_structure(unsigned set, unsigned binding, VkAccelerationStructureKHR tlas) {
 		VUK_EARLY_RET();
+		// acceleration structures are not render graph resources
+		replayable = false;
 		assert(set < VUK_MAX_SETS);
 		assert(binding < VUK_MAX_BINDINGS);
-		sets_to_bind.set(set, true);
-		auto& db = set_bindings[set].bindings[binding];
+		DescriptorBinding db;
+		db.as = {};
 		db.as.as = tlas;
 		db.as.wds.accelerationStructureCount = 1;
 		db.type = DescriptorType::eAccelerationStructureKHR;
-		set_bindings[set].used.set(binding);
+		_set_descriptor_binding(set, binding, db);
 		return *this;
 	}
 
@@ -596,7 +759,7 @@ namespace vuk {
 		if (!_bind_graphics_pipeline_state()) {
 			return *this;
 		}
-		ctx.vkCmdDraw(command_buffer, (uint32_t)vertex_count, (uint32_t)instance_count, (uint32_t)first_vertex, (uint32_t)first_instance);
+		_draw({ false, (uint32_t)vertex_count, (uint32_t)instance_count, (uint32_t)first_vertex, 0, (uint32_t)first_instance });
 		return *this;
 	}
 
@@ -606,16 +769,17 @@ namespace vuk {
 			return *this;
 		}
 
-		ctx.vkCmdDrawIndexed(command_buffer, (uint32_t)index_count, (uint32_t)instance_count, (uint32_t)first_index, vertex_offset, (uint32_t)first_instance);
+		_draw({ true, (uint32_t)index_count, (uint32_t)instance_count, (uint32_t)first_index, vertex_offset, (uint32_t)first_instance });
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::draw_indexed_indirect(size_t command_count, const Buffer& indirect_buffer) {
 		VUK_EARLY_RET();
+		_track_buffer(indirect_buffer);
 		if (!_bind_graphics_pipeline_state()) {
 			return *this;
 		}
-		ctx.vkCmdDrawIndexedIndirect(
+		_pfns().vkCmdDrawIndexedIndirect(
 		    command_buffer, indirect_buffer.buffer, (uint32_t)indirect_buffer.offset, (uint32_t)command_count, sizeof(DrawIndexedIndirectCommand));
 		return *this;
 	}
@@ -636,6 +800,7 @@ namespace vuk {
 			return *this;
 		}
 
+		replayable = false;
 		auto res = allocate_buffer(*allocator, { MemoryUsage::eCPUtoGPU, cmds.size_bytes(), 1 });
 		if (!res) {
 			current_error = std::move(res);
@@ -644,16 +809,18 @@ namespace vuk {
 
 		auto& buf = *res;
 		memcpy(buf->mapped_ptr, cmds.data(), cmds.size_bytes());
-		ctx.vkCmdDrawIndexedIndirect(command_buffer, buf->buffer, (uint32_t)buf->offset, (uint32_t)cmds.size(), sizeof(DrawIndexedIndirectCommand));
+		_pfns().vkCmdDrawIndexedIndirect(command_buffer, buf->buffer, (uint32_t)buf->offset, (uint32_t)cmds.size(), sizeof(DrawIndexedIndirectCommand));
 		return *this;
 	}
 
 	CommandBuffer& CommandBuffer::draw_indexed_indirect_count(size_t max_draw_count, const Buffer& indirect_buffer, const Buffer& count_buffer) {
 		VUK_EARLY_RET();
+		_track_buffer(indirect_buffer);
+		_track_buffer(count_buffer);
 		if (!_bind_graphics_pipeline_state()) {
 			return *this;
 		}
-		ctx.vkCmdDrawIndexedIndirectCount(command_buffer,
+		_pfns().vkCmdDrawIndexedIndirectCount(command_buffer,
 		                                  indirect_buffer.buffer,
 		                                  indirect_buffer.offset,
 		                                  count_buffer.buffer,
@@ -683,7 +850,7 @@ namespace vuk {
 		if (!_bind_compute_pipeline_state()) {
 			return *this;
 		}
-		ctx.vkCmdDispatch(command_buffer, (uint32_t)size_x, (uint32_t)size_y, (uint32_t)size_z);
+		_pfns().vkCmdDispatch(command_buffer, (uint32_t)size_x, (uint32_t)size_y, (uint32_t)size_z);
 		return *this;
 	}
 
@@ -698,7 +865,7 @@ namespace vuk {
 		uint32_t y = (uint32_t)(invocation_count_y + local_size[1] - 1) / local_size[1];
 		uint32_t z = (uint32_t)(invocation_count_z + local_size[2] - 1) / local_size[2];
 
-		ctx.vkCmdDispatch(command_buffer, x, y, z);
+		_pfns().vkCmdDispatch(command_buffer, x, y, z);
 		return *this;
 	}
 
@@ -738,10 +905,11 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::dispatch_indirect(const Buffer& indirect_buffer) {
 		VUK_EARLY_RET();
+		_track_buffer(indirect_buffer);
 		if (!_bind_compute_pipeline_state()) {
 			return *this;
 		}
-		ctx.vkCmdDispatchIndirect(command_buffer, indirect_buffer.buffer, indirect_buffer.offset);
+		_pfns().vkCmdDispatchIndirect(command_buffer, indirect_buffer.buffer, indirect_buffer.offset);
 		return *this;
 	}
 
@@ -763,7 +931,7 @@ namespace vuk {
 
 		auto& pipe = *current_ray_tracing_pipeline;
 
-		ctx.vkCmdTraceRaysKHR(
+		_pfns().vkCmdTraceRaysKHR(
 		    command_buffer, &pipe.rgen_region, &pipe.miss_region, &pipe.hit_region, &pipe.call_region, (uint32_t)size_x, (uint32_t)size_y, (uint32_t)size_z);
 		return *this;
 	}
@@ -795,9 +963,9 @@ namespace vuk {
 		isr.levelCount = attachment.level_count;
 
 		if (aspect == ImageAspectFlagBits::eColor) {
-			ctx.vkCmdClearColorImage(command_buffer, attachment.image.image, (VkImageLayout)layout, &c.c.color, 1, &isr);
+			_pfns().vkCmdClearColorImage(command_buffer, attachment.image.image, (VkImageLayout)layout, &c.c.color, 1, &isr);
 		} else if (aspect & (ImageAspectFlagBits::eDepth | ImageAspectFlagBits::eStencil)) {
-			ctx.vkCmdClearDepthStencilImage(command_buffer, attachment.image.image, (VkImageLayout)layout, &c.c.depthStencil, 1, &isr);
+			_pfns().vkCmdClearDepthStencilImage(command_buffer, attachment.image.image, (VkImageLayout)layout, &c.c.depthStencil, 1, &isr);
 		}
 
 		return *this;
@@ -851,7 +1019,7 @@ namespace vuk {
 		auto src_layout = *res_gl_src ? ImageLayout::eGeneral : ImageLayout::eTransferSrcOptimal;
 		auto dst_layout = *res_gl_dst ? ImageLayout::eGeneral : ImageLayout::eTransferDstOptimal;
 
-		ctx.vkCmdResolveImage(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_image.image, (VkImageLayout)dst_layout, 1, &ir);
+		_pfns().vkCmdResolveImage(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_image.image, (VkImageLayout)dst_layout, 1, &ir);
 
 		return *this;
 	}
@@ -886,7 +1054,7 @@ namespace vuk {
 		auto src_layout = *res_gl_src ? ImageLayout::eGeneral : ImageLayout::eTransferSrcOptimal;
 		auto dst_layout = *res_gl_dst ? ImageLayout::eGeneral : ImageLayout::eTransferDstOptimal;
 
-		ctx.vkCmdBlitImage(
+		_pfns().vkCmdBlitImage(
 		    command_buffer, src_image.image, (VkImageLayout)src_layout, dst_image.image, (VkImageLayout)dst_layout, 1, (VkImageBlit*)&region, (VkFilter)filter);
 
 		return *this;
@@ -916,7 +1084,7 @@ namespace vuk {
 			return *this;
 		}
 		auto dst_layout = *res_gl ? ImageLayout::eGeneral : ImageLayout::eTransferDstOptimal;
-		ctx.vkCmdCopyBufferToImage(command_buffer, src_bbuf.buffer, dst_image.image, (VkImageLayout)dst_layout, 1, (VkBufferImageCopy*)&bic);
+		_pfns().vkCmdCopyBufferToImage(command_buffer, src_bbuf.buffer, dst_image.image, (VkImageLayout)dst_layout, 1, (VkBufferImageCopy*)&bic);
 
 		return *this;
 	}
@@ -945,7 +1113,7 @@ namespace vuk {
 			return *this;
 		}
 		auto src_layout = *res_gl ? ImageLayout::eGeneral : ImageLayout::eTransferSrcOptimal;
-		ctx.vkCmdCopyImageToBuffer(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_bbuf.buffer, 1, (VkBufferImageCopy*)&bic);
+		_pfns().vkCmdCopyImageToBuffer(command_buffer, src_image.image, (VkImageLayout)src_layout, dst_bbuf.buffer, 1, (VkBufferImageCopy*)&bic);
 
 		return *this;
 	}
@@ -971,6 +1139,8 @@ namespace vuk {
 
 	CommandBuffer& CommandBuffer::copy_buffer(const Buffer& src, const Buffer& dst, size_t size) {
 		VUK_EARLY_RET();
+		_track_buffer(src);
+		_track_buffer(dst);
 
 		assert(src.size == dst.size);
 		if (src.buffer == dst.buffer) {
@@ -984,7 +1154,7 @@ namespace vuk {
 		bc.dstOffset += dst.offset;
 		bc.size = size == VK_WHOLE_SIZE ? src.size : size;
 
-		ctx.vkCmdCopyBuffer(command_buffer, src.buffer, dst.buffer, 1, &bc);
+		_pfns().vkCmdCopyBuffer(command_buffer, src.buffer, dst.buffer, 1, &bc);
 		return *this;
 	}
 
@@ -1002,7 +1172,8 @@ namespace vuk {
 	}
 
 	CommandBuffer& CommandBuffer::fill_buffer(const Buffer& dst, size_t size, uint32_t data) {
-		ctx.vkCmdFillBuffer(command_buffer, dst.buffer, dst.offset, size, data);
+		_track_buffer(dst);
+		_pfns().vkCmdFillBuffer(command_buffer, dst.buffer, dst.offset, size, data);
 		return *this;
 	}
 
@@ -1020,7 +1191,8 @@ namespace vuk {
 	}
 
 	CommandBuffer& CommandBuffer::update_buffer(const Buffer& dst, size_t size, void* data) {
-		ctx.vkCmdUpdateBuffer(command_buffer, dst.buffer, dst.offset, size, data);
+		_track_buffer(dst);
+		_pfns().vkCmdUpdateBuffer(command_buffer, dst.buffer, dst.offset, size, data);
 		return *this;
 	}
 
@@ -1030,7 +1202,7 @@ namespace vuk {
 		auto dst_use = to_use(dst_access, DomainFlagBits::eAny);
 		mb.srcAccessMask = is_read_access(src_use) ? 0 : (VkAccessFlags)src_use.access;
 		mb.dstAccessMask = (VkAccessFlags)dst_use.access;
-		ctx.vkCmdPipelineBarrier(command_buffer, (VkPipelineStageFlags)src_use.stages, (VkPipelineStageFlags)dst_use.stages, {}, 1, &mb, 0, nullptr, 0, nullptr);
+		_pfns().vkCmdPipelineBarrier(command_buffer, (VkPipelineStageFlags)src_use.stages, (VkPipelineStageFlags)dst_use.stages, {}, 1, &mb, 0, nullptr, 0, nullptr);
 		return *this;
 	}
 
@@ -1071,7 +1243,7 @@ namespace vuk {
 			imb.newLayout = (VkImageLayout)dst_use.layout;
 		}
 		imb.subresourceRange = isr;
-		ctx.vkCmdPipelineBarrier(command_buffer, (VkPipelineStageFlags)src_use.stages, (VkPipelineStageFlags)dst_use.stages, {}, 0, nullptr, 0, nullptr, 1, &imb);
+		_pfns().vkCmdPipelineBarrier(command_buffer, (VkPipelineStageFlags)src_use.stages, (VkPipelineStageFlags)dst_use.stages, {}, 0, nullptr, 0, nullptr, 1, &imb);
 
 		return *this;
 	}
@@ -1081,6 +1253,7 @@ namespace vuk {
 
 		vuk::TimestampQuery tsq;
 		vuk::TimestampQueryCreateInfo ci{ .query = q };
+		replayable = false;
 
 		auto res = allocator->allocate_timestamp_queries(std::span{ &tsq, 1 }, std::span{ &ci, 1 });
 		if (!res) {
@@ -1088,7 +1261,7 @@ namespace vuk {
 			return *this;
 		}
 
-		ctx.vkCmdWriteTimestamp(command_buffer, (VkPipelineStageFlagBits)stage, tsq.pool, tsq.id);
+		_pfns().vkCmdWriteTimestamp(command_buffer, (VkPipelineStageFlagBits)stage, tsq.pool, tsq.id);
 		return *this;
 	}
 
@@ -1097,7 +1270,9 @@ namespace vuk {
 	                                                            const VkAccelerationStructureBuildRangeInfoKHR* const* ppBuildRangeInfos) {
 		VUK_EARLY_RET();
 
-		ctx.vkCmdBuildAccelerationStructuresKHR(command_buffer, info_count, pInfos, ppBuildRangeInfos);
+		// the build infos point to user memory - not copied into command streams, so recorded directly
+		_flush_stream();
+		ctx.vkCmdBuildAccelerationStructuresKHR(get_underlying(), info_count, pInfos, ppBuildRangeInfos);
 		return *this;
 	}
 
@@ -1108,17 +1283,23 @@ namespace vuk {
 	VkCommandBuffer CommandBuffer::bind_compute_state() {
 		auto result = _bind_compute_pipeline_state();
 		assert(result);
-		return command_buffer;
+		invalidate_bound_state();
+		_flush_stream();
+		return get_underlying();
 	}
 	VkCommandBuffer CommandBuffer::bind_graphics_state() {
 		auto result = _bind_graphics_pipeline_state();
 		assert(result);
-		return command_buffer;
+		invalidate_bound_state();
+		_flush_stream();
+		return get_underlying();
 	}
 	VkCommandBuffer CommandBuffer::bind_ray_tracing_state() {
 		auto result = _bind_ray_tracing_pipeline_state();
 		assert(result);
-		return command_buffer;
+		invalidate_bound_state();
+		_flush_stream();
+		return get_underlying();
 	}
 
 	bool CommandBuffer::_bind_state(PipeType pipe_type) {
@@ -1134,22 +1315,8 @@ namespace vuk {
 			current_layout = current_ray_tracing_pipeline->pipeline_layout;
 			break;
 		}
-		VkPipelineBindPoint bind_point;
-		switch (pipe_type) {
-		case PipeType::eGraphics:
-			bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			break;
-		case PipeType::eCompute:
-			bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
-			break;
-		case PipeType::eRayTracing:
-			bind_point = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
-			break;
-		}
-
 		for (auto& pcr : pcrs) {
-			void* data = push_constant_buffer + pcr.offset;
-			ctx.vkCmdPushConstants(command_buffer, current_layout, pcr.stageFlags, pcr.offset, pcr.size, data);
+			_push_constants(current_layout, pcr);
 		}
 		pcrs.clear();
 
@@ -1176,6 +1343,19 @@ namespace vuk {
 			}
 			pipeline_set_layout = ds_layout_alloc_info->layout;
 
+			DescriptorSetLayoutCreateInfo* dslci;
+			switch (pipe_type) {
+			case PipeType::eGraphics:
+				dslci = &current_graphics_pipeline->base->dslcis[i];
+				break;
+			case PipeType::eCompute:
+				dslci = &current_compute_pipeline->base->dslcis[i];
+				break;
+			case PipeType::eRayTracing:
+				dslci = &current_ray_tracing_pipeline->base->dslcis[i];
+				break;
+			}
+
 			// binding validation
 			if (pipeline_set_layout != VK_NULL_HANDLE) { // set in the layout
 				bool is_used;
@@ -1191,6 +1371,15 @@ namespace vuk {
 					// detect if during this binding we disturb a set that we depend on
 					assert(highest_undisturbed_binding_required < lowest_disturbed_binding &&
 					       "Set composition disturbs previously bound set that is not recomposed or bound for this drawcall.");
+					bool rebind;
+					VUK_SB_TEST(sets_to_rebind, i, rebind);
+					if (rebind) { // bound by the parent of this command buffer, but not in this one yet
+						uint32_t inherited_offsets[VUK_MAX_BINDINGS];
+						auto inherited_offset_count = _collect_dynamic_offsets((unsigned)i, *dslci, inherited_offsets);
+						_bind_descriptor_set(
+						    pipe_type, current_layout, (uint32_t)i, descriptor_sets_used[i], std::span<const uint32_t>{ inherited_offsets, inherited_offset_count });
+						VUK_SB_SET(sets_to_rebind, i, false);
+					}
 					continue;
 				}
 			} else {                                         // not set in the layout
@@ -1201,6 +1390,7 @@ namespace vuk {
 					return false;
 				}
 			}
+			VUK_SB_SET(sets_to_rebind, i, false);
 			// if the newly bound DS has a different set layout than the previously bound set, then it disturbs all the sets at higher indices
 			bool is_disturbing = set_layouts_used[i] != pipeline_set_layout;
 			if (is_disturbing) {
@@ -1219,23 +1409,25 @@ namespace vuk {
 				break;
 			}
 
+			uint32_t dynamic_offsets_to_bind[VUK_MAX_BINDINGS];
+			auto dynamic_offset_count = _collect_dynamic_offsets((unsigned)i, *dslci, dynamic_offsets_to_bind);
+			std::span<const uint32_t> set_dynamic_offsets{ dynamic_offsets_to_bind, dynamic_offset_count };
+
 			if (!persistent_set_to_bind) {
-				std::vector<VkDescriptorSetLayoutBinding>* ppipeline_set_bindings;
-				DescriptorSetLayoutCreateInfo* dslci;
-				switch (pipe_type) {
-				case PipeType::eGraphics:
-					dslci = &current_graphics_pipeline->base->dslcis[i];
-					break;
-				case PipeType::eCompute:
-					dslci = &current_compute_pipeline->base->dslcis[i];
-					break;
-				case PipeType::eRayTracing:
-					dslci = &current_ray_tracing_pipeline->base->dslcis[i];
-					break;
+				// the bindings did not change since the set was last allocated for the same layout - bind it again
+				bool bindings_dirty;
+				VUK_SB_TEST(set_bindings_dirty, i, bindings_dirty);
+				auto& resolved = resolved_sets[i];
+				if (!bindings_dirty && resolved.reusable && resolved.descriptor_set != VK_NULL_HANDLE && resolved.layout == pipeline_set_layout) {
+					_bind_descriptor_set(pipe_type, current_layout, (uint32_t)i, resolved.descriptor_set, set_dynamic_offsets);
+					set_layouts_used[i] = pipeline_set_layout;
+					descriptor_sets_used[i] = resolved.descriptor_set;
+					continue;
 				}
-				ppipeline_set_bindings = &dslci->bindings;
-				auto& pipeline_set_bindings = *ppipeline_set_bindings;
+
+				auto& pipeline_set_bindings = dslci->bindings;
 				auto sb = set_bindings[i].finalize(dslci->used_bindings);
+				bool reusable = true;
 
 				for (uint64_t j = 0; j < pipeline_set_bindings.size(); j++) {
 					auto& pipe_binding = pipeline_set_bindings[j];
@@ -1244,9 +1436,17 @@ namespace vuk {
 					auto pipe_dtype = (DescriptorType)pipe_binding.descriptorType;
 					auto cbuf_dtype = cbuf_binding.type;
 
-					// untyped buffer descriptor inference
-					if (cbuf_dtype == DescriptorType::eUniformBuffer && pipe_dtype == DescriptorType::eStorageBuffer) {
-						cbuf_binding.type = DescriptorType::eStorageBuffer;
+					// untyped buffer descriptor inference - buffers take the buffer descriptor type of the pipeline
+					bool cbuf_dynamic = cbuf_dtype == DescriptorType::eUniformBufferDynamic;
+					bool pipe_dynamic = pipe_dtype == DescriptorType::eUniformBufferDynamic || pipe_dtype == DescriptorType::eStorageBufferDynamic;
+					if ((cbuf_dtype == DescriptorType::eUniformBuffer || cbuf_dynamic) &&
+					    (pipe_dtype == DescriptorType::eUniformBuffer || pipe_dtype == DescriptorType::eStorageBuffer || pipe_dynamic)) {
+						if (cbuf_dynamic && !pipe_dynamic) {
+							// no dynamic offset in the pipeline, so the offset goes into the descriptor - which then changes with every scratch allocation
+							cbuf_binding.buffer.offset += dynamic_offsets[i][pipe_binding.binding];
+							reusable = false;
+						}
+						cbuf_binding.type = pipe_dtype;
 						continue;
 					}
 					// storage image from any image
@@ -1292,17 +1492,28 @@ namespace vuk {
 
 				auto strategy = ds_strategy_flags.m_mask == 0 ? DescriptorSetStrategyFlagBits::eCommon : ds_strategy_flags;
 				Unique<DescriptorSet> ds;
-				if (strategy & DescriptorSetStrategyFlagBits::ePerLayout) {
-					if (auto ret = allocator->allocate_descriptor_sets_with_value(std::span{ &*ds, 1 }, std::span{ &sb, 1 }); !ret) {
+				if (recording) {
+					// sets bound by a recorded pass are replayed in later frames - they are allocated for the recording instead of the frame
+					if (auto ret = ctx.get_vk_resource().allocate_descriptor_sets_with_value(std::span{ &*ds, 1 }, std::span{ &sb, 1 }, VUK_HERE_AND_NOW()); !ret) {
 						current_error = std::move(ret);
 						return false;
 					}
-				} else if (strategy & DescriptorSetStrategyFlagBits::eCommon) {
-					if (auto ret = allocator->allocate_descriptor_sets(std::span{ &*ds, 1 }, std::span{ ds_layout_alloc_info, 1 }); !ret) {
+					recording->descriptor_sets.push_back(*ds);
+				} else if (strategy & DescriptorSetStrategyFlagBits::ePerLayout) {
+					if (auto ret = allocator->allocate_descriptor_sets_with_value(std::span{ &*ds, 1 }, std::span{ &sb, 1 }); !ret) {
 						current_error = std::move(ret);
 						return false;
 					}
+				} else if (strategy & DescriptorSetStrategyFlagBits::eCommon) {
+					{
+						VUK_ZONE(ctx.get_instrumentation_callbacks(), "Descriptor set allocation");
+						if (auto ret = allocator->allocate_descriptor_sets(std::span{ &*ds, 1 }, std::span{ ds_layout_alloc_info, 1 }); !ret) {
+							current_error = std::move(ret);
+							return false;
+						}
+					}
 
+					VUK_ZONE(ctx.get_instrumentation_callbacks(), "Descriptor set write");
 					auto& cinfo = sb;
 					auto mask = cinfo.used.to_ulong();
 					uint32_t leading_ones = num_leading_ones((uint32_t)mask);
@@ -1326,6 +1537,8 @@ namespace vuk {
 						switch (binding.type) {
 						case DescriptorType::eUniformBuffer:
 						case DescriptorType::eStorageBuffer:
+						case DescriptorType::eUniformBufferDynamic:
+						case DescriptorType::eStorageBufferDynamic:
 							write.pBufferInfo = &binding.buffer;
 							break;
 						case DescriptorType::eSampledImage:
@@ -1345,15 +1558,21 @@ namespace vuk {
 						}
 					}
 					ctx.vkUpdateDescriptorSets(allocator->get_context().device, j, writes, 0, nullptr);
+					ctx.get_frame_stat_counters().descriptor_sets_written += 1;
 				} else {
 					assert(0 && "Unimplemented DS strategy");
 				}
 
-				ctx.vkCmdBindDescriptorSets(command_buffer, bind_point, current_layout, (uint32_t)i, 1, &ds->descriptor_set, 0, nullptr);
+				_bind_descriptor_set(pipe_type, current_layout, (uint32_t)i, ds->descriptor_set, set_dynamic_offsets);
 				set_layouts_used[i] = ds->layout_info.layout;
+				descriptor_sets_used[i] = ds->descriptor_set;
+				// descriptor sets are released with the frame or the recording, so the set stays valid for the rest of the recording
+				resolved = { ds->descriptor_set, ds->layout_info.layout, reusable };
+				VUK_SB_SET(set_bindings_dirty, i, false);
 			} else {
-				ctx.vkCmdBindDescriptorSets(command_buffer, bind_point, current_layout, (uint32_t)i, 1, &persistent_sets[i].first, 0, nullptr);
+				_bind_descriptor_set(pipe_type, current_layout, (uint32_t)i, persistent_sets[i].first, set_dynamic_offsets);
 				set_layouts_used[i] = persistent_sets[i].second;
+				descriptor_sets_used[i] = persistent_sets[i].first;
 			}
 		}
 		auto sets_bound = sets_to_bind | persistent_sets_to_bind;            // these sets we bound freshly, valid
@@ -1366,7 +1585,400 @@ namespace vuk {
 		return true;
 	}
 
+	static constexpr VkPipelineBindPoint to_bind_point(size_t pipe_type) {
+		constexpr VkPipelineBindPoint bind_points[] = { VK_PIPELINE_BIND_POINT_GRAPHICS, VK_PIPELINE_BIND_POINT_COMPUTE, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR };
+		return bind_points[pipe_type];
+	}
+
+	void CommandBuffer::_bind_pipeline(PipeType pipe_type, VkPipeline pipeline) {
+		auto& bound = bound_state.pipelines[(size_t)pipe_type];
+		if (bound == pipeline) {
+			elided_calls++;
+			return;
+		}
+		_pfns().vkCmdBindPipeline(command_buffer, to_bind_point((size_t)pipe_type), pipeline);
+		bound = pipeline;
+	}
+
+	void CommandBuffer::_bind_descriptor_set(
+	    PipeType pipe_type, VkPipelineLayout layout, uint32_t index, VkDescriptorSet set, std::span<const uint32_t> dynamic_offsets) {
+		auto& sets = bound_state.sets[(size_t)pipe_type];
+		auto& set_layouts = bound_state.set_layouts[(size_t)pipe_type];
+		// dynamic offsets are not tracked, sets that take them are always bound
+		if (dynamic_offsets.empty() && sets[index] == set && set_layouts[index] == layout) {
+			elided_calls++;
+			return;
+		}
+		_pfns().vkCmdBindDescriptorSets(
+		    command_buffer, to_bind_point((size_t)pipe_type), layout, index, 1, &set, (uint32_t)dynamic_offsets.size(), dynamic_offsets.data());
+		sets[index] = set;
+		set_layouts[index] = layout;
+		// binding with a different pipeline layout may disturb the other sets - only trust the ones bound with this layout
+		for (uint32_t i = 0; i < VUK_MAX_SETS; i++) {
+			if (set_layouts[i] != layout) {
+				sets[i] = VK_NULL_HANDLE;
+				set_layouts[i] = VK_NULL_HANDLE;
+			}
+		}
+	}
+
+	void CommandBuffer::_push_constants(VkPipelineLayout layout, const VkPushConstantRange& pcr) {
+		auto& ranges = bound_state.push_constant_ranges;
+		void* data = push_constant_buffer + pcr.offset;
+		// push constants pushed with a different layout are not kept
+		if (bound_state.push_constant_layout != layout) {
+			ranges.clear();
+			bound_state.push_constant_layout = layout;
+		}
+		for (auto& r : ranges) {
+			if (r.stageFlags == pcr.stageFlags && r.offset == pcr.offset && r.size == pcr.size && memcmp(bound_state.push_constants + pcr.offset, data, pcr.size) == 0) {
+				elided_calls++;
+				return;
+			}
+		}
+		_pfns().vkCmdPushConstants(command_buffer, layout, pcr.stageFlags, pcr.offset, pcr.size, data);
+		// ranges overlapping the pushed one no longer hold the values in the shadow
+		for (size_t i = 0; i < ranges.size();) {
+			auto& r = ranges[i];
+			if (r.offset < pcr.offset + pcr.size && pcr.offset < r.offset + r.size) {
+				r = ranges.back();
+				ranges.pop_back();
+			} else {
+				i++;
+			}
+		}
+		if (ranges.size() < ranges.capacity()) {
+			ranges.push_back(pcr);
+			memcpy(bound_state.push_constants + pcr.offset, data, pcr.size);
+		}
+	}
+
+	void CommandBuffer::_mark_pipeline_state_dirty(bool graphics_only) {
+		pipeline_state_dirty[(size_t)PipeType::eGraphics] = true;
+		if (!graphics_only) {
+			pipeline_state_dirty[(size_t)PipeType::eCompute] = true;
+			pipeline_state_dirty[(size_t)PipeType::eRayTracing] = true;
+		}
+	}
+
+	void CommandBuffer::_set_vertex_input(const VertexInputAttributeDescription& viad) {
+		bool set;
+		VUK_SB_TEST(set_attribute_descriptions, viad.location, set);
+		if (!set || attribute_descriptions[viad.location] != viad) {
+			_mark_pipeline_state_dirty(true);
+		}
+		attribute_descriptions[viad.location] = viad;
+		VUK_SB_SET(set_attribute_descriptions, viad.location, true);
+	}
+
+	void CommandBuffer::_set_vertex_binding(unsigned binding, uint32_t stride) {
+		bool set;
+		VUK_SB_TEST(set_binding_descriptions, binding, set);
+		auto& vibd = binding_descriptions[binding];
+		if (!set || vibd.stride != stride || vibd.inputRate != VK_VERTEX_INPUT_RATE_VERTEX || vibd.binding != binding) {
+			_mark_pipeline_state_dirty(true);
+		}
+		vibd.binding = binding;
+		vibd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		vibd.stride = stride;
+		VUK_SB_SET(set_binding_descriptions, binding, true);
+	}
+
+	void CommandBuffer::_set_descriptor_binding(unsigned set, unsigned binding, const DescriptorBinding& db) {
+		auto& sb = set_bindings[set];
+		if (!sb.used.test(binding) || !(sb.bindings[binding] == db)) {
+			sb.bindings[binding] = db;
+			sb.used.set(binding);
+			VUK_SB_SET(set_bindings_dirty, set, true);
+		}
+		VUK_SB_SET(sets_to_bind, set, true);
+	}
+
+	uint32_t CommandBuffer::_collect_dynamic_offsets(unsigned set, const DescriptorSetLayoutCreateInfo& dslci, uint32_t* dst) {
+		// dynamic offsets are consumed in binding order - the bindings of the layout are sorted
+		uint32_t count = 0;
+		for (auto& b : dslci.bindings) {
+			auto type = (DescriptorType)b.descriptorType;
+			if (type != DescriptorType::eUniformBufferDynamic && type != DescriptorType::eStorageBufferDynamic) {
+				continue;
+			}
+			assert(b.descriptorCount == 1 && "Arrays of dynamic buffers are not supported.");
+			// buffers bound without a dynamic offset have it in the descriptor
+			bool from_scratch = b.binding < VUK_MAX_BINDINGS && set_bindings[set].used.test(b.binding) &&
+			                    set_bindings[set].bindings[b.binding].type == DescriptorType::eUniformBufferDynamic;
+			dst[count++] = from_scratch ? dynamic_offsets[set][b.binding] : 0;
+		}
+		return count;
+	}
+
+	void CommandBuffer::invalidate_bound_state() {
+		bound_state = {};
+	}
+
+	std::vector<CommandBuffer*> CommandBuffer::fork(size_t count) {
+		std::vector<CommandBuffer*> forked;
+		if (!current_error) {
+			return forked;
+		}
+		assert(children.empty() && "Children must be joined before forking again.");
+		assert((!ongoing_render_pass || primary_command_buffer != VK_NULL_HANDLE) && "Forking in a render pass requires Pass::use_secondary_command_buffers.");
+
+		replayable = false;
+		// the held back draw belongs before the commands of the children
+		_flush_draws();
+		// secondaries are begun without inherited queries, so they can't be executed while the pass is measured
+		if (statistics_query_pool) {
+			_flush_stream();
+			auto& pool = *statistics_query_pool;
+			if (pool.occlusion_used[statistics_query_index]) {
+				ctx.vkCmdEndQuery(get_underlying(), pool.occlusion, statistics_query_index);
+			}
+			ctx.vkCmdEndQuery(get_underlying(), pool.statistics, statistics_query_index);
+			pool.interrupted[statistics_query_index] = true;
+			statistics_query_pool = nullptr;
+		}
+		// command pools are externally synchronized - every child records from its own pool
+		VkCommandPoolCreateInfo cpci{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		cpci.flags = VkCommandPoolCreateFlagBits::VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		cpci.queueFamilyIndex = command_pool.queue_family_index;
+		std::vector<VkCommandPoolCreateInfo> cpcis(count, cpci);
+		child_command_pools.resize(count);
+		if (auto res = allocator->allocate_command_pools(std::span{ child_command_pools }, std::span{ cpcis }); !res) {
+			child_command_pools.clear();
+			current_error = std::move(res);
+			return forked;
+		}
+
+		for (auto& pool : child_command_pools) {
+			auto secondary = _begin_secondary(pool);
+			if (!secondary) {
+				current_error = Result<void>{ expected_error, secondary.error() };
+				return {};
+			}
+			auto& child = children.emplace_back(new CommandBuffer(*rg, ctx, *allocator, *secondary, ongoing_render_pass));
+			child->command_pool = pool;
+			child->_inherit_state(*this);
+			forked.push_back(child.get());
+		}
+		return forked;
+	}
+
+	CommandBuffer& CommandBuffer::join() {
+		if (children.empty()) {
+			return *this;
+		}
+		std::vector<VkCommandBuffer> secondaries;
+		for (auto& child : children) {
+			assert(child->children.empty() && "Children must be joined before their parent.");
+			elided_calls += child->elided_calls;
+			child->_flush_draws();
+			if (auto res = child->result(); !res) {
+				current_error = std::move(res);
+			} else if (auto result = ctx.vkEndCommandBuffer(child->command_buffer); result != VK_SUCCESS) {
+				current_error = Result<void>{ expected_error, VkException{ result } };
+			}
+			secondaries.push_back(child->command_buffer);
+		}
+		children.clear();
+		// pools are released with the frame
+		allocator->deallocate(std::span<const CommandPool>{ child_command_pools });
+		child_command_pools.clear();
+		VUK_EARLY_RET();
+
+		if (primary_command_buffer != VK_NULL_HANDLE) {
+			// what was recorded before the fork executes first, and recording continues in a new secondary command buffer
+			if (auto res = _execute_secondary(); !res) {
+				current_error = std::move(res);
+				return *this;
+			}
+			_pfns().vkCmdExecuteCommands(primary_command_buffer, (uint32_t)secondaries.size(), secondaries.data());
+			if (auto res = _record_into_secondary(); !res) {
+				current_error = std::move(res);
+				return *this;
+			}
+		} else {
+			_pfns().vkCmdExecuteCommands(command_buffer, (uint32_t)secondaries.size(), secondaries.data());
+		}
+		_restore_bound_state();
+		return *this;
+	}
+
+	Result<VkCommandBuffer> CommandBuffer::_begin_secondary(CommandPool pool) {
+		CommandBufferAllocation cba;
+		CommandBufferAllocationCreateInfo ci{ .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY, .command_pool = pool };
+		VUK_DO_OR_RETURN(allocator->allocate_command_buffers(std::span{ &cba, 1 }, std::span{ &ci, 1 }));
+
+		VkCommandBufferInheritanceInfo cbii{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		VkCommandBufferBeginInfo cbi{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, .pInheritanceInfo = &cbii };
+		if (ongoing_render_pass) {
+			cbii.renderPass = ongoing_render_pass->render_pass;
+			cbii.subpass = ongoing_render_pass->subpass;
+			cbii.framebuffer = ongoing_render_pass->framebuffer;
+			cbi.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		}
+		if (auto result = ctx.vkBeginCommandBuffer(cba.command_buffer, &cbi); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		return { expected_value, cba.command_buffer };
+	}
+
+	Result<void> CommandBuffer::_record_into_secondary() {
+		if (primary_command_buffer == VK_NULL_HANDLE) {
+			primary_command_buffer = command_buffer;
+		}
+		auto secondary = _begin_secondary(command_pool);
+		if (!secondary) {
+			return std::move(secondary);
+		}
+		command_buffer = *secondary;
+		return { expected_value };
+	}
+
+	Result<void> CommandBuffer::_execute_secondary() {
+		assert(primary_command_buffer != VK_NULL_HANDLE);
+		_flush_draws();
+		if (auto result = ctx.vkEndCommandBuffer(command_buffer); result != VK_SUCCESS) {
+			return { expected_error, VkException{ result } };
+		}
+		_pfns().vkCmdExecuteCommands(primary_command_buffer, 1, &command_buffer);
+		return { expected_value };
+	}
+
+	void CommandBuffer::_begin_stream(CommandStream& stream) {
+		assert(!this->stream);
+		stream.clear();
+		stream_target = command_buffer;
+		command_buffer = stream.handle();
+		this->stream = &stream;
+		replayable = true;
+	}
+
+	void CommandBuffer::_begin_recording(RecordedPass& recording) {
+		_begin_stream(recording.stream);
+		recording.descriptor_sets.clear();
+		recording.graphics_pipelines.clear();
+		recording.compute_pipelines.clear();
+		recording.ray_tracing_pipelines.clear();
+		this->recording = &recording;
+	}
+
+	void CommandBuffer::_flush_stream() {
+		// callers record into the command buffer directly next
+		_flush_draws();
+		if (!stream) {
+			return;
+		}
+		stream->translate(ctx, stream_target);
+		stream->clear();
+		// what follows is recorded directly, so the stream no longer holds the whole pass
+		replayable = false;
+	}
+
+	void CommandBuffer::_end_stream() {
+		_flush_draws();
+		// the stream is kept as it is, so that it can be stored for replaying
+		stream->translate(ctx, stream_target);
+		command_buffer = stream_target;
+		stream = nullptr;
+		recording = nullptr;
+	}
+
+	void CommandBuffer::_track_buffer(const Buffer& buffer) {
+		if (recording && replayable && !rg->is_resource_buffer(buffer, current_pass)) {
+			replayable = false;
+		}
+	}
+
+	void CommandBuffer::_track_image_view(ImageView image_view) {
+		if (recording && replayable && !rg->is_resource_image_view(image_view, current_pass)) {
+			replayable = false;
+		}
+	}
+
+	void CommandBuffer::_inherit_state(const CommandBuffer& parent) {
+		current_pass = parent.current_pass;
+		dynamic_state_flags = parent.dynamic_state_flags;
+		next_pipeline = parent.next_pipeline;
+		next_compute_pipeline = parent.next_compute_pipeline;
+		next_ray_tracing_pipeline = parent.next_ray_tracing_pipeline;
+		current_graphics_pipeline = parent.current_graphics_pipeline;
+		current_compute_pipeline = parent.current_compute_pipeline;
+		current_ray_tracing_pipeline = parent.current_ray_tracing_pipeline;
+		topology = parent.topology;
+		set_attribute_descriptions = parent.set_attribute_descriptions;
+		std::copy(std::begin(parent.attribute_descriptions), std::end(parent.attribute_descriptions), attribute_descriptions);
+		set_binding_descriptions = parent.set_binding_descriptions;
+		std::copy(std::begin(parent.binding_descriptions), std::end(parent.binding_descriptions), binding_descriptions);
+		spec_map_entries = parent.spec_map_entries;
+		rasterization_state = parent.rasterization_state;
+		depth_stencil_state = parent.depth_stencil_state;
+		conservative_state = parent.conservative_state;
+		broadcast_color_blend_attachment_0 = parent.broadcast_color_blend_attachment_0;
+		set_color_blend_attachments = parent.set_color_blend_attachments;
+		color_blend_attachments = parent.color_blend_attachments;
+		blend_constants = parent.blend_constants;
+		line_width = parent.line_width;
+		viewports = parent.viewports;
+		scissors = parent.scissors;
+		memcpy(push_constant_buffer, parent.push_constant_buffer, sizeof(push_constant_buffer));
+		pcrs = parent.pcrs;
+		ds_strategy_flags = parent.ds_strategy_flags;
+		draw_merging = parent.draw_merging;
+		sets_used = parent.sets_used;
+		std::copy(std::begin(parent.set_layouts_used), std::end(parent.set_layouts_used), set_layouts_used);
+		std::copy(std::begin(parent.descriptor_sets_used), std::end(parent.descriptor_sets_used), descriptor_sets_used);
+		sets_to_bind = parent.sets_to_bind;
+		std::copy(std::begin(parent.set_bindings), std::end(parent.set_bindings), set_bindings);
+		persistent_sets_to_bind = parent.persistent_sets_to_bind;
+		std::copy(std::begin(parent.persistent_sets), std::end(parent.persistent_sets), persistent_sets);
+		std::copy(std::begin(parent.pipeline_state_dirty), std::end(parent.pipeline_state_dirty), pipeline_state_dirty);
+		set_bindings_dirty = parent.set_bindings_dirty;
+		std::copy(std::begin(parent.resolved_sets), std::end(parent.resolved_sets), resolved_sets);
+		memcpy(dynamic_offsets, parent.dynamic_offsets, sizeof(dynamic_offsets));
+		// the scratch ring is not shared - children allocate their own chunks
+
+		bound_state = parent.bound_state;
+		_restore_bound_state();
+	}
+
+	void CommandBuffer::_restore_bound_state() {
+		// nothing is bound at the start of a secondary command buffer, nor after executing secondary command buffers - bind the shadowed state again
+		BoundState restored = bound_state;
+		invalidate_bound_state();
+		for (size_t i = 0; i < 3; i++) {
+			if (restored.pipelines[i] != VK_NULL_HANDLE) {
+				_bind_pipeline((PipeType)i, restored.pipelines[i]);
+			}
+		}
+		_flush_dynamic_state(dynamic_state_flags);
+		for (uint32_t i = 0; i < VUK_MAX_ATTRIBUTES; i++) {
+			if (restored.vertex_buffers[i] != VK_NULL_HANDLE) {
+				_pfns().vkCmdBindVertexBuffers(command_buffer, i, 1, &restored.vertex_buffers[i], &restored.vertex_buffer_offsets[i]);
+				bound_state.vertex_buffers[i] = restored.vertex_buffers[i];
+				bound_state.vertex_buffer_offsets[i] = restored.vertex_buffer_offsets[i];
+			}
+		}
+		if (restored.index_buffer != VK_NULL_HANDLE) {
+			_pfns().vkCmdBindIndexBuffer(command_buffer, restored.index_buffer, restored.index_buffer_offset, restored.index_type);
+			bound_state.index_buffer = restored.index_buffer;
+			bound_state.index_buffer_offset = restored.index_buffer_offset;
+			bound_state.index_type = restored.index_type;
+		}
+		for (auto& pcr : restored.push_constant_ranges) {
+			_pfns().vkCmdPushConstants(command_buffer, restored.push_constant_layout, pcr.stageFlags, pcr.offset, pcr.size, restored.push_constants + pcr.offset);
+		}
+		bound_state.push_constant_layout = restored.push_constant_layout;
+		bound_state.push_constant_ranges = restored.push_constant_ranges;
+		memcpy(bound_state.push_constants, restored.push_constants, sizeof(bound_state.push_constants));
+		// descriptor sets are bound again when a pipeline that uses them is bound, as the dynamic offsets depend on its layout
+		sets_to_rebind = sets_used;
+	}
+
 	bool CommandBuffer::_bind_compute_pipeline_state() {
+		if (next_compute_pipeline && !pipeline_state_dirty[(size_t)PipeType::eCompute] && current_compute_pipeline &&
+		    current_compute_pipeline->base == next_compute_pipeline) {
+			next_compute_pipeline = nullptr;
+		}
 		if (next_compute_pipeline) {
 			ComputePipelineInstanceCreateInfo pi;
 			pi.base = next_compute_pipeline;
@@ -1401,9 +2013,13 @@ namespace vuk {
 			allocator->allocate_compute_pipelines(std::span{ &current_compute_pipeline.value(), 1 }, std::span{ &pi, 1 });
 			// drop pipeline immediately
 			allocator->deallocate(std::span{ &current_compute_pipeline.value(), 1 });
+			if (recording) {
+				recording->compute_pipelines.push_back({ pi, current_compute_pipeline->pipeline });
+			}
 
-			ctx.vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, current_compute_pipeline->pipeline);
+			_bind_pipeline(PipeType::eCompute, current_compute_pipeline->pipeline);
 			next_compute_pipeline = nullptr;
+			pipeline_state_dirty[(size_t)PipeType::eCompute] = false;
 		}
 
 		return _bind_state(PipeType::eCompute);
@@ -1416,6 +2032,10 @@ namespace vuk {
 	};
 
 	bool CommandBuffer::_bind_graphics_pipeline_state() {
+		// nothing that goes into the pipeline changed since it was created - keep it
+		if (next_pipeline && !pipeline_state_dirty[(size_t)PipeType::eGraphics] && current_graphics_pipeline && current_graphics_pipeline->base == next_pipeline) {
+			next_pipeline = nullptr;
+		}
 		if (next_pipeline) {
 			GraphicsPipelineInstanceCreateInfo pi;
 			pi.base = next_pipeline;
@@ -1689,18 +2309,29 @@ namespace vuk {
 			// acquire_pipeline makes copy of extended_data if it needs to
 			current_graphics_pipeline = GraphicsPipelineInfo{};
 			allocator->allocate_graphics_pipelines(std::span{ &current_graphics_pipeline.value(), 1 }, std::span{ &pi, 1 });
+			if (recording) {
+				auto& kept = recording->graphics_pipelines.emplace_back(RecordedPass::GraphicsPipeline{ pi, {}, current_graphics_pipeline->pipeline });
+				if (!pi.is_inline()) {
+					kept.extended_data.assign(pi.extended_data, pi.extended_data + pi.extended_size);
+				}
+			}
 			if (!pi.is_inline()) {
 				delete pi.extended_data;
 			}
 			// drop pipeline immediately
 			allocator->deallocate(std::span{ &current_graphics_pipeline.value(), 1 });
 
-			ctx.vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, current_graphics_pipeline->pipeline);
+			_bind_pipeline(PipeType::eGraphics, current_graphics_pipeline->pipeline);
 			next_pipeline = nullptr;
+			pipeline_state_dirty[(size_t)PipeType::eGraphics] = false;
 		}
 		return _bind_state(PipeType::eGraphics);
 	}
 	bool CommandBuffer::_bind_ray_tracing_pipeline_state() {
+		if (next_ray_tracing_pipeline && !pipeline_state_dirty[(size_t)PipeType::eRayTracing] && current_ray_tracing_pipeline &&
+		    current_ray_tracing_pipeline->base == next_ray_tracing_pipeline) {
+			next_ray_tracing_pipeline = nullptr;
+		}
 		if (next_ray_tracing_pipeline) {
 			RayTracingPipelineInstanceCreateInfo pi;
 			pi.base = next_ray_tracing_pipeline;
@@ -1735,9 +2366,13 @@ namespace vuk {
 			allocator->allocate_ray_tracing_pipelines(std::span{ &current_ray_tracing_pipeline.value(), 1 }, std::span{ &pi, 1 });
 			// drop pipeline immediately
 			allocator->deallocate(std::span{ &current_ray_tracing_pipeline.value(), 1 });
+			if (recording) {
+				recording->ray_tracing_pipelines.push_back({ pi, current_ray_tracing_pipeline->pipeline });
+			}
 
-			ctx.vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, current_ray_tracing_pipeline->pipeline);
+			_bind_pipeline(PipeType::eRayTracing, current_ray_tracing_pipeline->pipeline);
 			next_ray_tracing_pipeline = nullptr;
+			pipeline_state_dirty[(size_t)PipeType::eRayTracing] = false;
 		}
 
 		return _bind_state(PipeType::eRayTracing);
@@ -0,0 +1,830 @@
+#include "vuk/CommandStream.hpp"
+#include "vuk/Allocator.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <ostream>
+
+namespace vuk {
+	namespace {
+		enum class Op : uint32_t {
+			eBindDescriptorSets,
+			eBindIndexBuffer,
+			eBindPipeline,
+			eBindVertexBuffers,
+			eBlitImage,
+			eClearColorImage,
+			eClearDepthStencilImage,
+			eCopyBuffer,
+			eCopyBufferToImage,
+			eCopyImageToBuffer,
+			eDispatch,
+			eDispatchIndirect,
+			eDraw,
+			eDrawIndexed,
+			eDrawIndexedIndirect,
+			eDrawIndexedIndirectCount,
+			eExecuteCommands,
+			eFillBuffer,
+			ePipelineBarrier,
+			ePushConstants,
+			eResolveImage,
+			eSetBlendConstants,
+			eSetDepthBias,
+			eSetDepthBounds,
+			eSetLineWidth,
+			eSetScissor,
+			eSetViewport,
+			eTraceRays,
+			eUpdateBuffer,
+			eWriteTimestamp,
+			eCount
+		};
+
+		constexpr const char* op_names[] = { "BindDescriptorSets",
+			                                   "BindIndexBuffer",
+			                                   "BindPipeline",
+			                                   "BindVertexBuffers",
+			                                   "BlitImage",
+			                                   "ClearColorImage",
+			                                   "ClearDepthStencilImage",
+			                                   "CopyBuffer",
+			                                   "CopyBufferToImage",
+			                                   "CopyImageToBuffer",
+			                                   "Dispatch",
+			                                   "DispatchIndirect",
+			                                   "Draw",
+			                                   "DrawIndexed",
+			                                   "DrawIndexedIndirect",
+			                                   "DrawIndexedIndirectCount",
+			                                   "ExecuteCommands",
+			                                   "FillBuffer",
+			                                   "PipelineBarrier",
+			                                   "PushConstants",
+			                                   "ResolveImage",
+			                                   "SetBlendConstants",
+			                                   "SetDepthBias",
+			                                   "SetDepthBounds",
+			                                   "SetLineWidth",
+			                                   "SetScissor",
+			                                   "SetViewport",
+			                                   "TraceRays",
+			                                   "UpdateBuffer",
+			                                   "WriteTimestamp" };
+		static_assert(std::size(op_names) == (size_t)Op::eCount);
+
+		// every record starts with a header, followed by the arguments of the command and then its arrays, each at its natural alignment
+		constexpr size_t record_alignment = 8;
+		struct RecordHeader {
+			Op op;
+			uint32_t size; // including the header, multiple of record_alignment
+		};
+		static_assert(sizeof(RecordHeader) == record_alignment);
+
+		constexpr uintptr_t align_up(uintptr_t value, uintptr_t alignment) {
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		struct BindDescriptorSets {
+			VkPipelineBindPoint bind_point;
+			VkPipelineLayout layout;
+			uint32_t first_set;
+			uint32_t set_count;
+			uint32_t dynamic_offset_count;
+		};
+		struct BindIndexBuffer {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			VkIndexType index_type;
+		};
+		struct BindPipeline {
+			VkPipelineBindPoint bind_point;
+			VkPipeline pipeline;
+		};
+		struct BindVertexBuffers {
+			uint32_t first_binding;
+			uint32_t binding_count;
+		};
+		struct BlitImage {
+			VkImage src;
+			VkImageLayout src_layout;
+			VkImage dst;
+			VkImageLayout dst_layout;
+			uint32_t region_count;
+			VkFilter filter;
+		};
+		struct ClearColorImage {
+			VkImage image;
+			VkImageLayout layout;
+			VkClearColorValue color;
+			uint32_t range_count;
+		};
+		struct ClearDepthStencilImage {
+			VkImage image;
+			VkImageLayout layout;
+			VkClearDepthStencilValue depth_stencil;
+			uint32_t range_count;
+		};
+		struct CopyBuffer {
+			VkBuffer src;
+			VkBuffer dst;
+			uint32_t region_count;
+		};
+		struct CopyBufferToImage {
+			VkBuffer src;
+			VkImage dst;
+			VkImageLayout dst_layout;
+			uint32_t region_count;
+		};
+		struct CopyImageToBuffer {
+			VkImage src;
+			VkImageLayout src_layout;
+			VkBuffer dst;
+			uint32_t region_count;
+		};
+		struct Dispatch {
+			uint32_t x;
+			uint32_t y;
+			uint32_t z;
+		};
+		struct DispatchIndirect {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+		};
+		struct Draw {
+			uint32_t vertex_count;
+			uint32_t instance_count;
+			uint32_t first_vertex;
+			uint32_t first_instance;
+		};
+		struct DrawIndexed {
+			uint32_t index_count;
+			uint32_t instance_count;
+			uint32_t first_index;
+			int32_t vertex_offset;
+			uint32_t first_instance;
+		};
+		struct DrawIndexedIndirect {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			uint32_t draw_count;
+			uint32_t stride;
+		};
+		struct DrawIndexedIndirectCount {
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			VkBuffer count_buffer;
+			VkDeviceSize count_offset;
+			uint32_t max_draw_count;
+			uint32_t stride;
+		};
+		struct ExecuteCommands {
+			uint32_t count;
+		};
+		struct FillBuffer {
+			VkBuffer dst;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			uint32_t data;
+		};
+		struct PipelineBarrier {
+			VkPipelineStageFlags src_stages;
+			VkPipelineStageFlags dst_stages;
+			VkDependencyFlags dependency_flags;
+			uint32_t memory_barrier_count;
+			uint32_t buffer_barrier_count;
+			uint32_t image_barrier_count;
+		};
+		struct PushConstants {
+			VkPipelineLayout layout;
+			VkShaderStageFlags stages;
+			uint32_t offset;
+			uint32_t size;
+		};
+		struct ResolveImage {
+			VkImage src;
+			VkImageLayout src_layout;
+			VkImage dst;
+			VkImageLayout dst_layout;
+			uint32_t region_count;
+		};
+		struct SetBlendConstants {
+			float constants[4];
+		};
+		struct SetDepthBias {
+			float constant_factor;
+			float clamp;
+			float slope_factor;
+		};
+		struct SetDepthBounds {
+			float min;
+			float max;
+		};
+		struct SetLineWidth {
+			float width;
+		};
+		struct SetRegions {
+			uint32_t first;
+			uint32_t count;
+		};
+		struct TraceRays {
+			VkStridedDeviceAddressRegionKHR raygen;
+			VkStridedDeviceAddressRegionKHR miss;
+			VkStridedDeviceAddressRegionKHR hit;
+			VkStridedDeviceAddressRegionKHR callable;
+			uint32_t width;
+			uint32_t height;
+			uint32_t depth;
+		};
+		struct UpdateBuffer {
+			VkBuffer dst;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+		struct WriteTimestamp {
+			VkPipelineStageFlagBits stage;
+			VkQueryPool pool;
+			uint32_t query;
+		};
+
+		template<class T>
+		struct Array {
+			const T* values;
+			uint32_t count;
+		};
+
+		struct Writer {
+			std::byte* dst;
+
+			template<class T>
+			void write(const T* values, size_t count) {
+				dst = reinterpret_cast<std::byte*>(align_up(reinterpret_cast<uintptr_t>(dst), alignof(T)));
+				if (count > 0) {
+					memcpy(dst, values, sizeof(T) * count);
+				}
+				dst += sizeof(T) * count;
+			}
+		};
+
+		struct Reader {
+			const std::byte* src;
+
+			template<class T>
+			const T* read(size_t count) {
+				src = reinterpret_cast<const std::byte*>(align_up(reinterpret_cast<uintptr_t>(src), alignof(T)));
+				auto values = reinterpret_cast<const T*>(src);
+				src += sizeof(T) * count;
+				return values;
+			}
+
+			template<class T>
+			const T& read() {
+				return *read<T>(1);
+			}
+		};
+
+		template<class Args, class... Ts>
+		void record(VkCommandBuffer cb, Op op, const Args& args, Array<Ts>... arrays) {
+			auto& stream = *reinterpret_cast<CommandStream*>(cb);
+			// enough for the worst case padding in front of every part
+			size_t max_size = sizeof(Args) + alignof(Args) + (0 + ... + (sizeof(Ts) * arrays.count + alignof(Ts)));
+			Writer w{ stream.begin_record((uint32_t)op, max_size) };
+			w.write(&args, 1);
+			(w.write(arrays.values, arrays.count), ...);
+			stream.end_record(w.dst);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdBindDescriptorSets(VkCommandBuffer cb,
+		                                                          VkPipelineBindPoint bind_point,
+		                                                          VkPipelineLayout layout,
+		                                                          uint32_t first_set,
+		                                                          uint32_t set_count,
+		                                                          const VkDescriptorSet* sets,
+		                                                          uint32_t dynamic_offset_count,
+		                                                          const uint32_t* dynamic_offsets) {
+			record(cb,
+			       Op::eBindDescriptorSets,
+			       BindDescriptorSets{ bind_point, layout, first_set, set_count, dynamic_offset_count },
+			       Array<VkDescriptorSet>{ sets, set_count },
+			       Array<uint32_t>{ dynamic_offsets, dynamic_offset_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdBindIndexBuffer(VkCommandBuffer cb, VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type) {
+			record(cb, Op::eBindIndexBuffer, BindIndexBuffer{ buffer, offset, index_type });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdBindPipeline(VkCommandBuffer cb, VkPipelineBindPoint bind_point, VkPipeline pipeline) {
+			record(cb, Op::eBindPipeline, BindPipeline{ bind_point, pipeline });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		record_vkCmdBindVertexBuffers(VkCommandBuffer cb, uint32_t first_binding, uint32_t binding_count, const VkBuffer* buffers, const VkDeviceSize* offsets) {
+			record(cb,
+			       Op::eBindVertexBuffers,
+			       BindVertexBuffers{ first_binding, binding_count },
+			       Array<VkBuffer>{ buffers, binding_count },
+			       Array<VkDeviceSize>{ offsets, binding_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdBlitImage(VkCommandBuffer cb,
+		                                                 VkImage src,
+		                                                 VkImageLayout src_layout,
+		                                                 VkImage dst,
+		                                                 VkImageLayout dst_layout,
+		                                                 uint32_t region_count,
+		                                                 const VkImageBlit* regions,
+		                                                 VkFilter filter) {
+			record(cb, Op::eBlitImage, BlitImage{ src, src_layout, dst, dst_layout, region_count, filter }, Array<VkImageBlit>{ regions, region_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdClearColorImage(
+		    VkCommandBuffer cb, VkImage image, VkImageLayout layout, const VkClearColorValue* color, uint32_t range_count, const VkImageSubresourceRange* ranges) {
+			record(cb, Op::eClearColorImage, ClearColorImage{ image, layout, *color, range_count }, Array<VkImageSubresourceRange>{ ranges, range_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdClearDepthStencilImage(VkCommandBuffer cb,
+		                                                              VkImage image,
+		                                                              VkImageLayout layout,
+		                                                              const VkClearDepthStencilValue* depth_stencil,
+		                                                              uint32_t range_count,
+		                                                              const VkImageSubresourceRange* ranges) {
+			record(cb,
+			       Op::eClearDepthStencilImage,
+			       ClearDepthStencilImage{ image, layout, *depth_stencil, range_count },
+			       Array<VkImageSubresourceRange>{ ranges, range_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdCopyBuffer(VkCommandBuffer cb, VkBuffer src, VkBuffer dst, uint32_t region_count, const VkBufferCopy* regions) {
+			record(cb, Op::eCopyBuffer, CopyBuffer{ src, dst, region_count }, Array<VkBufferCopy>{ regions, region_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdCopyBufferToImage(
+		    VkCommandBuffer cb, VkBuffer src, VkImage dst, VkImageLayout dst_layout, uint32_t region_count, const VkBufferImageCopy* regions) {
+			record(cb, Op::eCopyBufferToImage, CopyBufferToImage{ src, dst, dst_layout, region_count }, Array<VkBufferImageCopy>{ regions, region_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdCopyImageToBuffer(
+		    VkCommandBuffer cb, VkImage src, VkImageLayout src_layout, VkBuffer dst, uint32_t region_count, const VkBufferImageCopy* regions) {
+			record(cb, Op::eCopyImageToBuffer, CopyImageToBuffer{ src, src_layout, dst, region_count }, Array<VkBufferImageCopy>{ regions, region_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdDispatch(VkCommandBuffer cb, uint32_t x, uint32_t y, uint32_t z) {
+			record(cb, Op::eDispatch, Dispatch{ x, y, z });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdDispatchIndirect(VkCommandBuffer cb, VkBuffer buffer, VkDeviceSize offset) {
+			record(cb, Op::eDispatchIndirect, DispatchIndirect{ buffer, offset });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		record_vkCmdDraw(VkCommandBuffer cb, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+			record(cb, Op::eDraw, Draw{ vertex_count, instance_count, first_vertex, first_instance });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdDrawIndexed(
+		    VkCommandBuffer cb, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+			record(cb, Op::eDrawIndexed, DrawIndexed{ index_count, instance_count, first_index, vertex_offset, first_instance });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdDrawIndexedIndirect(VkCommandBuffer cb, VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+			record(cb, Op::eDrawIndexedIndirect, DrawIndexedIndirect{ buffer, offset, draw_count, stride });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdDrawIndexedIndirectCount(VkCommandBuffer cb,
+		                                                                VkBuffer buffer,
+		                                                                VkDeviceSize offset,
+		                                                                VkBuffer count_buffer,
+		                                                                VkDeviceSize count_offset,
+		                                                                uint32_t max_draw_count,
+		                                                                uint32_t stride) {
+			record(cb, Op::eDrawIndexedIndirectCount, DrawIndexedIndirectCount{ buffer, offset, count_buffer, count_offset, max_draw_count, stride });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdExecuteCommands(VkCommandBuffer cb, uint32_t count, const VkCommandBuffer* command_buffers) {
+			record(cb, Op::eExecuteCommands, ExecuteCommands{ count }, Array<VkCommandBuffer>{ command_buffers, count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdFillBuffer(VkCommandBuffer cb, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+			record(cb, Op::eFillBuffer, FillBuffer{ dst, offset, size, data });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdPipelineBarrier(VkCommandBuffer cb,
+		                                                       VkPipelineStageFlags src_stages,
+		                                                       VkPipelineStageFlags dst_stages,
+		                                                       VkDependencyFlags dependency_flags,
+		                                                       uint32_t memory_barrier_count,
+		                                                       const VkMemoryBarrier* memory_barriers,
+		                                                       uint32_t buffer_barrier_count,
+		                                                       const VkBufferMemoryBarrier* buffer_barriers,
+		                                                       uint32_t image_barrier_count,
+		                                                       const VkImageMemoryBarrier* image_barriers) {
+			// the barriers are copied without their pNext chains
+			record(cb,
+			       Op::ePipelineBarrier,
+			       PipelineBarrier{ src_stages, dst_stages, dependency_flags, memory_barrier_count, buffer_barrier_count, image_barrier_count },
+			       Array<VkMemoryBarrier>{ memory_barriers, memory_barrier_count },
+			       Array<VkBufferMemoryBarrier>{ buffer_barriers, buffer_barrier_count },
+			       Array<VkImageMemoryBarrier>{ image_barriers, image_barrier_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		record_vkCmdPushConstants(VkCommandBuffer cb, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values) {
+			record(cb, Op::ePushConstants, PushConstants{ layout, stages, offset, size }, Array<std::byte>{ static_cast<const std::byte*>(values), size });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdResolveImage(VkCommandBuffer cb,
+		                                                    VkImage src,
+		                                                    VkImageLayout src_layout,
+		                                                    VkImage dst,
+		                                                    VkImageLayout dst_layout,
+		                                                    uint32_t region_count,
+		                                                    const VkImageResolve* regions) {
+			record(cb, Op::eResolveImage, ResolveImage{ src, src_layout, dst, dst_layout, region_count }, Array<VkImageResolve>{ regions, region_count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetBlendConstants(VkCommandBuffer cb, const float constants[4]) {
+			record(cb, Op::eSetBlendConstants, SetBlendConstants{ { constants[0], constants[1], constants[2], constants[3] } });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetDepthBias(VkCommandBuffer cb, float constant_factor, float clamp, float slope_factor) {
+			record(cb, Op::eSetDepthBias, SetDepthBias{ constant_factor, clamp, slope_factor });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetDepthBounds(VkCommandBuffer cb, float min, float max) {
+			record(cb, Op::eSetDepthBounds, SetDepthBounds{ min, max });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetLineWidth(VkCommandBuffer cb, float width) {
+			record(cb, Op::eSetLineWidth, SetLineWidth{ width });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetScissor(VkCommandBuffer cb, uint32_t first, uint32_t count, const VkRect2D* scissors) {
+			record(cb, Op::eSetScissor, SetRegions{ first, count }, Array<VkRect2D>{ scissors, count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdSetViewport(VkCommandBuffer cb, uint32_t first, uint32_t count, const VkViewport* viewports) {
+			record(cb, Op::eSetViewport, SetRegions{ first, count }, Array<VkViewport>{ viewports, count });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdTraceRaysKHR(VkCommandBuffer cb,
+		                                                    const VkStridedDeviceAddressRegionKHR* raygen,
+		                                                    const VkStridedDeviceAddressRegionKHR* miss,
+		                                                    const VkStridedDeviceAddressRegionKHR* hit,
+		                                                    const VkStridedDeviceAddressRegionKHR* callable,
+		                                                    uint32_t width,
+		                                                    uint32_t height,
+		                                                    uint32_t depth) {
+			record(cb, Op::eTraceRays, TraceRays{ *raygen, *miss, *hit, *callable, width, height, depth });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdUpdateBuffer(VkCommandBuffer cb, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, const void* data) {
+			record(cb, Op::eUpdateBuffer, UpdateBuffer{ dst, offset, size }, Array<std::byte>{ static_cast<const std::byte*>(data), (uint32_t)size });
+		}
+
+		VKAPI_ATTR void VKAPI_CALL record_vkCmdWriteTimestamp(VkCommandBuffer cb, VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query) {
+			record(cb, Op::eWriteTimestamp, WriteTimestamp{ stage, pool, query });
+		}
+
+		ContextCreateParameters::FunctionPointers make_recording_functions() {
+			ContextCreateParameters::FunctionPointers p;
+			p.vkCmdBindDescriptorSets = &record_vkCmdBindDescriptorSets;
+			p.vkCmdBindIndexBuffer = &record_vkCmdBindIndexBuffer;
+			p.vkCmdBindPipeline = &record_vkCmdBindPipeline;
+			p.vkCmdBindVertexBuffers = &record_vkCmdBindVertexBuffers;
+			p.vkCmdBlitImage = &record_vkCmdBlitImage;
+			p.vkCmdClearColorImage = &record_vkCmdClearColorImage;
+			p.vkCmdClearDepthStencilImage = &record_vkCmdClearDepthStencilImage;
+			p.vkCmdCopyBuffer = &record_vkCmdCopyBuffer;
+			p.vkCmdCopyBufferToImage = &record_vkCmdCopyBufferToImage;
+			p.vkCmdCopyImageToBuffer = &record_vkCmdCopyImageToBuffer;
+			p.vkCmdDispatch = &record_vkCmdDispatch;
+			p.vkCmdDispatchIndirect = &record_vkCmdDispatchIndirect;
+			p.vkCmdDraw = &record_vkCmdDraw;
+			p.vkCmdDrawIndexed = &record_vkCmdDrawIndexed;
+			p.vkCmdDrawIndexedIndirect = &record_vkCmdDrawIndexedIndirect;
+			p.vkCmdDrawIndexedIndirectCount = &record_vkCmdDrawIndexedIndirectCount;
+			p.vkCmdExecuteCommands = &record_vkCmdExecuteCommands;
+			p.vkCmdFillBuffer = &record_vkCmdFillBuffer;
+			p.vkCmdPipelineBarrier = &record_vkCmdPipelineBarrier;
+			p.vkCmdPushConstants = &record_vkCmdPushConstants;
+			p.vkCmdResolveImage = &record_vkCmdResolveImage;
+			p.vkCmdSetBlendConstants = &record_vkCmdSetBlendConstants;
+			p.vkCmdSetDepthBias = &record_vkCmdSetDepthBias;
+			p.vkCmdSetDepthBounds = &record_vkCmdSetDepthBounds;
+			p.vkCmdSetLineWidth = &record_vkCmdSetLineWidth;
+			p.vkCmdSetScissor = &record_vkCmdSetScissor;
+			p.vkCmdSetViewport = &record_vkCmdSetViewport;
+			p.vkCmdTraceRaysKHR = &record_vkCmdTraceRaysKHR;
+			p.vkCmdUpdateBuffer = &record_vkCmdUpdateBuffer;
+			p.vkCmdWriteTimestamp = &record_vkCmdWriteTimestamp;
+			return p;
+		}
+	} // namespace
+
+	const ContextCreateParameters::FunctionPointers& CommandStream::get_recording_functions() {
+		static const ContextCreateParameters::FunctionPointers recording_functions = make_recording_functions();
+		return recording_functions;
+	}
+
+	std::byte* CommandStream::begin_record(uint32_t op, size_t max_payload_size) {
+		record_begin = data.size();
+		data.resize(record_begin + sizeof(RecordHeader) + max_payload_size);
+		auto header = reinterpret_cast<RecordHeader*>(data.data() + record_begin);
+		header->op = (Op)op;
+		return data.data() + record_begin + sizeof(RecordHeader);
+	}
+
+	void CommandStream::end_record(std::byte* payload_end) {
+		auto size = align_up(payload_end - (data.data() + record_begin), record_alignment);
+		assert(record_begin + size <= data.size());
+		reinterpret_cast<RecordHeader*>(data.data() + record_begin)->size = (uint32_t)size;
+		data.resize(record_begin + size);
+		command_count++;
+	}
+
+	void CommandStream::clear() noexcept {
+		data.clear();
+		record_begin = 0;
+		command_count = 0;
+	}
+
+	void CommandStream::translate(Context& ctx, VkCommandBuffer cb) const {
+		for (size_t offset = 0; offset < data.size();) {
+			auto& header = *reinterpret_cast<const RecordHeader*>(data.data() + offset);
+			Reader r{ data.data() + offset + sizeof(RecordHeader) };
+			offset += header.size;
+
+			switch (header.op) {
+			case Op::eBindDescriptorSets: {
+				auto& a = r.read<BindDescriptorSets>();
+				auto sets = r.read<VkDescriptorSet>(a.set_count);
+				auto dynamic_offsets = r.read<uint32_t>(a.dynamic_offset_count);
+				ctx.vkCmdBindDescriptorSets(cb, a.bind_point, a.layout, a.first_set, a.set_count, sets, a.dynamic_offset_count, dynamic_offsets);
+				break;
+			}
+			case Op::eBindIndexBuffer: {
+				auto& a = r.read<BindIndexBuffer>();
+				ctx.vkCmdBindIndexBuffer(cb, a.buffer, a.offset, a.index_type);
+				break;
+			}
+			case Op::eBindPipeline: {
+				auto& a = r.read<BindPipeline>();
+				ctx.vkCmdBindPipeline(cb, a.bind_point, a.pipeline);
+				break;
+			}
+			case Op::eBindVertexBuffers: {
+				auto& a = r.read<BindVertexBuffers>();
+				auto buffers = r.read<VkBuffer>(a.binding_count);
+				auto offsets = r.read<VkDeviceSize>(a.binding_count);
+				ctx.vkCmdBindVertexBuffers(cb, a.first_binding, a.binding_count, buffers, offsets);
+				break;
+			}
+			case Op::eBlitImage: {
+				auto& a = r.read<BlitImage>();
+				ctx.vkCmdBlitImage(cb, a.src, a.src_layout, a.dst, a.dst_layout, a.region_count, r.read<VkImageBlit>(a.region_count), a.filter);
+				break;
+			}
+			case Op::eClearColorImage: {
+				auto& a = r.read<ClearColorImage>();
+				ctx.vkCmdClearColorImage(cb, a.image, a.layout, &a.color, a.range_count, r.read<VkImageSubresourceRange>(a.range_count));
+				break;
+			}
+			case Op::eClearDepthStencilImage: {
+				auto& a = r.read<ClearDepthStencilImage>();
+				ctx.vkCmdClearDepthStencilImage(cb, a.image, a.layout, &a.depth_stencil, a.range_count, r.read<VkImageSubresourceRange>(a.range_count));
+				break;
+			}
+			case Op::eCopyBuffer: {
+				auto& a = r.read<CopyBuffer>();
+				ctx.vkCmdCopyBuffer(cb, a.src, a.dst, a.region_count, r.read<VkBufferCopy>(a.region_count));
+				break;
+			}
+			case Op::eCopyBufferToImage: {
+				auto& a = r.read<CopyBufferToImage>();
+				ctx.vkCmdCopyBufferToImage(cb, a.src, a.dst, a.dst_layout, a.region_count, r.read<VkBufferImageCopy>(a.region_count));
+				break;
+			}
+			case Op::eCopyImageToBuffer: {
+				auto& a = r.read<CopyImageToBuffer>();
+				ctx.vkCmdCopyImageToBuffer(cb, a.src, a.src_layout, a.dst, a.region_count, r.read<VkBufferImageCopy>(a.region_count));
+				break;
+			}
+			case Op::eDispatch: {
+				auto& a = r.read<Dispatch>();
+				ctx.vkCmdDispatch(cb, a.x, a.y, a.z);
+				break;
+			}
+			case Op::eDispatchIndirect: {
+				auto& a = r.read<DispatchIndirect>();
+				ctx.vkCmdDispatchIndirect(cb, a.buffer, a.offset);
+				break;
+			}
+			case Op::eDraw: {
+				auto& a = r.read<Draw>();
+				ctx.vkCmdDraw(cb, a.vertex_count, a.instance_count, a.first_vertex, a.first_instance);
+				break;
+			}
+			case Op::eDrawIndexed: {
+				auto& a = r.read<DrawIndexed>();
+				ctx.vkCmdDrawIndexed(cb, a.index_count, a.instance_count, a.first_index, a.vertex_offset, a.first_instance);
+				break;
+			}
+			case Op::eDrawIndexedIndirect: {
+				auto& a = r.read<DrawIndexedIndirect>();
+				ctx.vkCmdDrawIndexedIndirect(cb, a.buffer, a.offset, a.draw_count, a.stride);
+				break;
+			}
+			case Op::eDrawIndexedIndirectCount: {
+				auto& a = r.read<DrawIndexedIndirectCount>();
+				ctx.vkCmdDrawIndexedIndirectCount(cb, a.buffer, a.offset, a.count_buffer, a.count_offset, a.max_draw_count, a.stride);
+				break;
+			}
+			case Op::eExecuteCommands: {
+				auto& a = r.read<ExecuteCommands>();
+				ctx.vkCmdExecuteCommands(cb, a.count, r.read<VkCommandBuffer>(a.count));
+				break;
+			}
+			case Op::eFillBuffer: {
+				auto& a = r.read<FillBuffer>();
+				ctx.vkCmdFillBuffer(cb, a.dst, a.offset, a.size, a.data);
+				break;
+			}
+			case Op::ePipelineBarrier: {
+				auto& a = r.read<PipelineBarrier>();
+				auto memory_barriers = r.read<VkMemoryBarrier>(a.memory_barrier_count);
+				auto buffer_barriers = r.read<VkBufferMemoryBarrier>(a.buffer_barrier_count);
+				auto image_barriers = r.read<VkImageMemoryBarrier>(a.image_barrier_count);
+				ctx.vkCmdPipelineBarrier(cb,
+				                         a.src_stages,
+				                         a.dst_stages,
+				                         a.dependency_flags,
+				                         a.memory_barrier_count,
+				                         memory_barriers,
+				                         a.buffer_barrier_count,
+				                         buffer_barriers,
+				                         a.image_barrier_count,
+				                         image_barriers);
+				break;
+			}
+			case Op::ePushConstants: {
+				auto& a = r.read<PushConstants>();
+				ctx.vkCmdPushConstants(cb, a.layout, a.stages, a.offset, a.size, r.read<std::byte>(a.size));
+				break;
+			}
+			case Op::eResolveImage: {
+				auto& a = r.read<ResolveImage>();
+				ctx.vkCmdResolveImage(cb, a.src, a.src_layout, a.dst, a.dst_layout, a.region_count, r.read<VkImageResolve>(a.region_count));
+				break;
+			}
+			case Op::eSetBlendConstants: {
+				ctx.vkCmdSetBlendConstants(cb, r.read<SetBlendConstants>().constants);
+				break;
+			}
+			case Op::eSetDepthBias: {
+				auto& a = r.read<SetDepthBias>();
+				ctx.vkCmdSetDepthBias(cb, a.constant_factor, a.clamp, a.slope_factor);
+				break;
+			}
+			case Op::eSetDepthBounds: {
+				auto& a = r.read<SetDepthBounds>();
+				ctx.vkCmdSetDepthBounds(cb, a.min, a.max);
+				break;
+			}
+			case Op::eSetLineWidth: {
+				ctx.vkCmdSetLineWidth(cb, r.read<SetLineWidth>().width);
+				break;
+			}
+			case Op::eSetScissor: {
+				auto& a = r.read<SetRegions>();
+				ctx.vkCmdSetScissor(cb, a.first, a.count, r.read<VkRect2D>(a.count));
+				break;
+			}
+			case Op::eSetViewport: {
+				auto& a = r.read<SetRegions>();
+				ctx.vkCmdSetViewport(cb, a.first, a.count, r.read<VkViewport>(a.count));
+				break;
+			}
+			case Op::eTraceRays: {
+				auto& a = r.read<TraceRays>();
+				ctx.vkCmdTraceRaysKHR(cb, &a.raygen, &a.miss, &a.hit, &a.callable, a.width, a.height, a.depth);
+				break;
+			}
+			case Op::eUpdateBuffer: {
+				auto& a = r.read<UpdateBuffer>();
+				ctx.vkCmdUpdateBuffer(cb, a.dst, a.offset, a.size, r.read<std::byte>(a.size));
+				break;
+			}
+			case Op::eWriteTimestamp: {
+				auto& a = r.read<WriteTimestamp>();
+				ctx.vkCmdWriteTimestamp(cb, a.stage, a.pool, a.query);
+				break;
+			}
+			default:
+				assert(false && "Unknown command in stream.");
+				break;
+			}
+		}
+	}
+
+	void CommandStream::dump(std::ostream& os) const {
+		size_t index = 0;
+		for (size_t offset = 0; offset < data.size(); index++) {
+			auto& header = *reinterpret_cast<const RecordHeader*>(data.data() + offset);
+			Reader r{ data.data() + offset + sizeof(RecordHeader) };
+			offset += header.size;
+
+			os << index << ": " << op_names[(size_t)header.op];
+			switch (header.op) {
+			case Op::eDraw: {
+				auto& a = r.read<Draw>();
+				os << " vertices " << a.first_vertex << "+" << a.vertex_count << " instances " << a.first_instance << "+" << a.instance_count;
+				break;
+			}
+			case Op::eDrawIndexed: {
+				auto& a = r.read<DrawIndexed>();
+				os << " indices " << a.first_index << "+" << a.index_count << " vertex offset " << a.vertex_offset << " instances " << a.first_instance << "+"
+				   << a.instance_count;
+				break;
+			}
+			case Op::eDispatch: {
+				auto& a = r.read<Dispatch>();
+				os << " " << a.x << "x" << a.y << "x" << a.z;
+				break;
+			}
+			case Op::eBindPipeline: {
+				os << " " << r.read<BindPipeline>().pipeline;
+				break;
+			}
+			case Op::eBindDescriptorSets: {
+				auto& a = r.read<BindDescriptorSets>();
+				os << " sets " << a.first_set << "+" << a.set_count << " dynamic offsets " << a.dynamic_offset_count;
+				break;
+			}
+			case Op::ePushConstants: {
+				auto& a = r.read<PushConstants>();
+				os << " bytes " << a.offset << "+" << a.size;
+				break;
+			}
+			case Op::ePipelineBarrier: {
+				auto& a = r.read<PipelineBarrier>();
+				os << " memory " << a.memory_barrier_count << " buffer " << a.buffer_barrier_count << " image " << a.image_barrier_count;
+				break;
+			}
+			default:
+				os << " (" << header.size << " bytes)";
+				break;
+			}
+			os << "\n";
+		}
+	}
+
+	bool RecordedPass::acquire_pipelines(Allocator& allocator) const {
+		for (auto& p : graphics_pipelines) {
+			auto pi = p.create_info;
+			if (!pi.is_inline()) {
+				pi.extended_data = const_cast<std::byte*>(p.extended_data.data());
+			}
+			GraphicsPipelineInfo pipeline;
+			if (!allocator.allocate_graphics_pipelines(std::span{ &pipeline, 1 }, std::span{ &pi, 1 })) {
+				return false;
+			}
+			allocator.deallocate(std::span{ &pipeline, 1 });
+			if (pipeline.pipeline != p.pipeline) {
+				return false;
+			}
+		}
+		// the specialization info points into the create info, which is copied
+		auto point_specialization_info = [](auto& pi) {
+			if (pi.specialization_info.pData != nullptr) {
+				pi.specialization_info.pMapEntries = pi.specialization_map_entries.data();
+				pi.specialization_info.pData = pi.specialization_constant_data.data();
+				pi.base->psscis[0].pSpecializationInfo = &pi.specialization_info;
+			}
+		};
+		for (auto& p : compute_pipelines) {
+			auto pi = p.create_info;
+			point_specialization_info(pi);
+			ComputePipelineInfo pipeline;
+			if (!allocator.allocate_compute_pipelines(std::span{ &pipeline, 1 }, std::span{ &pi, 1 })) {
+				return false;
+			}
+			allocator.deallocate(std::span{ &pipeline, 1 });
+			if (pipeline.pipeline != p.pipeline) {
+				return false;
+			}
+		}
+		for (auto& p : ray_tracing_pipelines) {
+			auto pi = p.create_info;
+			point_specialization_info(pi);
+			RayTracingPipelineInfo pipeline;
+			if (!allocator.allocate_ray_tracing_pipelines(std::span{ &pipeline, 1 }, std::span{ &pi, 1 })) {
+				return false;
+			}
+			allocator.deallocate(std::span{ &pipeline, 1 });
+			if (pipeline.pipeline != p.pipeline) {
+				return false;
+			}
+		}
+		return true;
+	}
+} // namespace vuk
@@ -16,15 +16,19 @@
 #endif
 #include <algorithm>
 #include <atomic>
+#include <bit>
 
 #include "../src/ContextImpl.hpp"
 #include "vuk/Allocator.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/Program.hpp"
 #include "vuk/Query.hpp"
 #include "vuk/RenderGraph.hpp"
+#include "vuk/TraceRecorder.hpp"
 
 namespace {
 	/* TODO: I am currently unaware of any use case that would make supporting static loading worthwhile
@@ -92,7 +96,8 @@ namespace vuk {
 	    physical_device(params.physical_device),
 	    graphics_queue_family_index(params.graphics_queue_family_index),
 	    compute_queue_family_index(params.compute_queue_family_index),
-	    transfer_queue_family_index(params.transfer_queue_family_index) {
+	    transfer_queue_family_index(params.transfer_queue_family_index),
+	    memory_budget_enabled(params.memory_budget_enabled) {
 		// TODO: conversion to static factory fn
 		bool pfn_load_success = load_pfns(params, *this);
 		assert(pfn_load_success);
@@ -121,13 +126,13 @@ namespace vuk {
 		{
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_graphics_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.graphics_queue, params.graphics_queue_family_index, ts);
+			dedicated_graphics_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.graphics_queue, params.graphics_queue_family_index, ts, &impl->instrumentation);
 			graphics_queue = &dedicated_graphics_queue.value();
 		}
 		if (dedicated_compute_queue_) {
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_compute_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.compute_queue, params.compute_queue_family_index, ts);
+			dedicated_compute_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.compute_queue, params.compute_queue_family_index, ts, &impl->instrumentation);
 			compute_queue = &dedicated_compute_queue.value();
 		} else {
 			compute_queue = graphics_queue;
@@ -135,7 +140,7 @@ namespace vuk {
 		if (dedicated_transfer_queue_) {
 			TimelineSemaphore ts;
 			impl->device_vk_resource->allocate_timeline_semaphores(std::span{ &ts, 1 }, {});
-			dedicated_transfer_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.transfer_queue, params.transfer_queue_family_index, ts);
+			dedicated_transfer_queue.emplace(this->vkQueueSubmit, this->vkQueueSubmit2KHR, params.transfer_queue, params.transfer_queue_family_index, ts, &impl->instrumentation);
 			transfer_queue = &dedicated_transfer_queue.value();
 		} else {
 			transfer_queue = compute_queue ? compute_queue : graphics_queue;
@@ -159,6 +164,7 @@ namespace vuk {
 		graphics_queue_family_index = o.graphics_queue_family_index;
 		compute_queue_family_index = o.compute_queue_family_index;
 		transfer_queue_family_index = o.transfer_queue_family_index;
+		memory_budget_enabled = o.memory_budget_enabled;
 		dedicated_graphics_queue = std::move(o.dedicated_graphics_queue);
 		graphics_queue = &dedicated_graphics_queue.value();
 		dedicated_compute_queue = std::move(o.dedicated_compute_queue);
@@ -192,6 +198,7 @@ namespace vuk {
 		graphics_queue_family_index = o.graphics_queue_family_index;
 		compute_queue_family_index = o.compute_queue_family_index;
 		transfer_queue_family_index = o.transfer_queue_family_index;
+		memory_budget_enabled = o.memory_budget_enabled;
 		dedicated_graphics_queue = std::move(o.dedicated_graphics_queue);
 		graphics_queue = &dedicated_graphics_queue.value();
 		dedicated_compute_queue = std::move(o.dedicated_compute_queue);
@@ -311,6 +318,7 @@ namespace vuk {
 	}
 
 	void PersistentDescriptorSet::commit(Context& ctx) {
+		VUK_ZONE(ctx.get_instrumentation_callbacks(), "Persistent descriptor set commit");
 		wdss.clear();
 		for (unsigned i = 0; i < descriptor_bindings.size(); i++) {
 			auto& db = descriptor_bindings[i];
@@ -335,9 +343,11 @@ namespace vuk {
 			}
 		}
 		ctx.vkUpdateDescriptorSets(ctx.device, (uint32_t)wdss.size(), wdss.data(), 0, nullptr);
+		ctx.get_frame_stat_counters().descriptor_sets_written += 1;
 	}
 
 	ShaderModule Context::create(const create_info_t<ShaderModule>& cinfo) {
+		VUK_ZONE_DETAIL(&impl->instrumentation, "Shader module creation", cinfo.filename.c_str());
 		std::vector<uint32_t> spirv;
 		const uint32_t* spirv_ptr = nullptr;
 		size_t size = 0;
@@ -463,6 +473,7 @@ namespace vuk {
 	}
 
 	PipelineBaseInfo Context::create(const create_info_t<PipelineBaseInfo>& cinfo) {
+		VUK_ZONE(&impl->instrumentation, "Pipeline base creation");
 		std::vector<VkPipelineShaderStageCreateInfo> psscis;
 
 		// accumulate descriptors from all stages
@@ -739,6 +750,13 @@ namespace vuk {
 
 			this->vkDestroyPipelineCache(device, vk_pipeline_cache, nullptr);
 
+			for (auto* pools : { &impl->free_pass_statistics_pools, &impl->pending_pass_statistics_pools }) {
+				for (auto& pool : *pools) {
+					this->vkDestroyQueryPool(device, pool.statistics, nullptr);
+					this->vkDestroyQueryPool(device, pool.occlusion, nullptr);
+				}
+			}
+
 			if (dedicated_graphics_queue) {
 				impl->device_vk_resource->deallocate_timeline_semaphores(std::span{ &dedicated_graphics_queue->get_submit_sync(), 1 });
 			}
@@ -759,11 +777,249 @@ namespace vuk {
 		return impl->unique_handle_id_counter++;
 	}
 
+	static void reset_pass_statistics_query_pool(Context& ctx, PassStatisticsQueryPool& pool) {
+		ctx.vkResetQueryPool(ctx.device, pool.statistics, 0, PassStatisticsQueryPool::num_queries);
+		ctx.vkResetQueryPool(ctx.device, pool.occlusion, 0, PassStatisticsQueryPool::num_queries);
+		pool.count = 0;
+		std::fill(std::begin(pool.occlusion_used), std::end(pool.occlusion_used), false);
+		std::fill(std::begin(pool.interrupted), std::end(pool.interrupted), false);
+	}
+
+	// poll the pending pass statistics queries without waiting, and recycle the pools that have completed
+	static void read_pass_statistics(Context& ctx, ContextImpl& impl, uint64_t absolute_frame) {
+		// queries still not available after this many frames were recorded into command buffers that were never submitted
+		static constexpr uint64_t abandon_after_frames = 64;
+		// pipeline statistics are written in the order of their bits
+		static constexpr std::pair<VkQueryPipelineStatisticFlagBits, uint64_t PipelineStatistics::*> statistic_fields[] = {
+			{ VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT, &PipelineStatistics::vertex_shader_invocations },
+			{ VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT, &PipelineStatistics::clipping_invocations },
+			{ VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT, &PipelineStatistics::clipping_primitives },
+			{ VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT, &PipelineStatistics::fragment_shader_invocations },
+			{ VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT, &PipelineStatistics::compute_shader_invocations },
+		};
+
+		std::lock_guard _(impl.pass_statistics_lock);
+		auto& pending = impl.pending_pass_statistics_pools;
+		std::array<uint64_t, PassStatisticsQueryPool::num_queries * std::size(statistic_fields)> values;
+		std::array<uint64_t, PassStatisticsQueryPool::num_queries> samples;
+		for (auto it = pending.begin(); it != pending.end();) {
+			auto& pool = *it;
+			uint32_t statistic_count = std::popcount(pool.statistic_flags);
+			bool available = ctx.vkGetQueryPoolResults(ctx.device,
+			                                           pool.statistics,
+			                                           0,
+			                                           pool.count,
+			                                           sizeof(uint64_t) * statistic_count * pool.count,
+			                                           values.data(),
+			                                           sizeof(uint64_t) * statistic_count,
+			                                           VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+			// occlusion queries were only begun for passes inside a render pass
+			for (uint32_t i = 0; i < pool.count && available; i++) {
+				if (pool.occlusion_used[i]) {
+					available = ctx.vkGetQueryPoolResults(ctx.device, pool.occlusion, i, 1, sizeof(uint64_t), &samples[i], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) ==
+					            VK_SUCCESS;
+				}
+			}
+
+			if (available) {
+				for (uint32_t i = 0; i < pool.count; i++) {
+					if (pool.interrupted[i]) {
+						continue;
+					}
+					PassStatistics ps{ pool.passes[i], pool.absolute_frame, pool.occlusion_used[i], {} };
+					uint64_t* query_values = values.data() + i * statistic_count;
+					for (auto& [bit, field] : statistic_fields) {
+						if (pool.statistic_flags & bit) {
+							ps.statistics.*field = *query_values++;
+						}
+					}
+					if (pool.occlusion_used[i]) {
+						ps.statistics.samples_passed = samples[i];
+					}
+					impl.pass_statistics.push_back(ps);
+				}
+			} else if (absolute_frame - pool.absolute_frame < abandon_after_frames) {
+				++it;
+				continue;
+			}
+
+			reset_pass_statistics_query_pool(ctx, pool);
+			impl.free_pass_statistics_pools.push_back(std::move(pool));
+			it = pending.erase(it);
+		}
+	}
+
 	void Context::next_frame() {
+		VUK_FRAME_MARK(&impl->instrumentation, impl->frame_counter);
+		if (auto recorder = impl->trace_recorder.load()) {
+			recorder->record_frame(impl->frame_counter);
+		}
+		{
+			auto stats = impl->frame_stat_counters.take(impl->frame_counter);
+			std::lock_guard _(impl->frame_stats_lock);
+			impl->last_frame_stats = stats;
+		}
 		impl->frame_counter++;
+		impl->device_vk_resource->update_memory_budget(impl->frame_counter);
+		read_pass_statistics(*this, *impl, impl->frame_counter);
+		{
+			std::lock_guard _(impl->recorded_passes_lock);
+			auto frame = impl->frame_counter.load();
+			for (auto it = impl->recorded_passes.begin(); it != impl->recorded_passes.end();) {
+				if (it->second.expiry_frame <= frame) {
+					impl->retire_recorded_pass(*it->second.recording, frame);
+					it = impl->recorded_passes.erase(it);
+				} else {
+					// the pools of the descriptor sets kept by recordings must not be collected
+					for (auto& ds : it->second.recording->descriptor_sets) {
+						acquire_descriptor_pool(ds.layout_info, frame);
+					}
+					++it;
+				}
+			}
+			auto& retired = impl->retired_recorded_descriptor_sets;
+			for (auto it = retired.begin(); it != retired.end();) {
+				if (it->release_frame <= frame) {
+					impl->device_vk_resource->deallocate_descriptor_sets(it->descriptor_sets);
+					it = retired.erase(it);
+				} else {
+					for (auto& ds : it->descriptor_sets) {
+						acquire_descriptor_pool(ds.layout_info, frame);
+					}
+					++it;
+				}
+			}
+		}
 		collect(impl->frame_counter);
 	}
 
+	void Context::set_pass_statistics_enabled(bool enabled) {
+		impl->pass_statistics_enabled = enabled;
+	}
+
+	bool Context::pass_statistics_enabled() const {
+		return impl->pass_statistics_enabled;
+	}
+
+	std::shared_ptr<const RecordedPass> Context::acquire_recorded_pass(const RecordedPassKey& key) {
+		std::lock_guard _(impl->recorded_passes_lock);
+		auto it = impl->recorded_passes.find(key);
+		if (it == impl->recorded_passes.end() || it->second.expiry_frame <= impl->frame_counter) {
+			return nullptr;
+		}
+		return it->second.recording;
+	}
+
+	void Context::store_recorded_pass(RecordedPassKey key, RecordedPass recording) {
+		auto recorded = std::make_shared<const RecordedPass>(std::move(recording));
+		std::lock_guard _(impl->recorded_passes_lock);
+		auto& kept = impl->recorded_passes[std::move(key)];
+		// a recording made again replaces the previous one, which may still be replayed in frames in flight
+		if (kept.recording) {
+			impl->retire_recorded_pass(*kept.recording, impl->frame_counter);
+		}
+		kept = { std::move(recorded), impl->frame_counter + ContextImpl::recorded_pass_lifetime };
+	}
+
+	void Context::discard_recorded_pass(RecordedPass recording) {
+		std::lock_guard _(impl->recorded_passes_lock);
+		impl->retire_recorded_pass(recording, impl->frame_counter);
+	}
+
+	void Context::invalidate_recorded_passes() {
+		std::lock_guard _(impl->recorded_passes_lock);
+		for (auto& [key, kept] : impl->recorded_passes) {
+			impl->retire_recorded_pass(*kept.recording, impl->frame_counter);
+		}
+		impl->recorded_passes.clear();
+	}
+
+	std::vector<PassStatistics> Context::retrieve_pass_statistics() {
+		std::lock_guard _(impl->pass_statistics_lock);
+		return std::exchange(impl->pass_statistics, {});
+	}
+
+	PassStatisticsQueryPool Context::acquire_pass_statistics_query_pool(VkQueryPipelineStatisticFlags statistic_flags) {
+		{
+			std::lock_guard _(impl->pass_statistics_lock);
+			auto& free_pools = impl->free_pass_statistics_pools;
+			auto it = std::find_if(free_pools.begin(), free_pools.end(), [=](const PassStatisticsQueryPool& pool) { return pool.statistic_flags == statistic_flags; });
+			if (it != free_pools.end()) {
+				PassStatisticsQueryPool pool = std::move(*it);
+				free_pools.erase(it);
+				return pool;
+			}
+		}
+
+		PassStatisticsQueryPool pool;
+		pool.statistic_flags = statistic_flags;
+		VkQueryPoolCreateInfo qpci{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		qpci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		qpci.queryCount = PassStatisticsQueryPool::num_queries;
+		qpci.pipelineStatistics = statistic_flags;
+		VkResult result = this->vkCreateQueryPool(device, &qpci, nullptr, &pool.statistics);
+		if (result == VK_SUCCESS) {
+			qpci.queryType = VK_QUERY_TYPE_OCCLUSION;
+			qpci.pipelineStatistics = 0;
+			result = this->vkCreateQueryPool(device, &qpci, nullptr, &pool.occlusion);
+		}
+		// on failure, a pool without queries is returned and the passes go unmeasured
+		if (result != VK_SUCCESS) {
+			this->vkDestroyQueryPool(device, pool.statistics, nullptr);
+			pool.statistics = VK_NULL_HANDLE;
+			pool.occlusion = VK_NULL_HANDLE;
+			return pool;
+		}
+		reset_pass_statistics_query_pool(*this, pool);
+		return pool;
+	}
+
+	void Context::release_pass_statistics_query_pool(PassStatisticsQueryPool&& pool, bool recorded) {
+		if (pool.statistics == VK_NULL_HANDLE) {
+			return;
+		}
+		std::lock_guard _(impl->pass_statistics_lock);
+		if (recorded && pool.count > 0) {
+			impl->pending_pass_statistics_pools.push_back(std::move(pool));
+		} else {
+			reset_pass_statistics_query_pool(*this, pool);
+			impl->free_pass_statistics_pools.push_back(std::move(pool));
+		}
+	}
+
+	void Context::set_instrumentation_callbacks(const InstrumentationCallbacks& callbacks) {
+		impl->instrumentation = callbacks;
+	}
+
+	const InstrumentationCallbacks* Context::get_instrumentation_callbacks() const {
+		return &impl->instrumentation;
+	}
+
+	void Context::set_layout_promotion_options(const LayoutPromotionOptions& options) {
+		impl->layout_promotion = options;
+	}
+
+	const LayoutPromotionOptions* Context::get_layout_promotion_options() const {
+		return &impl->layout_promotion;
+	}
+
+	void Context::set_trace_recorder(TraceRecorder* recorder) {
+		impl->trace_recorder = recorder;
+	}
+
+	TraceRecorder* Context::get_trace_recorder() const {
+		return impl->trace_recorder;
+	}
+
+	FrameStats Context::get_frame_stats() const {
+		std::lock_guard _(impl->frame_stats_lock);
+		return impl->last_frame_stats;
+	}
+
+	FrameStatCounters& Context::get_frame_stat_counters() {
+		return impl->frame_stat_counters;
+	}
+
 	Result<void> Context::wait_idle() {
 		std::unique_lock<std::recursive_mutex> graphics_lock;
 		if (dedicated_graphics_queue) {
@@ -1,7 +1,10 @@
 #include "Cache.hpp"
 #include "RenderPass.hpp"
 #include "vuk/Allocator.hpp"
+#include "vuk/CommandStream.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/PipelineInstance.hpp"
 #include "vuk/Query.hpp"
 #include "vuk/resources/DeviceVkResource.hpp"
@@ -19,6 +22,7 @@ namespace vuk {
 		template<class T>
 		struct FN {
 			static T create_fn(void* ctx, const create_info_t<T>& ci) {
+				VUK_ZONE(reinterpret_cast<Context*>(ctx)->get_instrumentation_callbacks(), "Cache miss");
 				return reinterpret_cast<Context*>(ctx)->create(ci);
 			}
 
@@ -56,6 +60,41 @@ namespace vuk {
 		std::mutex query_lock;
 		robin_hood::unordered_map<Query, uint64_t> timestamp_result_map;
 
+		std::atomic<bool> pass_statistics_enabled = false;
+
+		struct KeptRecordedPass {
+			std::shared_ptr<const RecordedPass> recording;
+			uint64_t expiry_frame = 0;
+		};
+		// recordings are dropped after this many frames, and their descriptor sets released this many frames later - objects not used for this many
+		// frames are no longer in flight, which is what DeviceSuperFrameResource assumes when collecting its caches
+		static constexpr uint64_t recorded_pass_lifetime = 16;
+		std::mutex recorded_passes_lock;
+		robin_hood::unordered_flat_map<RecordedPassKey, KeptRecordedPass> recorded_passes;
+		struct RetiredDescriptorSets {
+			std::vector<DescriptorSet> descriptor_sets;
+			uint64_t release_frame;
+		};
+		std::vector<RetiredDescriptorSets> retired_recorded_descriptor_sets;
+
+		void retire_recorded_pass(const RecordedPass& recording, uint64_t frame) {
+			if (!recording.descriptor_sets.empty()) {
+				retired_recorded_descriptor_sets.push_back({ recording.descriptor_sets, frame + recorded_pass_lifetime });
+			}
+		}
+		std::mutex pass_statistics_lock;
+		std::vector<PassStatisticsQueryPool> free_pass_statistics_pools;
+		std::vector<PassStatisticsQueryPool> pending_pass_statistics_pools;
+		std::vector<PassStatistics> pass_statistics;
+
+		InstrumentationCallbacks instrumentation;
+		LayoutPromotionOptions layout_promotion;
+		std::atomic<TraceRecorder*> trace_recorder = nullptr;
+
+		FrameStatCounters frame_stat_counters;
+		mutable std::mutex frame_stats_lock;
+		FrameStats last_frame_stats;
+
 		void collect(uint64_t absolute_frame) {
 			// collect rarer resources
 			static constexpr uint32_t cache_collection_frequency = 16;
@@ -86,6 +125,13 @@ namespace vuk {
 		    descriptor_set_layouts(&ctx, &FN<struct DescriptorSetLayoutAllocInfo>::create_fn, &FN<struct DescriptorSetLayoutAllocInfo>::destroy_fn),
 		    pipeline_layouts(&ctx, &FN<VkPipelineLayout>::create_fn, &FN<VkPipelineLayout>::destroy_fn) {
 			ctx.vkGetPhysicalDeviceProperties(ctx.physical_device, &physical_device_properties);
+
+			pipelinebase_cache.frame_stats = &frame_stat_counters;
+			pool_cache.frame_stats = &frame_stat_counters;
+			sampler_cache.frame_stats = &frame_stat_counters;
+			shader_modules.frame_stats = &frame_stat_counters;
+			descriptor_set_layouts.frame_stats = &frame_stat_counters;
+			pipeline_layouts.frame_stats = &frame_stat_counters;
 		}
 	};
 } // namespace vuk
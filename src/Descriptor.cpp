@@ -1,15 +1,22 @@
 #include "vuk/Descriptor.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/Instrumentation.hpp"
 
+#include <algorithm>
+#include <array>
 #include <concurrentqueue.h>
 #include <mutex>
 #include <robin_hood.h>
 
 namespace vuk {
 	struct DescriptorPoolImpl {
+		static constexpr uint32_t initial_pool_sets = 16;
+		static constexpr uint32_t sets_per_batch = 32;
+
 		std::mutex grow_mutex;
 		std::vector<VkDescriptorPool> pools;
-		uint32_t sets_allocated = 0;
+		uint32_t sets_allocated = 0; // maxSets of the newest pool
+		uint32_t sets_remaining = 0; // sets that were not yet allocated from the newest pool
 		moodycamel::ConcurrentQueue<VkDescriptorSet> free_sets{ 1024 };
 	};
 
@@ -29,35 +36,48 @@ namespace vuk {
 	void DescriptorPool::grow(Context& ctx, vuk::DescriptorSetLayoutAllocInfo layout_alloc_info) {
 		if (!impl->grow_mutex.try_lock())
 			return;
-		VkDescriptorPoolCreateInfo dpci{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-		dpci.maxSets = impl->sets_allocated == 0 ? 1 : impl->sets_allocated * 2;
-		std::array<VkDescriptorPoolSize, 12> descriptor_counts = {};
-		size_t count = ctx.vkCmdBuildAccelerationStructuresKHR ? descriptor_counts.size() : descriptor_counts.size() - 1;
-		uint32_t used_idx = 0;
-		for (size_t i = 0; i < count; i++) {
-			if (layout_alloc_info.descriptor_counts[i] > 0) {
-				auto& d = descriptor_counts[used_idx];
-				d.type = i == 11 ? VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR : VkDescriptorType(i);
-				d.descriptorCount = layout_alloc_info.descriptor_counts[i] * dpci.maxSets;
-				used_idx++;
+		// the newest pool is exhausted - make a new one, twice as large
+		if (impl->sets_remaining == 0) {
+			VUK_ZONE(ctx.get_instrumentation_callbacks(), "Descriptor pool grow");
+			VkDescriptorPoolCreateInfo dpci{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+			dpci.maxSets = impl->sets_allocated == 0 ? DescriptorPoolImpl::initial_pool_sets : impl->sets_allocated * 2;
+			std::array<VkDescriptorPoolSize, 12> descriptor_counts = {};
+			size_t count = ctx.vkCmdBuildAccelerationStructuresKHR ? descriptor_counts.size() : descriptor_counts.size() - 1;
+			uint32_t used_idx = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (layout_alloc_info.descriptor_counts[i] > 0) {
+					auto& d = descriptor_counts[used_idx];
+					d.type = i == 11 ? VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR : VkDescriptorType(i);
+					d.descriptorCount = layout_alloc_info.descriptor_counts[i] * dpci.maxSets;
+					used_idx++;
+				}
+			}
+			dpci.pPoolSizes = descriptor_counts.data();
+			dpci.poolSizeCount = used_idx;
+			VkDescriptorPool pool;
+			if (ctx.vkCreateDescriptorPool(ctx.device, &dpci, nullptr, &pool) != VK_SUCCESS) {
+				impl->grow_mutex.unlock();
+				return;
 			}
+			impl->pools.emplace_back(pool);
+			impl->sets_allocated = dpci.maxSets;
+			impl->sets_remaining = dpci.maxSets;
 		}
-		dpci.pPoolSizes = descriptor_counts.data();
-		dpci.poolSizeCount = used_idx;
-		VkDescriptorPool pool;
-		ctx.vkCreateDescriptorPool(ctx.device, &dpci, nullptr, &pool);
-		impl->pools.emplace_back(pool);
 
+		// allocate a batch of sets from the pool, the rest is allocated when the free list runs dry again
 		VkDescriptorSetAllocateInfo dsai{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
 		dsai.descriptorPool = impl->pools.back();
-		dsai.descriptorSetCount = dpci.maxSets;
-		std::vector<VkDescriptorSetLayout> layouts(dpci.maxSets, layout_alloc_info.layout);
+		dsai.descriptorSetCount = std::min(impl->sets_remaining, DescriptorPoolImpl::sets_per_batch);
+		std::array<VkDescriptorSetLayout, DescriptorPoolImpl::sets_per_batch> layouts;
+		layouts.fill(layout_alloc_info.layout);
 		dsai.pSetLayouts = layouts.data();
-		// allocate all the descriptorsets
-		std::vector<VkDescriptorSet> sets(dsai.descriptorSetCount);
-		ctx.vkAllocateDescriptorSets(ctx.device, &dsai, sets.data());
-		impl->free_sets.enqueue_bulk(sets.data(), sets.size());
-		impl->sets_allocated = dpci.maxSets;
+		std::array<VkDescriptorSet, DescriptorPoolImpl::sets_per_batch> sets;
+		if (ctx.vkAllocateDescriptorSets(ctx.device, &dsai, sets.data()) == VK_SUCCESS) {
+			impl->free_sets.enqueue_bulk(sets.data(), dsai.descriptorSetCount);
+			impl->sets_remaining -= dsai.descriptorSetCount;
+		} else { // pool is fragmented or out of memory, move on to the next one
+			impl->sets_remaining = 0;
+		}
 
 		impl->grow_mutex.unlock();
 	}
@@ -1,19 +1,97 @@
 #include "vuk/resources/DeviceFrameResource.hpp"
+#include "AppendList.hpp"
 #include "BufferAllocator.hpp"
 #include "Cache.hpp"
 #include "RenderPass.hpp"
+#include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Descriptor.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/PipelineInstance.hpp"
 #include "vuk/Query.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <mutex>
 #include <numeric>
 #include <plf_colony.h>
 #include <shared_mutex>
+#include <type_traits>
 
 namespace vuk {
+	/// @brief Descriptor counts (indexed like DescriptorSetLayoutAllocInfo::descriptor_counts) and set count of a descriptor pool
+	struct DescriptorPoolSizes {
+		std::array<uint32_t, 12> descriptor_counts = {};
+		uint32_t max_sets = 0;
+
+		static DescriptorPoolSizes from_create_info(const VkDescriptorPoolCreateInfo& dpci) {
+			DescriptorPoolSizes sizes;
+			sizes.max_sets = dpci.maxSets;
+			for (uint32_t i = 0; i < dpci.poolSizeCount; i++) {
+				auto& ps = dpci.pPoolSizes[i];
+				if (ps.type == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR) {
+					sizes.descriptor_counts[11] += ps.descriptorCount;
+				} else if (ps.type < 11) {
+					sizes.descriptor_counts[ps.type] += ps.descriptorCount;
+				}
+			}
+			return sizes;
+		}
+
+		/// @brief Sizes used when there is no usage to go by
+		static DescriptorPoolSizes fallback(bool ray_tracing) {
+			DescriptorPoolSizes sizes;
+			sizes.max_sets = 1000;
+			sizes.descriptor_counts.fill(1000);
+			if (!ray_tracing) {
+				sizes.descriptor_counts[11] = 0;
+			}
+			return sizes;
+		}
+
+		/// @brief Fill out a create info referencing storage, types with a count of 0 are omitted
+		VkDescriptorPoolCreateInfo to_create_info(std::array<VkDescriptorPoolSize, 12>& storage) const {
+			VkDescriptorPoolCreateInfo dpci{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+			dpci.maxSets = max_sets;
+			for (size_t i = 0; i < descriptor_counts.size(); i++) {
+				if (descriptor_counts[i] > 0) {
+					auto& d = storage[dpci.poolSizeCount++];
+					d.type = i == 11 ? VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR : VkDescriptorType(i);
+					d.descriptorCount = descriptor_counts[i];
+				}
+			}
+			dpci.pPoolSizes = storage.data();
+			return dpci;
+		}
+
+		bool contains(const DescriptorPoolSizes& o) const {
+			for (size_t i = 0; i < descriptor_counts.size(); i++) {
+				if (descriptor_counts[i] < o.descriptor_counts[i]) {
+					return false;
+				}
+			}
+			return max_sets >= o.max_sets;
+		}
+
+		uint64_t total() const {
+			return std::accumulate(descriptor_counts.begin(), descriptor_counts.end(), (uint64_t)max_sets);
+		}
+
+		void merge_max(const DescriptorPoolSizes& o) {
+			for (size_t i = 0; i < descriptor_counts.size(); i++) {
+				descriptor_counts[i] = std::max(descriptor_counts[i], o.descriptor_counts[i]);
+			}
+			max_sets = std::max(max_sets, o.max_sets);
+		}
+	};
+
+	struct SizedDescriptorPool {
+		VkDescriptorPool pool;
+		DescriptorPoolSizes sizes;
+		uint64_t last_use_frame = 0;
+	};
+
 	struct DeviceSuperFrameResourceImpl {
 		DeviceSuperFrameResource* sfr;
 
@@ -26,9 +104,20 @@ namespace vuk {
 		plf::colony<DeviceMultiFrameResource> multi_frames;
 
 		std::mutex command_pool_mutex;
-		std::array<std::vector<VkCommandPool>, 3> command_pools;
+		std::unordered_map<uint32_t, std::vector<VkCommandPool>> command_pools;
+		// command buffers of recycled pools, reset along with their pool - indexed by level
+		std::unordered_map<VkCommandPool, std::array<std::vector<VkCommandBuffer>, 2>> command_buffers;
+		std::mutex sync_mutex;
+		std::vector<VkSemaphore> semaphores;
+		std::vector<VkFence> fences;
+		std::vector<TimelineSemaphore> timeline_semaphores;
 		std::mutex ds_pool_mutex;
-		std::vector<VkDescriptorPool> ds_pools;
+		std::vector<SizedDescriptorPool> ds_pools; // reset pools, ready for reuse
+		// descriptor usage of the most recently recycled frames, the peak is used to size the first pool of new frames
+		static constexpr size_t ds_usage_window = 16;
+		std::array<DescriptorPoolSizes, ds_usage_window> ds_usage_history = {};
+		uint64_t ds_usage_samples = 0;
+		DescriptorPoolStats ds_stats;
 
 		std::mutex images_mutex;
 		std::unordered_map<ImageCreateInfo, uint32_t> image_identity;
@@ -40,13 +129,22 @@ namespace vuk {
 		Cache<RayTracingPipelineInfo> ray_tracing_pipeline_cache;
 		Cache<VkRenderPass> render_pass_cache;
 
+		std::mutex history_mutex;
+		std::unordered_map<Name, std::unique_ptr<HistoryImages>> histories;
+		static constexpr uint64_t history_lifetime = 16;
+
 		BufferSubAllocator suballocators[4];
 
+		static const InstrumentationCallbacks* instrumentation(void* allocator) {
+			return reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->get_context().get_instrumentation_callbacks();
+		}
+
 		DeviceSuperFrameResourceImpl(DeviceSuperFrameResource& sfr, size_t frames_in_flight) :
 		    sfr(&sfr),
 		    image_cache(
 		        this,
 		        +[](void* allocator, const CachedImageIdentifier& cii) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        ImageWithIdentity i;
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_images({ &i.image, 1 }, { &cii.ici, 1 }, {}); // TODO: dropping error
 			        return i;
@@ -57,6 +155,7 @@ namespace vuk {
 		    image_view_cache(
 		        this,
 		        +[](void* allocator, const CompressedImageViewCreateInfo& civci) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        ImageView iv;
 			        ImageViewCreateInfo ivci = static_cast<ImageViewCreateInfo>(civci);
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_image_views({ &iv, 1 }, { &ivci, 1 }, {}); // TODO: dropping error
@@ -68,6 +167,7 @@ namespace vuk {
 		    graphics_pipeline_cache(
 		        this,
 		        +[](void* allocator, const GraphicsPipelineInstanceCreateInfo& ci) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        GraphicsPipelineInfo dst;
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_graphics_pipelines({ &dst, 1 }, { &ci, 1 }, {});
 			        return dst;
@@ -78,6 +178,7 @@ namespace vuk {
 		    compute_pipeline_cache(
 		        this,
 		        +[](void* allocator, const ComputePipelineInstanceCreateInfo& ci) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        ComputePipelineInfo dst;
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_compute_pipelines({ &dst, 1 }, { &ci, 1 }, {});
 			        return dst;
@@ -88,6 +189,7 @@ namespace vuk {
 		    ray_tracing_pipeline_cache(
 		        this,
 		        +[](void* allocator, const RayTracingPipelineInstanceCreateInfo& ci) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        RayTracingPipelineInfo dst;
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_ray_tracing_pipelines({ &dst, 1 }, { &ci, 1 }, {});
 			        return dst;
@@ -98,6 +200,7 @@ namespace vuk {
 		    render_pass_cache(
 		        this,
 		        +[](void* allocator, const RenderPassCreateInfo& ci) {
+			        VUK_ZONE(instrumentation(allocator), "Cache miss");
 			        VkRenderPass dst;
 			        reinterpret_cast<DeviceSuperFrameResourceImpl*>(allocator)->sfr->allocate_render_passes({ &dst, 1 }, { &ci, 1 }, {});
 			        return dst;
@@ -114,55 +217,113 @@ namespace vuk {
 				new (frames_storage.get() + i * sizeof(DeviceFrameResource)) DeviceFrameResource(sfr.get_context().device, sfr);
 			}
 			frames = reinterpret_cast<DeviceFrameResource*>(frames_storage.get());
+
+			auto* frame_stats = &sfr.get_context().get_frame_stat_counters();
+			image_cache.frame_stats = frame_stats;
+			image_view_cache.frame_stats = frame_stats;
+			graphics_pipeline_cache.frame_stats = frame_stats;
+			compute_pipeline_cache.frame_stats = frame_stats;
+			ray_tracing_pipeline_cache.frame_stats = frame_stats;
+			render_pass_cache.frame_stats = frame_stats;
+		}
+
+		/// @brief Peak usage over the usage window plus 25% headroom, or the fallback sizes if no frames were recorded yet
+		DescriptorPoolSizes estimate_descriptor_pool_sizes() {
+			if (ds_usage_samples == 0) {
+				return DescriptorPoolSizes::fallback(sfr->get_context().vkCmdBuildAccelerationStructuresKHR);
+			}
+			DescriptorPoolSizes peak;
+			for (size_t i = 0; i < std::min(ds_usage_samples, (uint64_t)ds_usage_window); i++) {
+				peak.merge_max(ds_usage_history[i]);
+			}
+			for (auto& c : peak.descriptor_counts) {
+				c += c / 4;
+			}
+			peak.max_sets += peak.max_sets / 4;
+			return peak;
+		}
+
+		/// @brief Get a descriptor pool that can hold at least sizes - reset pools are reused if they are not excessively large
+		Result<SizedDescriptorPool, AllocateException> acquire_descriptor_pool(const DescriptorPoolSizes& sizes, SourceLocationAtFrame loc) {
+			{
+				std::scoped_lock _(ds_pool_mutex);
+				auto best = ds_pools.end();
+				for (auto it = ds_pools.begin(); it != ds_pools.end(); ++it) {
+					if (!it->sizes.contains(sizes) || it->sizes.total() > 2 * sizes.total()) {
+						continue;
+					}
+					if (best == ds_pools.end() || it->sizes.total() < best->sizes.total()) {
+						best = it;
+					}
+				}
+				if (best != ds_pools.end()) {
+					auto pool = *best;
+					*best = ds_pools.back();
+					ds_pools.pop_back();
+					return { expected_value, pool };
+				}
+			}
+			VUK_ZONE(sfr->get_context().get_instrumentation_callbacks(), "Descriptor pool grow");
+			std::array<VkDescriptorPoolSize, 12> storage;
+			auto dpci = sizes.to_create_info(storage);
+			SizedDescriptorPool pool{ .sizes = sizes };
+			VUK_DO_OR_RETURN(sfr->upstream->allocate_descriptor_pools({ &pool.pool, 1 }, { &dpci, 1 }, loc));
+			return { expected_value, pool };
+		}
+
+		/// @brief Destroy reset pools that have not been reused for a while
+		void trim_descriptor_pools(uint64_t frame) {
+			std::scoped_lock _(ds_pool_mutex);
+			for (auto it = ds_pools.begin(); it != ds_pools.end();) {
+				if (it->last_use_frame + ds_usage_window < frame) {
+					sfr->upstream->deallocate_descriptor_pools({ &it->pool, 1 });
+					*it = ds_pools.back();
+					ds_pools.pop_back();
+				} else {
+					++it;
+				}
+			}
 		}
 	};
 
 	struct DeviceFrameResourceImpl {
 		Context* ctx;
-		std::mutex sema_mutex;
-		std::vector<VkSemaphore> semaphores;
-		std::mutex buf_mutex;
-		std::vector<Buffer> buffers;
-		std::mutex fence_mutex;
-		std::vector<VkFence> fences;
-		std::mutex cbuf_mutex;
-		std::vector<CommandBufferAllocation> cmdbuffers_to_free;
-		std::vector<CommandPool> cmdpools_to_free;
-		std::mutex framebuffer_mutex;
-		std::vector<VkFramebuffer> framebuffers;
-		std::mutex images_mutex;
-		std::vector<Image> images;
-		std::mutex image_views_mutex;
-		std::vector<ImageView> image_views;
-		std::mutex pds_mutex;
-		std::vector<PersistentDescriptorSet> persistent_descriptor_sets;
+		// resources to be released when the frame is recycled - these are pushed to from any thread without locking
+		AppendList<VkSemaphore> semaphores;
+		// binary semaphores whose signal a vuk submit or present waited on - only these are reused when the frame is recycled
+		AppendList<VkSemaphore> waited_semaphores;
+		AppendList<VkFence> fences;
+		AppendList<CommandBufferAllocation> cmdbuffers_to_free;
+		std::array<AppendList<CommandBufferAllocation>, 2> cmdbuffers_to_recycle; // indexed by level
+		AppendList<CommandPool> cmdpools_to_free;
+		AppendList<VkFramebuffer> framebuffers;
+		AppendList<Image> images;
+		AppendList<ImageView> image_views;
+		AppendList<PersistentDescriptorSet> persistent_descriptor_sets;
+		AppendList<DescriptorSet> descriptor_sets;
 		std::mutex ds_mutex;
-		std::vector<DescriptorSet> descriptor_sets;
-		std::atomic<VkDescriptorPool*> last_ds_pool;
-		plf::colony<VkDescriptorPool> ds_pools;
-		std::vector<VkDescriptorPool> ds_pools_to_destroy;
+		std::atomic<SizedDescriptorPool*> last_ds_pool;
+		plf::colony<SizedDescriptorPool> ds_pools;
+		DescriptorPoolSizes ds_pool_sizes; // sizes of the first pool, estimated from previous frames
+		std::array<std::atomic<uint32_t>, 12> ds_descriptors_used = {};
+		std::atomic<uint32_t> ds_sets_used = 0;
+		AppendList<VkDescriptorPool> ds_pools_to_destroy;
 
 		// only for use via SuperframeAllocator
-		std::mutex buffers_mutex;
-		std::vector<Buffer> buffer_gpus;
+		AppendList<Buffer> buffer_gpus;
 
 		std::vector<TimestampQueryPool> ts_query_pools;
 		std::mutex query_pool_mutex;
 		std::mutex ts_query_mutex;
 		uint64_t query_index = 0;
 		uint64_t current_ts_pool = 0;
-		std::mutex tsema_mutex;
-		std::vector<TimelineSemaphore> tsemas;
-		std::mutex as_mutex;
-		std::vector<VkAccelerationStructureKHR> ass;
-		std::mutex swapchain_mutex;
-		std::vector<VkSwapchainKHR> swapchains;
-		std::mutex pipelines_mutex;
-		std::vector<GraphicsPipelineInfo> graphics_pipes;
-		std::vector<ComputePipelineInfo> compute_pipes;
-		std::vector<RayTracingPipelineInfo> ray_tracing_pipes;
-		std::mutex render_passes_mutex;
-		std::vector<VkRenderPass> render_passes;
+		AppendList<TimelineSemaphore> tsemas;
+		AppendList<VkAccelerationStructureKHR> ass;
+		AppendList<VkSwapchainKHR> swapchains;
+		AppendList<GraphicsPipelineInfo> graphics_pipes;
+		AppendList<ComputePipelineInfo> compute_pipes;
+		AppendList<RayTracingPipelineInfo> ray_tracing_pipes;
+		AppendList<VkRenderPass> render_passes;
 
 		BufferLinearAllocator linear_cpu_only;
 		BufferLinearAllocator linear_cpu_gpu;
@@ -171,6 +332,7 @@ namespace vuk {
 
 		DeviceFrameResourceImpl(VkDevice device, DeviceSuperFrameResource& upstream) :
 		    ctx(&upstream.get_context()),
+		    ds_pool_sizes(DescriptorPoolSizes::fallback(upstream.get_context().vkCmdBuildAccelerationStructuresKHR)),
 		    linear_cpu_only(upstream, vuk::MemoryUsage::eCPUonly, all_buffer_usage_flags),
 		    linear_cpu_gpu(upstream, vuk::MemoryUsage::eCPUtoGPU, all_buffer_usage_flags),
 		    linear_gpu_cpu(upstream, vuk::MemoryUsage::eGPUtoCPU, all_buffer_usage_flags),
@@ -184,19 +346,22 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_semaphores(dst, loc));
-		std::unique_lock _(impl->sema_mutex);
-		auto& vec = impl->semaphores;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->semaphores.push(dst);
 		return { expected_value };
 	}
 
 	void DeviceFrameResource::deallocate_semaphores(std::span<const VkSemaphore> src) {} // noop
 
+	void record_semaphore_waited(Allocator& allocator, VkSemaphore semaphore) {
+		// semaphores waited on through other allocators are destroyed with their frame
+		if (auto frame = dynamic_cast<DeviceFrameResource*>(&allocator.get_device_resource())) {
+			frame->impl->waited_semaphores.push(semaphore);
+		}
+	}
+
 	Result<void, AllocateException> DeviceFrameResource::allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_fences(dst, loc));
-		std::unique_lock _(impl->fence_mutex);
-		auto& vec = impl->fences;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->fences.push(dst);
 		return { expected_value };
 	}
 
@@ -206,9 +371,9 @@ namespace vuk {
 	                                                                              std::span<const CommandBufferAllocationCreateInfo> cis,
 	                                                                              SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_command_buffers(dst, cis, loc));
-		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdbuffers_to_free;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			impl->cmdbuffers_to_recycle[cis[i].level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1].push(dst[i]);
+		}
 		return { expected_value };
 	}
 
@@ -217,9 +382,7 @@ namespace vuk {
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_command_pools(dst, cis, loc));
-		std::unique_lock _(impl->cbuf_mutex);
-		auto& vec = impl->cmdpools_to_free;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->cmdpools_to_free.push(dst);
 		return { expected_value };
 	}
 
@@ -256,9 +419,7 @@ namespace vuk {
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_framebuffers(std::span<VkFramebuffer> dst, std::span<const FramebufferCreateInfo> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_framebuffers(dst, cis, loc));
-		std::unique_lock _(impl->framebuffer_mutex);
-		auto& vec = impl->framebuffers;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->framebuffers.push(dst);
 		return { expected_value };
 	}
 
@@ -283,10 +444,7 @@ namespace vuk {
 	                                                                                         std::span<const PersistentDescriptorSetCreateInfo> cis,
 	                                                                                         SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_persistent_descriptor_sets(dst, cis, loc));
-		std::unique_lock _(impl->pds_mutex);
-
-		auto& vec = impl->persistent_descriptor_sets;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->persistent_descriptor_sets.push(dst);
 		return { expected_value };
 	}
 
@@ -296,10 +454,7 @@ namespace vuk {
 	DeviceFrameResource::allocate_descriptor_sets_with_value(std::span<DescriptorSet> dst, std::span<const SetBinding> cis, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_descriptor_sets_with_value(dst, cis, loc));
 
-		std::unique_lock _(impl->ds_mutex);
-
-		auto& vec = impl->descriptor_sets;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->descriptor_sets.push(dst);
 		return { expected_value };
 	}
 
@@ -307,55 +462,97 @@ namespace vuk {
 
 	Result<void, AllocateException>
 	DeviceFrameResource::allocate_descriptor_sets(std::span<DescriptorSet> dst, std::span<const DescriptorSetLayoutAllocInfo> cis, SourceLocationAtFrame loc) {
-		VkDescriptorPoolCreateInfo dpci{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-		dpci.maxSets = 1000;
-		std::array<VkDescriptorPoolSize, 12> descriptor_counts = {};
-		size_t count = get_context().vkCmdBuildAccelerationStructuresKHR ? descriptor_counts.size() : descriptor_counts.size() - 1;
-		for (size_t i = 0; i < count; i++) {
-			auto& d = descriptor_counts[i];
-			d.type = i == 11 ? VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR : VkDescriptorType(i);
-			d.descriptorCount = 1000;
-		}
-		dpci.pPoolSizes = descriptor_counts.data();
-		dpci.poolSizeCount = (uint32_t)count;
+		auto& sfr = *static_cast<DeviceSuperFrameResource*>(upstream);
+		// usage of this call, recorded in the frame once the call is done
+		std::array<uint32_t, 12> descriptors_used = {};
+		uint64_t i = 0;
+		// the first pool is sized from the usage of previous frames, additional pools from the usage of this frame so far
+		// either way, we make sure that the pool can fit a number of sets of the layout that triggered the allocation
+		auto next_pool_sizes = [&](const DescriptorSetLayoutAllocInfo& ci, bool first) {
+			DescriptorPoolSizes sizes;
+			if (first) {
+				sizes = impl->ds_pool_sizes;
+			} else {
+				for (size_t j = 0; j < sizes.descriptor_counts.size(); j++) {
+					sizes.descriptor_counts[j] = impl->ds_descriptors_used[j].load(std::memory_order_relaxed) + descriptors_used[j];
+				}
+				sizes.max_sets = impl->ds_sets_used.load(std::memory_order_relaxed) + (uint32_t)i;
+				// the pools of the frame are full, including the ones created during this call - matching their capacity doubles it
+				DescriptorPoolSizes capacity;
+				for (auto& pool : impl->ds_pools) {
+					for (size_t j = 0; j < capacity.descriptor_counts.size(); j++) {
+						capacity.descriptor_counts[j] += pool.sizes.descriptor_counts[j];
+					}
+					capacity.max_sets += pool.sizes.max_sets;
+				}
+				sizes.merge_max(capacity);
+			}
+			constexpr uint32_t min_sets = 16;
+			for (size_t j = 0; j < sizes.descriptor_counts.size(); j++) {
+				sizes.descriptor_counts[j] = std::max(sizes.descriptor_counts[j], ci.descriptor_counts[j] * min_sets);
+			}
+			sizes.max_sets = std::max(sizes.max_sets, min_sets);
+			return sizes;
+		};
 
 		if (impl->ds_pools.size() == 0) {
 			std::unique_lock _(impl->ds_mutex);
-			if (impl->ds_pools.size() == 0) { // this assures only 1 thread gets to do this
-				VkDescriptorPool pool;
-				VUK_DO_OR_RETURN(upstream->allocate_descriptor_pools({ &pool, 1 }, { &dpci, 1 }, loc));
-				impl->last_ds_pool = &*impl->ds_pools.emplace(pool);
+			if (impl->ds_pools.size() == 0 && dst.size() > 0) { // this assures only 1 thread gets to do this
+				auto pool = sfr.impl->acquire_descriptor_pool(next_pool_sizes(cis[0], true), loc);
+				if (!pool) {
+					return { expected_error, pool.error() };
+				}
+				impl->last_ds_pool = &*impl->ds_pools.emplace(*pool);
 			}
 		}
 
 		// look at last stored pool
-		VkDescriptorPool* last_pool = impl->last_ds_pool.load();
+		SizedDescriptorPool* last_pool = impl->last_ds_pool.load();
 
-		for (uint64_t i = 0; i < dst.size(); i++) {
+		VkResult result = VK_SUCCESS;
+		for (; i < dst.size(); i++) {
 			auto& ci = cis[i];
 			// attempt to allocate a set
 			VkDescriptorSetAllocateInfo dsai = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-			dsai.descriptorPool = *last_pool;
+			dsai.descriptorPool = last_pool->pool;
 			dsai.descriptorSetCount = 1;
 			dsai.pSetLayouts = &ci.layout;
 			dst[i].layout_info = ci;
-			auto result = impl->ctx->vkAllocateDescriptorSets(device, &dsai, &dst[i].descriptor_set);
+			result = impl->ctx->vkAllocateDescriptorSets(device, &dsai, &dst[i].descriptor_set);
 			// if we fail, we allocate another pool from upstream
 			if (result == VK_ERROR_OUT_OF_POOL_MEMORY ||
 			    result == VK_ERROR_FRAGMENTED_POOL) { // we potentially run this from multiple threads which results in additional pool allocs
 				{
 					std::unique_lock _(impl->ds_mutex);
-					VkDescriptorPool pool;
-					VUK_DO_OR_RETURN(upstream->allocate_descriptor_pools({ &pool, 1 }, { &dpci, 1 }, loc));
-					last_pool = &*impl->ds_pools.emplace(pool);
+					auto pool = sfr.impl->acquire_descriptor_pool(next_pool_sizes(ci, false), loc);
+					if (!pool) {
+						result = pool.error().code();
+						break;
+					}
+					last_pool = &*impl->ds_pools.emplace(*pool);
+					impl->last_ds_pool = last_pool;
 				}
-				dsai.descriptorPool = *last_pool;
+				dsai.descriptorPool = last_pool->pool;
 				result = impl->ctx->vkAllocateDescriptorSets(device, &dsai, &dst[i].descriptor_set);
-				if (result != VK_SUCCESS) {
-					return { expected_error, AllocateException{ result } };
-				}
+			}
+			if (result != VK_SUCCESS) {
+				break;
+			}
+			for (size_t j = 0; j < descriptors_used.size(); j++) {
+				descriptors_used[j] += ci.descriptor_counts[j];
 			}
 		}
+		// record usage once per call, to keep contention on the counters low
+		for (size_t j = 0; j < descriptors_used.size(); j++) {
+			if (descriptors_used[j] > 0) {
+				impl->ds_descriptors_used[j].fetch_add(descriptors_used[j], std::memory_order_relaxed);
+			}
+		}
+		impl->ds_sets_used.fetch_add((uint32_t)i, std::memory_order_relaxed);
+		impl->ctx->get_frame_stat_counters().descriptor_sets_allocated += i;
+		if (result != VK_SUCCESS) {
+			return { expected_error, AllocateException{ result } };
+		}
 		return { expected_value };
 	}
 
@@ -414,20 +611,14 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) {
 		VUK_DO_OR_RETURN(upstream->allocate_timeline_semaphores(dst, loc));
-		std::unique_lock _(impl->tsema_mutex);
-
-		auto& vec = impl->tsemas;
-		vec.insert(vec.end(), dst.begin(), dst.end());
+		impl->tsemas.push(dst);
 		return { expected_value };
 	}
 
 	void DeviceFrameResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
 	void DeviceFrameResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {
-		std::scoped_lock _(impl->swapchain_mutex);
-
-		auto& vec = impl->swapchains;
-		vec.insert(vec.end(), src.begin(), src.end());
+		impl->swapchains.push(src);
 	}
 
 	Result<void, AllocateException> DeviceFrameResource::allocate_graphics_pipelines(std::span<GraphicsPipelineInfo> dst,
@@ -492,30 +683,28 @@ namespace vuk {
 	void DeviceFrameResource::deallocate_render_passes(std::span<const VkRenderPass> src) {}
 
 	void DeviceFrameResource::wait() {
-		if (impl->fences.size() > 0) {
-			if (impl->fences.size() > 64) {
-				int i = 0;
-				for (; i < impl->fences.size() - 64; i += 64) {
-					impl->ctx->vkWaitForFences(device, 64, impl->fences.data() + i, true, UINT64_MAX);
-				}
-				impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size() - i, impl->fences.data() + i, true, UINT64_MAX);
-			} else {
-				impl->ctx->vkWaitForFences(device, (uint32_t)impl->fences.size(), impl->fences.data(), true, UINT64_MAX);
-			}
+		if (!impl->fences.empty() || !impl->tsemas.empty()) {
+			impl->ctx->get_frame_stat_counters().host_waits += 1;
 		}
-		if (impl->tsemas.size() > 0) {
+		impl->fences.for_each_chunk([&](std::span<VkFence> fences) {
+			for (size_t i = 0; i < fences.size(); i += 64) {
+				auto count = std::min(fences.size() - i, (size_t)64);
+				impl->ctx->vkWaitForFences(device, (uint32_t)count, fences.data() + i, true, UINT64_MAX);
+			}
+		});
+		if (!impl->tsemas.empty()) {
 			VkSemaphoreWaitInfo swi{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
 
-			std::vector<VkSemaphore> semas(impl->tsemas.size());
-			std::vector<uint64_t> values(impl->tsemas.size());
+			std::vector<VkSemaphore> semas;
+			std::vector<uint64_t> values;
 
-			for (uint64_t i = 0; i < impl->tsemas.size(); i++) {
-				semas[i] = impl->tsemas[i].semaphore;
-				values[i] = *impl->tsemas[i].value;
-			}
+			impl->tsemas.for_each([&](TimelineSemaphore& ts) {
+				semas.push_back(ts.semaphore);
+				values.push_back(*ts.value);
+			});
 			swi.pSemaphores = semas.data();
 			swi.pValues = values.data();
-			swi.semaphoreCount = (uint32_t)impl->tsemas.size();
+			swi.semaphoreCount = (uint32_t)semas.size();
 			impl->ctx->vkWaitSemaphores(device, &swi, UINT64_MAX);
 		}
 	}
@@ -544,28 +733,79 @@ namespace vuk {
 	    direct(dynamic_cast<DeviceVkResource*>(this->upstream)),
 	    impl(new DeviceSuperFrameResourceImpl(*this, frames_in_flight)) {}
 
+	Result<void, AllocateException> DeviceSuperFrameResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
+		std::scoped_lock _(impl->sync_mutex);
+		auto& source = impl->semaphores;
+		uint64_t i = 0;
+		for (; i < dst.size() && source.size() > 0; i++) {
+			dst[i] = source.back();
+			source.pop_back();
+		}
+		if (i < dst.size()) {
+			if (auto res = upstream->allocate_semaphores(dst.subspan(i), loc); !res) {
+				source.insert(source.end(), dst.begin(), dst.begin() + i);
+				return res;
+			}
+		}
+		return { expected_value };
+	}
+
 	void DeviceSuperFrameResource::deallocate_semaphores(std::span<const VkSemaphore> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->sema_mutex);
-		auto& vec = get_last_frame().impl->semaphores;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->semaphores.push(src);
+	}
+
+	Result<void, AllocateException> DeviceSuperFrameResource::allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) {
+		std::scoped_lock _(impl->sync_mutex);
+		auto& source = impl->fences;
+		uint64_t i = 0;
+		for (; i < dst.size() && source.size() > 0; i++) {
+			dst[i] = source.back();
+			source.pop_back();
+		}
+		if (i < dst.size()) {
+			if (auto res = upstream->allocate_fences(dst.subspan(i), loc); !res) {
+				source.insert(source.end(), dst.begin(), dst.begin() + i);
+				return res;
+			}
+		}
+		return { expected_value };
 	}
 
 	void DeviceSuperFrameResource::deallocate_fences(std::span<const VkFence> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->fence_mutex);
-		auto& vec = f.impl->fences;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->fences.push(src);
+	}
+
+	Result<void, AllocateException> DeviceSuperFrameResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
+	                                                                                   std::span<const CommandBufferAllocationCreateInfo> cis,
+	                                                                                   SourceLocationAtFrame loc) {
+		assert(cis.size() == dst.size());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			auto& ci = cis[i];
+			{
+				std::scoped_lock _(impl->command_pool_mutex);
+				auto it = impl->command_buffers.find(ci.command_pool.command_pool);
+				if (it != impl->command_buffers.end()) {
+					auto& source = it->second[ci.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1];
+					if (source.size() > 0) {
+						dst[i] = { source.back(), ci.command_pool };
+						source.pop_back();
+						continue;
+					}
+				}
+			}
+			if (auto res = upstream->allocate_command_buffers(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc); !res) {
+				deallocate_command_buffers({ dst.data(), (uint64_t)i });
+				return res;
+			}
+		}
+		return { expected_value };
 	}
 
 	void DeviceSuperFrameResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->cbuf_mutex);
-		auto& vec = f.impl->cmdbuffers_to_free;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->cmdbuffers_to_free.push(src);
 	}
 
 	Result<void, AllocateException>
@@ -579,6 +819,7 @@ namespace vuk {
 				dst[i] = { source.back(), ci.queueFamilyIndex };
 				source.pop_back();
 			} else {
+				VUK_ZONE(get_context().get_instrumentation_callbacks(), "Command pool grow");
 				VUK_DO_OR_RETURN(upstream->allocate_command_pools(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc));
 			}
 		}
@@ -594,26 +835,17 @@ namespace vuk {
 
 	void DeviceSuperFrameResource::deallocate_buffers(std::span<const Buffer> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->buffers_mutex);
-		auto& vec = f.impl->buffer_gpus;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->buffer_gpus.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_framebuffers(std::span<const VkFramebuffer> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->framebuffer_mutex);
-		auto& vec = f.impl->framebuffers;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->framebuffers.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_images(std::span<const Image> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->images_mutex);
-		auto& vec = f.impl->images;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->images.push(src);
 	}
 
 	Result<void, AllocateException>
@@ -659,41 +891,36 @@ namespace vuk {
 
 	void DeviceSuperFrameResource::deallocate_image_views(std::span<const ImageView> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->image_views_mutex);
-		auto& vec = f.impl->image_views;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->image_views.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_persistent_descriptor_sets(std::span<const PersistentDescriptorSet> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pds_mutex);
-		auto& vec = f.impl->persistent_descriptor_sets;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->persistent_descriptor_sets.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_descriptor_sets(std::span<const DescriptorSet> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->ds_mutex);
-		auto& vec = f.impl->descriptor_sets;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->descriptor_sets.push(src);
 	}
 
 	Result<void, AllocateException> DeviceSuperFrameResource::allocate_descriptor_pools(std::span<VkDescriptorPool> dst,
 	                                                                                    std::span<const VkDescriptorPoolCreateInfo> cis,
 	                                                                                    SourceLocationAtFrame loc) {
-		std::scoped_lock _(impl->ds_pool_mutex);
 		assert(cis.size() == dst.size());
 		for (uint64_t i = 0; i < dst.size(); i++) {
 			auto& ci = cis[i];
-			auto& source = impl->ds_pools;
-			if (source.size() > 0) {
-				dst[i] = source.back();
-				source.pop_back();
-			} else {
-				VUK_DO_OR_RETURN(upstream->allocate_descriptor_pools(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc));
+			// only plain pools are recycled
+			if (ci.flags == 0 && ci.pNext == nullptr) {
+				auto pool = impl->acquire_descriptor_pool(DescriptorPoolSizes::from_create_info(ci), loc);
+				if (!pool) {
+					deallocate_descriptor_pools({ dst.data(), (uint64_t)i });
+					return { expected_error, pool.error() };
+				}
+				dst[i] = pool->pool;
+			} else if (auto res = upstream->allocate_descriptor_pools(std::span{ &dst[i], 1 }, std::span{ &ci, 1 }, loc); !res) {
+				deallocate_descriptor_pools({ dst.data(), (uint64_t)i });
+				return res;
 			}
 		}
 		return { expected_value };
@@ -701,10 +928,7 @@ namespace vuk {
 
 	void DeviceSuperFrameResource::deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->ds_mutex);
-		auto& vec = f.impl->ds_pools_to_destroy;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->ds_pools_to_destroy.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_timestamp_query_pools(std::span<const TimestampQueryPool> src) {
@@ -717,61 +941,57 @@ namespace vuk {
 
 	void DeviceSuperFrameResource::deallocate_timestamp_queries(std::span<const TimestampQuery> src) {} // noop
 
+	Result<void, AllocateException> DeviceSuperFrameResource::allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) {
+		std::scoped_lock _(impl->sync_mutex);
+		auto& source = impl->timeline_semaphores;
+		uint64_t i = 0;
+		for (; i < dst.size() && source.size() > 0; i++) {
+			dst[i] = source.back();
+			source.pop_back();
+		}
+		if (i < dst.size()) {
+			if (auto res = upstream->allocate_timeline_semaphores(dst.subspan(i), loc); !res) {
+				source.insert(source.end(), dst.begin(), dst.begin() + i);
+				return res;
+			}
+		}
+		return { expected_value };
+	}
+
 	void DeviceSuperFrameResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->tsema_mutex);
-		auto& vec = f.impl->tsemas;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->tsemas.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->as_mutex);
-		auto& vec = f.impl->ass;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->ass.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->swapchain_mutex);
-		auto& vec = f.impl->swapchains;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->swapchains.push(src);
 	}
 
 	
 	void DeviceSuperFrameResource::deallocate_graphics_pipelines(std::span<const GraphicsPipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->graphics_pipes;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->graphics_pipes.push(src);
 	}
 	
 	void DeviceSuperFrameResource::deallocate_compute_pipelines(std::span<const ComputePipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->compute_pipes;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->compute_pipes.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_ray_tracing_pipelines(std::span<const RayTracingPipelineInfo> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->pipelines_mutex);
-		auto& vec = f.impl->ray_tracing_pipes;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->ray_tracing_pipes.push(src);
 	}
 
 	void DeviceSuperFrameResource::deallocate_render_passes(std::span<const VkRenderPass> src) {
 		std::shared_lock _s(impl->new_frame_mutex);
-		auto& f = get_last_frame();
-		std::unique_lock _(f.impl->render_passes_mutex);
-		auto& vec = f.impl->render_passes;
-		vec.insert(vec.end(), src.begin(), src.end());
+		get_last_frame().impl->render_passes.push(src);
 	}
 
 	DeviceFrameResource& DeviceSuperFrameResource::get_last_frame() {
@@ -789,6 +1009,7 @@ namespace vuk {
 		f.wait();
 		deallocate_frame(f);
 		f.construction_frame = impl->frame_counter.load();
+		f.impl->ds_pool_sizes = impl->estimate_descriptor_pool_sizes();
 
 		// handle MultiFrameResources
 		for (auto it = impl->multi_frames.begin(); it != impl->multi_frames.end();) {
@@ -804,6 +1025,7 @@ namespace vuk {
 		}
 
 		impl->image_identity.clear();
+		impl->trim_descriptor_pools(impl->frame_counter);
 		_s.unlock();
 		// garbage collect caches
 		impl->image_cache.collect(impl->frame_counter, 16);
@@ -812,57 +1034,167 @@ namespace vuk {
 		impl->compute_pipeline_cache.collect(impl->frame_counter, 16);
 		impl->ray_tracing_pipeline_cache.collect(impl->frame_counter, 16);
 		impl->render_pass_cache.collect(impl->frame_counter, 16);
+		{
+			std::scoped_lock _(impl->history_mutex);
+			std::erase_if(impl->histories, [&](auto& kv) { return kv.second->last_attached_frame + impl->history_lifetime < impl->frame_counter; });
+		}
 
 		return f;
 	}
 
+	Result<HistoryImages*, AllocateException>
+	DeviceSuperFrameResource::acquire_history_images(Name name, const ImageAttachment& attachment, uint32_t count, SourceLocationAtFrame loc) {
+		assert(count > 0);
+		assert(attachment.is_fully_known());
+		std::scoped_lock _(impl->history_mutex);
+		auto& history = impl->histories[name];
+		if (!history) {
+			history = std::make_unique<HistoryImages>();
+		}
+		std::scoped_lock _h(history->mutex);
+		if (history->images.size() != count || !(history->attachment == attachment)) {
+			// old images are deallocated through us, so they stay alive until the frames using them are recycled
+			history->images.clear();
+			history->image_views.clear();
+			history->last_uses.clear();
+			history->executions = 0;
+			history->attachment = attachment;
+
+			Allocator allocator(*this);
+			for (uint32_t i = 0; i < count; i++) {
+				ImageAttachment ia = attachment;
+				auto image = allocate_image(allocator, ia, loc);
+				if (!image) {
+					impl->histories.erase(name);
+					return { expected_error, image.error() };
+				}
+				ia.image = **image;
+				auto image_view = allocate_image_view(allocator, ia, loc);
+				if (!image_view) {
+					impl->histories.erase(name);
+					return { expected_error, image_view.error() };
+				}
+				history->images.emplace_back(std::move(*image));
+				history->image_views.emplace_back(std::move(*image_view));
+				history->last_uses.emplace_back(QueueResourceUse{ .layout = ImageLayout::eUndefined });
+			}
+		}
+		history->last_attached_frame = impl->frame_counter;
+		return { expected_value, history.get() };
+	}
+
 	DeviceMultiFrameResource& DeviceSuperFrameResource::get_multiframe_allocator(uint32_t frame_lifetime_count) {
 		std::unique_lock _s(impl->new_frame_mutex);
 
 		auto it = impl->multi_frames.emplace(DeviceMultiFrameResource(get_context().device, *this, frame_lifetime_count));
+		it->impl->ds_pool_sizes = impl->estimate_descriptor_pool_sizes();
 		return *it;
 	}
 
+	DescriptorPoolStats DeviceSuperFrameResource::get_descriptor_pool_stats() {
+		std::shared_lock _s(impl->new_frame_mutex);
+		return impl->ds_stats;
+	}
+
 	template<class T>
 	void DeviceSuperFrameResource::deallocate_frame(T& frame) {
 		auto& f = *frame.impl;
-		upstream->deallocate_semaphores(f.semaphores);
-		upstream->deallocate_fences(f.fences);
-		upstream->deallocate_command_buffers(f.cmdbuffers_to_free);
-		for (auto& pool : f.cmdpools_to_free) {
-			direct->ctx->vkResetCommandPool(get_context().device, pool.command_pool, {});
-		}
-		deallocate_command_pools(f.cmdpools_to_free);
-		for (Buffer& buf : f.buffer_gpus) {
-			impl->suballocators[(int)buf.memory_usage - 1].deallocate_buffer(buf);
-		}
-		upstream->deallocate_framebuffers(f.framebuffers);
-		upstream->deallocate_images(f.images);
-		upstream->deallocate_image_views(f.image_views);
-		upstream->deallocate_persistent_descriptor_sets(f.persistent_descriptor_sets);
-		upstream->deallocate_descriptor_sets(f.descriptor_sets);
+		// the frame has been waited on, so the sync objects can be reused instead of destroyed
+		f.fences.for_each_chunk([&](std::span<VkFence> fences) { get_context().vkResetFences(get_context().device, (uint32_t)fences.size(), fences.data()); });
+		// binary semaphores are only reused once a vuk submit or present waited on their signal - the others might still be signalled, and are destroyed
+		std::vector<VkSemaphore> waited;
+		f.waited_semaphores.for_each_chunk([&](std::span<VkSemaphore> src) { waited.insert(waited.end(), src.begin(), src.end()); });
+		std::sort(waited.begin(), waited.end());
+		std::vector<VkSemaphore> unwaited_semaphores;
+		{
+			std::scoped_lock _(impl->sync_mutex);
+			f.semaphores.for_each_chunk([&](std::span<VkSemaphore> src) {
+				for (auto& sema : src) {
+					if (std::binary_search(waited.begin(), waited.end(), sema)) {
+						impl->semaphores.push_back(sema);
+					} else {
+						unwaited_semaphores.push_back(sema);
+					}
+				}
+			});
+			f.fences.for_each_chunk([&](std::span<VkFence> src) { impl->fences.insert(impl->fences.end(), src.begin(), src.end()); });
+			f.tsemas.for_each_chunk(
+			    [&](std::span<TimelineSemaphore> src) { impl->timeline_semaphores.insert(impl->timeline_semaphores.end(), src.begin(), src.end()); });
+		}
+		upstream->deallocate_semaphores(unwaited_semaphores);
+		// command buffers from pools we are about to reset are kept with the pool, the rest is freed
+		std::vector<CommandPool> cmdpools_to_free;
+		f.cmdpools_to_free.for_each_chunk([&](std::span<CommandPool> src) { cmdpools_to_free.insert(cmdpools_to_free.end(), src.begin(), src.end()); });
+		f.cmdbuffers_to_free.for_each_chunk([&](std::span<CommandBufferAllocation> src) { upstream->deallocate_command_buffers(src); });
+		{
+			std::scoped_lock _(impl->command_pool_mutex);
+			for (size_t level = 0; level < f.cmdbuffers_to_recycle.size(); level++) {
+				f.cmdbuffers_to_recycle[level].for_each([&](CommandBufferAllocation& cbuf) {
+					if (std::find(cmdpools_to_free.begin(), cmdpools_to_free.end(), cbuf.command_pool) != cmdpools_to_free.end()) {
+						impl->command_buffers[cbuf.command_pool.command_pool][level].push_back(cbuf.command_buffer);
+					} else {
+						upstream->deallocate_command_buffers(std::span{ &cbuf, 1 });
+					}
+				});
+			}
+		}
+		for (auto& pool : cmdpools_to_free) {
+			get_context().vkResetCommandPool(get_context().device, pool.command_pool, {});
+		}
+		deallocate_command_pools(cmdpools_to_free);
+		f.buffer_gpus.for_each([&](Buffer& buf) { impl->suballocators[(int)buf.memory_usage - 1].deallocate_buffer(buf); });
+		f.framebuffers.for_each_chunk([&](std::span<VkFramebuffer> src) { upstream->deallocate_framebuffers(src); });
+		f.images.for_each_chunk([&](std::span<Image> src) { upstream->deallocate_images(src); });
+		f.image_views.for_each_chunk([&](std::span<ImageView> src) { upstream->deallocate_image_views(src); });
+		f.persistent_descriptor_sets.for_each_chunk([&](std::span<PersistentDescriptorSet> src) { upstream->deallocate_persistent_descriptor_sets(src); });
+		f.descriptor_sets.for_each_chunk([&](std::span<DescriptorSet> src) { upstream->deallocate_descriptor_sets(src); });
 		get_context().make_timestamp_results_available(f.ts_query_pools);
 		upstream->deallocate_timestamp_query_pools(f.ts_query_pools);
-		upstream->deallocate_timeline_semaphores(f.tsemas);
-		upstream->deallocate_acceleration_structures(f.ass);
-		upstream->deallocate_swapchains(f.swapchains);
-		upstream->deallocate_buffers(f.buffers);
-
-		for (auto& p : f.ds_pools) {
-			direct->ctx->vkResetDescriptorPool(get_context().device, p, {});
-			impl->ds_pools.push_back(p);
+		f.ass.for_each_chunk([&](std::span<VkAccelerationStructureKHR> src) { upstream->deallocate_acceleration_structures(src); });
+		f.swapchains.for_each_chunk([&](std::span<VkSwapchainKHR> src) { upstream->deallocate_swapchains(src); });
+
+		// record descriptor usage of regular frames, the pools of upcoming frames are sized from it
+		DescriptorPoolStats ds_stats;
+		DescriptorPoolSizes ds_usage;
+		for (size_t i = 0; i < ds_usage.descriptor_counts.size(); i++) {
+			ds_usage.descriptor_counts[i] = f.ds_descriptors_used[i].exchange(0);
+		}
+		ds_usage.max_sets = f.ds_sets_used.exchange(0);
+		ds_stats.descriptors_used = ds_usage.descriptor_counts;
+		ds_stats.sets_used = ds_usage.max_sets;
+		ds_stats.overflow_pools = f.ds_pools.size() > 1 ? (uint32_t)f.ds_pools.size() - 1 : 0;
+		{
+			std::scoped_lock _(impl->ds_pool_mutex);
+			for (auto& p : f.ds_pools) {
+				get_context().vkResetDescriptorPool(get_context().device, p.pool, {});
+				for (size_t i = 0; i < ds_stats.descriptor_capacity.size(); i++) {
+					ds_stats.descriptor_capacity[i] += p.sizes.descriptor_counts[i];
+				}
+				ds_stats.set_capacity += p.sizes.max_sets;
+				p.last_use_frame = impl->frame_counter;
+				impl->ds_pools.push_back(p);
+			}
+			ds_stats.recycled_pools = (uint32_t)impl->ds_pools.size();
+		}
+		if constexpr (!std::is_same_v<T, DeviceMultiFrameResource>) {
+			impl->ds_usage_history[impl->ds_usage_samples % impl->ds_usage_window] = ds_usage;
+			impl->ds_usage_samples++;
+			impl->ds_stats = ds_stats;
 		}
 
-		upstream->deallocate_descriptor_pools(f.ds_pools_to_destroy);
-		upstream->deallocate_graphics_pipelines(f.graphics_pipes);
-		upstream->deallocate_compute_pipelines(f.compute_pipes);
-		upstream->deallocate_ray_tracing_pipelines(f.ray_tracing_pipes);
-		upstream->deallocate_render_passes(f.render_passes);
+		f.ds_pools_to_destroy.for_each_chunk([&](std::span<VkDescriptorPool> src) { upstream->deallocate_descriptor_pools(src); });
+		f.graphics_pipes.for_each_chunk([&](std::span<GraphicsPipelineInfo> src) { upstream->deallocate_graphics_pipelines(src); });
+		f.compute_pipes.for_each_chunk([&](std::span<ComputePipelineInfo> src) { upstream->deallocate_compute_pipelines(src); });
+		f.ray_tracing_pipes.for_each_chunk([&](std::span<RayTracingPipelineInfo> src) { upstream->deallocate_ray_tracing_pipelines(src); });
+		f.render_passes.for_each_chunk([&](std::span<VkRenderPass> src) { upstream->deallocate_render_passes(src); });
 
 		f.semaphores.clear();
+		f.waited_semaphores.clear();
 		f.fences.clear();
 		f.buffer_gpus.clear();
 		f.cmdbuffers_to_free.clear();
+		f.cmdbuffers_to_recycle[0].clear();
+		f.cmdbuffers_to_recycle[1].clear();
 		f.cmdpools_to_free.clear();
 		f.ds_pools.clear();
 		if (direct) {
@@ -887,7 +1219,6 @@ namespace vuk {
 		f.tsemas.clear();
 		f.ass.clear();
 		f.swapchains.clear();
-		f.buffers.clear();
 		f.ds_pools_to_destroy.clear();
 		f.graphics_pipes.clear();
 		f.compute_pipes.clear();
@@ -896,6 +1227,8 @@ namespace vuk {
 	}
 
 	void DeviceSuperFrameResource::force_collect() {
+		// recorded passes bind pipelines that may be collected now
+		get_context().invalidate_recorded_passes();
 		impl->image_cache.collect(impl->frame_counter, 0);
 		impl->image_view_cache.collect(impl->frame_counter, 0);
 		impl->graphics_pipeline_cache.collect(impl->frame_counter, 0);
@@ -905,6 +1238,8 @@ namespace vuk {
 	}
 
 	DeviceSuperFrameResource::~DeviceSuperFrameResource() {
+		get_context().invalidate_recorded_passes();
+		impl->histories.clear();
 		impl->image_cache.clear();
 		impl->image_view_cache.clear();
 		impl->graphics_pipeline_cache.clear();
@@ -929,14 +1264,19 @@ namespace vuk {
 			deallocate_frame(f);
 			f.DeviceFrameResource::~DeviceFrameResource();
 		}
-		for (uint32_t i = 0; i < (uint32_t)impl->command_pools.size(); i++) {
-			for (auto& cpool : impl->command_pools[i]) {
-				CommandPool p{ cpool, i };
+		// command buffers are freed implicitly with their pools
+		impl->command_buffers.clear();
+		for (auto& [queue_family_index, cpools] : impl->command_pools) {
+			for (auto& cpool : cpools) {
+				CommandPool p{ cpool, queue_family_index };
 				upstream->deallocate_command_pools(std::span{ &p, 1 });
 			}
 		}
+		upstream->deallocate_semaphores(impl->semaphores);
+		upstream->deallocate_fences(impl->fences);
+		upstream->deallocate_timeline_semaphores(impl->timeline_semaphores);
 		for (auto& p : impl->ds_pools) {
-			direct->deallocate_descriptor_pools(std::span{ &p, 1 });
+			upstream->deallocate_descriptor_pools(std::span{ &p.pool, 1 });
 		}
 		delete impl;
 	}
@@ -3,6 +3,7 @@
 #include "RenderPass.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Descriptor.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/Query.hpp"
 
 #include <atomic>
@@ -225,6 +226,7 @@ namespace vuk {
 				}
 			}
 		}
+		impl->ctx->get_frame_stat_counters().descriptor_sets_allocated += dst.size();
 		return { expected_value };
 	}
 
@@ -287,6 +289,9 @@ namespace vuk {
 	void DeviceLinearResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {} // noop
 
 	void DeviceLinearResource::wait() {
+		if (impl->fences.size() > 0 || impl->tsemas.size() > 0) {
+			impl->ctx->get_frame_stat_counters().host_waits += 1;
+		}
 		if (impl->fences.size() > 0) {
 			if (impl->fences.size() > 64) {
 				int i = 0;
@@ -0,0 +1,440 @@
+#include "vuk/resources/DeviceNullResource.hpp"
+#include "vuk/Buffer.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/Descriptor.hpp"
+#include "vuk/Exception.hpp"
+#include "vuk/PipelineInstance.hpp"
+#include "vuk/Query.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+
+namespace vuk {
+	namespace {
+		/// @brief First-fit allocator over a simulated address space
+		struct SimulatedHeap {
+			static constexpr uint64_t capacity = 1ull << 40;
+
+			std::map<uint64_t, uint64_t> free_ranges = { { 0, capacity } }; // offset -> size
+			std::map<uint64_t, uint64_t> live;                              // offset -> size
+			NullMemoryStats stats;
+
+			std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment) {
+				for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+					auto [offset, range_size] = *it;
+					uint64_t aligned = align_up(offset, alignment);
+					if (aligned + size > offset + range_size) {
+						continue;
+					}
+					free_ranges.erase(it);
+					if (aligned > offset) {
+						free_ranges.emplace(offset, aligned - offset);
+					}
+					if (aligned + size < offset + range_size) {
+						free_ranges.emplace(aligned + size, offset + range_size - aligned - size);
+					}
+					live.emplace(aligned, size);
+					stats.allocated_bytes += size;
+					stats.peak_bytes = std::max(stats.peak_bytes, stats.allocated_bytes);
+					stats.allocation_count++;
+					stats.address_span = std::max(stats.address_span, aligned + size);
+					return aligned;
+				}
+				return {};
+			}
+
+			void deallocate(uint64_t offset) {
+				auto it = live.find(offset);
+				assert(it != live.end());
+				uint64_t size = it->second;
+				live.erase(it);
+				stats.allocated_bytes -= size;
+				stats.allocation_count--;
+				stats.address_span = live.empty() ? 0 : live.rbegin()->first + live.rbegin()->second;
+
+				// coalesce with the neighbouring free ranges
+				auto next = free_ranges.lower_bound(offset);
+				if (next != free_ranges.end() && next->first == offset + size) {
+					size += next->second;
+					next = free_ranges.erase(next);
+				}
+				if (next != free_ranges.begin()) {
+					auto prev = std::prev(next);
+					if (prev->first + prev->second == offset) {
+						prev->second += size;
+						return;
+					}
+				}
+				free_ranges.emplace(offset, size);
+			}
+		};
+
+		struct SimulatedAllocation {
+			MemoryUsage usage;
+			uint64_t offset;
+			std::unique_ptr<std::byte[]> host_memory;
+		};
+	} // namespace
+
+	struct DeviceNullResourceImpl {
+		std::atomic<uint64_t> next_handle = 1;
+		std::mutex mutex;
+		std::array<SimulatedHeap, 4> heaps;
+		std::unordered_map<uint64_t, SimulatedAllocation> allocations; // fake handle -> allocation
+
+		template<class T>
+		T make_handle() {
+			uint64_t id = next_handle.fetch_add(1, std::memory_order_relaxed);
+			if constexpr (std::is_pointer_v<T>) {
+				return reinterpret_cast<T>(static_cast<uintptr_t>(id));
+			} else {
+				return static_cast<T>(id);
+			}
+		}
+
+		template<class T>
+		static uint64_t handle_id(T handle) {
+			if constexpr (std::is_pointer_v<T>) {
+				return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+			} else {
+				return static_cast<uint64_t>(handle);
+			}
+		}
+
+		template<class T>
+		void make_handles(std::span<T> dst) {
+			for (auto& h : dst) {
+				h = make_handle<T>();
+			}
+		}
+
+		/// @brief Place size bytes into the simulated heap of usage, returns the offset into the heap or nothing if the heap is full
+		std::optional<uint64_t> allocate_memory(uint64_t handle, MemoryUsage usage, uint64_t size, uint64_t alignment) {
+			std::lock_guard _(mutex);
+			// zero-sized allocations still occupy a unique address
+			auto offset = heaps[(int)usage - 1].allocate(std::max<uint64_t>(size, 1), alignment);
+			if (!offset) {
+				return {};
+			}
+			SimulatedAllocation& a = allocations[handle];
+			a.usage = usage;
+			a.offset = *offset;
+			if (usage != MemoryUsage::eGPUonly) {
+				a.host_memory.reset(new std::byte[size]);
+			}
+			return offset;
+		}
+
+		void deallocate_memory(uint64_t handle) {
+			std::lock_guard _(mutex);
+			auto it = allocations.find(handle);
+			if (it == allocations.end()) {
+				return;
+			}
+			heaps[(int)it->second.usage - 1].deallocate(it->second.offset);
+			allocations.erase(it);
+		}
+
+		static uint64_t image_size(const ImageCreateInfo& ci) {
+			uint64_t size = 0;
+			for (uint32_t level = 0; level < ci.mipLevels; level++) {
+				Extent3D extent{ std::max(ci.extent.width >> level, 1u), std::max(ci.extent.height >> level, 1u), std::max(ci.extent.depth >> level, 1u) };
+				size += compute_image_size(ci.format, extent);
+			}
+			return size * ci.arrayLayers * (uint32_t)ci.samples;
+		}
+	};
+
+	DeviceNullResource::DeviceNullResource(Context* ctx) : ctx(ctx), impl(new DeviceNullResourceImpl) {}
+
+	DeviceNullResource::~DeviceNullResource() {
+		delete impl;
+	}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_semaphores(std::span<const VkSemaphore> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_fences(std::span<const VkFence> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_command_buffers(std::span<CommandBufferAllocation> dst,
+	                                                                             std::span<const CommandBufferAllocationCreateInfo> cis,
+	                                                                             SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			dst[i].command_buffer = impl->make_handle<VkCommandBuffer>();
+			dst[i].command_pool = cis[i].command_pool;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_command_buffers(std::span<const CommandBufferAllocation> dst) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_command_pools(std::span<CommandPool> dst, std::span<const VkCommandPoolCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			dst[i].command_pool = impl->make_handle<VkCommandPool>();
+			dst[i].queue_family_index = cis[i].queueFamilyIndex;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_command_pools(std::span<const CommandPool> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto& ci = cis[i];
+			auto buffer = impl->make_handle<VkBuffer>();
+			auto id = DeviceNullResourceImpl::handle_id(buffer);
+			auto offset = impl->allocate_memory(id, ci.mem_usage, ci.size, std::max<uint64_t>(ci.alignment, 1));
+			if (!offset) {
+				deallocate_buffers({ dst.data(), (uint64_t)i });
+				return { expected_error, AllocateException{ VK_ERROR_OUT_OF_DEVICE_MEMORY } };
+			}
+			std::byte* mapped_ptr = nullptr;
+			{
+				std::lock_guard _(impl->mutex);
+				mapped_ptr = impl->allocations.at(id).host_memory.get();
+			}
+			// give every usage its own range of device addresses
+			uint64_t device_address = ((uint64_t)ci.mem_usage << 44) + *offset;
+			dst[i] = Buffer{ reinterpret_cast<void*>(static_cast<uintptr_t>(id)), buffer, 0, ci.size, device_address, mapped_ptr, ci.mem_usage };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_buffers(std::span<const Buffer> src) {
+		for (auto& v : src) {
+			if (v) {
+				impl->deallocate_memory(DeviceNullResourceImpl::handle_id(v.buffer));
+			}
+		}
+	}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_framebuffers(std::span<VkFramebuffer> dst, std::span<const FramebufferCreateInfo> cis, SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_framebuffers(std::span<const VkFramebuffer> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto image = impl->make_handle<VkImage>();
+			auto id = DeviceNullResourceImpl::handle_id(image);
+			// images don't have host visible memory, use a typical optimal tiling alignment
+			auto offset = impl->allocate_memory(id, MemoryUsage::eGPUonly, DeviceNullResourceImpl::image_size(cis[i]), 64 * 1024);
+			if (!offset) {
+				deallocate_images({ dst.data(), (uint64_t)i });
+				return { expected_error, AllocateException{ VK_ERROR_OUT_OF_DEVICE_MEMORY } };
+			}
+			dst[i] = Image{ image, reinterpret_cast<void*>(static_cast<uintptr_t>(id)) };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_images(std::span<const Image> src) {
+		for (auto& v : src) {
+			if (v) {
+				impl->deallocate_memory(DeviceNullResourceImpl::handle_id(v.image));
+			}
+		}
+	}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_image_views(std::span<ImageView> dst, std::span<const ImageViewCreateInfo> cis, SourceLocationAtFrame loc) {
+		for (auto& iv : dst) {
+			auto payload = impl->make_handle<VkImageView>();
+			iv = ctx ? ctx->wrap(payload) : ImageView{ { DeviceNullResourceImpl::handle_id(payload) }, payload };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_image_views(std::span<const ImageView> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_persistent_descriptor_sets(std::span<PersistentDescriptorSet> dst,
+	                                                                                        std::span<const PersistentDescriptorSetCreateInfo> cis,
+	                                                                                        SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto& ci = cis[i];
+			PersistentDescriptorSet& tda = dst[i];
+			tda.backing_pool = impl->make_handle<VkDescriptorPool>();
+			tda.backing_set = impl->make_handle<VkDescriptorSet>();
+			for (unsigned j = 0; j < ci.dslci.bindings.size(); j++) {
+				tda.descriptor_bindings[j].resize(ci.dslci.bindings[j].descriptorCount);
+			}
+			if (ci.dslai.variable_count_binding != (unsigned)-1) {
+				tda.descriptor_bindings[ci.dslai.variable_count_binding].resize(ci.num_descriptors);
+			}
+			tda.set_layout_create_info = ci.dslci;
+			tda.set_layout = ci.dslai.layout;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_persistent_descriptor_sets(std::span<const PersistentDescriptorSet> src) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_descriptor_sets_with_value(std::span<DescriptorSet> dst, std::span<const SetBinding> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			dst[i] = { impl->make_handle<VkDescriptorSet>(), *cis[i].layout_info };
+		}
+		return { expected_value };
+	}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_descriptor_sets(std::span<DescriptorSet> dst, std::span<const DescriptorSetLayoutAllocInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			dst[i] = { impl->make_handle<VkDescriptorSet>(), cis[i] };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_descriptor_sets(std::span<const DescriptorSet> src) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_descriptor_pools(std::span<VkDescriptorPool> dst, std::span<const VkDescriptorPoolCreateInfo> cis, SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_descriptor_pools(std::span<const VkDescriptorPool> src) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_timestamp_query_pools(std::span<TimestampQueryPool> dst, std::span<const VkQueryPoolCreateInfo> cis, SourceLocationAtFrame loc) {
+		for (auto& v : dst) {
+			v.pool = impl->make_handle<VkQueryPool>();
+			v.count = 0;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_timestamp_query_pools(std::span<const TimestampQueryPool> src) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_timestamp_queries(std::span<TimestampQuery> dst, std::span<const TimestampQueryCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			auto& ci = cis[i];
+			ci.pool->queries[ci.pool->count++] = ci.query;
+			dst[i].id = ci.pool->count;
+			dst[i].pool = ci.pool->pool;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_timestamp_queries(std::span<const TimestampQuery> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) {
+		for (auto& v : dst) {
+			v.semaphore = impl->make_handle<VkSemaphore>();
+			v.value = new uint64_t{ 0 };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {
+		for (auto& v : src) {
+			if (v.semaphore != VK_NULL_HANDLE) {
+				delete v.value;
+			}
+		}
+	}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_acceleration_structures(std::span<VkAccelerationStructureKHR> dst,
+	                                                                                     std::span<const VkAccelerationStructureCreateInfoKHR> cis,
+	                                                                                     SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_acceleration_structures(std::span<const VkAccelerationStructureKHR> src) {}
+
+	void DeviceNullResource::deallocate_swapchains(std::span<const VkSwapchainKHR> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_graphics_pipelines(std::span<GraphicsPipelineInfo> dst,
+	                                                                                std::span<const GraphicsPipelineInstanceCreateInfo> cis,
+	                                                                                SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto base = cis[i].base;
+			dst[i] = { base, impl->make_handle<VkPipeline>(), base->pipeline_layout, base->layout_info };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_graphics_pipelines(std::span<const GraphicsPipelineInfo> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_compute_pipelines(std::span<ComputePipelineInfo> dst,
+	                                                                               std::span<const ComputePipelineInstanceCreateInfo> cis,
+	                                                                               SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto base = cis[i].base;
+			dst[i] = { { base, impl->make_handle<VkPipeline>(), base->pipeline_layout, base->layout_info }, base->reflection_info.local_size };
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_compute_pipelines(std::span<const ComputePipelineInfo> src) {}
+
+	Result<void, AllocateException> DeviceNullResource::allocate_ray_tracing_pipelines(std::span<RayTracingPipelineInfo> dst,
+	                                                                                   std::span<const RayTracingPipelineInstanceCreateInfo> cis,
+	                                                                                   SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			auto base = cis[i].base;
+			dst[i] = {};
+			dst[i].base = base;
+			dst[i].pipeline = impl->make_handle<VkPipeline>();
+			dst[i].pipeline_layout = base->pipeline_layout;
+			dst[i].layout_info = base->layout_info;
+		}
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_ray_tracing_pipelines(std::span<const RayTracingPipelineInfo> src) {}
+
+	Result<void, AllocateException>
+	DeviceNullResource::allocate_render_passes(std::span<VkRenderPass> dst, std::span<const RenderPassCreateInfo> cis, SourceLocationAtFrame loc) {
+		impl->make_handles(dst);
+		return { expected_value };
+	}
+
+	void DeviceNullResource::deallocate_render_passes(std::span<const VkRenderPass> src) {}
+
+	Context& DeviceNullResource::get_context() {
+		assert(ctx && "DeviceNullResource was created without a Context");
+		return *ctx;
+	}
+
+	std::array<NullMemoryStats, 4> DeviceNullResource::get_memory_stats() {
+		std::lock_guard _(impl->mutex);
+		std::array<NullMemoryStats, 4> stats;
+		for (size_t i = 0; i < stats.size(); i++) {
+			stats[i] = impl->heaps[i].stats;
+		}
+		return stats;
+	}
+} // namespace vuk
@@ -0,0 +1,443 @@
+#include "vuk/resources/DeviceTracingResource.hpp"
+#include "vuk/Hash.hpp"
+
+#include <chrono>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace vuk {
+	namespace {
+		constexpr char trace_magic[4] = { 'V', 'U', 'K', 'T' };
+		constexpr uint64_t trace_version = 1;
+		constexpr uint8_t deallocation_bit = 0x80;
+
+		// LEB128 - most fields of an event are small, so this keeps the trace compact
+		void write_varint(std::ostream& os, uint64_t value) {
+			do {
+				uint8_t byte = value & 0x7f;
+				value >>= 7;
+				if (value != 0) {
+					byte |= 0x80;
+				}
+				os.put((char)byte);
+			} while (value != 0);
+		}
+
+		bool read_varint(std::istream& is, uint64_t& value) {
+			value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				int byte = is.get();
+				if (byte == std::char_traits<char>::eof()) {
+					return false;
+				}
+				value |= (uint64_t)(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		template<class T>
+		bool read_varint_as(std::istream& is, T& value) {
+			uint64_t v;
+			if (!read_varint(is, v)) {
+				return false;
+			}
+			value = (T)v;
+			return true;
+		}
+
+		struct BufferKey {
+			VkBuffer buffer;
+			uint64_t offset;
+
+			bool operator==(const BufferKey&) const = default;
+		};
+	} // namespace
+} // namespace vuk
+
+namespace std {
+	template<>
+	struct hash<vuk::BufferKey> {
+		size_t operator()(vuk::BufferKey const& x) const noexcept {
+			size_t h = 0;
+			hash_combine(h, x.buffer, x.offset);
+			return h;
+		}
+	};
+} // namespace std
+
+namespace vuk {
+	void AllocationTrace::serialize(std::ostream& os) const {
+		os.write(trace_magic, sizeof(trace_magic));
+		write_varint(os, trace_version);
+		write_varint(os, events.size());
+		for (auto& e : events) {
+			os.put((char)((uint8_t)e.kind | (e.deallocation ? deallocation_bit : 0)));
+			write_varint(os, e.id);
+			if (e.deallocation) {
+				continue;
+			}
+			if (e.kind == TraceEventKind::eBuffer) {
+				write_varint(os, (uint64_t)e.buffer.mem_usage);
+				write_varint(os, e.buffer.size);
+				write_varint(os, e.buffer.alignment);
+			} else if (e.kind == TraceEventKind::eImage) {
+				auto& ci = e.image;
+				write_varint(os, ci.flags.m_mask);
+				write_varint(os, (uint64_t)ci.imageType);
+				write_varint(os, (uint64_t)ci.format);
+				write_varint(os, ci.extent.width);
+				write_varint(os, ci.extent.height);
+				write_varint(os, ci.extent.depth);
+				write_varint(os, ci.mipLevels);
+				write_varint(os, ci.arrayLayers);
+				write_varint(os, (uint64_t)ci.samples);
+				write_varint(os, (uint64_t)ci.tiling);
+				write_varint(os, ci.usage.m_mask);
+				write_varint(os, (uint64_t)ci.sharingMode);
+				write_varint(os, (uint64_t)ci.initialLayout);
+			}
+		}
+	}
+
+	std::optional<AllocationTrace> AllocationTrace::deserialize(std::istream& is) {
+		char magic[sizeof(trace_magic)];
+		if (!is.read(magic, sizeof(magic)) || !std::equal(std::begin(magic), std::end(magic), std::begin(trace_magic))) {
+			return {};
+		}
+		uint64_t version, count;
+		if (!read_varint(is, version) || version != trace_version || !read_varint(is, count)) {
+			return {};
+		}
+		AllocationTrace trace;
+		for (uint64_t i = 0; i < count; i++) {
+			int header = is.get();
+			if (header == std::char_traits<char>::eof()) {
+				return {};
+			}
+			AllocationTraceEvent e;
+			e.kind = (TraceEventKind)(header & ~deallocation_bit);
+			e.deallocation = (header & deallocation_bit) != 0;
+			if (e.kind > TraceEventKind::eImage || !read_varint(is, e.id)) {
+				return {};
+			}
+			bool ok = true;
+			if (!e.deallocation && e.kind == TraceEventKind::eBuffer) {
+				ok = read_varint_as(is, e.buffer.mem_usage) && read_varint_as(is, e.buffer.size) && read_varint_as(is, e.buffer.alignment);
+			} else if (!e.deallocation && e.kind == TraceEventKind::eImage) {
+				auto& ci = e.image;
+				ok = read_varint_as(is, ci.flags.m_mask) && read_varint_as(is, ci.imageType) && read_varint_as(is, ci.format) &&
+				     read_varint_as(is, ci.extent.width) && read_varint_as(is, ci.extent.height) && read_varint_as(is, ci.extent.depth) &&
+				     read_varint_as(is, ci.mipLevels) && read_varint_as(is, ci.arrayLayers) && read_varint_as(is, ci.samples) && read_varint_as(is, ci.tiling) &&
+				     read_varint_as(is, ci.usage.m_mask) && read_varint_as(is, ci.sharingMode) && read_varint_as(is, ci.initialLayout);
+			}
+			if (!ok) {
+				return {};
+			}
+			trace.events.push_back(e);
+		}
+		return trace;
+	}
+
+	struct DeviceTracingResourceImpl {
+		std::mutex mutex;
+		std::vector<AllocationTraceEvent> events;
+		uint64_t next_id = 0;
+		std::optional<uint64_t> current_frame;
+
+		std::unordered_map<VkSemaphore, uint64_t> semaphores;
+		std::unordered_map<VkFence, uint64_t> fences;
+		std::unordered_map<VkSemaphore, uint64_t> timeline_semaphores;
+		std::unordered_map<BufferKey, uint64_t> buffers;
+		std::unordered_map<VkImage, uint64_t> images;
+
+		void record_frame(uint64_t absolute_frame) {
+			if (current_frame && *current_frame >= absolute_frame) {
+				return;
+			}
+			current_frame = absolute_frame;
+			events.push_back(AllocationTraceEvent{ .kind = TraceEventKind::eFrame, .id = absolute_frame });
+		}
+
+		template<class K>
+		void record_allocation(std::unordered_map<K, uint64_t>& ids, const K& key, AllocationTraceEvent e, SourceLocationAtFrame loc) {
+			// VUK_HERE_AND_NOW() doesn't carry a frame
+			if (loc.absolute_frame != (uint64_t)-1) {
+				record_frame(loc.absolute_frame);
+			}
+			e.id = next_id++;
+			ids.emplace(key, e.id);
+			events.push_back(e);
+		}
+
+		template<class K>
+		void record_deallocation(std::unordered_map<K, uint64_t>& ids, const K& key, TraceEventKind kind) {
+			auto it = ids.find(key);
+			// not allocated through us
+			if (it == ids.end()) {
+				return;
+			}
+			events.push_back(AllocationTraceEvent{ .kind = kind, .deallocation = true, .id = it->second });
+			ids.erase(it);
+		}
+	};
+
+	DeviceTracingResource::DeviceTracingResource(DeviceResource& upstream) : DeviceNestedResource(upstream), impl(new DeviceTracingResourceImpl) {}
+
+	DeviceTracingResource::~DeviceTracingResource() {
+		delete impl;
+	}
+
+	Result<void, AllocateException> DeviceTracingResource::allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_semaphores(dst, loc));
+		std::lock_guard _(impl->mutex);
+		for (auto& v : dst) {
+			impl->record_allocation(impl->semaphores, v, { .kind = TraceEventKind::eSemaphore }, loc);
+		}
+		return { expected_value };
+	}
+
+	void DeviceTracingResource::deallocate_semaphores(std::span<const VkSemaphore> src) {
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				impl->record_deallocation(impl->semaphores, v, TraceEventKind::eSemaphore);
+			}
+		}
+		upstream->deallocate_semaphores(src);
+	}
+
+	Result<void, AllocateException> DeviceTracingResource::allocate_fences(std::span<VkFence> dst, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_fences(dst, loc));
+		std::lock_guard _(impl->mutex);
+		for (auto& v : dst) {
+			impl->record_allocation(impl->fences, v, { .kind = TraceEventKind::eFence }, loc);
+		}
+		return { expected_value };
+	}
+
+	void DeviceTracingResource::deallocate_fences(std::span<const VkFence> src) {
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				impl->record_deallocation(impl->fences, v, TraceEventKind::eFence);
+			}
+		}
+		upstream->deallocate_fences(src);
+	}
+
+	Result<void, AllocateException> DeviceTracingResource::allocate_timeline_semaphores(std::span<TimelineSemaphore> dst, SourceLocationAtFrame loc) {
+		VUK_DO_OR_RETURN(upstream->allocate_timeline_semaphores(dst, loc));
+		std::lock_guard _(impl->mutex);
+		for (auto& v : dst) {
+			impl->record_allocation(impl->timeline_semaphores, v.semaphore, { .kind = TraceEventKind::eTimelineSemaphore }, loc);
+		}
+		return { expected_value };
+	}
+
+	void DeviceTracingResource::deallocate_timeline_semaphores(std::span<const TimelineSemaphore> src) {
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				impl->record_deallocation(impl->timeline_semaphores, v.semaphore, TraceEventKind::eTimelineSemaphore);
+			}
+		}
+		upstream->deallocate_timeline_semaphores(src);
+	}
+
+	Result<void, AllocateException> DeviceTracingResource::allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		VUK_DO_OR_RETURN(upstream->allocate_buffers(dst, cis, loc));
+		std::lock_guard _(impl->mutex);
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			impl->record_allocation(impl->buffers, BufferKey{ dst[i].buffer, dst[i].offset }, { .kind = TraceEventKind::eBuffer, .buffer = cis[i] }, loc);
+		}
+		return { expected_value };
+	}
+
+	void DeviceTracingResource::deallocate_buffers(std::span<const Buffer> src) {
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				impl->record_deallocation(impl->buffers, BufferKey{ v.buffer, v.offset }, TraceEventKind::eBuffer);
+			}
+		}
+		upstream->deallocate_buffers(src);
+	}
+
+	Result<void, AllocateException> DeviceTracingResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
+		assert(dst.size() == cis.size());
+		VUK_DO_OR_RETURN(upstream->allocate_images(dst, cis, loc));
+		std::lock_guard _(impl->mutex);
+		for (uint64_t i = 0; i < dst.size(); i++) {
+			ImageCreateInfo ci = cis[i];
+			// pointers would dangle by the time the trace is replayed
+			ci.pNext = nullptr;
+			ci.queueFamilyIndexCount = 0;
+			ci.pQueueFamilyIndices = nullptr;
+			impl->record_allocation(impl->images, dst[i].image, { .kind = TraceEventKind::eImage, .image = ci }, loc);
+		}
+		return { expected_value };
+	}
+
+	void DeviceTracingResource::deallocate_images(std::span<const Image> src) {
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				impl->record_deallocation(impl->images, v.image, TraceEventKind::eImage);
+			}
+		}
+		upstream->deallocate_images(src);
+	}
+
+	void DeviceTracingResource::next_frame(uint64_t absolute_frame) {
+		std::lock_guard _(impl->mutex);
+		impl->record_frame(absolute_frame);
+	}
+
+	AllocationTrace DeviceTracingResource::get_trace() {
+		std::lock_guard _(impl->mutex);
+		return AllocationTrace{ impl->events };
+	}
+
+	void DeviceTracingResource::clear_trace() {
+		std::lock_guard _(impl->mutex);
+		impl->events.clear();
+		impl->current_frame.reset();
+		impl->semaphores.clear();
+		impl->fences.clear();
+		impl->timeline_semaphores.clear();
+		impl->buffers.clear();
+		impl->images.clear();
+	}
+
+	ReplayReport replay_trace(const AllocationTrace& trace, DeviceResource& resource, std::function<DeviceResource&(uint64_t absolute_frame)> on_frame) {
+		using clock = std::chrono::steady_clock;
+
+		ReplayReport report;
+		DeviceResource* current = &resource;
+		std::unordered_map<uint64_t, VkSemaphore> semaphores;
+		std::unordered_map<uint64_t, VkFence> fences;
+		std::unordered_map<uint64_t, TimelineSemaphore> timeline_semaphores;
+		std::unordered_map<uint64_t, Buffer> buffers;
+		std::unordered_map<uint64_t, Image> images;
+		uint64_t live_buffer_bytes = 0;
+		clock::duration elapsed{};
+
+		auto timed = [&](auto&& f) {
+			auto start = clock::now();
+			auto result = f();
+			elapsed += clock::now() - start;
+			return result;
+		};
+
+		auto replay_allocation = [&](auto& live, auto& object, auto&& f, uint64_t id) {
+			if (timed(f)) {
+				live.emplace(id, object);
+				report.allocations++;
+				return true;
+			}
+			report.failed_allocations++;
+			return false;
+		};
+
+		auto replay_deallocation = [&](auto& live, uint64_t id, auto&& f) {
+			auto it = live.find(id);
+			// allocation failed during replay or the trace started after the allocation
+			if (it == live.end()) {
+				return;
+			}
+			timed([&] {
+				f(it->second);
+				return true;
+			});
+			live.erase(it);
+			report.deallocations++;
+		};
+
+		for (auto& e : trace.events) {
+			switch (e.kind) {
+			case TraceEventKind::eFrame:
+				report.frames++;
+				if (on_frame) {
+					current = &on_frame(e.id);
+				}
+				break;
+			case TraceEventKind::eSemaphore: {
+				if (e.deallocation) {
+					replay_deallocation(semaphores, e.id, [&](VkSemaphore& s) { current->deallocate_semaphores({ &s, 1 }); });
+				} else {
+					VkSemaphore s;
+					replay_allocation(semaphores, s, [&] { return (bool)current->allocate_semaphores({ &s, 1 }, VUK_HERE_AND_NOW()); }, e.id);
+				}
+				break;
+			}
+			case TraceEventKind::eFence: {
+				if (e.deallocation) {
+					replay_deallocation(fences, e.id, [&](VkFence& f) { current->deallocate_fences({ &f, 1 }); });
+				} else {
+					VkFence f;
+					replay_allocation(fences, f, [&] { return (bool)current->allocate_fences({ &f, 1 }, VUK_HERE_AND_NOW()); }, e.id);
+				}
+				break;
+			}
+			case TraceEventKind::eTimelineSemaphore: {
+				if (e.deallocation) {
+					replay_deallocation(timeline_semaphores, e.id, [&](TimelineSemaphore& s) { current->deallocate_timeline_semaphores({ &s, 1 }); });
+				} else {
+					TimelineSemaphore s;
+					replay_allocation(timeline_semaphores, s, [&] { return (bool)current->allocate_timeline_semaphores({ &s, 1 }, VUK_HERE_AND_NOW()); }, e.id);
+				}
+				break;
+			}
+			case TraceEventKind::eBuffer: {
+				if (e.deallocation) {
+					replay_deallocation(buffers, e.id, [&](Buffer& b) {
+						live_buffer_bytes -= b.size;
+						current->deallocate_buffers({ &b, 1 });
+					});
+				} else {
+					Buffer b;
+					if (replay_allocation(buffers, b, [&] { return (bool)current->allocate_buffers({ &b, 1 }, { &e.buffer, 1 }, VUK_HERE_AND_NOW()); }, e.id)) {
+						live_buffer_bytes += b.size;
+						report.peak_buffer_bytes = std::max(report.peak_buffer_bytes, live_buffer_bytes);
+					}
+				}
+				break;
+			}
+			case TraceEventKind::eImage: {
+				if (e.deallocation) {
+					replay_deallocation(images, e.id, [&](Image& i) { current->deallocate_images({ &i, 1 }); });
+				} else {
+					Image i;
+					replay_allocation(images, i, [&] { return (bool)current->allocate_images({ &i, 1 }, { &e.image, 1 }, VUK_HERE_AND_NOW()); }, e.id);
+				}
+				break;
+			}
+			}
+			report.peak_live_objects = std::max(report.peak_live_objects, (uint64_t)(buffers.size() + images.size()));
+		}
+		report.seconds = std::chrono::duration<double>(elapsed).count();
+
+		for (auto& [id, v] : semaphores) {
+			current->deallocate_semaphores({ &v, 1 });
+		}
+		for (auto& [id, v] : fences) {
+			current->deallocate_fences({ &v, 1 });
+		}
+		for (auto& [id, v] : timeline_semaphores) {
+			current->deallocate_timeline_semaphores({ &v, 1 });
+		}
+		for (auto& [id, v] : buffers) {
+			current->deallocate_buffers({ &v, 1 });
+		}
+		for (auto& [id, v] : images) {
+			current->deallocate_images({ &v, 1 });
+		}
+		return report;
+	}
+} // namespace vuk
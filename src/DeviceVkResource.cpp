@@ -3,6 +3,8 @@
 #include "vuk/Buffer.hpp"
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
+#include "vuk/FrameStats.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/PipelineInstance.hpp"
 #include "vuk/Query.hpp"
 #include "vuk/resources/DeviceNestedResource.hpp"
@@ -16,9 +18,12 @@
 		printf("\n");                                                                                                                                              \
 	} while (false)
 #endif
+#include "vuk/Hash.hpp"
+#include <algorithm>
 #include <mutex>
 #include <numeric>
 #include <sstream>
+#include <unordered_map>
 #include <vk_mem_alloc.h>
 
 namespace vuk {
@@ -45,12 +50,127 @@ namespace vuk {
 		}
 	}
 
+	struct AllocationSite {
+		const char* file;
+		const char* function;
+		uint32_t line;
+		uint32_t column;
+
+		bool operator==(const AllocationSite&) const = default;
+	};
+
+	struct AllocationSiteHash {
+		size_t operator()(const AllocationSite& site) const {
+			size_t h = std::hash<const char*>{}(site.file);
+			hash_combine(h, site.function, site.line, site.column);
+			return h;
+		}
+	};
+
+	struct AllocationRecord {
+		AllocationSite site;
+		uint64_t size;
+		uint32_t heap;
+		MemoryUsage usage;
+	};
+
+	struct BudgetCallback {
+		uint64_t id;
+		float threshold;
+		MemoryBudgetCallback callback;
+		std::array<bool, VK_MAX_MEMORY_HEAPS> above = {};
+	};
+
+	struct BudgetEvent {
+		MemoryBudgetCallback callback;
+		uint32_t heap_index;
+		HeapMemoryStats stats;
+		bool above;
+	};
+
 	struct DeviceVkResourceImpl {
 		std::mutex mutex;
 		VmaAllocator allocator;
 		VkPhysicalDeviceProperties properties;
+		VkPhysicalDeviceMemoryProperties memory_properties;
 		std::vector<uint32_t> all_queue_families;
 		uint32_t queue_family_count;
+
+		// allocation telemetry - guarded by mutex
+		std::array<HeapMemoryStats, VK_MAX_MEMORY_HEAPS> heaps = {};
+		std::array<AllocationStats, 4> usages = {};
+		std::unordered_map<AllocationSite, AllocationSiteStats, AllocationSiteHash> sites;
+		std::unordered_map<VmaAllocation, AllocationRecord> allocations;
+		std::vector<BudgetCallback> budget_callbacks;
+		uint64_t next_budget_callback_id = 0;
+
+		void track_allocation(VmaAllocation allocation, const VmaAllocationInfo& info, MemoryUsage usage, SourceLocationAtFrame loc) {
+			AllocationRecord record{ { loc.location.file_name(), loc.location.function_name(), loc.location.line(), loc.location.column() },
+				                       info.size,
+				                       memory_properties.memoryTypes[info.memoryType].heapIndex,
+				                       usage };
+			auto& heap = heaps[record.heap];
+			heap.allocated_bytes += record.size;
+			heap.allocation_count++;
+			auto& us = usages[to_integral(usage) - 1];
+			us.bytes += record.size;
+			us.count++;
+			auto& site = sites.try_emplace(record.site, AllocationSiteStats{ loc.location }).first->second;
+			site.stats.bytes += record.size;
+			site.stats.count++;
+			allocations.emplace(allocation, record);
+		}
+
+		void untrack_allocation(VmaAllocation allocation) {
+			auto it = allocations.find(allocation);
+			if (it == allocations.end()) {
+				return;
+			}
+			auto& record = it->second;
+			auto& heap = heaps[record.heap];
+			heap.allocated_bytes -= record.size;
+			heap.allocation_count--;
+			auto& us = usages[to_integral(record.usage) - 1];
+			us.bytes -= record.size;
+			us.count--;
+			auto site_it = sites.find(record.site);
+			site_it->second.stats.bytes -= record.size;
+			if (--site_it->second.stats.count == 0) {
+				sites.erase(site_it);
+			}
+			allocations.erase(it);
+		}
+
+		HeapMemoryStats get_heap_stats(uint32_t heap_index, const VmaBudget& budget) {
+			HeapMemoryStats stats = heaps[heap_index];
+			stats.usage = budget.usage;
+			stats.budget = budget.budget;
+			return stats;
+		}
+
+		// crossed thresholds are collected here, and the callbacks invoked once the mutex is released
+		void check_budgets(std::vector<BudgetEvent>& events) {
+			if (budget_callbacks.empty()) {
+				return;
+			}
+			std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+			vmaGetHeapBudgets(allocator, budgets.data());
+			for (auto& cb : budget_callbacks) {
+				for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+					bool above = budgets[i].budget > 0 && (double)budgets[i].usage > cb.threshold * (double)budgets[i].budget;
+					if (above != cb.above[i]) {
+						cb.above[i] = above;
+						events.push_back(BudgetEvent{ cb.callback, i, get_heap_stats(i, budgets[i]), above });
+					}
+				}
+			}
+		}
+
+		static void dispatch(std::span<BudgetEvent> events) {
+			for (auto& e : events) {
+				e.callback(e.heap_index, e.stats, e.above);
+			}
+		}
 	};
 
 	DeviceVkResource::DeviceVkResource(Context& ctx) : ctx(&ctx), impl(new DeviceVkResourceImpl), device(ctx.device) {
@@ -59,6 +179,9 @@ namespace vuk {
 		allocatorInfo.physicalDevice = ctx.physical_device;
 		allocatorInfo.device = device;
 		allocatorInfo.flags = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT | VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+		if (ctx.memory_budget_enabled) {
+			allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
 
 		VmaVulkanFunctions vulkanFunctions = {};
 		vulkanFunctions.vkGetPhysicalDeviceProperties = ctx.vkGetPhysicalDeviceProperties;
@@ -78,10 +201,12 @@ namespace vuk {
 		vulkanFunctions.vkCreateImage = ctx.vkCreateImage;
 		vulkanFunctions.vkDestroyImage = ctx.vkDestroyImage;
 		vulkanFunctions.vkCmdCopyBuffer = ctx.vkCmdCopyBuffer;
+		vulkanFunctions.vkGetPhysicalDeviceMemoryProperties2KHR = ctx.vkGetPhysicalDeviceMemoryProperties2;
 		allocatorInfo.pVulkanFunctions = &vulkanFunctions;
 
 		vmaCreateAllocator(&allocatorInfo, &impl->allocator);
 		ctx.vkGetPhysicalDeviceProperties(ctx.physical_device, &impl->properties);
+		ctx.vkGetPhysicalDeviceMemoryProperties(ctx.physical_device, &impl->memory_properties);
 
 		if (ctx.transfer_queue_family_index != ctx.graphics_queue_family_index && ctx.compute_queue_family_index != ctx.graphics_queue_family_index) {
 			impl->all_queue_families = { ctx.graphics_queue_family_index, ctx.compute_queue_family_index, ctx.transfer_queue_family_index };
@@ -214,8 +339,9 @@ namespace vuk {
 
 	Result<void, AllocateException> DeviceVkResource::allocate_buffers(std::span<Buffer> dst, std::span<const BufferCreateInfo> cis, SourceLocationAtFrame loc) {
 		assert(dst.size() == cis.size());
+		std::vector<BudgetEvent> events;
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
-			std::lock_guard _(impl->mutex);
+			std::unique_lock _(impl->mutex);
 			auto& ci = cis[i];
 			VkBufferCreateInfo bci{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
 			bci.size = ci.size;
@@ -234,63 +360,139 @@ namespace vuk {
 			// ignore alignment: we get a fresh VkBuffer which satisfies all alignments inside the VkBfufer
 			auto res = vmaCreateBuffer(impl->allocator, &bci, &aci, &buffer, &allocation, &allocation_info);
 			if (res != VK_SUCCESS) {
+				_.unlock();
 				deallocate_buffers({ dst.data(), (uint64_t)i });
+				DeviceVkResourceImpl::dispatch(events);
 				return { expected_error, AllocateException{ res } };
 			}
 #if VUK_DEBUG_ALLOCATIONS
 			vmaSetAllocationName(impl->allocator, allocation, to_string(loc).c_str());
 #endif
+			impl->track_allocation(allocation, allocation_info, ci.mem_usage, loc);
+			impl->check_budgets(events);
 			VkBufferDeviceAddressInfo bdai{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, buffer };
 			uint64_t device_address = ctx->vkGetBufferDeviceAddress(device, &bdai);
 			dst[i] = Buffer{ allocation, buffer, 0, ci.size, device_address, static_cast<std::byte*>(allocation_info.pMappedData), ci.mem_usage };
 		}
+		DeviceVkResourceImpl::dispatch(events);
 		return { expected_value };
 	}
 
 	void DeviceVkResource::deallocate_buffers(std::span<const Buffer> src) {
-		for (auto& v : src) {
-			if (v) {
-				vmaDestroyBuffer(impl->allocator, v.buffer, static_cast<VmaAllocation>(v.allocation));
+		std::vector<BudgetEvent> events;
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				if (v) {
+					impl->untrack_allocation(static_cast<VmaAllocation>(v.allocation));
+					vmaDestroyBuffer(impl->allocator, v.buffer, static_cast<VmaAllocation>(v.allocation));
+				}
 			}
+			impl->check_budgets(events);
 		}
+		DeviceVkResourceImpl::dispatch(events);
 	}
 
 	Result<void, AllocateException> DeviceVkResource::allocate_images(std::span<Image> dst, std::span<const ImageCreateInfo> cis, SourceLocationAtFrame loc) {
 		assert(dst.size() == cis.size());
+		std::vector<BudgetEvent> events;
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
-			std::lock_guard _(impl->mutex);
+			std::unique_lock _(impl->mutex);
 			VmaAllocationCreateInfo aci{};
 			aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
 			VkImage vkimg;
 			VmaAllocation allocation;
 			VkImageCreateInfo vkici = cis[i];
+			// concurrent images without explicit queue families are shared by all of them, like buffers
+			if (vkici.sharingMode == VK_SHARING_MODE_CONCURRENT && vkici.queueFamilyIndexCount == 0) {
+				if (impl->queue_family_count > 1) {
+					vkici.queueFamilyIndexCount = impl->queue_family_count;
+					vkici.pQueueFamilyIndices = impl->all_queue_families.data();
+				} else {
+					vkici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				}
+			}
 			if (cis[i].usage & (vuk::ImageUsageFlagBits::eColorAttachment | vuk::ImageUsageFlagBits::eDepthStencilAttachment)) {
 				// this is a rendertarget, put it into the dedicated memory
 				aci.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
 			}
 
-			auto res = vmaCreateImage(impl->allocator, &vkici, &aci, &vkimg, &allocation, nullptr);
+			VmaAllocationInfo allocation_info;
+			auto res = vmaCreateImage(impl->allocator, &vkici, &aci, &vkimg, &allocation, &allocation_info);
 
 			if (res != VK_SUCCESS) {
+				_.unlock();
 				deallocate_images({ dst.data(), (uint64_t)i });
+				DeviceVkResourceImpl::dispatch(events);
 				return { expected_error, AllocateException{ res } };
 			}
 #if VUK_DEBUG_ALLOCATIONS
 			vmaSetAllocationName(impl->allocator, allocation, to_string(loc).c_str());
 #endif
+			impl->track_allocation(allocation, allocation_info, MemoryUsage::eGPUonly, loc);
+			impl->check_budgets(events);
 
 			dst[i] = Image{ vkimg, allocation };
 		}
+		ctx->get_frame_stat_counters().images_created += dst.size();
+		DeviceVkResourceImpl::dispatch(events);
 		return { expected_value };
 	}
 
 	void DeviceVkResource::deallocate_images(std::span<const Image> src) {
-		for (auto& v : src) {
-			if (v) {
-				vmaDestroyImage(impl->allocator, v.image, static_cast<VmaAllocation>(v.allocation));
+		std::vector<BudgetEvent> events;
+		{
+			std::lock_guard _(impl->mutex);
+			for (auto& v : src) {
+				if (v) {
+					impl->untrack_allocation(static_cast<VmaAllocation>(v.allocation));
+					vmaDestroyImage(impl->allocator, v.image, static_cast<VmaAllocation>(v.allocation));
+				}
 			}
+			impl->check_budgets(events);
+		}
+		DeviceVkResourceImpl::dispatch(events);
+	}
+
+	MemoryStatsSnapshot DeviceVkResource::get_memory_stats() {
+		std::lock_guard _(impl->mutex);
+		MemoryStatsSnapshot snapshot;
+		std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+		vmaGetHeapBudgets(impl->allocator, budgets.data());
+		for (uint32_t i = 0; i < impl->memory_properties.memoryHeapCount; i++) {
+			snapshot.heaps.push_back(impl->get_heap_stats(i, budgets[i]));
+		}
+		snapshot.usages = impl->usages;
+		snapshot.sites.reserve(impl->sites.size());
+		for (auto& [site, site_stats] : impl->sites) {
+			snapshot.sites.push_back(site_stats);
+		}
+		std::sort(snapshot.sites.begin(), snapshot.sites.end(), [](auto& a, auto& b) { return a.stats.bytes > b.stats.bytes; });
+		return snapshot;
+	}
+
+	uint64_t DeviceVkResource::add_memory_budget_callback(float threshold, MemoryBudgetCallback callback) {
+		std::lock_guard _(impl->mutex);
+		auto id = impl->next_budget_callback_id++;
+		impl->budget_callbacks.push_back(BudgetCallback{ id, threshold, std::move(callback) });
+		return id;
+	}
+
+	void DeviceVkResource::remove_memory_budget_callback(uint64_t id) {
+		std::lock_guard _(impl->mutex);
+		std::erase_if(impl->budget_callbacks, [=](auto& cb) { return cb.id == id; });
+	}
+
+	void DeviceVkResource::update_memory_budget(uint64_t absolute_frame) {
+		std::vector<BudgetEvent> events;
+		{
+			std::lock_guard _(impl->mutex);
+			// changing the frame index makes VMA fetch the budget from the driver
+			vmaSetCurrentFrameIndex(impl->allocator, (uint32_t)absolute_frame);
+			impl->check_budgets(events);
 		}
+		DeviceVkResourceImpl::dispatch(events);
 	}
 
 	Result<void, AllocateException>
@@ -311,6 +513,7 @@ namespace vuk {
 			}
 			dst[i] = ctx->wrap(iv);
 		}
+		ctx->get_frame_stat_counters().image_views_created += dst.size();
 		return { expected_value };
 	}
 
@@ -382,6 +585,7 @@ namespace vuk {
 			tda.set_layout_create_info = ci.dslci;
 			tda.set_layout = dsl;
 		}
+		ctx->get_frame_stat_counters().descriptor_sets_allocated += dst.size();
 
 		return { expected_value };
 	}
@@ -396,6 +600,7 @@ namespace vuk {
 	DeviceVkResource::allocate_descriptor_sets_with_value(std::span<DescriptorSet> dst, std::span<const SetBinding> cis, SourceLocationAtFrame loc) {
 		assert(dst.size() == cis.size());
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
+			VUK_ZONE(ctx->get_instrumentation_callbacks(), "Descriptor set write");
 			auto& cinfo = cis[i];
 			auto& pool = ctx->acquire_descriptor_pool(*cinfo.layout_info, ctx->get_frame_count());
 			auto ds = pool.acquire(*ctx, *cinfo.layout_info);
@@ -421,6 +626,8 @@ namespace vuk {
 				switch (binding.type) {
 				case DescriptorType::eUniformBuffer:
 				case DescriptorType::eStorageBuffer:
+				case DescriptorType::eUniformBufferDynamic:
+				case DescriptorType::eStorageBufferDynamic:
 					write.pBufferInfo = &binding.buffer;
 					break;
 				case DescriptorType::eSampledImage:
@@ -442,6 +649,9 @@ namespace vuk {
 			ctx->vkUpdateDescriptorSets(device, j, writes.data(), 0, nullptr);
 			dst[i] = { ds, *cinfo.layout_info };
 		}
+		auto& stats = ctx->get_frame_stat_counters();
+		stats.descriptor_sets_allocated += dst.size();
+		stats.descriptor_sets_written += dst.size();
 		return { expected_value };
 	}
 
@@ -453,6 +663,7 @@ namespace vuk {
 			auto& pool = ctx->acquire_descriptor_pool(cinfo, ctx->get_frame_count());
 			dst[i] = { pool.acquire(*ctx, cinfo), cinfo };
 		}
+		ctx->get_frame_stat_counters().descriptor_sets_allocated += dst.size();
 		return { expected_value };
 	}
 
@@ -601,6 +812,7 @@ namespace vuk {
 		assert(dst.size() == cis.size());
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
 			GraphicsPipelineInstanceCreateInfo cinfo = cis[i];
+			VUK_ZONE_DETAIL(ctx->get_instrumentation_callbacks(), "Graphics pipeline creation", cinfo.base->pipeline_name.c_str());
 			// create gfx pipeline
 			VkGraphicsPipelineCreateInfo gpci{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
 			gpci.renderPass = cinfo.render_pass;
@@ -872,6 +1084,7 @@ namespace vuk {
 			ctx->set_name(pipeline, cinfo.base->pipeline_name);
 			dst[i] = { cinfo.base, pipeline, gpci.layout, cinfo.base->layout_info };
 		}
+		ctx->get_frame_stat_counters().pipelines_created += dst.size();
 
 		return { expected_value };
 	}
@@ -887,6 +1100,7 @@ namespace vuk {
 		assert(dst.size() == cis.size());
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
 			ComputePipelineInstanceCreateInfo cinfo = cis[i];
+			VUK_ZONE_DETAIL(ctx->get_instrumentation_callbacks(), "Compute pipeline creation", cinfo.base->pipeline_name.c_str());
 			// create compute pipeline
 			VkComputePipelineCreateInfo cpci{ .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
 			cpci.layout = cinfo.base->pipeline_layout;
@@ -902,6 +1116,7 @@ namespace vuk {
 			ctx->set_name(pipeline, cinfo.base->pipeline_name);
 			dst[i] = { { cinfo.base, pipeline, cpci.layout, cinfo.base->layout_info }, cinfo.base->reflection_info.local_size };
 		}
+		ctx->get_frame_stat_counters().pipelines_created += dst.size();
 
 		return { expected_value };
 	}
@@ -918,6 +1133,7 @@ namespace vuk {
 		assert(dst.size() == cis.size());
 		for (int64_t i = 0; i < (int64_t)dst.size(); i++) {
 			RayTracingPipelineInstanceCreateInfo cinfo = cis[i];
+			VUK_ZONE_DETAIL(ctx->get_instrumentation_callbacks(), "Ray tracing pipeline creation", cinfo.base->pipeline_name.c_str());
 			// create ray tracing pipeline
 			VkRayTracingPipelineCreateInfoKHR cpci{ .sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR };
 			cpci.layout = cinfo.base->pipeline_layout;
@@ -1045,6 +1261,7 @@ namespace vuk {
 			ctx->set_name(pipeline, cinfo.base->pipeline_name);
 			dst[i] = { { cinfo.base, pipeline, cpci.layout, cinfo.base->layout_info }, rgen_region, miss_region, hit_region, call_region, SBT };
 		}
+		ctx->get_frame_stat_counters().pipelines_created += dst.size();
 
 		return { expected_value };
 	}
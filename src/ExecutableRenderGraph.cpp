@@ -2,11 +2,16 @@
 #include "RenderGraphImpl.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/CommandBuffer.hpp"
+#include "vuk/CommandStream.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/Future.hpp"
 #include "vuk/Hash.hpp" // for create
+#include "vuk/Instrumentation.hpp"
+#include "vuk/Query.hpp"
 #include "vuk/RenderGraph.hpp"
 #include "vuk/Util.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
 
 #include <sstream>
 #include <unordered_set>
@@ -32,6 +37,27 @@ namespace vuk {
 		ctx.vkCmdBeginRenderPass(cbuf, &rbi, use_secondary_command_buffers ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 	}
 
+	// commands kept for a pass with a content key are looked up with the key and everything the commands can refer to through the render graph
+	RecordedPassKey recorded_pass_key(RGCImpl& impl, PassInfo& pass) {
+		RecordedPassKey key{ pass.pass->content_key, pass.qualified_name, (uint32_t)pass.domain.m_mask };
+		auto& objects = key.objects;
+		for (auto& r : pass.resources.to_span(impl.resources)) {
+			if (r.type == Resource::Type::eBuffer) {
+				auto& buffer = impl.get_bound_buffer(r.reference).buffer;
+				objects.insert(objects.end(), { (uint64_t)buffer.buffer, buffer.offset, buffer.size });
+			} else {
+				auto& ia = impl.get_bound_attachment(r.reference).attachment;
+				objects.insert(objects.end(), { (uint64_t)ia.image.image, (uint64_t)ia.image_view.payload, (uint64_t)r.promoted_to_general });
+			}
+		}
+		// the commands only need a compatible render pass - the framebuffer is allocated anew every frame
+		if (pass.render_pass_index >= 0) {
+			auto& rpass = impl.rpis[pass.render_pass_index];
+			objects.insert(objects.end(), { (uint64_t)rpass.handle, (uint64_t)pass.subpass, (uint64_t)rpass.fbci.width, (uint64_t)rpass.fbci.height });
+		}
+		return key;
+	}
+
 	[[nodiscard]] bool resolve_image_barrier(const Context& ctx, VkImageMemoryBarrier2KHR& dep, const AttachmentInfo& bound, vuk::DomainFlagBits current_domain) {
 		dep.image = bound.attachment.image.image;
 		// turn base_{layer, level} into absolute values wrt the image
@@ -48,7 +74,7 @@ namespace vuk {
 				dep.subresourceRange.layerCount = static_cast<uint32_t>(count);
 			}
 		} else {
-			if (dep.subresourceRange.baseArrayLayer > bound.attachment.base_layer + bound.attachment.layer_count) {
+			if (dep.subresourceRange.baseArrayLayer >= bound.attachment.base_layer + bound.attachment.layer_count) {
 				return false;
 			}
 		}
@@ -61,12 +87,16 @@ namespace vuk {
 				dep.subresourceRange.levelCount = static_cast<uint32_t>(count);
 			}
 		} else {
-			if (dep.subresourceRange.baseMipLevel > bound.attachment.base_level + bound.attachment.level_count) {
+			if (dep.subresourceRange.baseMipLevel >= bound.attachment.base_level + bound.attachment.level_count) {
 				return false;
 			}
 		}
 
-		if (dep.srcQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
+		if (bound.attachment.sharing_mode == SharingMode::eConcurrent) {
+			// no ownership to transfer - the semaphore wait orders the queues
+			dep.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			dep.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		} else if (dep.srcQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED) {
 			assert(dep.dstQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED);
 			bool transition = dep.dstQueueFamilyIndex != dep.srcQueueFamilyIndex;
 			auto src_domain = static_cast<vuk::DomainFlagBits>(dep.srcQueueFamilyIndex);
@@ -90,6 +120,7 @@ namespace vuk {
 		}
 		vuk::CommandBuffer::RenderPassInfo rpi;
 		rpi.render_pass = rpass.handle;
+		rpi.framebuffer = rpass.framebuffer;
 		rpi.subpass = (uint32_t)i;
 		rpi.extent = vuk::Extent2D{ rpass.fbci.width, rpass.fbci.height };
 		auto& spdesc = rpass.rpci.subpass_descriptions[i];
@@ -108,6 +139,7 @@ namespace vuk {
 	                            VkCommandBuffer cbuf,
 	                            vuk::DomainFlagBits domain,
 	                            RelSpan<VkMemoryBarrier2KHR> mem_bars,
+	                            RelSpan<VkBufferMemoryBarrier2KHR> buf_bars,
 	                            RelSpan<VkImageMemoryBarrier2KHR> im_bars) {
 		// resolve and compact image barriers in place
 		auto im_span = im_bars.to_span(image_barriers);
@@ -131,23 +163,80 @@ namespace vuk {
 			im_span[imbar_dst_index++] = dep;
 		}
 
+		// resolve and compact buffer barriers in place - ranges are relative to the bound buffer
+		auto buf_span = buf_bars.to_span(buffer_barriers);
+
+		uint32_t bufbar_dst_index = 0;
+		for (auto src_index = 0; src_index < buf_bars.size(); src_index++) {
+			auto dep = buf_span[src_index];
+			int32_t bound_idx;
+			std::memcpy(&bound_idx, &dep.pNext, sizeof(bound_idx));
+			dep.pNext = 0;
+			auto& bound = get_bound_buffer(bound_idx).buffer;
+			if (dep.offset >= bound.size) {
+				continue;
+			}
+			dep.buffer = bound.buffer;
+			dep.size = std::min(dep.size, bound.size - dep.offset);
+			dep.offset += bound.offset;
+			buf_span[bufbar_dst_index++] = dep;
+		}
+
 		auto mem_span = mem_bars.to_span(mem_barriers);
 
 		VkDependencyInfoKHR dependency_info{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
 			                                   .memoryBarrierCount = (uint32_t)mem_span.size(),
 			                                   .pMemoryBarriers = mem_span.data(),
+			                                   .bufferMemoryBarrierCount = bufbar_dst_index,
+			                                   .pBufferMemoryBarriers = buf_span.data(),
 			                                   .imageMemoryBarrierCount = imbar_dst_index,
 			                                   .pImageMemoryBarriers = im_span.data() };
 
-		if (mem_bars.size() > 0 || imbar_dst_index > 0) {
+		if (mem_bars.size() > 0 || bufbar_dst_index > 0 || imbar_dst_index > 0) {
 			ctx.vkCmdPipelineBarrier2KHR(cbuf, &dependency_info);
+			auto& stats = ctx.get_frame_stat_counters();
+			stats.image_barriers += imbar_dst_index;
+			stats.buffer_barriers += bufbar_dst_index;
+			stats.memory_barriers += mem_span.size();
 		}
 	}
 
+	namespace {
+		// pass statistics query pools used while recording a submit, handed back to the Context when recording ends
+		struct PassStatisticsQueries {
+			Context& ctx;
+			VkQueryPipelineStatisticFlags statistic_flags = 0;
+			std::vector<PassStatisticsQueryPool> pools;
+			bool recorded = false;
+
+			~PassStatisticsQueries() {
+				for (auto& pool : pools) {
+					ctx.release_pass_statistics_query_pool(std::move(pool), recorded);
+				}
+			}
+		};
+	} // namespace
+
 	Result<SubmitInfo> ExecutableRenderGraph::record_single_submit(Allocator& alloc, std::span<PassInfo*> passes, vuk::DomainFlagBits domain) {
 		assert(passes.size() > 0);
 
 		auto& ctx = alloc.get_context();
+		VUK_ZONE(ctx.get_instrumentation_callbacks(), "Record submit");
+		// while a trace is captured, we time every pass on the GPU
+		TraceRecorder* recorder = ctx.get_trace_recorder();
+		auto& stats = ctx.get_frame_stat_counters();
+		// when enabled, we count the work of every pass with pipeline statistics queries
+		// graphics statistics can't be queried on compute queues, and transfers have no statistics
+		PassStatisticsQueries statistic_queries{ ctx };
+		if (ctx.pass_statistics_enabled()) {
+			if (domain == DomainFlagBits::eGraphicsQueue) {
+				statistic_queries.statistic_flags = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+				                                    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+				                                    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+			} else if (domain == DomainFlagBits::eComputeQueue) {
+				statistic_queries.statistic_flags = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+			}
+		}
 		SubmitInfo si;
 
 		Unique<CommandPool> cpool(alloc);
@@ -171,8 +260,12 @@ namespace vuk {
 
 		uint64_t command_buffer_index = passes[0]->command_buffer_index;
 		int32_t render_pass_index = -1;
+		bool secondary_contents = false;
+		RecordedPass recording;
 		for (size_t i = 0; i < passes.size(); i++) {
 			auto& pass = passes[i];
+			stats.passes_recorded += 1;
+			VUK_ZONE_DETAIL(ctx.get_instrumentation_callbacks(), "Record pass", pass->qualified_name.is_invalid() ? nullptr : pass->qualified_name.name.c_str());
 
 			for (auto& ref : pass->referenced_swapchains.to_span(impl->swapchain_references)) {
 				used_swapchains.emplace(impl->get_bound_attachment(ref).swapchain);
@@ -199,14 +292,20 @@ namespace vuk {
 
 			if (i > 1) {
 				// insert post-barriers
-				impl->emit_barriers(ctx, cbuf, domain, passes[i - 1]->post_memory_barriers, passes[i - 1]->post_image_barriers);
+				impl->emit_barriers(ctx, cbuf, domain, passes[i - 1]->post_memory_barriers, passes[i - 1]->post_buffer_barriers, passes[i - 1]->post_image_barriers);
 			}
 			// insert pre-barriers
-			impl->emit_barriers(ctx, cbuf, domain, pass->pre_memory_barriers, pass->pre_image_barriers);
+			impl->emit_barriers(ctx, cbuf, domain, pass->pre_memory_barriers, pass->pre_buffer_barriers, pass->pre_image_barriers);
 
 			// if render pass is changing and new pass uses one
 			if (pass->render_pass_index != render_pass_index && pass->render_pass_index != -1) {
-				begin_render_pass(ctx, impl->rpis[pass->render_pass_index], cbuf, false);
+				// the render pass is recorded into secondary command buffers if any of its passes asks for them
+				secondary_contents = false;
+				for (size_t j = i; j < passes.size() && passes[j]->render_pass_index == pass->render_pass_index; j++) {
+					secondary_contents |= passes[j]->pass->use_secondary_command_buffers;
+				}
+				begin_render_pass(ctx, impl->rpis[pass->render_pass_index], cbuf, secondary_contents);
+				stats.render_passes += 1;
 			}
 
 			render_pass_index = pass->render_pass_index;
@@ -220,11 +319,16 @@ namespace vuk {
 			}
 
 			CommandBuffer cobuf(*this, ctx, alloc, cbuf);
+			cobuf.command_pool = *cpool;
 			if (render_pass_index >= 0) {
 				fill_render_pass_info(impl->rpis[pass->render_pass_index], 0, cobuf);
 			} else {
 				cobuf.ongoing_render_pass = {};
 			}
+			bool record_secondary = render_pass_index >= 0 && secondary_contents;
+			if (record_secondary) {
+				VUK_DO_OR_RETURN(cobuf._record_into_secondary());
+			}
 
 			// propagate signals onto SI
 			auto pass_fut_signals = pass->future_signals.to_span(impl->future_signals);
@@ -233,9 +337,78 @@ namespace vuk {
 			if (!pass->qualified_name.is_invalid()) {
 				ctx.begin_region(cobuf.command_buffer, pass->qualified_name.name);
 			}
+			PassTimestamps timestamps;
+			if (recorder) {
+				timestamps = { pass->qualified_name.name, ctx.create_timestamp_query(), ctx.create_timestamp_query() };
+				cobuf.write_timestamp(timestamps.begin, PipelineStageFlagBits::eTopOfPipe);
+			}
+			PassStatisticsQueryPool* query_pool = nullptr;
+			uint32_t query_index = 0;
+			// queries can't be begun in a subpass with secondary command buffer contents
+			if (statistic_queries.statistic_flags != 0 && !record_secondary) {
+				auto& pools = statistic_queries.pools;
+				if (pools.empty() || pools.back().count == PassStatisticsQueryPool::num_queries) {
+					pools.push_back(ctx.acquire_pass_statistics_query_pool(statistic_queries.statistic_flags));
+					pools.back().absolute_frame = ctx.get_frame_count();
+				}
+				if (pools.back().statistics != VK_NULL_HANDLE) {
+					query_pool = &pools.back();
+					query_index = query_pool->count++;
+					query_pool->passes[query_index] = pass->qualified_name.name;
+					// occlusion queries must begin and end within a subpass
+					query_pool->occlusion_used[query_index] = render_pass_index >= 0;
+					ctx.vkCmdBeginQuery(cbuf, query_pool->statistics, query_index, 0);
+					if (query_pool->occlusion_used[query_index]) {
+						ctx.vkCmdBeginQuery(cbuf, query_pool->occlusion, query_index, 0);
+					}
+					cobuf.statistics_query_pool = query_pool;
+					cobuf.statistics_query_index = query_index;
+				}
+			}
 			if (pass->pass->execute) {
 				cobuf.current_pass = pass;
-				pass->pass->execute(cobuf);
+				// passes with a content key replay the commands kept from an earlier frame, if the key and resources are unchanged
+				bool replayable = pass->pass->content_key != 0 && !record_secondary;
+				RecordedPassKey recorded_key = replayable ? recorded_pass_key(*impl, *pass) : RecordedPassKey{};
+				std::shared_ptr<const RecordedPass> recorded = replayable ? ctx.acquire_recorded_pass(recorded_key) : nullptr;
+				// acquiring the pipelines again keeps them in the caches while the recording is replayed - if one was recreated, the pass is recorded again
+				if (recorded && !recorded->acquire_pipelines(alloc)) {
+					recorded = nullptr;
+				}
+				if (recorded) {
+					recorded->stream.translate(ctx, cobuf.command_buffer);
+					stats.passes_replayed += 1;
+				} else {
+					// passes recorded for replaying are streamed, and translated into the command buffer once they return
+					if (replayable) {
+						cobuf._begin_recording(recording);
+					}
+					pass->pass->execute(cobuf);
+					// children that were not joined by the pass execute at its end
+					cobuf.join();
+					cobuf._flush_draws();
+					if (replayable) {
+						cobuf._end_stream();
+						if (cobuf.replayable && cobuf.current_error) {
+							ctx.store_recorded_pass(recorded_key, std::move(recording));
+						} else {
+							ctx.discard_recorded_pass(std::move(recording));
+						}
+					}
+					stats.redundant_binds_elided += cobuf.get_elided_call_count();
+				}
+			}
+			// the query was already ended if the pass forked
+			if (cobuf.statistics_query_pool) {
+				if (query_pool->occlusion_used[query_index]) {
+					ctx.vkCmdEndQuery(cbuf, query_pool->occlusion, query_index);
+				}
+				ctx.vkCmdEndQuery(cbuf, query_pool->statistics, query_index);
+				cobuf.statistics_query_pool = nullptr;
+			}
+			if (recorder) {
+				cobuf.write_timestamp(timestamps.end, PipelineStageFlagBits::eBottomOfPipe);
+				si.pass_timestamps.push_back(timestamps);
 			}
 			if (!pass->qualified_name.is_invalid()) {
 				ctx.end_region(cobuf.command_buffer);
@@ -244,6 +417,12 @@ namespace vuk {
 			if (auto res = cobuf.result(); !res) {
 				return res;
 			}
+			if (record_secondary) {
+				VUK_DO_OR_RETURN(cobuf._execute_secondary());
+			}
+			if (pass->memoization_hash != 0) {
+				impl->memoized_passes[pass->qualified_name] = pass->memoization_hash;
+			}
 		}
 
 		if (render_pass_index != -1) {
@@ -251,11 +430,12 @@ namespace vuk {
 		}
 
 		// insert post-barriers
-		impl->emit_barriers(ctx, cbuf, domain, passes.back()->post_memory_barriers, passes.back()->post_image_barriers);
+		impl->emit_barriers(ctx, cbuf, domain, passes.back()->post_memory_barriers, passes.back()->post_buffer_barriers, passes.back()->post_image_barriers);
 
 		if (auto result = ctx.vkEndCommandBuffer(cbuf); result != VK_SUCCESS) {
 			return { expected_error, VkException{ result } };
 		}
+		statistic_queries.recorded = true;
 
 		si.used_swapchains.insert(si.used_swapchains.end(), used_swapchains.begin(), used_swapchains.end());
 
@@ -264,6 +444,7 @@ namespace vuk {
 
 	Result<SubmitBundle> ExecutableRenderGraph::execute(Allocator& alloc, std::vector<std::pair<SwapchainRef, size_t>> swp_with_index) {
 		Context& ctx = alloc.get_context();
+		ctx.get_frame_stat_counters().passes_compiled += impl->stats.passes;
 
 		// bind swapchain attachment images & ivs
 		for (auto& bound : impl->bound_attachments) {
@@ -797,6 +978,22 @@ namespace vuk {
 			sbundle.batches.emplace_back(std::move(*batch));
 		}
 
+		// carry the final uses of history images over to the next execution, then rotate the histories
+		// the queue is carried over too: the next execution must use the images on the same queue, as it has nothing to wait on for a transfer
+		for (auto& attachment_info : impl->bound_attachments) {
+			if (attachment_info.history) {
+				auto& history = *attachment_info.history;
+				std::scoped_lock _(history.mutex);
+				history.last_uses[history.slot(attachment_info.history_age)] = attachment_info.final_use;
+			}
+		}
+		for (auto& attachment_info : impl->bound_attachments) {
+			if (attachment_info.history && attachment_info.history_age == 0) {
+				std::scoped_lock _(attachment_info.history->mutex);
+				attachment_info.history->executions++;
+			}
+		}
+
 		return { expected_value, std::move(sbundle) };
 	}
 
@@ -835,6 +1032,27 @@ namespace vuk {
 		return { expected_error, errors::make_cbuf_references_undeclared_resource(*pass_info, Resource::Type::eImage, name_ref.name.name) };
 	}
 
+	bool ExecutableRenderGraph::is_resource_buffer(const Buffer& buffer, PassInfo* pass_info) {
+		for (auto& r : pass_info->resources.to_span(impl->resources)) {
+			if (r.type == Resource::Type::eBuffer) {
+				auto& bound = impl->get_bound_buffer(r.reference).buffer;
+				if (bound.buffer == buffer.buffer && buffer.offset >= bound.offset && buffer.offset + buffer.size <= bound.offset + bound.size) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool ExecutableRenderGraph::is_resource_image_view(ImageView image_view, PassInfo* pass_info) {
+		for (auto& r : pass_info->resources.to_span(impl->resources)) {
+			if (r.type == Resource::Type::eImage && impl->get_bound_attachment(r.reference).attachment.image_view.payload == image_view.payload) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	QualifiedName ExecutableRenderGraph::resolve_name(Name name, PassInfo* pass_info) const noexcept {
 		auto qualified_name = QualifiedName{ pass_info->qualified_name.prefix, name };
 		return impl->resolve_name(qualified_name);
@@ -0,0 +1,869 @@
+#include "vuk/NullDevice.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace vuk {
+	struct NullDeviceImpl;
+
+	namespace {
+		struct NullMemory {
+			std::byte* data;
+			VkDeviceSize size;
+			VkDeviceAddress address;
+		};
+
+		struct NullBuffer {
+			VkDeviceSize size;
+			NullMemory* memory = nullptr;
+			VkDeviceSize offset = 0;
+
+			std::byte* data() const {
+				return memory ? memory->data + offset : nullptr;
+			}
+		};
+
+		struct NullImage {
+			VkDeviceSize size;
+		};
+
+		struct NullDescriptorPool {
+			uint32_t max_sets;
+			uint32_t allocated = 0;
+		};
+
+		struct NullCommandPool;
+
+		struct NullCommandBuffer {
+			NullDeviceImpl* device;
+			NullCommandPool* pool;
+			/// @brief Commands that have an effect observable on the host, carried out on submission
+			std::vector<std::function<void()>> deferred;
+
+			uint64_t commands = 0;
+			uint64_t draws = 0;
+			uint64_t dispatches = 0;
+			uint64_t barriers = 0;
+
+			void reset() {
+				deferred.clear();
+				commands = draws = dispatches = barriers = 0;
+			}
+		};
+
+		struct NullCommandPool {
+			std::vector<NullCommandBuffer*> command_buffers;
+		};
+
+		struct NullQueue {
+			NullDeviceImpl* device;
+		};
+	} // namespace
+
+	struct NullDeviceImpl {
+		VkPhysicalDeviceProperties properties = {};
+		VkPhysicalDeviceMemoryProperties memory_properties = {};
+		std::array<NullQueue, 3> queues;
+
+		std::atomic<uint64_t> next_handle = 1;
+		std::atomic<VkDeviceAddress> next_device_address = 1ull << 32;
+
+		std::atomic<uint64_t> submits = 0;
+		std::atomic<uint64_t> command_buffers_submitted = 0;
+		std::atomic<uint64_t> commands = 0;
+		std::atomic<uint64_t> draws = 0;
+		std::atomic<uint64_t> dispatches = 0;
+		std::atomic<uint64_t> barriers = 0;
+		std::atomic<uint64_t> pipelines_created = 0;
+		std::atomic<uint64_t> descriptor_sets_allocated = 0;
+		std::atomic<uint64_t> descriptor_writes = 0;
+		std::atomic<uint64_t> device_memory_bytes = 0;
+
+		NullDeviceImpl() {
+			for (auto& q : queues) {
+				q.device = this;
+			}
+
+			properties.apiVersion = VK_API_VERSION_1_2;
+			properties.deviceType = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+			strncpy(properties.deviceName, "vuk null device", VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1);
+			auto& limits = properties.limits;
+			limits.maxImageDimension1D = 16384;
+			limits.maxImageDimension2D = 16384;
+			limits.maxImageDimension3D = 2048;
+			limits.maxImageDimensionCube = 16384;
+			limits.maxImageArrayLayers = 2048;
+			limits.maxUniformBufferRange = 65536;
+			limits.maxStorageBufferRange = 1u << 30;
+			limits.maxPushConstantsSize = 256;
+			limits.maxMemoryAllocationCount = 4096;
+			limits.maxSamplerAllocationCount = 4000;
+			limits.bufferImageGranularity = 1;
+			limits.maxBoundDescriptorSets = 8;
+			limits.maxPerStageResources = 1u << 20;
+			limits.maxDescriptorSetSamplers = 1u << 20;
+			limits.maxDescriptorSetUniformBuffers = 1u << 20;
+			limits.maxDescriptorSetStorageBuffers = 1u << 20;
+			limits.maxDescriptorSetSampledImages = 1u << 20;
+			limits.maxDescriptorSetStorageImages = 1u << 20;
+			limits.maxVertexInputAttributes = 32;
+			limits.maxVertexInputBindings = 32;
+			limits.maxColorAttachments = 8;
+			limits.maxComputeWorkGroupCount[0] = limits.maxComputeWorkGroupCount[1] = limits.maxComputeWorkGroupCount[2] = 65535;
+			limits.maxComputeWorkGroupInvocations = 1024;
+			limits.maxComputeWorkGroupSize[0] = 1024;
+			limits.maxComputeWorkGroupSize[1] = 1024;
+			limits.maxComputeWorkGroupSize[2] = 64;
+			limits.maxSamplerAnisotropy = 16.f;
+			limits.maxViewports = 16;
+			limits.maxViewportDimensions[0] = limits.maxViewportDimensions[1] = 16384;
+			limits.maxFramebufferWidth = limits.maxFramebufferHeight = 16384;
+			limits.maxFramebufferLayers = 2048;
+			limits.framebufferColorSampleCounts = limits.framebufferDepthSampleCounts = limits.sampledImageColorSampleCounts =
+			    VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_2_BIT | VK_SAMPLE_COUNT_4_BIT | VK_SAMPLE_COUNT_8_BIT;
+			limits.minMemoryMapAlignment = 64;
+			limits.minTexelBufferOffsetAlignment = 16;
+			limits.minUniformBufferOffsetAlignment = 256;
+			limits.minStorageBufferOffsetAlignment = 64;
+			limits.optimalBufferCopyOffsetAlignment = 1;
+			limits.optimalBufferCopyRowPitchAlignment = 1;
+			limits.nonCoherentAtomSize = 64;
+			limits.timestampComputeAndGraphics = VK_TRUE;
+			limits.timestampPeriod = 1.f;
+
+			// a discrete GPU: device local VRAM and host memory
+			memory_properties.memoryHeapCount = 2;
+			memory_properties.memoryHeaps[0] = { 8ull << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+			memory_properties.memoryHeaps[1] = { 16ull << 30, 0 };
+			memory_properties.memoryTypeCount = 3;
+			memory_properties.memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+			memory_properties.memoryTypes[1] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+			memory_properties.memoryTypes[2] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+		}
+
+		template<class T>
+		T make_handle() {
+			uint64_t id = next_handle.fetch_add(1, std::memory_order_relaxed);
+			if constexpr (std::is_pointer_v<T>) {
+				return reinterpret_cast<T>(static_cast<uintptr_t>(id));
+			} else {
+				return static_cast<T>(id);
+			}
+		}
+
+		template<class T>
+		void make_handles(T* dst, uint32_t count) {
+			for (uint32_t i = 0; i < count; i++) {
+				dst[i] = make_handle<T>();
+			}
+		}
+	};
+
+	namespace {
+		// dispatchable handles all point to the NullDeviceImpl, non-dispatchable handles either carry a counter value or point to the backing object
+
+		NullDeviceImpl* device_of(VkDevice device) {
+			return reinterpret_cast<NullDeviceImpl*>(device);
+		}
+
+		NullDeviceImpl* device_of(VkPhysicalDevice physical_device) {
+			return reinterpret_cast<NullDeviceImpl*>(physical_device);
+		}
+
+		NullCommandBuffer* from_handle(VkCommandBuffer cb) {
+			return reinterpret_cast<NullCommandBuffer*>(cb);
+		}
+
+		template<class T, class H>
+		T* from_handle(H handle) {
+			if constexpr (std::is_pointer_v<H>) {
+				return reinterpret_cast<T*>(handle);
+			} else {
+				return reinterpret_cast<T*>(static_cast<uintptr_t>(handle));
+			}
+		}
+
+		template<class H, class T>
+		H to_handle(T* object) {
+			if constexpr (std::is_pointer_v<H>) {
+				return reinterpret_cast<H>(object);
+			} else {
+				return static_cast<H>(reinterpret_cast<uintptr_t>(object));
+			}
+		}
+
+		void count(VkCommandBuffer cb) {
+			from_handle(cb)->commands++;
+		}
+
+		VkDeviceSize image_size(const VkImageCreateInfo& ci) {
+			VkDeviceSize size = 0;
+			for (uint32_t level = 0; level < ci.mipLevels; level++) {
+				Extent3D extent{ std::max(ci.extent.width >> level, 1u), std::max(ci.extent.height >> level, 1u), std::max(ci.extent.depth >> level, 1u) };
+				size += compute_image_size((Format)ci.format, extent);
+			}
+			return size * ci.arrayLayers * (uint32_t)ci.samples;
+		}
+
+		// commands
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBindDescriptorSets(VkCommandBuffer cb,
+		                                                        VkPipelineBindPoint,
+		                                                        VkPipelineLayout,
+		                                                        uint32_t,
+		                                                        uint32_t,
+		                                                        const VkDescriptorSet*,
+		                                                        uint32_t,
+		                                                        const uint32_t*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBindIndexBuffer(VkCommandBuffer cb, VkBuffer, VkDeviceSize, VkIndexType) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBindPipeline(VkCommandBuffer cb, VkPipelineBindPoint, VkPipeline) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBindVertexBuffers(VkCommandBuffer cb, uint32_t, uint32_t, const VkBuffer*, const VkDeviceSize*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBlitImage(VkCommandBuffer cb, VkImage, VkImageLayout, VkImage, VkImageLayout, uint32_t, const VkImageBlit*, VkFilter) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		null_vkCmdClearColorImage(VkCommandBuffer cb, VkImage, VkImageLayout, const VkClearColorValue*, uint32_t, const VkImageSubresourceRange*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		null_vkCmdClearDepthStencilImage(VkCommandBuffer cb, VkImage, VkImageLayout, const VkClearDepthStencilValue*, uint32_t, const VkImageSubresourceRange*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdCopyBuffer(VkCommandBuffer cb, VkBuffer src, VkBuffer dst, uint32_t region_count, const VkBufferCopy* regions) {
+			count(cb);
+			auto src_buffer = from_handle<NullBuffer>(src);
+			auto dst_buffer = from_handle<NullBuffer>(dst);
+			from_handle(cb)->deferred.push_back([=, regions = std::vector<VkBufferCopy>(regions, regions + region_count)] {
+				for (auto& r : regions) {
+					memmove(dst_buffer->data() + r.dstOffset, src_buffer->data() + r.srcOffset, r.size);
+				}
+			});
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdCopyBufferToImage(VkCommandBuffer cb, VkBuffer, VkImage, VkImageLayout, uint32_t, const VkBufferImageCopy*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdCopyImageToBuffer(VkCommandBuffer cb, VkImage, VkImageLayout, VkBuffer, uint32_t, const VkBufferImageCopy*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdFillBuffer(VkCommandBuffer cb, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+			count(cb);
+			auto dst_buffer = from_handle<NullBuffer>(dst);
+			if (size == VK_WHOLE_SIZE) {
+				size = (dst_buffer->size - offset) & ~3ull;
+			}
+			from_handle(cb)->deferred.push_back([=] {
+				for (VkDeviceSize i = 0; i < size; i += sizeof(uint32_t)) {
+					memcpy(dst_buffer->data() + offset + i, &data, sizeof(uint32_t));
+				}
+			});
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdUpdateBuffer(VkCommandBuffer cb, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, const void* data) {
+			count(cb);
+			auto dst_buffer = from_handle<NullBuffer>(dst);
+			auto bytes = static_cast<const std::byte*>(data);
+			from_handle(cb)->deferred.push_back([=, contents = std::vector<std::byte>(bytes, bytes + size)] {
+				memcpy(dst_buffer->data() + offset, contents.data(), contents.size());
+			});
+		}
+
+		VKAPI_ATTR void VKAPI_CALL
+		null_vkCmdResolveImage(VkCommandBuffer cb, VkImage, VkImageLayout, VkImage, VkImageLayout, uint32_t, const VkImageResolve*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdPipelineBarrier(VkCommandBuffer cb,
+		                                                     VkPipelineStageFlags,
+		                                                     VkPipelineStageFlags,
+		                                                     VkDependencyFlags,
+		                                                     uint32_t,
+		                                                     const VkMemoryBarrier*,
+		                                                     uint32_t,
+		                                                     const VkBufferMemoryBarrier*,
+		                                                     uint32_t,
+		                                                     const VkImageMemoryBarrier*) {
+			count(cb);
+			from_handle(cb)->barriers++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdWriteTimestamp(VkCommandBuffer cb, VkPipelineStageFlagBits, VkQueryPool, uint32_t) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBeginQuery(VkCommandBuffer cb, VkQueryPool, uint32_t, VkQueryControlFlags) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdEndQuery(VkCommandBuffer cb, VkQueryPool, uint32_t) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDraw(VkCommandBuffer cb, uint32_t, uint32_t, uint32_t, uint32_t) {
+			count(cb);
+			from_handle(cb)->draws++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDrawIndexed(VkCommandBuffer cb, uint32_t, uint32_t, uint32_t, int32_t, uint32_t) {
+			count(cb);
+			from_handle(cb)->draws++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDrawIndexedIndirect(VkCommandBuffer cb, VkBuffer, VkDeviceSize, uint32_t, uint32_t) {
+			count(cb);
+			from_handle(cb)->draws++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDrawIndexedIndirectCount(VkCommandBuffer cb, VkBuffer, VkDeviceSize, VkBuffer, VkDeviceSize, uint32_t, uint32_t) {
+			count(cb);
+			from_handle(cb)->draws++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDispatch(VkCommandBuffer cb, uint32_t, uint32_t, uint32_t) {
+			count(cb);
+			from_handle(cb)->dispatches++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdDispatchIndirect(VkCommandBuffer cb, VkBuffer, VkDeviceSize) {
+			count(cb);
+			from_handle(cb)->dispatches++;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdPushConstants(VkCommandBuffer cb, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t, const void*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetViewport(VkCommandBuffer cb, uint32_t, uint32_t, const VkViewport*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetScissor(VkCommandBuffer cb, uint32_t, uint32_t, const VkRect2D*) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetLineWidth(VkCommandBuffer cb, float) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetDepthBias(VkCommandBuffer cb, float, float, float) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetBlendConstants(VkCommandBuffer cb, const float[4]) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdSetDepthBounds(VkCommandBuffer cb, float, float) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdBeginRenderPass(VkCommandBuffer cb, const VkRenderPassBeginInfo*, VkSubpassContents) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdNextSubpass(VkCommandBuffer cb, VkSubpassContents) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdEndRenderPass(VkCommandBuffer cb) {
+			count(cb);
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdExecuteCommands(VkCommandBuffer cb, uint32_t command_buffer_count, const VkCommandBuffer* command_buffers) {
+			count(cb);
+			std::vector<NullCommandBuffer*> secondaries;
+			for (uint32_t i = 0; i < command_buffer_count; i++) {
+				secondaries.push_back(from_handle(command_buffers[i]));
+			}
+			// the secondaries are carried out when the primary is submitted
+			from_handle(cb)->deferred.push_back([secondaries = std::move(secondaries)] {
+				for (auto secondary : secondaries) {
+					for (auto& f : secondary->deferred) {
+						f();
+					}
+				}
+			});
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkCmdPipelineBarrier2KHR(VkCommandBuffer cb, const VkDependencyInfoKHR*) {
+			count(cb);
+			from_handle(cb)->barriers++;
+		}
+
+		// physical device
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetPhysicalDeviceProperties(VkPhysicalDevice physical_device, VkPhysicalDeviceProperties* properties) {
+			*properties = device_of(physical_device)->properties;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetPhysicalDeviceProperties2(VkPhysicalDevice physical_device, VkPhysicalDeviceProperties2* properties) {
+			// extension structures in the chain are left untouched
+			properties->properties = device_of(physical_device)->properties;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physical_device, VkPhysicalDeviceMemoryProperties* properties) {
+			*properties = device_of(physical_device)->memory_properties;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physical_device, VkPhysicalDeviceMemoryProperties2* properties) {
+			properties->memoryProperties = device_of(physical_device)->memory_properties;
+		}
+
+		// objects without state
+
+		template<class CI, class T>
+		VKAPI_ATTR VkResult VKAPI_CALL null_create(VkDevice device, const CI*, const VkAllocationCallbacks*, T* handle) {
+			*handle = device_of(device)->make_handle<T>();
+			return VK_SUCCESS;
+		}
+
+		template<class T>
+		VKAPI_ATTR void VKAPI_CALL null_destroy(VkDevice, T, const VkAllocationCallbacks*) {}
+
+		// pipelines
+
+		template<class CI>
+		VKAPI_ATTR VkResult VKAPI_CALL
+		null_create_pipelines(VkDevice device, VkPipelineCache, uint32_t count, const CI*, const VkAllocationCallbacks*, VkPipeline* pipelines) {
+			device_of(device)->make_handles(pipelines, count);
+			device_of(device)->pipelines_created += count;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkGetPipelineCacheData(VkDevice, VkPipelineCache, size_t* data_size, void*) {
+			*data_size = 0;
+			return VK_SUCCESS;
+		}
+
+		// command pools and buffers
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*, VkCommandPool* pool) {
+			*pool = to_handle<VkCommandPool>(new NullCommandPool);
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkResetCommandPool(VkDevice, VkCommandPool pool, VkCommandPoolResetFlags) {
+			for (auto& cb : from_handle<NullCommandPool>(pool)->command_buffers) {
+				cb->reset();
+			}
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkDestroyCommandPool(VkDevice, VkCommandPool pool, const VkAllocationCallbacks*) {
+			auto p = from_handle<NullCommandPool>(pool);
+			if (!p) {
+				return;
+			}
+			for (auto& cb : p->command_buffers) {
+				delete cb;
+			}
+			delete p;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* ai, VkCommandBuffer* command_buffers) {
+			auto pool = from_handle<NullCommandPool>(ai->commandPool);
+			for (uint32_t i = 0; i < ai->commandBufferCount; i++) {
+				auto cb = new NullCommandBuffer{ device_of(device), pool };
+				pool->command_buffers.push_back(cb);
+				command_buffers[i] = reinterpret_cast<VkCommandBuffer>(cb);
+			}
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkFreeCommandBuffers(VkDevice, VkCommandPool pool, uint32_t count, const VkCommandBuffer* command_buffers) {
+			auto& pool_cbs = from_handle<NullCommandPool>(pool)->command_buffers;
+			for (uint32_t i = 0; i < count; i++) {
+				auto cb = from_handle(command_buffers[i]);
+				if (!cb) {
+					continue;
+				}
+				std::erase(pool_cbs, cb);
+				delete cb;
+			}
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkBeginCommandBuffer(VkCommandBuffer cb, const VkCommandBufferBeginInfo*) {
+			from_handle(cb)->reset();
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkEndCommandBuffer(VkCommandBuffer command_buffer) {
+			// accumulate the counters here, to keep the recording calls free of atomics
+			auto cb = from_handle(command_buffer);
+			cb->device->commands += cb->commands;
+			cb->device->draws += cb->draws;
+			cb->device->dispatches += cb->dispatches;
+			cb->device->barriers += cb->barriers;
+			return VK_SUCCESS;
+		}
+
+		// descriptors
+
+		VKAPI_ATTR VkResult VKAPI_CALL
+		null_vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo* ci, const VkAllocationCallbacks*, VkDescriptorPool* pool) {
+			*pool = to_handle<VkDescriptorPool>(new NullDescriptorPool{ ci->maxSets });
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkResetDescriptorPool(VkDevice, VkDescriptorPool pool, VkDescriptorPoolResetFlags) {
+			from_handle<NullDescriptorPool>(pool)->allocated = 0;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkDestroyDescriptorPool(VkDevice, VkDescriptorPool pool, const VkAllocationCallbacks*) {
+			delete from_handle<NullDescriptorPool>(pool);
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkAllocateDescriptorSets(VkDevice device, const VkDescriptorSetAllocateInfo* ai, VkDescriptorSet* sets) {
+			// only the set count is tracked, so that pool growth paths are exercised
+			auto pool = from_handle<NullDescriptorPool>(ai->descriptorPool);
+			if (pool->allocated + ai->descriptorSetCount > pool->max_sets) {
+				return VK_ERROR_OUT_OF_POOL_MEMORY;
+			}
+			pool->allocated += ai->descriptorSetCount;
+			device_of(device)->make_handles(sets, ai->descriptorSetCount);
+			device_of(device)->descriptor_sets_allocated += ai->descriptorSetCount;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkUpdateDescriptorSets(VkDevice device, uint32_t write_count, const VkWriteDescriptorSet*, uint32_t, const VkCopyDescriptorSet*) {
+			device_of(device)->descriptor_writes += write_count;
+		}
+
+		// queries
+
+		VKAPI_ATTR VkResult VKAPI_CALL
+		null_vkGetQueryPoolResults(VkDevice, VkQueryPool, uint32_t, uint32_t, size_t data_size, void* data, VkDeviceSize, VkQueryResultFlags) {
+			memset(data, 0, data_size);
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkResetQueryPool(VkDevice, VkQueryPool, uint32_t, uint32_t) {}
+
+		// synchronization - all work is complete as soon as it is submitted
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkWaitForFences(VkDevice, uint32_t, const VkFence*, VkBool32, uint64_t) {
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkResetFences(VkDevice, uint32_t, const VkFence*) {
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkWaitSemaphores(VkDevice, const VkSemaphoreWaitInfo*, uint64_t) {
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkDeviceWaitIdle(VkDevice) {
+			return VK_SUCCESS;
+		}
+
+		void execute(NullDeviceImpl* device, VkCommandBuffer command_buffer) {
+			auto cb = from_handle(command_buffer);
+			for (auto& f : cb->deferred) {
+				f();
+			}
+			device->command_buffers_submitted++;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkQueueSubmit(VkQueue queue, uint32_t count, const VkSubmitInfo* submits, VkFence) {
+			auto device = reinterpret_cast<NullQueue*>(queue)->device;
+			for (uint32_t i = 0; i < count; i++) {
+				for (uint32_t j = 0; j < submits[i].commandBufferCount; j++) {
+					execute(device, submits[i].pCommandBuffers[j]);
+				}
+			}
+			device->submits++;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkQueueSubmit2KHR(VkQueue queue, uint32_t count, const VkSubmitInfo2KHR* submits, VkFence) {
+			auto device = reinterpret_cast<NullQueue*>(queue)->device;
+			for (uint32_t i = 0; i < count; i++) {
+				for (uint32_t j = 0; j < submits[i].commandBufferInfoCount; j++) {
+					execute(device, submits[i].pCommandBufferInfos[j].commandBuffer);
+				}
+			}
+			device->submits++;
+			return VK_SUCCESS;
+		}
+
+		// memory
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo* ai, const VkAllocationCallbacks*, VkDeviceMemory* memory) {
+			// calloc'd memory is usually lazily committed by the OS, so large blocks that are not written to are cheap
+			auto data = static_cast<std::byte*>(calloc(ai->allocationSize, 1));
+			if (!data) {
+				return VK_ERROR_OUT_OF_HOST_MEMORY;
+			}
+			auto d = device_of(device);
+			auto address = d->next_device_address.fetch_add(align_up<VkDeviceSize>(ai->allocationSize, 1 << 16));
+			*memory = to_handle<VkDeviceMemory>(new NullMemory{ data, ai->allocationSize, address });
+			d->device_memory_bytes += ai->allocationSize;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+			auto m = from_handle<NullMemory>(memory);
+			if (!m) {
+				return;
+			}
+			device_of(device)->device_memory_bytes -= m->size;
+			free(m->data);
+			delete m;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** data) {
+			*data = from_handle<NullMemory>(memory)->data + offset;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkUnmapMemory(VkDevice, VkDeviceMemory) {}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*) {
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkBindBufferMemory(VkDevice, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
+			auto b = from_handle<NullBuffer>(buffer);
+			b->memory = from_handle<NullMemory>(memory);
+			b->offset = offset;
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize) {
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* requirements) {
+			requirements->size = align_up<VkDeviceSize>(from_handle<NullBuffer>(buffer)->size, 256);
+			requirements->alignment = 256;
+			requirements->memoryTypeBits = 0b111;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* requirements) {
+			requirements->size = align_up<VkDeviceSize>(from_handle<NullImage>(image)->size, 1 << 16);
+			requirements->alignment = 1 << 16;
+			// images can't be host visible
+			requirements->memoryTypeBits = 0b001;
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkCreateBuffer(VkDevice, const VkBufferCreateInfo* ci, const VkAllocationCallbacks*, VkBuffer* buffer) {
+			*buffer = to_handle<VkBuffer>(new NullBuffer{ ci->size });
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+			delete from_handle<NullBuffer>(buffer);
+		}
+
+		VKAPI_ATTR VkResult VKAPI_CALL null_vkCreateImage(VkDevice, const VkImageCreateInfo* ci, const VkAllocationCallbacks*, VkImage* image) {
+			*image = to_handle<VkImage>(new NullImage{ image_size(*ci) });
+			return VK_SUCCESS;
+		}
+
+		VKAPI_ATTR void VKAPI_CALL null_vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*) {
+			delete from_handle<NullImage>(image);
+		}
+
+		VKAPI_ATTR VkDeviceAddress VKAPI_CALL null_vkGetBufferDeviceAddress(VkDevice, const VkBufferDeviceAddressInfo* info) {
+			auto b = from_handle<NullBuffer>(info->buffer);
+			return b->memory ? b->memory->address + b->offset : 0;
+		}
+	} // namespace
+
+	NullDevice::NullDevice() : impl(new NullDeviceImpl) {}
+
+	NullDevice::~NullDevice() {
+		delete impl;
+	}
+
+	ContextCreateParameters NullDevice::get_context_create_parameters() {
+		ContextCreateParameters params{ reinterpret_cast<VkInstance>(impl),
+			                              reinterpret_cast<VkDevice>(impl),
+			                              reinterpret_cast<VkPhysicalDevice>(impl),
+			                              reinterpret_cast<VkQueue>(&impl->queues[0]),
+			                              0,
+			                              reinterpret_cast<VkQueue>(&impl->queues[1]),
+			                              1,
+			                              reinterpret_cast<VkQueue>(&impl->queues[2]),
+			                              2 };
+		params.allow_dynamic_loading_of_vk_function_pointers = false;
+
+		auto& p = params.pointers;
+		p.vkCmdBindDescriptorSets = &null_vkCmdBindDescriptorSets;
+		p.vkCmdBindIndexBuffer = &null_vkCmdBindIndexBuffer;
+		p.vkCmdBindPipeline = &null_vkCmdBindPipeline;
+		p.vkCmdBindVertexBuffers = &null_vkCmdBindVertexBuffers;
+		p.vkCmdBlitImage = &null_vkCmdBlitImage;
+		p.vkCmdClearColorImage = &null_vkCmdClearColorImage;
+		p.vkCmdClearDepthStencilImage = &null_vkCmdClearDepthStencilImage;
+		p.vkCmdCopyBuffer = &null_vkCmdCopyBuffer;
+		p.vkCmdCopyBufferToImage = &null_vkCmdCopyBufferToImage;
+		p.vkCmdCopyImageToBuffer = &null_vkCmdCopyImageToBuffer;
+		p.vkCmdFillBuffer = &null_vkCmdFillBuffer;
+		p.vkCmdUpdateBuffer = &null_vkCmdUpdateBuffer;
+		p.vkCmdResolveImage = &null_vkCmdResolveImage;
+		p.vkCmdPipelineBarrier = &null_vkCmdPipelineBarrier;
+		p.vkCmdWriteTimestamp = &null_vkCmdWriteTimestamp;
+		p.vkCmdBeginQuery = &null_vkCmdBeginQuery;
+		p.vkCmdEndQuery = &null_vkCmdEndQuery;
+		p.vkCmdDraw = &null_vkCmdDraw;
+		p.vkCmdDrawIndexed = &null_vkCmdDrawIndexed;
+		p.vkCmdDrawIndexedIndirect = &null_vkCmdDrawIndexedIndirect;
+		p.vkCmdDispatch = &null_vkCmdDispatch;
+		p.vkCmdDispatchIndirect = &null_vkCmdDispatchIndirect;
+		p.vkCmdPushConstants = &null_vkCmdPushConstants;
+		p.vkCmdSetViewport = &null_vkCmdSetViewport;
+		p.vkCmdSetScissor = &null_vkCmdSetScissor;
+		p.vkCmdSetLineWidth = &null_vkCmdSetLineWidth;
+		p.vkCmdSetDepthBias = &null_vkCmdSetDepthBias;
+		p.vkCmdSetBlendConstants = &null_vkCmdSetBlendConstants;
+		p.vkCmdSetDepthBounds = &null_vkCmdSetDepthBounds;
+
+		p.vkGetPhysicalDeviceProperties = &null_vkGetPhysicalDeviceProperties;
+
+		p.vkCreateFramebuffer = &null_create<VkFramebufferCreateInfo, VkFramebuffer>;
+		p.vkDestroyFramebuffer = &null_destroy<VkFramebuffer>;
+
+		p.vkCreateCommandPool = &null_vkCreateCommandPool;
+		p.vkResetCommandPool = &null_vkResetCommandPool;
+		p.vkDestroyCommandPool = &null_vkDestroyCommandPool;
+
+		p.vkAllocateCommandBuffers = &null_vkAllocateCommandBuffers;
+		p.vkBeginCommandBuffer = &null_vkBeginCommandBuffer;
+		p.vkEndCommandBuffer = &null_vkEndCommandBuffer;
+		p.vkFreeCommandBuffers = &null_vkFreeCommandBuffers;
+
+		p.vkCreateDescriptorPool = &null_vkCreateDescriptorPool;
+		p.vkResetDescriptorPool = &null_vkResetDescriptorPool;
+		p.vkDestroyDescriptorPool = &null_vkDestroyDescriptorPool;
+
+		p.vkAllocateDescriptorSets = &null_vkAllocateDescriptorSets;
+		p.vkUpdateDescriptorSets = &null_vkUpdateDescriptorSets;
+
+		p.vkCreateGraphicsPipelines = &null_create_pipelines<VkGraphicsPipelineCreateInfo>;
+		p.vkCreateComputePipelines = &null_create_pipelines<VkComputePipelineCreateInfo>;
+		p.vkDestroyPipeline = &null_destroy<VkPipeline>;
+
+		p.vkCreateQueryPool = &null_create<VkQueryPoolCreateInfo, VkQueryPool>;
+		p.vkGetQueryPoolResults = &null_vkGetQueryPoolResults;
+		p.vkDestroyQueryPool = &null_destroy<VkQueryPool>;
+
+		p.vkCreatePipelineCache = &null_create<VkPipelineCacheCreateInfo, VkPipelineCache>;
+		p.vkGetPipelineCacheData = &null_vkGetPipelineCacheData;
+		p.vkDestroyPipelineCache = &null_destroy<VkPipelineCache>;
+
+		p.vkCreateRenderPass = &null_create<VkRenderPassCreateInfo, VkRenderPass>;
+		p.vkCmdBeginRenderPass = &null_vkCmdBeginRenderPass;
+		p.vkCmdNextSubpass = &null_vkCmdNextSubpass;
+		p.vkCmdEndRenderPass = &null_vkCmdEndRenderPass;
+		p.vkCmdExecuteCommands = &null_vkCmdExecuteCommands;
+		p.vkDestroyRenderPass = &null_destroy<VkRenderPass>;
+
+		p.vkCreateSampler = &null_create<VkSamplerCreateInfo, VkSampler>;
+		p.vkDestroySampler = &null_destroy<VkSampler>;
+
+		p.vkCreateShaderModule = &null_create<VkShaderModuleCreateInfo, VkShaderModule>;
+		p.vkDestroyShaderModule = &null_destroy<VkShaderModule>;
+
+		p.vkCreateImageView = &null_create<VkImageViewCreateInfo, VkImageView>;
+		p.vkDestroyImageView = &null_destroy<VkImageView>;
+
+		p.vkCreateDescriptorSetLayout = &null_create<VkDescriptorSetLayoutCreateInfo, VkDescriptorSetLayout>;
+		p.vkDestroyDescriptorSetLayout = &null_destroy<VkDescriptorSetLayout>;
+
+		p.vkCreatePipelineLayout = &null_create<VkPipelineLayoutCreateInfo, VkPipelineLayout>;
+		p.vkDestroyPipelineLayout = &null_destroy<VkPipelineLayout>;
+
+		p.vkCreateFence = &null_create<VkFenceCreateInfo, VkFence>;
+		p.vkWaitForFences = &null_vkWaitForFences;
+		p.vkResetFences = &null_vkResetFences;
+		p.vkDestroyFence = &null_destroy<VkFence>;
+
+		p.vkCreateSemaphore = &null_create<VkSemaphoreCreateInfo, VkSemaphore>;
+		p.vkWaitSemaphores = &null_vkWaitSemaphores;
+		p.vkDestroySemaphore = &null_destroy<VkSemaphore>;
+
+		p.vkQueueSubmit = &null_vkQueueSubmit;
+		p.vkDeviceWaitIdle = &null_vkDeviceWaitIdle;
+
+		p.vkGetPhysicalDeviceMemoryProperties = &null_vkGetPhysicalDeviceMemoryProperties;
+		p.vkAllocateMemory = &null_vkAllocateMemory;
+		p.vkFreeMemory = &null_vkFreeMemory;
+		p.vkMapMemory = &null_vkMapMemory;
+		p.vkUnmapMemory = &null_vkUnmapMemory;
+		p.vkFlushMappedMemoryRanges = &null_vkFlushMappedMemoryRanges;
+		p.vkInvalidateMappedMemoryRanges = &null_vkFlushMappedMemoryRanges;
+		p.vkBindBufferMemory = &null_vkBindBufferMemory;
+		p.vkBindImageMemory = &null_vkBindImageMemory;
+		p.vkGetBufferMemoryRequirements = &null_vkGetBufferMemoryRequirements;
+		p.vkGetImageMemoryRequirements = &null_vkGetImageMemoryRequirements;
+		p.vkCreateBuffer = &null_vkCreateBuffer;
+		p.vkDestroyBuffer = &null_vkDestroyBuffer;
+		p.vkCreateImage = &null_vkCreateImage;
+		p.vkDestroyImage = &null_vkDestroyImage;
+
+		p.vkGetPhysicalDeviceProperties2 = &null_vkGetPhysicalDeviceProperties2;
+		p.vkGetPhysicalDeviceMemoryProperties2 = &null_vkGetPhysicalDeviceMemoryProperties2;
+
+		p.vkGetBufferDeviceAddress = &null_vkGetBufferDeviceAddress;
+		p.vkCmdDrawIndexedIndirectCount = &null_vkCmdDrawIndexedIndirectCount;
+		p.vkResetQueryPool = &null_vkResetQueryPool;
+
+		p.vkCmdPipelineBarrier2KHR = &null_vkCmdPipelineBarrier2KHR;
+		p.vkQueueSubmit2KHR = &null_vkQueueSubmit2KHR;
+
+		return params;
+	}
+
+	NullDeviceStats NullDevice::get_stats() {
+		NullDeviceStats stats;
+		stats.submits = impl->submits;
+		stats.command_buffers_submitted = impl->command_buffers_submitted;
+		stats.commands = impl->commands;
+		stats.draws = impl->draws;
+		stats.dispatches = impl->dispatches;
+		stats.barriers = impl->barriers;
+		stats.pipelines_created = impl->pipelines_created;
+		stats.descriptor_sets_allocated = impl->descriptor_sets_allocated;
+		stats.descriptor_writes = impl->descriptor_writes;
+		stats.device_memory_bytes = impl->device_memory_bytes;
+		return stats;
+	}
+
+	void NullDevice::reset_stats() {
+		impl->submits = 0;
+		impl->command_buffers_submitted = 0;
+		impl->commands = 0;
+		impl->draws = 0;
+		impl->dispatches = 0;
+		impl->barriers = 0;
+		impl->pipelines_created = 0;
+		impl->descriptor_sets_allocated = 0;
+		impl->descriptor_writes = 0;
+	}
+} // namespace vuk
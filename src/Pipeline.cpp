@@ -17,10 +17,15 @@ namespace vuk {
 			dslci.index = index;
 			auto& bindings = dslci.bindings;
 
+			auto dynamic_offset = index * VUK_MAX_BINDINGS;
+			auto is_dynamic = [&](unsigned binding) {
+				return binding < VUK_MAX_BINDINGS && bci.dynamic_buffer_bindings.test(dynamic_offset + binding);
+			};
+
 			for (auto& ub : set.uniform_buffers) {
 				VkDescriptorSetLayoutBinding layoutBinding;
 				layoutBinding.binding = ub.binding;
-				layoutBinding.descriptorType = (VkDescriptorType)DescriptorType::eUniformBuffer;
+				layoutBinding.descriptorType = (VkDescriptorType)(is_dynamic(ub.binding) ? DescriptorType::eUniformBufferDynamic : DescriptorType::eUniformBuffer);
 				layoutBinding.descriptorCount = 1;
 				layoutBinding.stageFlags = ub.stage;
 				layoutBinding.pImmutableSamplers = nullptr;
@@ -33,7 +38,7 @@ namespace vuk {
 			for (auto& sb : set.storage_buffers) {
 				VkDescriptorSetLayoutBinding layoutBinding;
 				layoutBinding.binding = sb.binding;
-				layoutBinding.descriptorType = (VkDescriptorType)DescriptorType::eStorageBuffer;
+				layoutBinding.descriptorType = (VkDescriptorType)(is_dynamic(sb.binding) ? DescriptorType::eStorageBufferDynamic : DescriptorType::eStorageBuffer);
 				layoutBinding.descriptorCount = 1;
 				layoutBinding.stageFlags = sb.stage;
 				layoutBinding.pImmutableSamplers = nullptr;
@@ -5,8 +5,12 @@
 #include "vuk/Context.hpp"
 #include "vuk/Exception.hpp"
 #include "vuk/Future.hpp"
+#include "vuk/Hash.hpp"
+#include "vuk/Instrumentation.hpp"
+#include "vuk/resources/DeviceFrameResource.hpp"
 
 #include <charconv>
+#include <chrono>
 #include <set>
 #include <sstream>
 #include <unordered_set>
@@ -16,6 +20,17 @@
 namespace {
 	void diverge(vuk::CommandBuffer&) {}
 	void converge(vuk::CommandBuffer&) {}
+
+	// adds the wall time of its scope to a phase time, also when the phase returns early with an error
+	struct PhaseTimer {
+		PhaseTimer(double& dst) : dst(dst), start(std::chrono::steady_clock::now()) {}
+		~PhaseTimer() {
+			dst += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		double& dst;
+		std::chrono::steady_clock::time_point start;
+	};
 } // namespace
 
 namespace vuk {
@@ -41,6 +56,10 @@ namespace vuk {
 		pw.name = p.name;
 		pw.arguments = p.arguments;
 		pw.execute = std::move(p.execute);
+		pw.use_secondary_command_buffers = p.use_secondary_command_buffers;
+		pw.content_key = p.content_key;
+		pw.pure = p.pure;
+		pw.parameter_hash = p.parameter_hash;
 		pw.execute_on = p.execute_on;
 		pw.resources.offset0 = impl->resources.size();
 		impl->resources.insert(impl->resources.end(), p.resources.begin(), p.resources.end());
@@ -165,6 +184,111 @@ namespace vuk {
 		std::erase_if(passes, [](auto& pass) { return pass.pass->type == PassType::eDiverge && pass.resources.size() == 0; });
 	}
 
+	size_t RGCImpl::skip_memoized_passes() {
+		if (std::none_of(computed_passes.begin(), computed_passes.end(), [](auto& pass) { return pass.pass->pure; })) {
+			return 0;
+		}
+		// versions written again later in the graph - a pure pass writing them would not leave its results behind
+		robin_hood::unordered_flat_set<QualifiedName> overwritten;
+		for (auto& pass : computed_passes) {
+			for (auto& res : pass.resources.to_span(resources)) {
+				if (!res.name.is_invalid() && (is_write_access(res.ia) || res.ia == Access::eConsume)) {
+					overwritten.emplace(res.name);
+				}
+			}
+		}
+
+		// versions written by pure passes, with the input hash of the pass
+		robin_hood::unordered_flat_map<QualifiedName, uint64_t> pure_outputs;
+		// outputs of skipped passes refer to the version the pass read
+		robin_hood::unordered_flat_map<QualifiedName, QualifiedName> skipped_outputs;
+		for (auto& pass : computed_passes) {
+			if (!pass.pass->pure) {
+				continue;
+			}
+			size_t hash = 0;
+			hash_combine(hash, pass.pass->parameter_hash, pass.qualified_name);
+			bool memoizable = true;
+			for (auto& res : pass.resources.to_span(resources)) {
+				if (res.name.is_invalid() || (!res.out_name.is_invalid() && overwritten.contains(res.out_name))) {
+					memoizable = false;
+					break;
+				}
+				hash_combine(hash, res.name, res.ia);
+				auto root = resolve_name(res.name);
+				if (res.name != root) {
+					// written earlier in the graph - unchanged only if a pure pass wrote it
+					auto it = pure_outputs.find(res.name);
+					if (it == pure_outputs.end()) {
+						memoizable = false;
+						break;
+					}
+					hash_combine(hash, it->second);
+				}
+				if (res.type == Resource::Type::eImage) {
+					auto it = std::find_if(bound_attachments.begin(), bound_attachments.end(), [&](auto& bound) { return bound.name == root; });
+					if (it == bound_attachments.end() || !it->attachment.has_concrete_image() || !it->attachment.has_concrete_image_view()) {
+						memoizable = false;
+						break;
+					}
+					hash_combine(hash, it->attachment.image.image, it->attachment.image_view.payload);
+				} else {
+					auto it = std::find_if(bound_buffers.begin(), bound_buffers.end(), [&](auto& bound) { return bound.name == root; });
+					if (it == bound_buffers.end() || it->buffer.buffer == VK_NULL_HANDLE) {
+						memoizable = false;
+						break;
+					}
+					hash_combine(hash, it->buffer.buffer, it->buffer.offset, it->buffer.size);
+				}
+			}
+
+			auto entry = memoized_passes.find(pass.qualified_name);
+			if (!memoizable) {
+				// the pass runs with inputs we can't compare, so what it left behind is not known anymore
+				if (entry != memoized_passes.end()) {
+					memoized_passes.erase(entry);
+				}
+				continue;
+			}
+			for (auto& res : pass.resources.to_span(resources)) {
+				if (!res.out_name.is_invalid()) {
+					pure_outputs.emplace(res.out_name, hash);
+				}
+			}
+			if (entry != memoized_passes.end() && entry->second == hash) {
+				for (auto& res : pass.resources.to_span(resources)) {
+					if (!res.out_name.is_invalid()) {
+						skipped_outputs.emplace(res.out_name, res.name);
+					}
+				}
+				pass.resources = {};
+			} else {
+				pass.memoization_hash = hash;
+			}
+		}
+
+		if (skipped_outputs.empty()) {
+			return 0;
+		}
+		auto resolve_skipped = [&](QualifiedName name) {
+			for (auto it = skipped_outputs.find(name); it != skipped_outputs.end(); it = skipped_outputs.find(name)) {
+				name = it->second;
+			}
+			return name;
+		};
+		for (auto& pass : computed_passes) {
+			for (auto& res : pass.resources.to_span(resources)) {
+				if (!res.name.is_invalid()) {
+					res.name = resolve_skipped(res.name);
+				}
+			}
+		}
+		for (auto& [name, release] : releases) {
+			name = resolve_skipped(name);
+		}
+		return std::erase_if(computed_passes, [](auto& pass) { return pass.pass->pure && pass.resources.size() == 0 && pass.memoization_hash == 0; });
+	}
+
 	Result<void> build_links(std::span<PassInfo> passes, ResourceLinkMap& res_to_links, std::vector<Resource>& resources, std::vector<ChainAccess>& pass_reads) {
 		// build edges into link map
 		// reserving here to avoid rehashing map
@@ -274,7 +398,8 @@ namespace vuk {
 					indegrees[read.pass]++;                                         // this only counts as a dep if there is a def before
 					adjacency_matrix[link.def->pass * passes.size() + read.pass]++; // def -> read
 				}
-				if ((link.undef && link.undef->pass >= 0)) {
+				// a pass may read one subrange of an image and write another
+				if ((link.undef && link.undef->pass >= 0 && link.undef->pass != read.pass)) {
 					indegrees[link.undef->pass]++;
 					adjacency_matrix[read.pass * passes.size() + link.undef->pass]++; // read -> undef
 				}
@@ -310,9 +435,263 @@ namespace vuk {
 		}
 		assert(ordered_passes.size() == passes.size());
 
+		if (compile_options.reorder_passes) {
+			reorder_passes(passes, adjacency_matrix);
+		}
+
 		return { expected_value };
 	}
 
+	void RGCImpl::reorder_passes(std::span<PassInfo> passes, std::span<const uint8_t> adjacency_matrix) {
+		auto n = passes.size();
+		// chains used by each pass, and the chains it renders to
+		std::vector<std::vector<ChainLink*>> used_chains(n);
+		std::vector<std::vector<ChainLink*>> attachment_chains(n);
+		for (size_t i = 0; i < n; i++) {
+			for (auto& res : passes[i].resources.to_span(resources)) {
+				auto it = res_to_links.find(res.name);
+				if (it == res_to_links.end()) {
+					continue;
+				}
+				ChainLink* head = &it->second;
+				while (head->prev) {
+					head = head->prev;
+				}
+				used_chains[i].push_back(head);
+				if (is_framebuffer_attachment(res)) {
+					attachment_chains[i].push_back(head);
+				}
+			}
+			std::sort(used_chains[i].begin(), used_chains[i].end());
+			used_chains[i].erase(std::unique(used_chains[i].begin(), used_chains[i].end()), used_chains[i].end());
+			std::sort(attachment_chains[i].begin(), attachment_chains[i].end());
+			attachment_chains[i].erase(std::unique(attachment_chains[i].begin(), attachment_chains[i].end()), attachment_chains[i].end());
+		}
+
+		auto mergeable = [&](size_t a, size_t b) {
+			auto da = passes[a].pass->execute_on;
+			auto db = passes[b].pass->execute_on;
+			return !attachment_chains[a].empty() && attachment_chains[a] == attachment_chains[b] && (da == DomainFlagBits::eAny || db == DomainFlagBits::eAny || da == db);
+		};
+		auto shares_chain = [&](size_t a, size_t b) {
+			auto& ua = used_chains[a];
+			auto& ub = used_chains[b];
+			size_t i = 0, j = 0;
+			while (i < ua.size() && j < ub.size()) {
+				if (ua[i] == ub[j]) {
+					return true;
+				}
+				if (ua[i] < ub[j]) {
+					i++;
+				} else {
+					j++;
+				}
+			}
+			return false;
+		};
+		// a pair of neighbouring passes that can be merged into one render pass is worth more than any amount of clustering around it
+		std::vector<uint32_t> pair_score(n * n);
+		for (size_t a = 0; a < n; a++) {
+			for (size_t b = a + 1; b < n; b++) {
+				uint32_t score = (mergeable(a, b) ? 4 : 0) + (shares_chain(a, b) ? 1 : 0);
+				pair_score[a * n + b] = pair_score[b * n + a] = score;
+			}
+		}
+
+		std::vector<size_t> order(ordered_idx_to_computed_pass_idx.begin(), ordered_idx_to_computed_pass_idx.end());
+		auto score_at = [&](size_t pos_a, size_t pos_b) -> int64_t {
+			return pos_a < n && pos_b < n ? pair_score[order[pos_a] * n + order[pos_b]] : 0;
+		};
+		auto report = [&](size_t& merge_candidates, size_t& resource_switches) {
+			merge_candidates = resource_switches = 0;
+			for (size_t pos = 1; pos < n; pos++) {
+				merge_candidates += mergeable(order[pos - 1], order[pos]);
+				resource_switches += !shares_chain(order[pos - 1], order[pos]);
+			}
+		};
+		auto& stats_report = stats.reordering;
+		report(stats_report.merge_candidates_before, stats_report.resource_switches_before);
+
+		// local search: move single passes to the position between their dependencies that improves the score the most, until no move improves it
+		// only strictly improving moves are taken, so independent passes that gain nothing keep their scheduled order
+		for (size_t sweep = 0; sweep < n; sweep++) {
+			bool improved = false;
+			for (size_t from = 0; from < n; from++) {
+				auto p = order[from];
+				// the pass can move anywhere after its last predecessor and before its first successor
+				size_t lo = 0, hi = n - 1;
+				for (size_t pos = 0; pos < n; pos++) {
+					if (adjacency_matrix[order[pos] * n + p] > 0 && pos < from) {
+						lo = pos + 1;
+					}
+					if (adjacency_matrix[p * n + order[pos]] > 0 && pos > from) {
+						hi = std::min(hi, pos - 1);
+					}
+				}
+				// gain of removing the pass from its position
+				int64_t removal = (from > 0 && from + 1 < n ? score_at(from - 1, from + 1) : 0) - (from > 0 ? score_at(from - 1, from) : 0) - score_at(from, from + 1);
+				int64_t best_gain = 0;
+				size_t best_to = from;
+				for (size_t to = lo; to <= hi; to++) {
+					if (to == from) {
+						continue;
+					}
+					// neighbours of the pass after moving it to position to
+					size_t left = to < from ? to - 1 : to;
+					size_t right = to < from ? to : to + 1;
+					bool has_left = to > 0;
+					int64_t insertion = (has_left ? score_at(left, from) : 0) + score_at(from, right) - (has_left ? score_at(left, right) : 0);
+					if (removal + insertion > best_gain) {
+						best_gain = removal + insertion;
+						best_to = to;
+					}
+				}
+				if (best_to != from) {
+					order.erase(order.begin() + from);
+					order.insert(order.begin() + best_to, p);
+					improved = true;
+				}
+			}
+			if (!improved) {
+				break;
+			}
+		}
+
+		report(stats_report.merge_candidates_after, stats_report.resource_switches_after);
+		for (size_t pos = 0; pos < n; pos++) {
+			stats_report.passes_moved += order[pos] != ordered_idx_to_computed_pass_idx[pos];
+			computed_pass_idx_to_ordered_idx[order[pos]] = pos;
+			ordered_idx_to_computed_pass_idx[pos] = order[pos];
+			ordered_passes[pos] = &passes[order[pos]];
+		}
+	}
+
+	size_t RGCImpl::promote_layouts(const LayoutPromotionOptions& options) {
+		size_t promoted = 0;
+		if (options.max_layout_transitions == UINT32_MAX && !options.promote_storage_sampled_alternation) {
+			return promoted;
+		}
+		for (auto& head : chains) {
+			// subchains share their image with the chain they diverged from, which is not tracked here
+			if (head->type != Resource::Type::eImage || head->source || head->child_chains.size() > 0 || head->def->pass >= 0) {
+				continue;
+			}
+			auto& att = get_bound_attachment(head->def->pass);
+			if (att.type == AttachmentInfo::Type::eSwapchain) {
+				continue;
+			}
+
+			// layouts of the chain in order of use: the reads of a link share a layout, like when emitting their barrier
+			bool eligible = true;
+			std::vector<ImageLayout> layouts;
+			for (ChainLink* link = head; link != nullptr && eligible; link = link->next) {
+				if (link->reads.size() > 0) {
+					ImageLayout layout = ImageLayout::eUndefined;
+					for (auto& r : link->reads.to_span(pass_reads)) {
+						auto& res = get_resource(r);
+						eligible &= !is_framebuffer_attachment(res);
+						layout = combine_layout(layout, to_use(res.ia, DomainFlagBits::eAny).layout);
+					}
+					layouts.push_back(layout);
+				}
+				if (link->undef && link->undef->pass >= 0) {
+					auto& res = get_resource(*link->undef);
+					eligible &= !is_framebuffer_attachment(res);
+					layouts.push_back(to_use(res.ia, DomainFlagBits::eAny).layout);
+				}
+			}
+			if (!eligible) {
+				continue;
+			}
+
+			uint32_t transitions = 0;
+			uint32_t storage_sampled_switches = 0;
+			ImageLayout previous = att.acquire.src_use.layout;
+			for (auto layout : layouts) {
+				if (layout == ImageLayout::eUndefined || layout == previous) {
+					continue;
+				}
+				if (previous != ImageLayout::eUndefined) {
+					transitions++;
+				}
+				if ((previous == ImageLayout::eGeneral && layout == ImageLayout::eReadOnlyOptimalKHR) ||
+				    (previous == ImageLayout::eReadOnlyOptimalKHR && layout == ImageLayout::eGeneral)) {
+					storage_sampled_switches++;
+				}
+				previous = layout;
+			}
+
+			bool alternates = options.promote_storage_sampled_alternation && storage_sampled_switches >= 2;
+			if (!alternates && (options.max_layout_transitions == UINT32_MAX || transitions <= options.max_layout_transitions)) {
+				continue;
+			}
+
+			for (ChainLink* link = head; link != nullptr; link = link->next) {
+				if (link->def->pass >= 0) {
+					get_resource(*link->def).promoted_to_general = true;
+				}
+				for (auto& r : link->reads.to_span(pass_reads)) {
+					get_resource(r).promoted_to_general = true;
+				}
+				if (link->undef && link->undef->pass >= 0) {
+					get_resource(*link->undef).promoted_to_general = true;
+				}
+			}
+			promoted++;
+		}
+		return promoted;
+	}
+
+	size_t RGCImpl::select_concurrent_sharing(uint32_t attachment_crossings) {
+		size_t selected = 0;
+		for (auto& head : chains) {
+			if (head->type != Resource::Type::eImage || head->source || head->def->pass >= 0) {
+				continue;
+			}
+			// only images that the render graph creates itself
+			auto& att = get_bound_attachment(head->def->pass);
+			if (att.type != AttachmentInfo::Type::eInternal || att.parent_attachment < 0 || att.attachment.has_concrete_image() ||
+			    att.attachment.sharing_mode == SharingMode::eConcurrent) {
+				continue;
+			}
+
+			uint32_t crossings = 0;
+			bool is_attachment = false;
+			DomainFlags last_domain = DomainFlagBits::eNone;
+			auto visit = [&](ChainAccess access) {
+				is_attachment |= is_framebuffer_attachment(get_resource(access));
+				auto domain = get_pass(access).domain & DomainFlagBits::eQueueMask;
+				if (last_domain != DomainFlagBits::eNone && domain != last_domain) {
+					crossings++;
+				}
+				last_domain = domain;
+			};
+			for (ChainLink* link = head; link != nullptr; link = link->next) {
+				for (auto& r : link->reads.to_span(pass_reads)) {
+					visit(r);
+				}
+				if (link->undef && link->undef->pass >= 0) {
+					visit(*link->undef);
+				}
+			}
+
+			if (crossings == 0 || (is_attachment && crossings < attachment_crossings)) {
+				continue;
+			}
+			att.attachment.sharing_mode = SharingMode::eConcurrent;
+			selected++;
+		}
+		return selected;
+	}
+
+	bool RGCImpl::is_shared_concurrently(int32_t bound_attachment) {
+		auto& att = get_bound_attachment(bound_attachment);
+		if (att.parent_attachment < 0) {
+			return get_bound_attachment(att.parent_attachment).attachment.sharing_mode == SharingMode::eConcurrent;
+		}
+		return att.attachment.sharing_mode == SharingMode::eConcurrent;
+	}
+
 	Result<void> RGCImpl::fix_subchains() {
 		// subchain fixup pass
 
@@ -800,32 +1179,85 @@ namespace vuk {
 
 	Result<void> Compiler::compile(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
 		auto arena = impl->arena_.release();
+		auto memoized_passes = std::move(impl->memoized_passes);
 		delete impl;
 		arena->reset();
 		impl = new RGCImpl(arena);
+		impl->memoized_passes = std::move(memoized_passes);
+
+		auto& stats = impl->stats;
+		PhaseTimer total_timer(stats.total_time);
+		VUK_ZONE(compile_options.instrumentation, "Render graph compile");
+		{
+			PhaseTimer _(stats.phase_times.inlining);
+			VUK_ZONE(compile_options.instrumentation, "Inlining");
+			VUK_DO_OR_RETURN(inline_rgs(rgs));
 
-		VUK_DO_OR_RETURN(inline_rgs(rgs));
+			impl->compute_assigned_names();
 
-		impl->compute_assigned_names();
+			impl->merge_diverge_passes(impl->computed_passes);
 
-		impl->merge_diverge_passes(impl->computed_passes);
+			stats.passes_memoized = impl->skip_memoized_passes();
+		}
+		stats.passes = impl->computed_passes.size();
+		stats.resources = impl->resources.size();
 
 		// run global pass ordering - once we split per-queue we don't see enough
 		// inputs to order within a queue
 
-		VUK_DO_OR_RETURN(build_links(impl->computed_passes, impl->res_to_links, impl->resources, impl->pass_reads));
-		VUK_DO_OR_RETURN(impl->terminate_chains());
-		VUK_DO_OR_RETURN(collect_chains(impl->res_to_links, impl->chains));
-		VUK_DO_OR_RETURN(impl->diagnose_unheaded_chains());
-		VUK_DO_OR_RETURN(impl->schedule_intra_queue(impl->computed_passes, compile_options));
-		VUK_DO_OR_RETURN(impl->fix_subchains());
+		{
+			PhaseTimer _(stats.phase_times.link_building);
+			VUK_ZONE(compile_options.instrumentation, "Link building");
+			VUK_DO_OR_RETURN(build_links(impl->computed_passes, impl->res_to_links, impl->resources, impl->pass_reads));
+			VUK_DO_OR_RETURN(impl->terminate_chains());
+		}
+		{
+			PhaseTimer _(stats.phase_times.chain_collection);
+			VUK_ZONE(compile_options.instrumentation, "Chain collection");
+			VUK_DO_OR_RETURN(collect_chains(impl->res_to_links, impl->chains));
+			VUK_DO_OR_RETURN(impl->diagnose_unheaded_chains());
+		}
+		stats.chains = impl->chains.size();
+		{
+			PhaseTimer _(stats.phase_times.scheduling);
+			VUK_ZONE(compile_options.instrumentation, "Scheduling");
+			VUK_DO_OR_RETURN(impl->schedule_intra_queue(impl->computed_passes, compile_options));
+			VUK_DO_OR_RETURN(impl->fix_subchains());
+		}
 
 		// auto dumped_graph = dump_graph();
 
-		queue_inference();
-		pass_partitioning();
-		resource_linking();
-		render_pass_assignment();
+		{
+			PhaseTimer _(stats.phase_times.queue_inference);
+			VUK_ZONE(compile_options.instrumentation, "Queue inference");
+			queue_inference();
+			if (compile_options.concurrent_sharing) {
+				stats.chains_shared_concurrently = impl->select_concurrent_sharing(compile_options.concurrent_sharing_attachment_crossings);
+			}
+		}
+		{
+			PhaseTimer _(stats.phase_times.partitioning);
+			VUK_ZONE(compile_options.instrumentation, "Pass partitioning");
+			pass_partitioning();
+		}
+		{
+			PhaseTimer _(stats.phase_times.resource_linking);
+			VUK_ZONE(compile_options.instrumentation, "Resource linking");
+			resource_linking();
+		}
+		{
+			PhaseTimer _(stats.phase_times.render_pass_assignment);
+			VUK_ZONE(compile_options.instrumentation, "Render pass assignment");
+			render_pass_assignment();
+		}
+		{
+			PhaseTimer _(stats.phase_times.layout_promotion);
+			VUK_ZONE(compile_options.instrumentation, "Layout promotion");
+			stats.chains_promoted_to_general = impl->promote_layouts(compile_options.layout_promotion ? *compile_options.layout_promotion : LayoutPromotionOptions{});
+		}
+		stats.render_passes_before_merge = std::count_if(impl->rpis.begin(), impl->rpis.end(), [](const RenderPassInfo& rpi) { return rpi.attachments.size() > 0; });
+		stats.arena_bytes_used = impl->arena_->used();
+		stats.arena_capacity = impl->arena_->size();
 
 		return { expected_value };
 	}
@@ -919,6 +1351,31 @@ namespace vuk {
 		impl->bound_attachments.emplace(attachment_info.name, attachment_info);
 	}
 
+	Result<void> RenderGraph::attach_history(Name name, ImageAttachment att, DeviceSuperFrameResource& resource, uint32_t history_length) {
+		auto acquired = resource.acquire_history_images(name, att, history_length + 1);
+		if (!acquired) {
+			return std::move(acquired);
+		}
+		HistoryImages* history = *acquired;
+		std::scoped_lock _(history->mutex);
+		for (uint32_t age = 0; age <= history_length; age++) {
+			auto slot = history->slot(age);
+			AttachmentInfo attachment_info;
+			attachment_info.name = { Name{}, age == 0 ? name : name.append(age == 1 ? "@prev" : "@prev" + std::to_string(age)) };
+			attachment_info.attachment = att;
+			attachment_info.attachment.image = *history->images[slot];
+			attachment_info.attachment.image_view = *history->image_views[slot];
+			attachment_info.type = AttachmentInfo::Type::eExternal;
+			attachment_info.acquire.src_use = history->last_uses[slot];
+			// images the graph does not use are carried over unchanged
+			attachment_info.final_use = attachment_info.acquire.src_use;
+			attachment_info.history = history;
+			attachment_info.history_age = age;
+			impl->bound_attachments.emplace(attachment_info.name, attachment_info);
+		}
+		return { expected_value };
+	}
+
 	void RenderGraph::attach_and_clear_image(Name name, ImageAttachment att, Clear clear_value, Access initial_acc) {
 		Name tmp_name = name.append(get_temporary_name().to_sv());
 		attach_image(tmp_name, att, initial_acc);
@@ -1161,6 +1618,137 @@ namespace vuk {
 		};
 	}
 
+	namespace {
+		// end of a layer or level range, VK_REMAINING_* extends to the end of the image
+		uint32_t range_end(uint32_t base, uint32_t count) {
+			return count == VK_REMAINING_ARRAY_LAYERS ? UINT32_MAX : base + count;
+		}
+
+		uint64_t range_end(const Subrange::Buffer& range) {
+			return range.size == VK_WHOLE_SIZE ? UINT64_MAX : range.offset + range.size;
+		}
+
+		Subrange::Image make_subrange(uint32_t layer_begin, uint32_t layer_end, uint32_t level_begin, uint32_t level_end) {
+			return { .base_layer = layer_begin,
+				       .base_level = level_begin,
+				       .layer_count = layer_end == UINT32_MAX ? VK_REMAINING_ARRAY_LAYERS : layer_end - layer_begin,
+				       .level_count = level_end == UINT32_MAX ? VK_REMAINING_MIP_LEVELS : level_end - level_begin };
+		}
+
+		Subrange::Buffer make_subrange(uint64_t begin, uint64_t end) {
+			return { .offset = begin, .size = end == UINT64_MAX ? VK_WHOLE_SIZE : end - begin };
+		}
+
+		std::optional<Subrange::Image> intersect(const Subrange::Image& a, const Subrange::Image& b) {
+			uint32_t layer_begin = std::max(a.base_layer, b.base_layer);
+			uint32_t layer_end = std::min(range_end(a.base_layer, a.layer_count), range_end(b.base_layer, b.layer_count));
+			uint32_t level_begin = std::max(a.base_level, b.base_level);
+			uint32_t level_end = std::min(range_end(a.base_level, a.level_count), range_end(b.base_level, b.level_count));
+			if (layer_begin >= layer_end || level_begin >= level_end) {
+				return {};
+			}
+			return make_subrange(layer_begin, layer_end, level_begin, level_end);
+		}
+
+		std::optional<Subrange::Buffer> intersect(const Subrange::Buffer& a, const Subrange::Buffer& b) {
+			uint64_t begin = std::max(a.offset, b.offset);
+			uint64_t end = std::min(range_end(a), range_end(b));
+			if (begin >= end) {
+				return {};
+			}
+			return make_subrange(begin, end);
+		}
+
+		// the parts of range a outside of o, where o lies within a
+		template<class F>
+		void for_each_remainder(const Subrange::Image& a, const Subrange::Image& o, F&& f) {
+			uint32_t a_layer_end = range_end(a.base_layer, a.layer_count);
+			uint32_t a_level_end = range_end(a.base_level, a.level_count);
+			uint32_t o_layer_end = range_end(o.base_layer, o.layer_count);
+			uint32_t o_level_end = range_end(o.base_level, o.level_count);
+			if (a.base_layer < o.base_layer) {
+				f(make_subrange(a.base_layer, o.base_layer, a.base_level, a_level_end));
+			}
+			if (o_layer_end < a_layer_end) {
+				f(make_subrange(o_layer_end, a_layer_end, a.base_level, a_level_end));
+			}
+			if (a.base_level < o.base_level) {
+				f(make_subrange(o.base_layer, o_layer_end, a.base_level, o.base_level));
+			}
+			if (o_level_end < a_level_end) {
+				f(make_subrange(o.base_layer, o_layer_end, o_level_end, a_level_end));
+			}
+		}
+
+		template<class F>
+		void for_each_remainder(const Subrange::Buffer& a, const Subrange::Buffer& o, F&& f) {
+			if (a.offset < o.offset) {
+				f(make_subrange(a.offset, o.offset));
+			}
+			if (range_end(o) < range_end(a)) {
+				f(make_subrange(range_end(o), range_end(a)));
+			}
+		}
+
+		bool same_use(const QueueResourceUse& a, const QueueResourceUse& b) {
+			return a.stages == b.stages && a.access == b.access && a.layout == b.layout && a.domain == b.domain;
+		}
+
+		// framebuffer attachments are always bound whole
+		Subrange::Image image_access_range(const Resource& res) {
+			return is_framebuffer_attachment(res) ? Subrange::Image{} : res.image_subrange;
+		}
+
+		// last use of each part of an image or buffer, so that an access only synchronizes against the parts it overlaps
+		// the parts always cover the range of the chain, a use of the whole range merges them again
+		template<class Range>
+		struct SubresourceUses {
+			struct Part {
+				Range range;
+				QueueResourceUse use;
+			};
+
+			Range whole;
+			std::vector<Part> parts;
+
+			void reset(Range range, QueueResourceUse use) {
+				whole = range;
+				parts.assign(1, Part{ range, use });
+			}
+
+			bool is_undefined(const Range& range) const {
+				return std::all_of(parts.begin(), parts.end(), [&](const Part& part) { return !intersect(part.range, range) || part.use.layout == ImageLayout::eUndefined; });
+			}
+
+			// union of the uses of all parts
+			QueueResourceUse merged_use(QueueResourceUse last_use) const {
+				for (auto& part : parts) {
+					last_use.stages |= part.use.stages;
+					last_use.access |= part.use.access;
+				}
+				return last_use;
+			}
+
+			void record(const Range& range, QueueResourceUse use) {
+				std::vector<Part> new_parts;
+				for (auto& part : parts) {
+					auto overlap = intersect(part.range, range);
+					if (!overlap) {
+						new_parts.push_back(part);
+						continue;
+					}
+					// the parts of the old range outside the overlap keep their use
+					for_each_remainder(part.range, *overlap, [&](Range remainder) { new_parts.push_back({ remainder, part.use }); });
+					new_parts.push_back({ *overlap, use });
+				}
+				parts = std::move(new_parts);
+				if (std::all_of(parts.begin(), parts.end(), [&](const Part& part) { return same_use(part.use, use); })) {
+					reset(whole, use);
+				}
+			}
+		};
+	} // namespace
+
 	bool crosses_queue(QueueResourceUse last_use, QueueResourceUse current_use) {
 		return (last_use.domain != DomainFlagBits::eNone && last_use.domain != DomainFlagBits::eAny && current_use.domain != DomainFlagBits::eNone &&
 		        current_use.domain != DomainFlagBits::eAny && (last_use.domain & DomainFlagBits::eQueueMask) != (current_use.domain & DomainFlagBits::eQueueMask));
@@ -1230,6 +1818,29 @@ namespace vuk {
 		barriers.append(mem_barriers, barrier);
 	}
 
+	void RGCImpl::emit_buffer_barrier(RelSpan<VkBufferMemoryBarrier2KHR>& barriers,
+	                                  int32_t bound_buffer,
+	                                  QueueResourceUse last_use,
+	                                  QueueResourceUse current_use,
+	                                  const Subrange::Buffer& range) {
+		scope_to_domain((VkPipelineStageFlagBits2KHR&)last_use.stages, current_use.domain & DomainFlagBits::eQueueMask);
+		scope_to_domain((VkPipelineStageFlagBits2KHR&)current_use.stages, current_use.domain & DomainFlagBits::eQueueMask);
+
+		VkBufferMemoryBarrier2KHR barrier{ .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR };
+		barrier.srcAccessMask = is_read_access(last_use) ? 0 : (VkAccessFlags)last_use.access;
+		barrier.dstAccessMask = (VkAccessFlags)current_use.access;
+		barrier.srcStageMask = (VkPipelineStageFlagBits2)last_use.stages.m_mask;
+		barrier.dstStageMask = (VkPipelineStageFlagBits2)current_use.stages.m_mask;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		// relative to the bound buffer, resolved when recording
+		barrier.offset = range.offset;
+		barrier.size = range.size;
+		std::memcpy(&barrier.pNext, &bound_buffer, sizeof(int32_t));
+
+		barriers.append(buffer_barriers, barrier);
+	}
+
 	Result<void> RGCImpl::generate_barriers_and_waits() {
 		// we need to handle chains in order of dependency
 		std::vector<ChainLink*> work_queue;
@@ -1264,6 +1875,37 @@ namespace vuk {
 			// initial waits are handled by the common chain code
 			// last use on the chain
 			QueueResourceUse last_use;
+			// last use of each part of the image, for accesses to subranges
+			SubresourceUses<Subrange::Image> subresource_uses;
+			SubresourceUses<Subrange::Buffer> buffer_uses;
+			// the pass using the resource last on the chain, in execution order
+			int32_t last_pass_on_chain = -1;
+			auto emit_subresource_barriers = [&](RelSpan<VkImageMemoryBarrier2KHR>& barriers, QueueResourceUse use, Subrange::Image range, bool is_release) {
+				for (auto& part : subresource_uses.parts) {
+					if (auto overlap = intersect(part.range, range)) {
+						emit_image_barrier(barriers, head->def->pass, part.use, use, *overlap, aspect, is_release);
+					}
+				}
+			};
+			// accesses to the whole buffer are synchronized with a global memory barrier, accesses to a range with buffer barriers on the overlap
+			auto emit_buffer_barriers = [&](RelSpan<VkMemoryBarrier2KHR>& memory_barriers,
+			                                RelSpan<VkBufferMemoryBarrier2KHR>& range_barriers,
+			                                QueueResourceUse use,
+			                                Subrange::Buffer range) {
+				if (range == Subrange::Buffer{}) {
+					emit_memory_barrier(memory_barriers, buffer_uses.parts.size() > 1 ? buffer_uses.merged_use(last_use) : last_use, use);
+					return;
+				}
+				for (auto& part : buffer_uses.parts) {
+					auto overlap = intersect(part.range, range);
+					// nothing to wait for before the first access
+					if (!overlap || part.use.stages == PipelineStageFlags{}) {
+						continue;
+					}
+					// after a read, the barrier carries no access but extends the execution dependency on the write that the read waited for
+					emit_buffer_barrier(range_barriers, head->def->pass, part.use, use, *overlap);
+				}
+			};
 			ChainLink* link;
 			for (link = head; link != nullptr; link = link->next) {
 				// populate last use from def or attach
@@ -1271,8 +1913,26 @@ namespace vuk {
 					auto& def_pass = get_pass(*link->def);
 					auto& def_res = get_resource(*link->def);
 					last_use = to_use(def_res.ia, def_pass.domain);
+					if (is_image && def_res.promoted_to_general) {
+						last_use.layout = ImageLayout::eGeneral;
+					}
 				} else {
 					last_use = is_image ? get_bound_attachment(head->def->pass).acquire.src_use : get_bound_buffer(head->def->pass).acquire.src_use;
+					// history images are last used on a queue of an earlier execution - there is nothing to wait on if they are used on another queue now
+					if (is_image && get_bound_attachment(head->def->pass).history && last_use.domain != DomainFlagBits::eAny) {
+						auto last_queue = last_use.domain & DomainFlagBits::eQueueMask;
+						bool other_queue = link->undef && link->undef->pass >= 0 && (get_pass(*link->undef).domain & DomainFlagBits::eQueueMask) != last_queue;
+						for (auto& r : link->reads.to_span(pass_reads)) {
+							other_queue |= (get_pass(r).domain & DomainFlagBits::eQueueMask) != last_queue;
+						}
+						if (other_queue) {
+							return { expected_error, errors::make_history_queue_exception(get_bound_attachment(head->def->pass)) };
+						}
+					}
+				}
+				if (link == head) {
+					subresource_uses.reset(image_subrange, last_use);
+					buffer_uses.reset(Subrange::Buffer{}, last_use);
 				}
 
 				// handle chain
@@ -1302,6 +1962,9 @@ namespace vuk {
 						bool need_general = false;
 						use.domain = DomainFlagBits::eNone;
 						use.layout = ImageLayout::eReadOnlyOptimalKHR;
+						// reads of a single subrange synchronize only that subrange, reads of different subranges synchronize the whole resource
+						Subrange::Image read_range;
+						Subrange::Buffer buffer_read_range;
 						for (; read_idx < reads.size(); read_idx++) {
 							auto& r = reads[read_idx];
 							auto& pass = get_pass(r);
@@ -1316,6 +1979,17 @@ namespace vuk {
 								// so we synchronize against them individually by setting last use and ending the read gather
 								break;
 							}
+							if (read_idx == start_of_reads) {
+								read_range = image_access_range(res);
+								buffer_read_range = res.buffer_subrange;
+							} else {
+								if (read_range != image_access_range(res)) {
+									read_range = Subrange::Image{};
+								}
+								if (buffer_read_range != res.buffer_subrange) {
+									buffer_read_range = Subrange::Buffer{};
+								}
+							}
 							// this read can be merged, so merge it
 							int32_t order_idx = (int32_t)computed_pass_idx_to_ordered_idx[r.pass];
 							if (order_idx < first_pass_idx) {
@@ -1328,7 +2002,7 @@ namespace vuk {
 							if (is_transfer_access(res.ia)) {
 								need_transfer = true;
 							}
-							if (is_storage_access(res.ia)) {
+							if (is_storage_access(res.ia) || res.promoted_to_general) {
 								need_general = true;
 							}
 							if (is_readonly_access(res.ia)) {
@@ -1361,18 +2035,16 @@ namespace vuk {
 						// TODO: do not emit this if dep is a read and the layouts match
 						auto& dst = get_pass(first_pass_idx);
 						if (is_image) {
-							if (crosses_queue(last_use, use)) {
-								emit_image_barrier(get_pass((int32_t)computed_pass_idx_to_ordered_idx[last_use_source]).post_image_barriers,
-								                   head->def->pass,
-								                   last_use,
-								                   use,
-								                   image_subrange,
-								                   aspect,
-								                   true);
+							// concurrent images need no release, the acquire on the other queue does the layout transition
+							if (crosses_queue(last_use, use) && !is_shared_concurrently(head->def->pass)) {
+								emit_subresource_barriers(
+								    get_pass((int32_t)computed_pass_idx_to_ordered_idx[last_use_source]).post_image_barriers, use, read_range, true);
 							}
-							emit_image_barrier(dst.pre_image_barriers, head->def->pass, last_use, use, image_subrange, aspect);
+							emit_subresource_barriers(dst.pre_image_barriers, use, read_range, false);
+							subresource_uses.record(read_range, use);
 						} else {
-							emit_memory_barrier(dst.pre_memory_barriers, last_use, use);
+							emit_buffer_barriers(dst.pre_memory_barriers, dst.pre_buffer_barriers, use, buffer_read_range);
+							buffer_uses.record(buffer_read_range, use);
 						}
 						if (crosses_queue(last_use, use)) {
 							// in this case def was on a different queue the subsequent reads
@@ -1386,6 +2058,7 @@ namespace vuk {
 						last_use_source = reads[read_idx - 1].pass;
 						start_of_reads = read_idx;
 					}
+					last_pass_on_chain = std::max(last_pass_on_chain, last_executing_pass_idx);
 				}
 
 				// if there are no intervening reads, emit def -> undef, otherwise emit reads -> undef
@@ -1395,9 +2068,13 @@ namespace vuk {
 					auto& pass = get_pass(*link->undef);
 					auto& res = get_resource(*link->undef);
 					QueueResourceUse use = to_use(res.ia, pass.domain);
+					if (is_image && res.promoted_to_general) {
+						use.layout = ImageLayout::eGeneral;
+					}
 					if (use.layout == ImageLayout::eGeneral) {
 						res.promoted_to_general = true;
 					}
+					Subrange::Image range = image_access_range(res);
 
 					// handle renderpass details
 					// all renderpass write-attachments are entered via an undef (because of it being a write)
@@ -1407,7 +2084,7 @@ namespace vuk {
 						for (auto& att : rpi.attachments.to_span(rp_infos)) {
 							if (att.attachment_info == &bound_att) {
 								// if the last use was discard, then downgrade load op
-								if (last_use.layout == ImageLayout::eUndefined) {
+								if (subresource_uses.is_undefined(range)) {
 									att.description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 								} else if (use.access & AccessFlagBits::eColorAttachmentWrite) { // add CA read, because of LOAD_OP_LOAD
 									use.access |= AccessFlagBits::eColorAttachmentRead;
@@ -1428,15 +2105,18 @@ namespace vuk {
 
 					if (res.ia != eConsume) {
 						if (is_image) {
-							if (crosses_queue(last_use, use)) { // release barrier
+							if (crosses_queue(last_use, use) && !is_shared_concurrently(head->def->pass)) { // release barrier
 								if (last_executing_pass_idx !=
 								    -1) { // if last_executing_pass_idx is -1, then there is release in this rg, so we don't emit the release (single-sided acq)
-									emit_image_barrier(get_pass(last_executing_pass_idx).post_image_barriers, head->def->pass, last_use, use, image_subrange, aspect, true);
+									emit_subresource_barriers(get_pass(last_executing_pass_idx).post_image_barriers, use, range, true);
 								}
 							}
-							emit_image_barrier(get_pass(*link->undef).pre_image_barriers, head->def->pass, last_use, use, image_subrange, aspect);
+							emit_subresource_barriers(get_pass(*link->undef).pre_image_barriers, use, range, false);
+							subresource_uses.record(range, use);
 						} else {
-							emit_memory_barrier(get_pass(*link->undef).pre_memory_barriers, last_use, use);
+							auto& undef_pass = get_pass(*link->undef);
+							emit_buffer_barriers(undef_pass.pre_memory_barriers, undef_pass.pre_buffer_barriers, use, res.buffer_subrange);
+							buffer_uses.record(res.buffer_subrange, use);
 						}
 
 						if (crosses_queue(last_use, use)) {
@@ -1451,6 +2131,7 @@ namespace vuk {
 							}
 						}
 						last_use = use;
+						last_pass_on_chain = std::max(last_pass_on_chain, (int32_t)computed_pass_idx_to_ordered_idx[link->undef->pass]);
 					}
 				}
 
@@ -1460,6 +2141,22 @@ namespace vuk {
 				}
 			}
 
+			// if accesses to subranges left the parts of the image in different states, bring the parts to the last use
+			// so that whatever comes after the chain (release, subchains, next execution of a history) sees a single state
+			if (is_image && subresource_uses.parts.size() > 1 && last_pass_on_chain >= 0 &&
+			    (link->undef || link->child_chains.size() > 0 || get_bound_attachment(head->def->pass).history)) {
+				for (auto& part : subresource_uses.parts) {
+					if (!same_use(part.use, last_use)) {
+						emit_image_barrier(get_pass(last_pass_on_chain).post_image_barriers, head->def->pass, part.use, last_use, part.range, aspect);
+					}
+				}
+				subresource_uses.reset(image_subrange, last_use);
+			}
+			// whatever comes after the chain waits for the accesses to all ranges of the buffer
+			if (!is_image && buffer_uses.parts.size() > 1) {
+				last_use = buffer_uses.merged_use(last_use);
+			}
+
 			// tail can be either a release or nothing
 			if (link->undef && link->undef->pass < 0) { // a release
 				// what if last pass is a read:
@@ -1504,17 +2201,26 @@ namespace vuk {
 					if (is_image) {
 						// single sided release barrier
 						emit_image_barrier(get_pass(last_pass_idx).post_image_barriers, head->def->pass, last_use, use, image_subrange, aspect, true);
+						if (!is_subchain) {
+							get_bound_attachment(head->def->pass).final_use = use;
+						}
 					} else {
 						emit_memory_barrier(get_pass(last_pass_idx).post_memory_barriers, last_use, use);
 					}
+				} else if (is_image && !is_subchain) {
+					get_bound_attachment(head->def->pass).final_use = last_use;
 				}
 			} else if (!link->undef) {
+				if (is_image && !is_subchain) {
+					get_bound_attachment(head->def->pass).final_use = last_use;
+				}
 				// no release on this end, so if def belongs to an RP and there were no reads, we can downgrade the store
+				// (unless the image is history, which is read by the next execution)
 				if (link->def && link->def->pass >= 0 && link->reads.size() == 0) {
 					auto& pass = get_pass(link->def->pass);
-					if (pass.render_pass_index >= 0) {
+					auto& bound_att = get_bound_attachment(head->def->pass);
+					if (pass.render_pass_index >= 0 && !bound_att.history) {
 						auto& rpi = rpis[pass.render_pass_index];
-						auto& bound_att = get_bound_attachment(head->def->pass);
 						for (auto& att : rpi.attachments.to_span(rp_infos)) {
 							if (att.attachment_info == &bound_att) {
 								att.description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -1583,7 +2289,8 @@ namespace vuk {
 				continue;
 			}
 			// - contain only color and ds deps between them
-			if (pass0.post_memory_barriers.size() > 0 || pass1.pre_memory_barriers.size() > 0) {
+			if (pass0.post_memory_barriers.size() > 0 || pass1.pre_memory_barriers.size() > 0 || pass0.post_buffer_barriers.size() > 0 ||
+			    pass1.pre_buffer_barriers.size() > 0) {
 				continue;
 			}
 			for (auto& bar : pass0.post_image_barriers.to_span(image_barriers)) {
@@ -1816,20 +2523,72 @@ namespace vuk {
 	Result<ExecutableRenderGraph> Compiler::link(std::span<std::shared_ptr<RenderGraph>> rgs, const RenderGraphCompileOptions& compile_options) {
 		VUK_DO_OR_RETURN(compile(rgs, compile_options));
 
-		VUK_DO_OR_RETURN(impl->generate_barriers_and_waits());
-
-		VUK_DO_OR_RETURN(impl->merge_rps());
-
-		VUK_DO_OR_RETURN(impl->assign_passes_to_batches());
-
-		VUK_DO_OR_RETURN(impl->build_waits());
+		auto& stats = impl->stats;
+		PhaseTimer total_timer(stats.total_time);
+		VUK_ZONE(compile_options.instrumentation, "Render graph link");
+		{
+			PhaseTimer _(stats.phase_times.barrier_generation);
+			VUK_ZONE(compile_options.instrumentation, "Barrier generation");
+			VUK_DO_OR_RETURN(impl->generate_barriers_and_waits());
+		}
+		{
+			PhaseTimer _(stats.phase_times.render_pass_merge);
+			VUK_ZONE(compile_options.instrumentation, "Render pass merge");
+			VUK_DO_OR_RETURN(impl->merge_rps());
+		}
+		{
+			PhaseTimer _(stats.phase_times.batching);
+			VUK_ZONE(compile_options.instrumentation, "Batching");
+			VUK_DO_OR_RETURN(impl->assign_passes_to_batches());
 
-		// we now have enough data to build VkRenderPasses and VkFramebuffers
-		VUK_DO_OR_RETURN(impl->build_renderpasses());
+			VUK_DO_OR_RETURN(impl->build_waits());
+		}
+		{
+			PhaseTimer _(stats.phase_times.render_pass_building);
+			VUK_ZONE(compile_options.instrumentation, "Render pass building");
+			// we now have enough data to build VkRenderPasses and VkFramebuffers
+			VUK_DO_OR_RETURN(impl->build_renderpasses());
+		}
+
+		// barrier ranges are relative to the bound attachment until recording, resolve the remaining levels and layers against it
+		auto count_subresources = [&](RelSpan<VkImageMemoryBarrier2KHR> barriers) {
+			for (auto& bar : barriers.to_span(impl->image_barriers)) {
+				int32_t bound_attachment;
+				std::memcpy(&bound_attachment, &bar.pNext, sizeof(int32_t));
+				auto& ia = impl->get_bound_attachment(bound_attachment).attachment;
+				auto& range = bar.subresourceRange;
+				size_t levels = range.levelCount != VK_REMAINING_MIP_LEVELS ? range.levelCount
+				                : ia.level_count != VK_REMAINING_MIP_LEVELS   ? ia.level_count - range.baseMipLevel
+				                                                              : 1;
+				size_t layers = range.layerCount != VK_REMAINING_ARRAY_LAYERS ? range.layerCount
+				                : ia.layer_count != VK_REMAINING_ARRAY_LAYERS ? ia.layer_count - range.baseArrayLayer
+				                                                              : 1;
+				stats.image_barrier_subresources += levels * layers;
+			}
+		};
+		for (auto& pass : impl->computed_passes) {
+			stats.image_barriers += pass.pre_image_barriers.size() + pass.post_image_barriers.size();
+			count_subresources(pass.pre_image_barriers);
+			count_subresources(pass.post_image_barriers);
+			stats.memory_barriers += pass.pre_memory_barriers.size() + pass.post_memory_barriers.size();
+			stats.buffer_barriers += pass.pre_buffer_barriers.size() + pass.post_buffer_barriers.size();
+		}
+		stats.render_passes_after_merge = std::count_if(impl->rpis.begin(), impl->rpis.end(), [](const RenderPassInfo& rpi) { return rpi.attachments.size() > 0; });
+		stats.arena_bytes_used = impl->arena_->used();
+
+		VUK_COUNTER(compile_options.instrumentation, "vuk passes", stats.passes);
+		VUK_COUNTER(compile_options.instrumentation, "vuk image barriers", stats.image_barriers);
+		VUK_COUNTER(compile_options.instrumentation, "vuk memory barriers", stats.memory_barriers);
+		VUK_COUNTER(compile_options.instrumentation, "vuk buffer barriers", stats.buffer_barriers);
+		VUK_COUNTER(compile_options.instrumentation, "vuk render passes", stats.render_passes_after_merge);
 
 		return { expected_value, *this };
 	}
 
+	const CompileStats& Compiler::get_compile_stats() const {
+		return impl->stats;
+	}
+
 	std::span<ChainLink*> Compiler::get_use_chains() const {
 		return std::span(impl->chains);
 	}
@@ -55,6 +55,10 @@ namespace vuk {
 		RelSpan<Resource> resources;
 
 		std::function<void(CommandBuffer&)> execute;
+		bool use_secondary_command_buffers = false;
+		uint64_t content_key = 0;
+		bool pure = false;
+		uint64_t parameter_hash = 0;
 		std::byte* arguments; // internal use
 		PassType type;
 		source_location source;
@@ -77,12 +81,15 @@ namespace vuk {
 
 		RelSpan<VkImageMemoryBarrier2KHR> pre_image_barriers, post_image_barriers;
 		RelSpan<VkMemoryBarrier2KHR> pre_memory_barriers, post_memory_barriers;
+		RelSpan<VkBufferMemoryBarrier2KHR> pre_buffer_barriers, post_buffer_barriers;
 		RelSpan<std::pair<DomainFlagBits, uint64_t>> relative_waits;
 		RelSpan<std::pair<DomainFlagBits, uint64_t>> absolute_waits;
 		RelSpan<FutureBase*> future_signals;
 		RelSpan<int32_t> referenced_swapchains; // TODO: maybe not the best place for it
 
 		int32_t is_waited_on = 0;
+		// hash of the inputs of a pure pass, remembered once the pass is recorded
+		uint64_t memoization_hash = 0;
 	};
 
 #define INIT(x) x(decltype(x)::allocator_type(*arena_))
@@ -152,6 +159,8 @@ namespace vuk {
 		RGCImpl(arena* a) : arena_(a), INIT(computed_passes), INIT(ordered_passes), INIT(partitioned_passes), INIT(rpis) {}
 		std::unique_ptr<arena> arena_;
 
+		CompileStats stats;
+
 		// per PassInfo
 		std::vector<Resource> resources;
 
@@ -175,6 +184,7 @@ namespace vuk {
 
 		std::vector<VkImageMemoryBarrier2KHR> image_barriers;
 		std::vector<VkMemoryBarrier2KHR> mem_barriers;
+		std::vector<VkBufferMemoryBarrier2KHR> buffer_barriers;
 
 		ResourceLinkMap res_to_links;
 		std::vector<ChainAccess> pass_reads;
@@ -273,13 +283,21 @@ namespace vuk {
 
 		void merge_diverge_passes(std::vector<PassInfo, short_alloc<PassInfo, 64>>& passes);
 
+		// kept across compiles - input hashes of pure passes as of the last time they were recorded
+		robin_hood::unordered_flat_map<QualifiedName, uint64_t> memoized_passes;
+		size_t skip_memoized_passes();
+
 		void compute_prefixes(const RenderGraph& rg, std::string& prefix);
 		void inline_subgraphs(const RenderGraph& rg, robin_hood::unordered_flat_set<RenderGraph*>& consumed_rgs);
 
 		Result<void> terminate_chains();
 		Result<void> diagnose_unheaded_chains();
 		Result<void> schedule_intra_queue(std::span<struct PassInfo> passes, const RenderGraphCompileOptions& compile_options);
+		void reorder_passes(std::span<struct PassInfo> passes, std::span<const uint8_t> adjacency_matrix);
 		Result<void> fix_subchains();
+		size_t promote_layouts(const LayoutPromotionOptions& options);
+		size_t select_concurrent_sharing(uint32_t attachment_crossings);
+		bool is_shared_concurrently(int32_t bound_attachment);
 
 		void emit_image_barrier(RelSpan<VkImageMemoryBarrier2KHR>&,
 		                        int32_t bound_attachment,
@@ -289,6 +307,11 @@ namespace vuk {
 		                        ImageAspectFlags aspect,
 		                        bool is_release = false);
 		void emit_memory_barrier(RelSpan<VkMemoryBarrier2KHR>&, QueueResourceUse last_use, QueueResourceUse current_use);
+		void emit_buffer_barrier(RelSpan<VkBufferMemoryBarrier2KHR>&,
+		                         int32_t bound_buffer,
+		                         QueueResourceUse last_use,
+		                         QueueResourceUse current_use,
+		                         const Subrange::Buffer& range);
 
 		// opt passes
 		Result<void> merge_rps();
@@ -303,6 +326,7 @@ namespace vuk {
 		                   VkCommandBuffer cbuf,
 		                   vuk::DomainFlagBits domain,
 		                   RelSpan<VkMemoryBarrier2KHR> mem_bars,
+		                   RelSpan<VkBufferMemoryBarrier2KHR> buf_bars,
 		                   RelSpan<VkImageMemoryBarrier2KHR> im_bars);
 
 		ImageUsageFlags compute_usage(const ChainLink* head);
@@ -351,5 +375,6 @@ namespace vuk {
 		RenderGraphException make_unattached_resource_exception(PassInfo& pass_info, Resource& resource);
 		RenderGraphException make_cbuf_references_unknown_resource(PassInfo& pass_info, Resource::Type type, Name name);
 		RenderGraphException make_cbuf_references_undeclared_resource(PassInfo& pass_info, Resource::Type type, Name name);
+		RenderGraphException make_history_queue_exception(AttachmentInfo& attachment_info);
 	} // namespace errors
 };  // namespace vuk
\ No newline at end of file
@@ -6,11 +6,13 @@
 namespace vuk {
 	namespace detail {
 		ImageResourceInputOnly ImageResource::operator>>(Access ia) {
-			return { name, ia };
+			return { name, ia, subrange };
 		}
 
 		Resource ImageResourceInputOnly::operator>>(Name out) {
-			return { name, Resource::Type::eImage, ba, out };
+			Resource res{ name, Resource::Type::eImage, ba, out };
+			res.image_subrange = subrange;
+			return res;
 		}
 
 		ImageResourceInputOnly::operator Resource() {
@@ -21,11 +23,13 @@ namespace vuk {
 		}
 
 		BufferResourceInputOnly BufferResource::operator>>(Access ba) {
-			return { name, ba };
+			return { name, ba, subrange };
 		}
 
 		Resource BufferResourceInputOnly::operator>>(Name out) {
-			return { name, Resource::Type::eBuffer, ba, out };
+			Resource res{ name, Resource::Type::eBuffer, ba, out };
+			res.buffer_subrange = subrange;
+			return res;
 		}
 
 		BufferResourceInputOnly::operator Resource() {
@@ -186,5 +190,12 @@ namespace vuk {
 			                                  name.c_str());
 			return RenderGraphException(std::move(message));
 		}
+
+		RenderGraphException make_history_queue_exception(AttachmentInfo& attachment_info) {
+			std::string message = fmt::format("History image <{}> is used on a different queue than in the previous execution - history images must be used on "
+			                                  "the same queue in every execution.",
+			                                  attachment_info.name.name.c_str());
+			return RenderGraphException(std::move(message));
+		}
 	} // namespace errors
 } // namespace vuk
@@ -297,6 +297,12 @@ namespace vuk {
 
 		RelSpan<ChainLink*> use_chains = {};
 		std::optional<Allocator> allocator = {};
+
+		// history resource the image belongs to, and how many executions old it is
+		HistoryImages* history = nullptr;
+		uint32_t history_age = 0;
+		// use at the end of the graph, carried over to the next execution for history images
+		QueueResourceUse final_use = {};
 	};
 
 	struct AttachmentRPInfo {
@@ -0,0 +1,459 @@
+#include "vuk/TraceRecorder.hpp"
+#include "vuk/Context.hpp"
+#include "vuk/Instrumentation.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace vuk {
+	std::string_view to_name(vuk::DomainFlagBits d);
+
+	namespace {
+		struct ZoneEvent {
+			const InstrumentationZone* zone;
+			std::string detail;
+			uint32_t thread;
+			int64_t ns;
+			bool begin;
+		};
+
+		struct CounterEvent {
+			const char* name;
+			double value;
+			int64_t ns;
+		};
+
+		struct FrameEvent {
+			uint64_t absolute_frame;
+			int64_t ns;
+		};
+
+		struct GpuPassEvent {
+			Name name;
+			Query begin;
+			Query end;
+			std::optional<uint64_t> begin_ticks;
+			std::optional<uint64_t> end_ticks;
+		};
+
+		struct SubmitEvent {
+			DomainFlagBits domain;
+			uint32_t queue_index;
+			uint64_t signal_value;
+			std::vector<std::pair<uint32_t, uint64_t>> waits; // queue index and timeline value
+			uint32_t thread;
+			int64_t begin_ns;
+			int64_t end_ns;
+			std::vector<GpuPassEvent> passes;
+		};
+
+		// a device timestamp and the host time it was taken at
+		struct Calibration {
+			uint64_t gpu_ticks;
+			std::chrono::steady_clock::time_point host_time;
+		};
+
+		// the host time domain that matches std::chrono::steady_clock
+		std::optional<VkTimeDomainEXT> steady_clock_time_domain() {
+#if defined(_WIN32)
+			return VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#elif defined(__linux__)
+			return VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#else
+			return {};
+#endif
+		}
+
+		std::chrono::steady_clock::time_point host_timestamp_to_steady_clock(uint64_t value) {
+#if defined(_WIN32)
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			uint64_t freq = (uint64_t)frequency.QuadPart;
+			uint64_t ns = (value / freq) * 1000000000ull + (value % freq) * 1000000000ull / freq;
+			return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+#else
+			return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(value)));
+#endif
+		}
+
+		void write_escaped(std::ostream& os, std::string_view str) {
+			os << '"';
+			for (char c : str) {
+				switch (c) {
+				case '"':
+					os << "\\\"";
+					break;
+				case '\\':
+					os << "\\\\";
+					break;
+				case '\n':
+					os << "\\n";
+					break;
+				case '\t':
+					os << "\\t";
+					break;
+				default:
+					if ((unsigned char)c < 0x20) {
+						os << ' ';
+					} else {
+						os << c;
+					}
+				}
+			}
+			os << '"';
+		}
+	} // namespace
+
+	struct TraceRecorderImpl {
+		Context& ctx;
+
+		std::mutex mutex;
+		bool capturing = false;
+		std::chrono::steady_clock::time_point origin;
+		InstrumentationCallbacks previous;
+		std::optional<Calibration> calibration;
+
+		std::unordered_map<std::thread::id, uint32_t> threads;
+		std::vector<ZoneEvent> zones;
+		std::vector<CounterEvent> counters;
+		std::vector<FrameEvent> frames;
+		std::vector<SubmitEvent> submits;
+
+		TraceRecorderImpl(Context& ctx) : ctx(ctx), origin(std::chrono::steady_clock::now()) {}
+
+		int64_t to_ns(std::chrono::steady_clock::time_point t) const {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count();
+		}
+
+		int64_t now_ns() const {
+			return to_ns(std::chrono::steady_clock::now());
+		}
+
+		// must be called with the mutex held
+		uint32_t thread_index() {
+			return threads.try_emplace(std::this_thread::get_id(), (uint32_t)threads.size()).first->second;
+		}
+
+		void calibrate() {
+			calibration.reset();
+			auto host_domain = steady_clock_time_domain();
+			if (!host_domain || !ctx.vkGetCalibratedTimestampsEXT || !ctx.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) {
+				return;
+			}
+			uint32_t domain_count = 0;
+			ctx.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(ctx.physical_device, &domain_count, nullptr);
+			std::vector<VkTimeDomainEXT> domains(domain_count);
+			ctx.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(ctx.physical_device, &domain_count, domains.data());
+			auto has_domain = [&](VkTimeDomainEXT d) {
+				return std::find(domains.begin(), domains.end(), d) != domains.end();
+			};
+			if (!has_domain(VK_TIME_DOMAIN_DEVICE_EXT) || !has_domain(*host_domain)) {
+				return;
+			}
+
+			VkCalibratedTimestampInfoEXT infos[2] = { { .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT },
+				                                        { .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = *host_domain } };
+			uint64_t timestamps[2];
+			uint64_t max_deviation;
+			if (ctx.vkGetCalibratedTimestampsEXT(ctx.device, 2, infos, timestamps, &max_deviation) != VK_SUCCESS) {
+				return;
+			}
+			calibration = Calibration{ timestamps[0], host_timestamp_to_steady_clock(timestamps[1]) };
+		}
+
+		// fetch the GPU timestamps that have become available since the last call
+		void resolve_timestamps() {
+			for (auto& submit : submits) {
+				for (auto& pass : submit.passes) {
+					if (!pass.begin_ticks && ctx.is_timestamp_available(pass.begin)) {
+						pass.begin_ticks = ctx.retrieve_timestamp(pass.begin);
+					}
+					if (!pass.end_ticks && ctx.is_timestamp_available(pass.end)) {
+						pass.end_ticks = ctx.retrieve_timestamp(pass.end);
+					}
+				}
+			}
+		}
+
+		static void* begin_zone(void* user_data, const InstrumentationZone& zone, const char* detail) {
+			auto& self = *reinterpret_cast<TraceRecorderImpl*>(user_data);
+			void* zone_data = self.previous.begin_zone ? self.previous.begin_zone(self.previous.user_data, zone, detail) : nullptr;
+			std::lock_guard _(self.mutex);
+			self.zones.push_back(ZoneEvent{ &zone, detail ? detail : "", self.thread_index(), self.now_ns(), true });
+			return zone_data;
+		}
+
+		static void end_zone(void* user_data, void* zone_data) {
+			auto& self = *reinterpret_cast<TraceRecorderImpl*>(user_data);
+			{
+				std::lock_guard _(self.mutex);
+				self.zones.push_back(ZoneEvent{ nullptr, {}, self.thread_index(), self.now_ns(), false });
+			}
+			if (self.previous.end_zone) {
+				self.previous.end_zone(self.previous.user_data, zone_data);
+			}
+		}
+
+		static void counter(void* user_data, const char* name, double value) {
+			auto& self = *reinterpret_cast<TraceRecorderImpl*>(user_data);
+			{
+				std::lock_guard _(self.mutex);
+				self.counters.push_back(CounterEvent{ name, value, self.now_ns() });
+			}
+			if (self.previous.counter) {
+				self.previous.counter(self.previous.user_data, name, value);
+			}
+		}
+
+		// frames are recorded through record_frame, so they are captured without VUK_INSTRUMENTATION too
+		static void frame_mark(void* user_data, uint64_t absolute_frame) {
+			auto& self = *reinterpret_cast<TraceRecorderImpl*>(user_data);
+			if (self.previous.frame_mark) {
+				self.previous.frame_mark(self.previous.user_data, absolute_frame);
+			}
+		}
+	};
+
+	TraceRecorder::TraceRecorder(Context& ctx) : impl(new TraceRecorderImpl(ctx)) {}
+
+	TraceRecorder::~TraceRecorder() {
+		end_capture();
+		delete impl;
+	}
+
+	void TraceRecorder::begin_capture() {
+		if (impl->capturing) {
+			return;
+		}
+		impl->previous = *impl->ctx.get_instrumentation_callbacks();
+		impl->ctx.set_instrumentation_callbacks(InstrumentationCallbacks{ .begin_zone = &TraceRecorderImpl::begin_zone,
+		                                                                  .end_zone = &TraceRecorderImpl::end_zone,
+		                                                                  .counter = &TraceRecorderImpl::counter,
+		                                                                  .frame_mark = &TraceRecorderImpl::frame_mark,
+		                                                                  .user_data = impl });
+		impl->calibrate();
+		impl->capturing = true;
+		impl->ctx.set_trace_recorder(this);
+	}
+
+	void TraceRecorder::end_capture() {
+		if (!impl->capturing) {
+			return;
+		}
+		impl->ctx.set_trace_recorder(nullptr);
+		impl->ctx.set_instrumentation_callbacks(impl->previous);
+		impl->capturing = false;
+	}
+
+	bool TraceRecorder::is_capturing() const {
+		return impl->capturing;
+	}
+
+	void TraceRecorder::clear() {
+		std::lock_guard _(impl->mutex);
+		impl->zones.clear();
+		impl->counters.clear();
+		impl->frames.clear();
+		impl->submits.clear();
+		impl->origin = std::chrono::steady_clock::now();
+	}
+
+	void TraceRecorder::record_submit(DomainFlagBits domain,
+	                                  uint64_t signal_value,
+	                                  std::span<const std::pair<DomainFlagBits, uint64_t>> waits,
+	                                  std::span<const PassTimestamps> passes,
+	                                  std::chrono::steady_clock::time_point submit_begin,
+	                                  std::chrono::steady_clock::time_point submit_end) {
+		SubmitEvent submit{ .domain = domain, .queue_index = impl->ctx.domain_to_queue_index(domain), .signal_value = signal_value };
+		for (auto& [wait_domain, value] : waits) {
+			submit.waits.emplace_back(impl->ctx.domain_to_queue_index(wait_domain), value);
+		}
+		for (auto& p : passes) {
+			submit.passes.push_back(GpuPassEvent{ p.name, p.begin, p.end });
+		}
+		submit.begin_ns = impl->to_ns(submit_begin);
+		submit.end_ns = impl->to_ns(submit_end);
+
+		std::lock_guard _(impl->mutex);
+		submit.thread = impl->thread_index();
+		impl->submits.emplace_back(std::move(submit));
+	}
+
+	void TraceRecorder::record_frame(uint64_t absolute_frame) {
+		std::lock_guard _(impl->mutex);
+		impl->frames.push_back(FrameEvent{ absolute_frame, impl->now_ns() });
+	}
+
+	void TraceRecorder::write_json(std::ostream& os) {
+		std::lock_guard _(impl->mutex);
+		impl->resolve_timestamps();
+
+		constexpr int cpu_pid = 1;
+		constexpr int gpu_pid = 2;
+		double period = impl->ctx.physical_device_properties.limits.timestampPeriod;
+
+		// place the GPU timeline on the host timeline: either from the calibration, or such that no GPU work starts before it was submitted
+		int64_t gpu_offset_ns = 0;
+		if (impl->calibration) {
+			gpu_offset_ns = impl->to_ns(impl->calibration->host_time) - (int64_t)((double)impl->calibration->gpu_ticks * period);
+		} else {
+			bool first = true;
+			for (auto& submit : impl->submits) {
+				for (auto& pass : submit.passes) {
+					if (pass.begin_ticks) {
+						int64_t offset = submit.begin_ns - (int64_t)((double)*pass.begin_ticks * period);
+						gpu_offset_ns = first ? offset : std::max(gpu_offset_ns, offset);
+						first = false;
+					}
+				}
+			}
+		}
+		auto gpu_ns = [&](uint64_t ticks) {
+			return (int64_t)((double)ticks * period) + gpu_offset_ns;
+		};
+
+		std::ostringstream ss;
+		ss.setf(std::ios::fixed);
+		ss.precision(3);
+		auto us = [](int64_t ns) {
+			return (double)ns / 1000.0;
+		};
+		bool first_event = true;
+		auto begin_event = [&]() -> std::ostream& {
+			if (!first_event) {
+				ss << ",\n";
+			}
+			first_event = false;
+			return ss;
+		};
+
+		ss << "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"gpu_timeline\":" << (impl->calibration ? "\"calibrated\"" : "\"aligned to submits\"")
+		   << "},\"traceEvents\":[\n";
+
+		begin_event() << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << cpu_pid << ",\"args\":{\"name\":\"CPU\"}}";
+		begin_event() << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << gpu_pid << ",\"args\":{\"name\":\"GPU\"}}";
+		for (auto& [id, index] : impl->threads) {
+			begin_event() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << cpu_pid << ",\"tid\":" << index << ",\"args\":{\"name\":\"Thread " << index
+			              << "\"}}";
+		}
+		std::vector<uint32_t> named_queues;
+		for (auto& submit : impl->submits) {
+			if (std::find(named_queues.begin(), named_queues.end(), submit.queue_index) == named_queues.end()) {
+				named_queues.push_back(submit.queue_index);
+				begin_event() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << gpu_pid << ",\"tid\":" << submit.queue_index << ",\"args\":{\"name\":\""
+				              << to_name(submit.domain) << " queue\"}}";
+			}
+		}
+
+		for (auto& z : impl->zones) {
+			auto& e = begin_event() << "{\"ph\":\"" << (z.begin ? 'B' : 'E') << "\",\"pid\":" << cpu_pid << ",\"tid\":" << z.thread << ",\"ts\":" << us(z.ns);
+			if (z.begin) {
+				e << ",\"cat\":\"vuk\",\"name\":";
+				write_escaped(e, z.zone->name);
+				e << ",\"args\":{\"function\":";
+				write_escaped(e, z.zone->function);
+				if (!z.detail.empty()) {
+					e << ",\"detail\":";
+					write_escaped(e, z.detail);
+				}
+				e << "}";
+			}
+			e << "}";
+		}
+		for (auto& c : impl->counters) {
+			auto& e = begin_event() << "{\"ph\":\"C\",\"pid\":" << cpu_pid << ",\"ts\":" << us(c.ns) << ",\"name\":";
+			write_escaped(e, c.name);
+			e << ",\"args\":{\"value\":" << c.value << "}}";
+		}
+		for (auto& f : impl->frames) {
+			begin_event() << "{\"ph\":\"i\",\"s\":\"g\",\"pid\":" << cpu_pid << ",\"tid\":0,\"ts\":" << us(f.ns) << ",\"name\":\"Frame " << f.absolute_frame
+			              << "\"}";
+		}
+
+		// a submit is drawn on the CPU thread that submitted it and, if its timestamps are available, on the GPU track of its queue
+		struct SubmitSpan {
+			int pid;
+			uint32_t tid;
+			int64_t begin_ns;
+			int64_t end_ns;
+		};
+		std::unordered_map<uint64_t, SubmitSpan> spans; // keyed by queue index and signal value
+		auto key = [](uint32_t queue_index, uint64_t value) {
+			return ((uint64_t)queue_index << 62) | value;
+		};
+		uint64_t flow_id = 0;
+		auto flow = [&](const SubmitSpan& from, const SubmitSpan& to) {
+			flow_id++;
+			begin_event() << "{\"ph\":\"s\",\"cat\":\"vuk.flow\",\"name\":\"wait\",\"id\":" << flow_id << ",\"pid\":" << from.pid << ",\"tid\":" << from.tid
+			              << ",\"ts\":" << us(from.end_ns) << "}";
+			begin_event() << "{\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"vuk.flow\",\"name\":\"wait\",\"id\":" << flow_id << ",\"pid\":" << to.pid
+			              << ",\"tid\":" << to.tid << ",\"ts\":" << us(to.begin_ns) << "}";
+		};
+
+		for (auto& submit : impl->submits) {
+			auto& e = begin_event() << "{\"ph\":\"X\",\"cat\":\"vuk.submit\",\"pid\":" << cpu_pid << ",\"tid\":" << submit.thread << ",\"ts\":" << us(submit.begin_ns)
+			                        << ",\"dur\":" << us(submit.end_ns - submit.begin_ns) << ",\"name\":\"Submit " << to_name(submit.domain) << " #"
+			                        << submit.signal_value << "\"}";
+			SubmitSpan cpu_span{ cpu_pid, submit.thread, submit.begin_ns, submit.end_ns };
+
+			std::optional<SubmitSpan> gpu_span;
+			for (auto& pass : submit.passes) {
+				if (!pass.begin_ticks || !pass.end_ticks) {
+					continue;
+				}
+				int64_t begin = gpu_ns(*pass.begin_ticks);
+				int64_t end = std::max(gpu_ns(*pass.end_ticks), begin);
+				e << ",\n{\"ph\":\"X\",\"cat\":\"vuk.gpu\",\"pid\":" << gpu_pid << ",\"tid\":" << submit.queue_index << ",\"ts\":" << us(begin)
+				  << ",\"dur\":" << us(end - begin) << ",\"name\":";
+				write_escaped(e, pass.name.is_invalid() ? std::string_view("<unnamed pass>") : pass.name.to_sv());
+				e << "}";
+				if (!gpu_span) {
+					gpu_span = SubmitSpan{ gpu_pid, submit.queue_index, begin, end };
+				} else {
+					gpu_span->begin_ns = std::min(gpu_span->begin_ns, begin);
+					gpu_span->end_ns = std::max(gpu_span->end_ns, end);
+				}
+			}
+			if (gpu_span) {
+				e << ",\n{\"ph\":\"X\",\"cat\":\"vuk.gpu\",\"pid\":" << gpu_pid << ",\"tid\":" << submit.queue_index << ",\"ts\":" << us(gpu_span->begin_ns)
+				  << ",\"dur\":" << us(gpu_span->end_ns - gpu_span->begin_ns) << ",\"name\":\"" << to_name(submit.domain) << " #" << submit.signal_value << "\"}";
+				// the submission on the CPU leads to the work on the GPU
+				SubmitSpan submit_point = cpu_span;
+				submit_point.end_ns = submit_point.begin_ns;
+				flow(submit_point, *gpu_span);
+			}
+			spans.emplace(key(submit.queue_index, submit.signal_value), gpu_span ? *gpu_span : cpu_span);
+		}
+
+		// queue waits
+		for (auto& submit : impl->submits) {
+			auto& waiter = spans.at(key(submit.queue_index, submit.signal_value));
+			for (auto& [queue_index, value] : submit.waits) {
+				auto it = spans.find(key(queue_index, value));
+				if (it != spans.end()) {
+					flow(it->second, waiter);
+				}
+			}
+		}
+
+		ss << "\n]}\n";
+		os << ss.str();
+	}
+} // namespace vuk
@@ -1,11 +1,15 @@
 #include "vuk/Util.hpp"
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/Future.hpp"
+#include "vuk/Instrumentation.hpp"
 #include "vuk/RenderGraph.hpp"
 #include "vuk/SampledImage.hpp"
+#include "vuk/TraceRecorder.hpp"
 
 #include <atomic>
+#include <chrono>
 #ifndef DOCTEST_CONFIG_DISABLE
 #include <doctest/doctest.h>
 #endif
@@ -24,17 +28,29 @@ namespace vuk {
 		std::array<std::atomic<uint64_t>, 3> last_device_waits;
 		std::atomic<uint64_t> last_host_wait;
 		uint32_t family_index;
-
-		QueueImpl(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
+		const InstrumentationCallbacks* instrumentation;
+
+		QueueImpl(PFN_vkQueueSubmit fn1,
+		          PFN_vkQueueSubmit2KHR fn2,
+		          VkQueue queue,
+		          uint32_t queue_family_index,
+		          TimelineSemaphore ts,
+		          const InstrumentationCallbacks* instrumentation) :
 		    queueSubmit(fn1),
 		    queueSubmit2KHR(fn2),
 		    submit_sync(ts),
 		    queue(queue),
-		    family_index(queue_family_index) {}
+		    family_index(queue_family_index),
+		    instrumentation(instrumentation) {}
 	};
 
-	Queue::Queue(PFN_vkQueueSubmit fn1, PFN_vkQueueSubmit2KHR fn2, VkQueue queue, uint32_t queue_family_index, TimelineSemaphore ts) :
-	    impl(new QueueImpl(fn1, fn2, queue, queue_family_index, ts)) {}
+	Queue::Queue(PFN_vkQueueSubmit fn1,
+	             PFN_vkQueueSubmit2KHR fn2,
+	             VkQueue queue,
+	             uint32_t queue_family_index,
+	             TimelineSemaphore ts,
+	             const InstrumentationCallbacks* instrumentation) :
+	    impl(new QueueImpl(fn1, fn2, queue, queue_family_index, ts, instrumentation)) {}
 	Queue::~Queue() {
 		delete impl;
 	}
@@ -55,6 +71,7 @@ namespace vuk {
 	}
 
 	Result<void> Queue::submit(std::span<VkSubmitInfo2KHR> sis, VkFence fence) {
+		VUK_ZONE(impl->instrumentation, "Queue submit");
 		VkResult result = impl->queueSubmit2KHR(impl->queue, (uint32_t)sis.size(), sis.data(), fence);
 		if (result != VK_SUCCESS) {
 			return { expected_error, VkException{ result } };
@@ -63,6 +80,7 @@ namespace vuk {
 	}
 
 	Result<void> Queue::submit(std::span<VkSubmitInfo> sis, VkFence fence) {
+		VUK_ZONE(impl->instrumentation, "Queue submit");
 		std::lock_guard _(impl->queue_lock);
 		VkResult result = impl->queueSubmit(impl->queue, (uint32_t)sis.size(), sis.data(), fence);
 		if (result != VK_SUCCESS) {
@@ -93,6 +111,7 @@ namespace vuk {
 		swi.pValues = values.data();
 		swi.semaphoreCount = count;
 		VkResult result = this->vkWaitSemaphores(device, &swi, UINT64_MAX);
+		get_frame_stat_counters().host_waits += 1;
 		for (auto [domain, v] : queue_waits) {
 			auto& q = domain_to_queue(domain);
 			q.impl->last_host_wait.store(v);
@@ -104,7 +123,9 @@ namespace vuk {
 	}
 
 	Result<void> link_execute_submit(Allocator& allocator, Compiler& compiler, std::span<std::shared_ptr<RenderGraph>> rgs) {
-		auto erg = compiler.link(rgs, {});
+		auto erg = compiler.link(rgs,
+		                         { .instrumentation = allocator.get_context().get_instrumentation_callbacks(),
+		                           .layout_promotion = allocator.get_context().get_layout_promotion_options() });
 		if (!erg) {
 			return erg;
 		}
@@ -298,6 +319,9 @@ namespace vuk {
 	}
 #endif
 
+	// notes a binary semaphore waited on by a submit or present in the frame resource of the allocator, implemented in DeviceFrameResource.cpp
+	void record_semaphore_waited(Allocator& allocator, VkSemaphore semaphore);
+
 	Result<void> submit(Allocator& allocator, SubmitBundle bundle, VkSemaphore present_rdy, VkSemaphore render_complete) {
 		Context& ctx = allocator.get_context();
 
@@ -341,6 +365,14 @@ namespace vuk {
 				std::swap(bundle.batches[0], bundle.batches[1]); // FIXME: silence some false positive validation
 			}
 		}
+		TraceRecorder* recorder = ctx.get_trace_recorder();
+		struct TracedSubmit {
+			SubmitInfo* submit_info;
+			uint64_t signal_value;
+			std::vector<std::pair<DomainFlagBits, uint64_t>> waits;
+		};
+		std::vector<TracedSubmit> traced_submits;
+
 		for (SubmitBatch& batch : bundle.batches) {
 			auto domain = batch.domain;
 			Queue& queue = ctx.domain_to_queue(domain);
@@ -419,6 +451,14 @@ namespace vuk {
 					fut->initial_visibility = ssi.value;
 				}
 
+				if (recorder) {
+					TracedSubmit& traced = traced_submits.emplace_back(TracedSubmit{ &submit_info, ssi.value });
+					for (auto& w : submit_info.relative_waits) {
+						traced.waits.emplace_back(w.first, queue_progress_references[ctx.domain_to_queue_index(w.first)] + w.second);
+					}
+					traced.waits.insert(traced.waits.end(), submit_info.absolute_waits.begin(), submit_info.absolute_waits.end());
+				}
+
 				uint32_t signal_sema_count = 1;
 				signal_semas.emplace_back(ssi);
 				if (domain == DomainFlagBits::eGraphicsQueue && i == batch.submits.size() - 1 &&
@@ -442,7 +482,24 @@ namespace vuk {
 				si.signalSemaphoreInfoCount = signal_sema_count;
 			}
 
+			auto submit_begin = std::chrono::steady_clock::now();
 			VUK_DO_OR_RETURN(queue.submit(std::span{ sis }, *fence));
+			// the signal of the acquire is consumed - the semaphore can be reused once the frame is recycled
+			for (auto& w : wait_semas) {
+				if (w.semaphore == present_rdy) {
+					record_semaphore_waited(allocator, present_rdy);
+				}
+			}
+			auto& stats = ctx.get_frame_stat_counters();
+			stats.submits += sis.size();
+			stats.command_buffers += cbufsis.size();
+			if (recorder) {
+				auto submit_end = std::chrono::steady_clock::now();
+				for (auto& traced : traced_submits) {
+					recorder->record_submit(domain, traced.signal_value, traced.waits, traced.submit_info->pass_timestamps, submit_begin, submit_end);
+				}
+				traced_submits.clear();
+			}
 		}
 
 		return { expected_value };
@@ -466,7 +523,7 @@ namespace vuk {
 		return { expected_value };
 	}
 
-	Result<VkResult> present_to_one(Context& ctx, SingleSwapchainRenderBundle&& bundle) {
+	static Result<VkResult> present_to_one(Context& ctx, Allocator* allocator, SingleSwapchainRenderBundle&& bundle) {
 		VkPresentInfoKHR pi{ .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
 		pi.swapchainCount = 1;
 		pi.pSwapchains = &bundle.swapchain->swapchain;
@@ -474,6 +531,11 @@ namespace vuk {
 		pi.waitSemaphoreCount = 1;
 		pi.pWaitSemaphores = &bundle.render_complete;
 		auto present_result = ctx.vkQueuePresentKHR(ctx.graphics_queue->impl->queue, &pi);
+		// the wait of the present executes even if the presentation engine rejects the image
+		if (allocator && (present_result == VK_SUCCESS || present_result == VK_SUBOPTIMAL_KHR || present_result == VK_ERROR_OUT_OF_DATE_KHR ||
+		                  present_result == VK_ERROR_SURFACE_LOST_KHR)) {
+			record_semaphore_waited(*allocator, bundle.render_complete);
+		}
 		if (present_result != VK_SUCCESS && present_result != VK_SUBOPTIMAL_KHR) {
 			return { expected_error, VkException{ present_result } };
 		}
@@ -483,6 +545,14 @@ namespace vuk {
 		return { expected_value, VK_SUCCESS };
 	}
 
+	Result<VkResult> present_to_one(Context& ctx, SingleSwapchainRenderBundle&& bundle) {
+		return present_to_one(ctx, nullptr, std::move(bundle));
+	}
+
+	Result<VkResult> present_to_one(Allocator& allocator, SingleSwapchainRenderBundle&& bundle) {
+		return present_to_one(allocator.get_context(), &allocator, std::move(bundle));
+	}
+
 	Result<SingleSwapchainRenderBundle> acquire_one(Allocator& allocator, SwapchainRef swapchain) {
 		Context& ctx = allocator.get_context();
 		Unique<std::array<VkSemaphore, 2>> semas(allocator);
@@ -528,7 +598,7 @@ namespace vuk {
 		if (!bundle2) {
 			return bundle2;
 		}
-		return present_to_one(allocator.get_context(), std::move(*bundle2));
+		return present_to_one(allocator, std::move(*bundle2));
 	}
 
 	Result<void> execute_submit_and_wait(Allocator& allocator, ExecutableRenderGraph&& rg) {
@@ -541,6 +611,12 @@ namespace vuk {
 
 	Result<VkResult> present(Allocator& allocator, Compiler& compiler, SwapchainRef swapchain, Future&& future, RenderGraphCompileOptions compile_options) {
 		auto ptr = future.get_render_graph();
+		if (!compile_options.instrumentation) {
+			compile_options.instrumentation = allocator.get_context().get_instrumentation_callbacks();
+		}
+		if (!compile_options.layout_promotion) {
+			compile_options.layout_promotion = allocator.get_context().get_layout_promotion_options();
+		}
 		auto erg = compiler.link(std::span{ &ptr, 1 }, compile_options);
 		if (!erg) {
 			return erg;
@@ -603,6 +679,7 @@ namespace vuk {
 	}
 
 	Result<void> Future::wait(Allocator& allocator, Compiler& compiler) {
+		VUK_ZONE(allocator.get_context().get_instrumentation_callbacks(), "Future wait");
 		if (control->status == FutureBase::Status::eInitial && !rg) {
 			return { expected_error,
 				       RenderGraphException{} }; // can't get wait for future that has not been attached anything or has been attached into a rendergraph
@@ -613,7 +690,9 @@ namespace vuk {
 			allocator.get_context().wait_for_domains(std::span{ &w, 1 });
 			return { expected_value };
 		} else {
-			auto erg = compiler.link(std::span{ &rg, 1 }, {});
+			auto erg = compiler.link(std::span{ &rg, 1 },
+			                         { .instrumentation = allocator.get_context().get_instrumentation_callbacks(),
+			                           .layout_promotion = allocator.get_context().get_layout_promotion_options() });
 			if (!erg) {
 				return erg;
 			}
@@ -642,7 +721,9 @@ namespace vuk {
 			return { expected_value }; // nothing to do
 		} else {
 			control->status = FutureBase::Status::eSubmitted;
-			auto erg = compiler.link(std::span{ &rg, 1 }, {});
+			auto erg = compiler.link(std::span{ &rg, 1 },
+			                         { .instrumentation = allocator.get_context().get_instrumentation_callbacks(),
+			                           .layout_promotion = allocator.get_context().get_layout_promotion_options() });
 			if (!erg) {
 				return erg;
 			}
@@ -4,6 +4,7 @@
 #include "vuk/AllocatorHelpers.hpp"
 #include "vuk/CommandBuffer.hpp"
 #include "vuk/Context.hpp"
+#include "vuk/NullDevice.hpp"
 #include "vuk/RenderGraph.hpp"
 #include "vuk/resources/DeviceFrameResource.hpp"
 #include <VkBootstrap.h>
@@ -21,8 +22,20 @@ namespace vuk {
 		vkb::Device vkbdevice;
 		std::optional<DeviceSuperFrameResource> sfa_resource;
 		std::optional<Allocator> allocator;
+		std::optional<NullDevice> null_device;
 
 		bool bringup() {
+#if VUK_TESTS_NULL_DEVICE
+			has_rt = false;
+			null_device.emplace();
+			context.emplace(null_device->get_context_create_parameters());
+			device = context->device;
+			physical_device = context->physical_device;
+			sfa_resource.emplace(*context, 3);
+			allocator.emplace(*sfa_resource);
+			needs_bringup = false;
+			return true;
+#else
 			vkb::InstanceBuilder builder;
 			builder.request_validation_layers()
 			    .set_debug_callback([](VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -86,6 +99,7 @@ namespace vuk {
 			vk11features.shaderDrawParameters = true;
 			VkPhysicalDeviceFeatures2 vk10features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR };
 			vk10features.features.shaderInt64 = true;
+			vk10features.features.pipelineStatisticsQuery = true;
 			VkPhysicalDeviceSynchronization2FeaturesKHR sync_feat{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
 				                                                     .synchronization2 = true };
 			VkPhysicalDeviceAccelerationStructureFeaturesKHR accelFeature{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
@@ -137,11 +151,18 @@ namespace vuk {
 			allocator.emplace(*sfa_resource);
 			needs_bringup = false;
 			return true;
+#endif
 		}
 
 		bool teardown() {
 			context->wait_idle();
+			allocator.reset();
+			sfa_resource.reset();
 			context.reset();
+			if (null_device) {
+				null_device.reset();
+				return true;
+			}
 			vkb::destroy_device(vkbdevice);
 			vkb::destroy_instance(vkbinstance);
 			return true;
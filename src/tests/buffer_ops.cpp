@@ -1,7 +1,12 @@
 #include "TestContext.hpp"
 #include "vuk/AllocatorHelpers.hpp"
+#include "vuk/CommandStream.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/Partials.hpp"
+#include "vuk/TraceRecorder.hpp"
 #include <doctest/doctest.h>
+#include <sstream>
+#include <thread>
 
 using namespace vuk;
 
@@ -45,4 +50,576 @@ TEST_CASE("test buffer upload/download") {
 		auto res = download_buffer(fut).get<Buffer>(*test_context.allocator, test_context.compiler);
 		CHECK(std::span((uint32_t*)res->mapped_ptr, 5) == std::span(data));
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("trace recorder") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	TraceRecorder recorder(ctx);
+	recorder.begin_capture();
+	CHECK(ctx.get_trace_recorder() == &recorder);
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	recorder.end_capture();
+	CHECK(ctx.get_trace_recorder() == nullptr);
+
+	std::stringstream ss;
+	recorder.write_json(ss);
+	auto json = ss.str();
+	CHECK(json.starts_with("{\"displayTimeUnit\""));
+	CHECK(json.find("\"name\":\"Submit ") != std::string::npos);
+	CHECK(json.ends_with("]}\n"));
+}
+
+TEST_CASE("forked command buffers") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("fork");
+	rg->attach_buffer("dst", **buf);
+	size_t forked = 0;
+	// each child fills its own quarter of the buffer with its index
+	rg->add_pass({ .name = "forking", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [&forked](CommandBuffer& cbuf) {
+		              auto children = cbuf.fork(4);
+		              forked = children.size();
+		              Buffer dst = *cbuf.get_resource_buffer("dst");
+		              std::vector<std::thread> threads;
+		              for (uint32_t i = 0; i < children.size(); i++) {
+			              threads.emplace_back([child = children[i], quarter = dst.subrange(i * 4, 4), i] { child->fill_buffer(quarter, 4, i + 1); });
+		              }
+		              for (auto& t : threads) {
+			              t.join();
+		              }
+		              cbuf.join();
+	              } });
+
+	auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+	REQUIRE(res);
+	CHECK(forked == 4);
+	auto expected = { 1u, 2u, 3u, 4u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+}
+
+TEST_CASE("forked command buffers with pass statistics") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("fork_statistics");
+	rg->attach_buffer("dst", **buf);
+	rg->add_pass({ .name = "forking", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+		              auto children = cbuf.fork(2);
+		              Buffer dst = *cbuf.get_resource_buffer("dst");
+		              for (uint32_t i = 0; i < children.size(); i++) {
+			              children[i]->fill_buffer(dst.subrange(i * 8, 8), 8, i + 1);
+		              }
+		              cbuf.join();
+	              } });
+	rg->add_pass({ .name = "measured", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "dst+"_buffer >> eTransferWrite >> "dst++" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.fill_buffer(cbuf.get_resource_buffer("dst+")->subrange(12, 4), 4, 3);
+	              } });
+
+	ctx.set_pass_statistics_enabled(true);
+	auto res = download_buffer(Future{ rg, "dst++" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+	ctx.set_pass_statistics_enabled(false);
+	REQUIRE(res);
+	auto expected = { 1u, 1u, 2u, 3u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+	// results are read back in next_frame
+	ctx.next_frame();
+
+	// the query around the forking pass was ended before the secondaries executed
+	auto statistics = ctx.retrieve_pass_statistics();
+	REQUIRE(statistics.size() == 1);
+	CHECK(statistics[0].pass == Name("measured"));
+}
+
+TEST_CASE("command stream") {
+	REQUIRE(test_context.prepare());
+	CommandStream stream;
+	auto& recording = CommandStream::get_recording_functions();
+	recording.vkCmdDraw(stream.handle(), 3, 1, 0, 0);
+	recording.vkCmdDraw(stream.handle(), 3, 2, 0, 1);
+	uint32_t value = 7;
+	recording.vkCmdPushConstants(stream.handle(), VK_NULL_HANDLE, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(value), &value);
+	CHECK(stream.size() == 3);
+	std::stringstream ss;
+	stream.dump(ss);
+	CHECK(ss.str().find("1: Draw vertices 0+3 instances 1+2") != std::string::npos);
+	CHECK(ss.str().find("2: PushConstants bytes 0+4") != std::string::npos);
+	stream.clear();
+	CHECK(stream.empty());
+
+	// the same pass recorded directly and through a stream (to be replayed) leaves the same contents behind
+	auto run = [&](bool streamed) {
+		auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("streamed");
+		rg->attach_buffer("dst", **buf);
+		rg->add_pass({ .name = "fill", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+			              cbuf.fill_buffer("dst", 8, 1u);
+			              uint32_t hi[] = { 2u, 3u };
+			              cbuf.update_buffer(cbuf.get_resource_buffer("dst")->subrange(8, 8), sizeof(hi), hi);
+		              },
+		               .content_key = streamed ? 1u : 0u });
+		auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+		REQUIRE(res);
+		auto data = (uint32_t*)res->mapped_ptr;
+		return std::vector<uint32_t>(data, data + 4);
+	};
+	auto direct = run(false);
+	auto streamed = run(true);
+	CHECK(direct == std::vector<uint32_t>{ 1u, 1u, 2u, 3u });
+	CHECK(streamed == direct);
+}
+
+#if VUK_USE_SHADERC && VUK_TESTS_NULL_DEVICE
+TEST_CASE("draw merging") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+void main() { gl_Position = vec4(float(gl_VertexIndex), float(gl_InstanceIndex), 0, 1); })",
+	              "merging.vert");
+	pbci.add_glsl(R"(#version 450
+layout(location = 0) out vec4 color;
+void main() { color = vec4(1); })",
+	              "merging.frag");
+	ctx.create_named_pipeline("merging", pbci);
+
+	auto count_draws = [&](bool merging) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("merging");
+		rg->attach_image("target",
+		                 ImageAttachment{ .usage = ImageUsageFlagBits::eColorAttachment,
+		                                  .extent = Dimension3D::absolute(4, 4),
+		                                  .format = Format::eR8G8B8A8Unorm,
+		                                  .sample_count = Samples::e1,
+		                                  .view_type = ImageViewType::e2D,
+		                                  .base_level = 0,
+		                                  .level_count = 1,
+		                                  .base_layer = 0,
+		                                  .layer_count = 1 });
+		// the first four draws continue each other's instance range, the last one does not
+		rg->add_pass({ .name = "draws", .resources = { "target"_image >> eColorWrite >> "target+" }, .execute = [merging](CommandBuffer& cbuf) {
+			              cbuf.set_draw_merging(merging)
+			                  .set_viewport(0, Rect2D::framebuffer())
+			                  .set_scissor(0, Rect2D::framebuffer())
+			                  .set_rasterization({})
+			                  .set_color_blend("target", {})
+			                  .bind_graphics_pipeline("merging");
+			              for (uint32_t i = 0; i < 4; i++) {
+				              cbuf.draw(3, 1, 0, i);
+			              }
+			              cbuf.draw(3, 1, 0, 8);
+		              } });
+		auto before = test_context.null_device->get_stats().draws;
+		Compiler compiler;
+		auto erg = compiler.link(std::span{ &rg, 1 }, {});
+		REQUIRE(erg);
+		REQUIRE(execute_submit_and_wait(*test_context.allocator, std::move(*erg)));
+		return test_context.null_device->get_stats().draws - before;
+	};
+	CHECK(count_draws(false) == 5);
+	CHECK(count_draws(true) == 2);
+}
+#endif
+
+TEST_CASE("replayed passes") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	size_t executed = 0;
+	// the buffer is cleared by a pass that is not replayed, so the contents come from the replayed fill
+	auto record = [&] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("replayed");
+		rg->attach_buffer("dst", **buf);
+		rg->add_pass({ .name = "clear", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+			              cbuf.fill_buffer("dst", 16, 0u);
+		              } });
+		rg->add_pass({ .name = "fill", .resources = { "dst+"_buffer >> eTransferWrite >> "dst++" }, .execute = [&executed](CommandBuffer& cbuf) {
+			              executed++;
+			              cbuf.fill_buffer("dst+", 8, 1u);
+		              },
+		               .content_key = 1 });
+		auto res = download_buffer(Future{ rg, "dst++" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+		REQUIRE(res);
+		auto data = (uint32_t*)res->mapped_ptr;
+		return std::vector<uint32_t>(data, data + 4);
+	};
+	auto expected = std::vector<uint32_t>{ 1u, 1u, 0u, 0u };
+	ctx.invalidate_recorded_passes();
+	ctx.next_frame();
+	CHECK(record() == expected);
+	CHECK(record() == expected);
+	CHECK(executed == 1);
+	ctx.next_frame();
+	CHECK(ctx.get_frame_stats().passes_replayed == 1);
+	ctx.invalidate_recorded_passes();
+	CHECK(record() == expected);
+	CHECK(executed == 2);
+}
+
+TEST_CASE("replayed passes referring to other buffers") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	auto other = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	size_t executed = 0;
+	// the other buffer is not a resource of the pass, so it is not part of the key - it could be destroyed before a replay
+	auto record = [&] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("replayed_other");
+		rg->attach_buffer("dst", **buf);
+		rg->add_pass({ .name = "fill", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [&executed, &other](CommandBuffer& cbuf) {
+			              executed++;
+			              cbuf.fill_buffer("dst", 16, 1u);
+			              cbuf.fill_buffer(**other, 16, 2u);
+		              },
+		               .content_key = 1 });
+		REQUIRE(Future{ rg, "dst+" }.wait(*test_context.allocator, test_context.compiler));
+	};
+	ctx.invalidate_recorded_passes();
+	record();
+	record();
+	CHECK(executed == 2);
+}
+
+#if VUK_USE_SHADERC
+TEST_CASE("replayed passes with descriptor sets") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+layout(local_size_x = 4) in;
+layout(std430, binding = 0) buffer Data { uint data[]; };
+void main() { data[gl_GlobalInvocationID.x] = gl_GlobalInvocationID.x + 1; })",
+	              "replayed.comp");
+	ctx.create_named_pipeline("replayed_indices", pbci);
+
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	size_t executed = 0;
+	// every execution is in a new frame, so the per-frame descriptor sets of earlier frames are recycled
+	auto record = [&] {
+		Allocator frame_allocator(test_context.sfa_resource->get_next_frame());
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("replayed_sets");
+		rg->attach_buffer("dst", **buf);
+		rg->add_pass({ .name = "clear", .resources = { "dst"_buffer >> eTransferWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+			              cbuf.fill_buffer("dst", 16, 0u);
+		              } });
+		rg->add_pass({ .name = "indices", .resources = { "dst+"_buffer >> eComputeWrite >> "dst++" }, .execute = [&executed](CommandBuffer& cbuf) {
+			              executed++;
+			              cbuf.bind_compute_pipeline("replayed_indices").bind_buffer(0, 0, "dst+").dispatch(1);
+		              },
+		               .content_key = 1 });
+		auto res = download_buffer(Future{ rg, "dst++" }).get<Buffer>(frame_allocator, test_context.compiler);
+		REQUIRE(res);
+		auto data = (uint32_t*)res->mapped_ptr;
+		return std::vector<uint32_t>(data, data + 4);
+	};
+	auto expected = std::vector<uint32_t>{ 1u, 2u, 3u, 4u };
+	ctx.invalidate_recorded_passes();
+	ctx.next_frame();
+	record();
+	auto replayed = record();
+	// binding a descriptor set does not keep the pass from being replayed
+	CHECK(executed == 1);
+	ctx.next_frame();
+	CHECK(ctx.get_frame_stats().passes_replayed == 1);
+	for (size_t i = 0; i < 4; i++) {
+		replayed = record();
+	}
+	// the set is owned by the recording, so it is still valid after the frame it was allocated in was recycled
+	CHECK(executed == 1);
+#if !VUK_TESTS_NULL_DEVICE
+	CHECK(replayed == expected);
+#endif
+	// collecting the caches drops the recordings, as their pipelines may be gone
+	test_context.sfa_resource->force_collect();
+	replayed = record();
+	CHECK(executed == 2);
+#if !VUK_TESTS_NULL_DEVICE
+	CHECK(replayed == expected);
+#endif
+}
+#endif
+
+#if VUK_USE_SHADERC
+TEST_CASE("redundant binds") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+layout(local_size_x = 4) in;
+layout(std430, binding = 0) buffer Data { uint data[]; };
+void main() { data[gl_GlobalInvocationID.x] = gl_GlobalInvocationID.x + 1; })",
+	              "redundant.comp");
+	ctx.create_named_pipeline("redundant_indices", pbci);
+
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("redundant");
+	rg->attach_buffer("dst", **buf);
+	uint64_t elided = 0;
+	// the second dispatch binds the same pipeline and buffer, so the pipeline and descriptor set binds are elided
+	rg->add_pass({ .name = "indices", .resources = { "dst"_buffer >> eComputeWrite >> "dst+" }, .execute = [&elided](CommandBuffer& cbuf) {
+		              cbuf.bind_compute_pipeline("redundant_indices").bind_buffer(0, 0, "dst").dispatch(1);
+		              auto before = cbuf.get_elided_call_count();
+		              cbuf.bind_compute_pipeline("redundant_indices").bind_buffer(0, 0, "dst").dispatch(1);
+		              elided = cbuf.get_elided_call_count() - before;
+	              } });
+	ctx.next_frame();
+	auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+	REQUIRE(res);
+	CHECK(elided == 2);
+	ctx.next_frame();
+	CHECK(ctx.get_frame_stats().redundant_binds_elided >= 2);
+#if !VUK_TESTS_NULL_DEVICE
+	auto expected = { 1u, 2u, 3u, 4u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+#endif
+}
+#endif
+
+#if VUK_USE_SHADERC
+TEST_CASE("resolved state reuse") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+layout(local_size_x = 4) in;
+layout(constant_id = 0) const uint base = 0;
+layout(std430, binding = 0) buffer Data { uint data[]; };
+void main() { data[gl_GlobalInvocationID.x] = base + gl_GlobalInvocationID.x + 1; })",
+	              "reuse.comp");
+	ctx.create_named_pipeline("reuse_indices", pbci);
+
+	// the second range starts at the buffer offset alignment of the device
+	size_t second = ctx.min_buffer_alignment;
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, second + 16, 1 });
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("reuse");
+	rg->attach_buffer("dst", **buf);
+	uint64_t changed_elided = 0;
+	uint64_t repeated_elided = 0;
+	// changing a specialization constant or a binding must not reuse the pipeline or set of the previous dispatch, repeating them must
+	rg->add_pass({ .name = "indices", .resources = { "dst"_buffer >> eComputeWrite >> "dst+" }, .execute = [&](CommandBuffer& cbuf) {
+		              Buffer dst = *cbuf.get_resource_buffer("dst");
+		              cbuf.bind_compute_pipeline("reuse_indices").specialize_constants(0, 0u).bind_buffer(0, 0, dst.subrange(0, 16)).dispatch(1);
+		              auto before = cbuf.get_elided_call_count();
+		              cbuf.bind_compute_pipeline("reuse_indices").specialize_constants(0, 10u).bind_buffer(0, 0, dst.subrange(second, 16)).dispatch(1);
+		              changed_elided = cbuf.get_elided_call_count() - before;
+		              before = cbuf.get_elided_call_count();
+		              cbuf.bind_compute_pipeline("reuse_indices").specialize_constants(0, 10u).bind_buffer(0, 0, dst.subrange(second, 16)).dispatch(1);
+		              repeated_elided = cbuf.get_elided_call_count() - before;
+	              } });
+	auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+	REQUIRE(res);
+	CHECK(changed_elided == 0);
+	CHECK(repeated_elided == 2);
+#if !VUK_TESTS_NULL_DEVICE
+	auto expected_first = { 1u, 2u, 3u, 4u };
+	auto expected_second = { 11u, 12u, 13u, 14u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected_first));
+	CHECK(std::span((uint32_t*)(res->mapped_ptr + second), 4) == std::span(expected_second));
+#endif
+}
+#endif
+
+#if VUK_USE_SHADERC
+TEST_CASE("scratch ring dynamic offsets") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+layout(local_size_x = 1) in;
+layout(binding = 0) uniform Params { uint index; uint value; };
+layout(std430, binding = 1) buffer Data { uint data[]; };
+void main() { data[index] = value; })",
+	              "scratch.comp");
+	pbci.set_binding_dynamic(0, 0);
+	ctx.create_named_pipeline("scratch_params", pbci);
+
+	struct Params {
+		uint32_t index;
+		uint32_t value;
+	};
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("scratch");
+	rg->attach_buffer("dst", **buf);
+	// every dispatch gets its own uniforms from the ring, each must see the values written for it
+	rg->add_pass({ .name = "params", .resources = { "dst"_buffer >> eComputeWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.bind_compute_pipeline("scratch_params").bind_buffer(0, 1, "dst");
+		              for (uint32_t i = 0; i < 4; i++) {
+			              *cbuf.map_scratch_buffer<Params>(0, 0) = { i, (i + 1) * 10 };
+			              cbuf.dispatch(1);
+		              }
+	              } });
+#if VUK_TESTS_NULL_DEVICE
+	auto sets_before = test_context.null_device->get_stats().descriptor_sets_allocated;
+#endif
+	auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+	REQUIRE(res);
+#if VUK_TESTS_NULL_DEVICE
+	// only the dynamic offset changes between the dispatches, so they share one descriptor set
+	CHECK(test_context.null_device->get_stats().descriptor_sets_allocated - sets_before <= 1);
+#else
+	auto expected = { 10u, 20u, 30u, 40u };
+	CHECK(std::span((uint32_t*)res->mapped_ptr, 4) == std::span(expected));
+#endif
+}
+#endif
+
+TEST_CASE("pass statistics") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 12, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("statistics");
+	rg->attach_buffer("src", **buf);
+	rg->add_pass({ .name = "measured", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "src"_buffer >> eComputeRW >> "src+" } });
+
+	ctx.set_pass_statistics_enabled(true);
+	Future fut{ rg, "src+" };
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	ctx.set_pass_statistics_enabled(false);
+	// results are read back in next_frame
+	ctx.next_frame();
+
+	auto statistics = ctx.retrieve_pass_statistics();
+	REQUIRE(statistics.size() == 1);
+	CHECK(statistics[0].pass == Name("measured"));
+	// not inside a render pass
+	CHECK(!statistics[0].occlusion_measured);
+	CHECK(ctx.retrieve_pass_statistics().empty());
+}
+
+#if VUK_USE_SHADERC
+TEST_CASE("pass statistics of a dispatch") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	pbci.add_glsl(R"(#version 450
+layout(local_size_x = 4) in;
+layout(std430, binding = 0) buffer Data { uint data[]; };
+void main() { data[gl_GlobalInvocationID.x] = 1; })",
+	              "statistics.comp");
+	ctx.create_named_pipeline("statistics_dispatch", pbci);
+
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("statistics_dispatch");
+	rg->attach_buffer("dst", **buf);
+	rg->add_pass({ .name = "dispatch", .resources = { "dst"_buffer >> eComputeWrite >> "dst+" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.bind_compute_pipeline("statistics_dispatch").bind_buffer(0, 0, "dst").dispatch(1);
+	              } });
+
+	ctx.set_pass_statistics_enabled(true);
+	Future fut{ rg, "dst+" };
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	ctx.set_pass_statistics_enabled(false);
+	ctx.next_frame();
+
+	auto statistics = ctx.retrieve_pass_statistics();
+	REQUIRE(statistics.size() == 1);
+	CHECK(statistics[0].pass == Name("dispatch"));
+	CHECK(!statistics[0].occlusion_measured);
+#if !VUK_TESTS_NULL_DEVICE
+	// the null device reports zeroes for every query
+	CHECK(statistics[0].statistics.compute_shader_invocations > 0);
+#endif
+}
+
+TEST_CASE("pass statistics in a render pass") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	PipelineBaseCreateInfo pbci;
+	// a triangle covering the whole target
+	pbci.add_glsl(R"(#version 450
+void main() { gl_Position = vec4(vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2 - 1, 0, 1); })",
+	              "statistics.vert");
+	pbci.add_glsl(R"(#version 450
+layout(location = 0) out vec4 color;
+void main() { color = vec4(1); })",
+	              "statistics.frag");
+	ctx.create_named_pipeline("statistics_draw", pbci);
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("statistics_draw");
+	rg->attach_image("target",
+	                 ImageAttachment{ .usage = ImageUsageFlagBits::eColorAttachment,
+	                                  .extent = Dimension3D::absolute(4, 4),
+	                                  .format = Format::eR8G8B8A8Unorm,
+	                                  .sample_count = Samples::e1,
+	                                  .view_type = ImageViewType::e2D,
+	                                  .base_level = 0,
+	                                  .level_count = 1,
+	                                  .base_layer = 0,
+	                                  .layer_count = 1 });
+	rg->add_pass({ .name = "draw", .resources = { "target"_image >> eColorWrite >> "target+" }, .execute = [](CommandBuffer& cbuf) {
+		              cbuf.set_viewport(0, Rect2D::framebuffer())
+		                  .set_scissor(0, Rect2D::framebuffer())
+		                  .set_rasterization({})
+		                  .set_color_blend("target", {})
+		                  .bind_graphics_pipeline("statistics_draw")
+		                  .draw(3, 1, 0, 0);
+	              } });
+
+	ctx.set_pass_statistics_enabled(true);
+	Compiler compiler;
+	auto erg = compiler.link(std::span{ &rg, 1 }, {});
+	REQUIRE(erg);
+	REQUIRE(execute_submit_and_wait(*test_context.allocator, std::move(*erg)));
+	ctx.set_pass_statistics_enabled(false);
+	ctx.next_frame();
+
+	auto statistics = ctx.retrieve_pass_statistics();
+	REQUIRE(statistics.size() == 1);
+	CHECK(statistics[0].pass == Name("draw"));
+	// inside a render pass, so samples are counted with an occlusion query
+	CHECK(statistics[0].occlusion_measured);
+#if !VUK_TESTS_NULL_DEVICE
+	CHECK(statistics[0].statistics.vertex_shader_invocations > 0);
+	// the occlusion query is not precise, only passing samples at all are guaranteed to be reported
+	CHECK(statistics[0].statistics.samples_passed > 0);
+#endif
+}
+#endif
+
+#if VUK_INSTRUMENTATION
+#include "vuk/Instrumentation.hpp"
+
+namespace {
+	struct ZoneRecorder {
+		int depth = 0;
+		int max_depth = 0;
+		std::vector<std::string> zones;
+		std::vector<std::string> counters;
+	};
+} // namespace
+
+TEST_CASE("instrumentation zones") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 12, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("zones");
+	rg->attach_buffer("src", **buf);
+	rg->add_pass({ .name = "a", .resources = { "src"_buffer >> eComputeRW >> "src+" } });
+	rg->add_pass({ .name = "b", .resources = { "src+"_buffer >> eTransferRead } });
+
+	ZoneRecorder recorder;
+	InstrumentationCallbacks callbacks{ .begin_zone =
+		                                    [](void* user_data, const InstrumentationZone& zone, const char*) -> void* {
+			                                    auto& r = *reinterpret_cast<ZoneRecorder*>(user_data);
+			                                    r.zones.emplace_back(zone.name);
+			                                    r.max_depth = std::max(r.max_depth, ++r.depth);
+			                                    return nullptr;
+		                                    },
+		                                .end_zone = [](void* user_data, void*) { reinterpret_cast<ZoneRecorder*>(user_data)->depth--; },
+		                                .counter = [](void* user_data, const char* name,
+		                                              double) { reinterpret_cast<ZoneRecorder*>(user_data)->counters.emplace_back(name); },
+		                                .user_data = &recorder };
+
+	Compiler compiler;
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, { .instrumentation = &callbacks }));
+	CHECK(recorder.depth == 0);
+	// phases are nested in the compile and link zones
+	CHECK(recorder.max_depth == 2);
+	CHECK(std::find(recorder.zones.begin(), recorder.zones.end(), "Barrier generation") != recorder.zones.end());
+	CHECK(std::find(recorder.counters.begin(), recorder.counters.end(), "vuk passes") != recorder.counters.end());
+}
+#endif
@@ -1,7 +1,14 @@
 #include "TestContext.hpp"
+#include "vuk/NullDevice.hpp"
 #include "vuk/AllocatorHelpers.hpp"
+#include "vuk/FrameStats.hpp"
 #include "vuk/Partials.hpp"
+#include "vuk/resources/DeviceNullResource.hpp"
+#include "vuk/resources/DeviceTracingResource.hpp"
+#include <algorithm>
 #include <doctest/doctest.h>
+#include <sstream>
+#include <thread>
 
 using namespace vuk;
 
@@ -29,6 +36,16 @@ struct AllocatorChecker : DeviceNestedResource {
 		counter -= src.size();
 		upstream->deallocate_images(src);
 	}
+
+	Result<void, AllocateException> allocate_semaphores(std::span<VkSemaphore> dst, SourceLocationAtFrame loc) override {
+		counter += dst.size();
+		return upstream->allocate_semaphores(dst, loc);
+	}
+
+	void deallocate_semaphores(std::span<const VkSemaphore> src) override {
+		counter -= src.size();
+		upstream->deallocate_semaphores(src);
+	}
 };
 
 TEST_CASE("superframe allocator, uncached resource") {
@@ -48,6 +65,245 @@ TEST_CASE("superframe allocator, uncached resource") {
 	REQUIRE(ac.counter == 0);
 }
 
+TEST_CASE("superframe allocator, recycled semaphores") {
+	REQUIRE(test_context.prepare());
+
+	DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 4, 1 });
+
+	VkSemaphore sema1;
+	{
+		Allocator frame_allocator(sfr.get_next_frame());
+		frame_allocator.allocate_semaphores(std::span{ &sema1, 1 });
+		// the first submit signals the semaphore, and the second waits on it
+		std::pair<VkSemaphore, VkSemaphore> wait_signal[] = { { VK_NULL_HANDLE, sema1 }, { sema1, VK_NULL_HANDLE } };
+		for (auto [wait, signal] : wait_signal) {
+			std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("semaphore");
+			rg->attach_buffer("dst", **buf);
+			rg->add_pass({ .name = "fill", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "dst"_buffer >> eTransferWrite }, .execute = [](CommandBuffer& cbuf) {
+				              cbuf.fill_buffer("dst", 4, 1);
+			              } });
+			Compiler compiler;
+			auto erg = compiler.link(std::span{ &rg, 1 }, {});
+			REQUIRE(erg);
+			std::pair v = { &frame_allocator, &*erg };
+			REQUIRE(execute_submit(frame_allocator, std::span{ &v, 1 }, {}, wait, signal));
+		}
+	}
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+	VkSemaphore sema2;
+	{
+		auto& fa = sfr.get_next_frame();
+		fa.allocate_semaphores(std::span{ &sema2, 1 }, {});
+	}
+	REQUIRE(sema1 == sema2);
+}
+
+TEST_CASE("superframe allocator, unwaited semaphores") {
+	REQUIRE(test_context.prepare());
+
+	AllocatorChecker ac(*test_context.sfa_resource);
+	DeviceSuperFrameResource sfr(ac, 2);
+
+	VkSemaphore sema;
+	{
+		auto& fa = sfr.get_next_frame();
+		// might be signalled by a submit outside of vuk - no vuk submit waited on it
+		fa.allocate_semaphores(std::span{ &sema, 1 }, {});
+	}
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+	sfr.get_next_frame();
+	// destroyed instead of recycled
+	CHECK(ac.counter == 0);
+}
+
+TEST_CASE("superframe allocator, descriptor pools sized from usage") {
+	REQUIRE(test_context.prepare());
+
+	auto& ctx = *test_context.context;
+	VkDescriptorSetLayoutBinding binding{ .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_ALL };
+	VkDescriptorSetLayoutCreateInfo dslci{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1, .pBindings = &binding };
+	DescriptorSetLayoutAllocInfo dslai;
+	ctx.vkCreateDescriptorSetLayout(ctx.device, &dslci, nullptr, &dslai.layout);
+	dslai.descriptor_counts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] = 1;
+	{
+		DeviceSuperFrameResource sfr(*test_context.sfa_resource, 2);
+
+		const size_t num_sets = 100;
+		std::vector<DescriptorSetLayoutAllocInfo> cis(num_sets, dslai);
+		std::vector<DescriptorSet> sets(num_sets);
+		for (size_t i = 0; i < 6; i++) {
+			auto& fa = sfr.get_next_frame();
+			REQUIRE(fa.allocate_descriptor_sets(sets, cis, {}));
+		}
+		sfr.get_next_frame();
+		auto stats = sfr.get_descriptor_pool_stats();
+		REQUIRE(stats.sets_used == num_sets);
+		REQUIRE(stats.descriptors_used[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] == num_sets);
+		// after a few frames the pools only hold the types that are used, and fit the whole frame
+		REQUIRE(stats.overflow_pools == 0);
+		REQUIRE(stats.descriptor_capacity[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] >= num_sets);
+		REQUIRE(stats.descriptor_capacity[VK_DESCRIPTOR_TYPE_SAMPLER] == 0);
+		REQUIRE(stats.utilization() > 0.5f);
+
+		// a spike within a single call grows the pools geometrically, instead of adding many small pools
+		const size_t spike = 20 * num_sets;
+		std::vector<DescriptorSetLayoutAllocInfo> spike_cis(spike, dslai);
+		std::vector<DescriptorSet> spike_sets(spike);
+		{
+			auto& fa = sfr.get_next_frame();
+			REQUIRE(fa.allocate_descriptor_sets(spike_sets, spike_cis, {}));
+		}
+		sfr.get_next_frame();
+		sfr.get_next_frame();
+		stats = sfr.get_descriptor_pool_stats();
+		REQUIRE(stats.sets_used == spike);
+		CHECK(stats.overflow_pools <= 6);
+	}
+	ctx.vkDestroyDescriptorSetLayout(ctx.device, dslai.layout, nullptr);
+}
+
+TEST_CASE("frame allocator, multithreaded allocation") {
+	REQUIRE(test_context.prepare());
+
+	AllocatorChecker ac(*test_context.sfa_resource);
+	{
+		DeviceSuperFrameResource sfr(ac, 2);
+
+		const size_t num_threads = 8;
+		const size_t num_allocations = 1024;
+		auto& fa = sfr.get_next_frame();
+		std::vector<std::vector<Buffer>> buffers(num_threads);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < num_threads; i++) {
+			threads.emplace_back([&, i]() {
+				BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUtoGPU, .size = 256, .alignment = 16 };
+				for (size_t j = 0; j < num_allocations; j++) {
+					Buffer buf;
+					if (fa.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, {})) {
+						buffers[i].push_back(buf);
+					}
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		// every allocation succeeded, and no two threads were handed the same memory
+		std::vector<Buffer> all;
+		for (auto& b : buffers) {
+			all.insert(all.end(), b.begin(), b.end());
+		}
+		REQUIRE(all.size() == num_threads * num_allocations);
+		std::sort(all.begin(), all.end(), [](const Buffer& a, const Buffer& b) { return a.buffer < b.buffer || (a.buffer == b.buffer && a.offset < b.offset); });
+		for (size_t i = 1; i < all.size(); i++) {
+			if (all[i].buffer == all[i - 1].buffer) {
+				REQUIRE(all[i - 1].offset + all[i - 1].size <= all[i].offset);
+			}
+		}
+		sfr.get_next_frame();
+		sfr.get_next_frame();
+	}
+	REQUIRE(ac.counter == 0);
+}
+
+TEST_CASE("direct allocator, memory telemetry") {
+	REQUIRE(test_context.prepare());
+
+	auto& vk_resource = test_context.context->get_vk_resource();
+	uint32_t crossings = 0;
+	auto cb_id = vk_resource.add_memory_budget_callback(0.f, [&](uint32_t heap_index, const HeapMemoryStats& stats, bool above) {
+		if (above) {
+			crossings++;
+		}
+	});
+
+	auto before = vk_resource.get_memory_stats();
+	auto& usage_before = before.usages[(int)MemoryUsage::eCPUonly - 1];
+	Buffer buf;
+	BufferCreateInfo bci{ .mem_usage = vuk::MemoryUsage::eCPUonly, .size = 1024 * 1024 };
+	auto loc = VUK_HERE_AND_NOW();
+	REQUIRE(vk_resource.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, loc));
+	REQUIRE(crossings > 0);
+
+	auto during = vk_resource.get_memory_stats();
+	auto& usage_during = during.usages[(int)MemoryUsage::eCPUonly - 1];
+	REQUIRE(usage_during.count == usage_before.count + 1);
+	REQUIRE(usage_during.bytes >= usage_before.bytes + bci.size);
+	auto site = std::find_if(during.sites.begin(), during.sites.end(), [&](const AllocationSiteStats& s) { return s.location.line() == loc.location.line(); });
+	REQUIRE(site != during.sites.end());
+	REQUIRE(site->stats.bytes >= bci.size);
+
+	vk_resource.deallocate_buffers(std::span{ &buf, 1 });
+	vk_resource.remove_memory_budget_callback(cb_id);
+	auto after = vk_resource.get_memory_stats();
+	REQUIRE(after.usages[(int)MemoryUsage::eCPUonly - 1].count == usage_before.count);
+}
+
+TEST_CASE("allocation trace, record and replay without a device") {
+	DeviceNullResource recorded_upstream;
+	DeviceTracingResource tracer(recorded_upstream);
+
+	std::vector<Buffer> buffers(8);
+	for (uint64_t frame = 0; frame < 4; frame++) {
+		tracer.next_frame(frame);
+		for (size_t i = 0; i < buffers.size(); i++) {
+			if (buffers[i]) {
+				tracer.deallocate_buffers(std::span{ &buffers[i], 1 });
+			}
+			BufferCreateInfo bci{ .mem_usage = i % 2 ? MemoryUsage::eCPUtoGPU : MemoryUsage::eGPUonly, .size = 1024 * (i + frame + 1), .alignment = 256 };
+			REQUIRE(tracer.allocate_buffers(std::span{ &buffers[i], 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW()));
+		}
+		Image image;
+		ImageCreateInfo ici{ .format = Format::eR8G8B8A8Unorm, .extent = { 64, 64, 1 }, .mipLevels = 7, .usage = ImageUsageFlagBits::eSampled };
+		REQUIRE(tracer.allocate_images(std::span{ &image, 1 }, std::span{ &ici, 1 }, VUK_HERE_AND_NOW()));
+		tracer.deallocate_images(std::span{ &image, 1 });
+	}
+	tracer.deallocate_buffers(buffers);
+	auto recorded_stats = recorded_upstream.get_memory_stats();
+
+	std::stringstream stream;
+	tracer.get_trace().serialize(stream);
+	auto trace = AllocationTrace::deserialize(stream);
+	REQUIRE(trace);
+	REQUIRE(trace->events.size() == tracer.get_trace().events.size());
+
+	DeviceNullResource replayed_upstream;
+	auto report = replay_trace(*trace, replayed_upstream);
+	REQUIRE(report.frames == 4);
+	REQUIRE(report.allocations == 4 * (buffers.size() + 1));
+	REQUIRE(report.deallocations == report.allocations);
+	REQUIRE(report.failed_allocations == 0);
+
+	auto replayed_stats = replayed_upstream.get_memory_stats();
+	for (size_t i = 0; i < replayed_stats.size(); i++) {
+		REQUIRE(replayed_stats[i].peak_bytes == recorded_stats[i].peak_bytes);
+		REQUIRE(replayed_stats[i].allocated_bytes == 0);
+	}
+}
+
+TEST_CASE("null device, context and superframe allocator") {
+	NullDevice null_device;
+	{
+		Context ctx(null_device.get_context_create_parameters());
+		DeviceSuperFrameResource sfr(ctx, 2);
+		for (int frame = 0; frame < 4; frame++) {
+			auto& fr = sfr.get_next_frame();
+			Buffer buf;
+			BufferCreateInfo bci{ .mem_usage = MemoryUsage::eCPUtoGPU, .size = 1024 };
+			REQUIRE(fr.allocate_buffers(std::span{ &buf, 1 }, std::span{ &bci, 1 }, VUK_HERE_AND_NOW()));
+			REQUIRE(buf.mapped_ptr);
+			REQUIRE(buf.device_address != 0);
+			std::fill_n(buf.mapped_ptr, bci.size, std::byte{ 0xff });
+			ctx.next_frame();
+		}
+		REQUIRE(null_device.get_stats().device_memory_bytes > 0);
+	}
+	REQUIRE(null_device.get_stats().device_memory_bytes == 0);
+}
+
 /* TEST_CASE("frame allocator, uncached resource") {
 	REQUIRE(test_context.prepare());
 
@@ -177,4 +433,27 @@ TEST_CASE("multiframe allocator, cached resource identity for different MFAs") {
 	REQUIRE(im3 != im4);
 	REQUIRE((im3 != im1 && im3 != im2));
 	REQUIRE((im4 != im1 && im4 != im2));
-}
\ No newline at end of file
+}
+
+TEST_CASE("frame stats") {
+	REQUIRE(test_context.prepare());
+	auto& ctx = *test_context.context;
+	// start from a fresh frame
+	ctx.next_frame();
+	auto data = { 1u, 2u, 3u };
+	auto [buf, fut] = create_buffer(*test_context.allocator, MemoryUsage::eGPUonly, DomainFlagBits::eAny, std::span(data));
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	auto frame = ctx.get_frame_count();
+	ctx.next_frame();
+
+	auto stats = ctx.get_frame_stats();
+	CHECK(stats.absolute_frame == frame);
+	CHECK(stats.passes_compiled >= 1);
+	CHECK(stats.passes_recorded >= 1);
+	CHECK(stats.submits >= 1);
+	CHECK(stats.command_buffers >= 1);
+	CHECK(stats.host_waits >= 1);
+	// the next frame starts from zero
+	ctx.next_frame();
+	CHECK(ctx.get_frame_stats().submits == 0);
+}
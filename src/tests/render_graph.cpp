@@ -0,0 +1,324 @@
+#include "TestContext.hpp"
+#include "vuk/AllocatorHelpers.hpp"
+#include "vuk/Partials.hpp"
+#include <doctest/doctest.h>
+
+using namespace vuk;
+
+TEST_CASE("compile stats") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 12, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("stats");
+	rg->attach_buffer("src", **buf);
+	rg->add_pass({ .name = "a", .resources = { "src"_buffer >> eComputeRW >> "src+" } });
+	rg->add_pass({ .name = "b", .resources = { "src+"_buffer >> eComputeRW >> "src++" } });
+	rg->add_pass({ .name = "c", .resources = { "src++"_buffer >> eTransferRead } });
+
+	Compiler compiler;
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, {}));
+	auto compile_stats = compiler.get_compile_stats();
+	CHECK(compile_stats.passes == 3);
+	CHECK(compile_stats.chains >= 1);
+	CHECK(compile_stats.memory_barriers == 0);
+	CHECK(compile_stats.arena_bytes_used > 0);
+
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	auto& link_stats = compiler.get_compile_stats();
+	CHECK(link_stats.passes == 3);
+	// a dependency between each pair of passes
+	CHECK(link_stats.memory_barriers >= 2);
+	CHECK(link_stats.render_passes_before_merge == 0);
+	auto& t = link_stats.phase_times;
+	double sum = t.inlining + t.link_building + t.chain_collection + t.scheduling + t.queue_inference + t.partitioning + t.resource_linking +
+	             t.render_pass_assignment + t.barrier_generation + t.render_pass_merge + t.batching + t.render_pass_building;
+	CHECK(link_stats.total_time >= sum);
+}
+
+TEST_CASE("memoized passes") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	size_t executed = 0;
+	// the fill value is the parameter of the pass, a skipped pass must leave the contents of its last execution behind
+	auto run = [&](uint32_t value) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("memoized");
+		rg->attach_buffer("dst", **buf);
+		rg->add_pass({ .name = "fill",
+		               .resources = { "dst"_buffer >> eTransferWrite >> "dst+" },
+		               .execute = [&executed, value](CommandBuffer& cbuf) {
+			               executed++;
+			               cbuf.fill_buffer("dst", 16, value);
+		               },
+		               .pure = true,
+		               .parameter_hash = value });
+		auto res = download_buffer(Future{ rg, "dst+" }).get<Buffer>(*test_context.allocator, test_context.compiler);
+		REQUIRE(res);
+		auto data = (uint32_t*)res->mapped_ptr;
+		return std::vector<uint32_t>(data, data + 4);
+	};
+	CHECK(run(1) == std::vector<uint32_t>(4, 1u));
+	CHECK(run(1) == std::vector<uint32_t>(4, 1u));
+	CHECK(executed == 1);
+	CHECK(test_context.compiler.get_compile_stats().passes_memoized == 1);
+	CHECK(run(2) == std::vector<uint32_t>(4, 2u));
+	CHECK(executed == 2);
+}
+
+TEST_CASE("history resources") {
+	REQUIRE(test_context.prepare());
+	ImageAttachment ia{ .usage = ImageUsageFlagBits::eTransferDst | ImageUsageFlagBits::eTransferSrc,
+		                  .extent = Dimension3D::absolute(4, 4),
+		                  .format = Format::eR8G8B8A8Unorm,
+		                  .sample_count = Samples::e1,
+		                  .view_type = ImageViewType::e2D,
+		                  .base_level = 0,
+		                  .level_count = 1,
+		                  .base_layer = 0,
+		                  .layer_count = 1 };
+	auto readback = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUtoCPU, 4 * 4 * 4, 1 });
+	// every execution writes the current image, and reads back the first texel of the previous one
+	auto run = [&](ClearColor color) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("history");
+		REQUIRE(rg->attach_history("hist", ia, *test_context.sfa_resource));
+		rg->attach_buffer("readback", **readback);
+		rg->add_pass({ .name = "write",
+		               .resources = { "hist"_image >> eTransferWrite >> "hist+", "hist@prev"_image >> eTransferRead, "readback"_buffer >> eTransferWrite >> "readback+" },
+		               .execute = [color](CommandBuffer& cbuf) {
+			               cbuf.clear_image("hist", color);
+			               BufferImageCopy bic{ .imageSubresource = { .aspectMask = ImageAspectFlagBits::eColor }, .imageExtent = { 4, 4, 1 } };
+			               cbuf.copy_image_to_buffer("hist@prev", "readback", bic);
+		               } });
+		Future fut{ rg, "readback+" };
+		REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+		return *(uint32_t*)(*readback)->mapped_ptr;
+	};
+	run(ClearColor{ 1.f, 0.f, 0.f, 1.f });
+	HistoryImages* history = *test_context.sfa_resource->acquire_history_images("hist", ia, 2);
+	CHECK(history->executions == 1);
+	// the image written is the previous image of the next execution, in the layout it was left in
+	CHECK(history->last_uses[history->slot(1)].layout == ImageLayout::eTransferDstOptimal);
+	CHECK(history->last_uses[history->slot(0)].layout == ImageLayout::eTransferSrcOptimal);
+	auto previous = run(ClearColor{ 0.f, 1.f, 0.f, 1.f });
+	CHECK(history->executions == 2);
+	CHECK(history->last_uses[history->slot(0)].layout == ImageLayout::eTransferSrcOptimal);
+	auto before_previous = run(ClearColor{ 0.f, 0.f, 1.f, 1.f });
+#if !VUK_TESTS_NULL_DEVICE
+	// what one execution wrote is read as @prev in the next one
+	CHECK(previous == 0xff0000ffu);
+	CHECK(before_previous == 0xff00ff00u);
+#endif
+}
+
+TEST_CASE("subresource tracking") {
+	REQUIRE(test_context.prepare());
+	auto make_graph = [] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("subresources");
+		rg->attach_image("img",
+		                 ImageAttachment{ .usage = ImageUsageFlagBits::eTransferDst | ImageUsageFlagBits::eTransferSrc,
+		                                  .extent = Dimension3D::absolute(4, 4),
+		                                  .format = Format::eR8G8B8A8Unorm,
+		                                  .sample_count = Samples::e1,
+		                                  .view_type = ImageViewType::e2D,
+		                                  .base_level = 0,
+		                                  .level_count = 3,
+		                                  .base_layer = 0,
+		                                  .layer_count = 1 });
+		return rg;
+	};
+
+	Compiler compiler;
+	// each pass reads the previous mip and writes the next one of the same image
+	// every barrier covers the single mip that is accessed: L0 and L1 before mip1, L1 and L2 before mip2
+	auto rg = make_graph();
+	rg->add_pass({ .name = "mip1",
+	               .resources = { "img"_image[{ .base_level = 0, .level_count = 1 }] >> eTransferRead,
+	                              "img"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferWrite >> "img+" } });
+	rg->add_pass({ .name = "mip2",
+	               .resources = { "img+"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferRead,
+	                              "img+"_image[{ .base_level = 2, .level_count = 1 }] >> eTransferWrite >> "img++" } });
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	CHECK(compiler.get_compile_stats().image_barriers == 4);
+	CHECK(compiler.get_compile_stats().image_barrier_subresources == 4);
+
+	// writes to disjoint mips only transition their own mip, the second write does not wait on the first
+	rg = make_graph();
+	rg->add_pass({ .name = "w0", .resources = { "img"_image[{ .base_level = 0, .level_count = 1 }] >> eTransferWrite >> "img+" } });
+	rg->add_pass({ .name = "w1", .resources = { "img+"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferWrite >> "img++" } });
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	CHECK(compiler.get_compile_stats().image_barriers == 2);
+	CHECK(compiler.get_compile_stats().image_barrier_subresources == 2);
+
+	// a use of the whole image waits on both parts
+	rg = make_graph();
+	rg->add_pass({ .name = "w0", .resources = { "img"_image[{ .base_level = 0, .level_count = 1 }] >> eTransferWrite >> "img+" } });
+	rg->add_pass({ .name = "w1", .resources = { "img+"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferWrite >> "img++" } });
+	rg->add_pass({ .name = "read", .resources = { "img++"_image >> eTransferRead } });
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	CHECK(compiler.get_compile_stats().image_barriers == 5);
+	CHECK(compiler.get_compile_stats().image_barrier_subresources == 5);
+
+	// the passes still execute
+	rg = make_graph();
+	size_t executed = 0;
+	rg->add_pass({ .name = "mip1",
+	               .resources = { "img"_image[{ .base_level = 0, .level_count = 1 }] >> eTransferRead,
+	                              "img"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferWrite >> "img+" },
+	               .execute = [&executed](CommandBuffer&) {
+		               executed++;
+	               } });
+	rg->add_pass({ .name = "mip2",
+	               .resources = { "img+"_image[{ .base_level = 1, .level_count = 1 }] >> eTransferRead,
+	                              "img+"_image[{ .base_level = 2, .level_count = 1 }] >> eTransferWrite >> "img++" },
+	               .execute = [&executed](CommandBuffer&) {
+		               executed++;
+	               } });
+	Future fut{ rg, "img++" };
+	REQUIRE(fut.wait(*test_context.allocator, test_context.compiler));
+	CHECK(executed == 2);
+}
+
+TEST_CASE("buffer range tracking") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("buffer ranges");
+	rg->attach_buffer("buf", **buf);
+	// the two halves are written independently, the read only depends on the first half
+	rg->add_pass({ .name = "lo", .resources = { "buf"_buffer[{ .offset = 0, .size = 8 }] >> eTransferWrite >> "buf+" } });
+	rg->add_pass({ .name = "hi", .resources = { "buf+"_buffer[{ .offset = 8, .size = 8 }] >> eTransferWrite >> "buf++" } });
+	rg->add_pass({ .name = "read", .resources = { "buf++"_buffer[{ .offset = 0, .size = 8 }] >> eTransferRead } });
+
+	Compiler compiler;
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	auto& stats = compiler.get_compile_stats();
+	CHECK(stats.buffer_barriers == 1);
+	CHECK(stats.memory_barriers == 0);
+}
+
+TEST_CASE("buffer range tracking, read after read") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+
+	std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("buffer reads");
+	rg->attach_buffer("buf", **buf);
+	rg->add_pass({ .name = "write", .resources = { "buf"_buffer >> eTransferWrite >> "buf+" } });
+	rg->add_pass({ .name = "compute", .resources = { "buf+"_buffer[{ .offset = 0, .size = 8 }] >> eComputeRead } });
+	rg->add_pass({ .name = "hi", .resources = { "buf+"_buffer[{ .offset = 8, .size = 8 }] >> eTransferWrite >> "buf++" } });
+	rg->add_pass({ .name = "vertex", .resources = { "buf++"_buffer[{ .offset = 0, .size = 8 }] >> eVertexRead } });
+
+	Compiler compiler;
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	// write -> compute, write -> hi, and compute -> vertex: the vertex read depends on the first write through the compute read
+	CHECK(compiler.get_compile_stats().buffer_barriers == 3);
+}
+
+TEST_CASE("pass reordering") {
+	REQUIRE(test_context.prepare());
+	auto buf = allocate_buffer(*test_context.allocator, { MemoryUsage::eGPUonly, 16, 1 });
+	auto make_graph = [&] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("reordering");
+		auto ia = ImageAttachment{ .usage = ImageUsageFlagBits::eColorAttachment,
+			                         .extent = Dimension3D::absolute(4, 4),
+			                         .format = Format::eR8G8B8A8Unorm,
+			                         .sample_count = Samples::e1,
+			                         .view_type = ImageViewType::e2D,
+			                         .base_level = 0,
+			                         .level_count = 1,
+			                         .base_layer = 0,
+			                         .layer_count = 1 };
+		rg->attach_image("a", ia);
+		rg->attach_image("b", ia);
+		rg->attach_buffer("buf", **buf);
+		// two modules rendering to their own attachment, with b1 also depending on a0 - scheduling interleaves them as b0, a0, b1, a1
+		rg->add_pass({ .name = "a0", .resources = { "a"_image >> eColorWrite >> "a+", "buf"_buffer >> eTransferWrite >> "buf+" } });
+		rg->add_pass({ .name = "b0", .resources = { "b"_image >> eColorWrite >> "b+" } });
+		rg->add_pass({ .name = "a1", .resources = { "a+"_image >> eColorRW >> "a++" } });
+		rg->add_pass({ .name = "b1", .resources = { "b+"_image >> eColorRW >> "b++", "buf+"_buffer >> eTransferRead } });
+		return rg;
+	};
+
+	Compiler compiler;
+	auto rg = make_graph();
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	auto render_passes_scheduled = compiler.get_compile_stats().render_passes_after_merge;
+
+	rg = make_graph();
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, { .reorder_passes = true }));
+	auto& stats = compiler.get_compile_stats();
+	CHECK(stats.reordering.merge_candidates_after > stats.reordering.merge_candidates_before);
+	CHECK(stats.reordering.resource_switches_after <= stats.reordering.resource_switches_before);
+	CHECK(stats.reordering.passes_moved > 0);
+	CHECK(stats.render_passes_after_merge < render_passes_scheduled);
+}
+
+TEST_CASE("layout promotion") {
+	REQUIRE(test_context.prepare());
+	auto make_graph = [] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("promotion");
+		rg->attach_image("img",
+		                 ImageAttachment{ .usage = ImageUsageFlagBits::eStorage | ImageUsageFlagBits::eSampled,
+		                                  .extent = Dimension3D::absolute(4, 4),
+		                                  .format = Format::eR8G8B8A8Unorm,
+		                                  .sample_count = Samples::e1,
+		                                  .view_type = ImageViewType::e2D,
+		                                  .base_level = 0,
+		                                  .level_count = 1,
+		                                  .base_layer = 0,
+		                                  .layer_count = 1 });
+		// storage and sampled uses alternate, each one would transition the image
+		rg->add_pass({ .name = "write0", .resources = { "img"_image >> eComputeWrite >> "img+" } });
+		rg->add_pass({ .name = "sample0", .resources = { "img+"_image >> eComputeSampled } });
+		rg->add_pass({ .name = "write1", .resources = { "img+"_image >> eComputeRW >> "img++" } });
+		rg->add_pass({ .name = "sample1", .resources = { "img++"_image >> eComputeSampled } });
+		return rg;
+	};
+
+	Compiler compiler;
+	// nothing is promoted unless a profile opts in
+	auto rg = make_graph();
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, {}));
+	CHECK(compiler.get_compile_stats().chains_promoted_to_general == 0);
+
+	rg = make_graph();
+	LayoutPromotionOptions alternation{ .promote_storage_sampled_alternation = true };
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, { .layout_promotion = &alternation }));
+	CHECK(compiler.get_compile_stats().chains_promoted_to_general == 1);
+
+	rg = make_graph();
+	LayoutPromotionOptions transitions{ .max_layout_transitions = 2 };
+	REQUIRE(compiler.compile(std::span{ &rg, 1 }, { .layout_promotion = &transitions }));
+	CHECK(compiler.get_compile_stats().chains_promoted_to_general == 1);
+}
+
+TEST_CASE("concurrent sharing") {
+	REQUIRE(test_context.prepare());
+	auto make_graph = [] {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("concurrent");
+		rg->attach_image("img",
+		                 ImageAttachment{ .usage = ImageUsageFlagBits::eStorage | ImageUsageFlagBits::eSampled,
+		                                  .extent = Dimension3D::absolute(4, 4),
+		                                  .format = Format::eR8G8B8A8Unorm,
+		                                  .sample_count = Samples::e1,
+		                                  .view_type = ImageViewType::e2D,
+		                                  .base_level = 0,
+		                                  .level_count = 1,
+		                                  .base_layer = 0,
+		                                  .layer_count = 1 });
+		// produced by async compute, consumed on graphics
+		rg->add_pass({ .name = "produce", .execute_on = DomainFlagBits::eComputeQueue, .resources = { "img"_image >> eComputeWrite >> "img+" } });
+		rg->add_pass({ .name = "consume", .execute_on = DomainFlagBits::eGraphicsQueue, .resources = { "img+"_image >> eFragmentSampled } });
+		return rg;
+	};
+
+	Compiler compiler;
+	auto rg = make_graph();
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, {}));
+	auto exclusive_barriers = compiler.get_compile_stats().image_barriers;
+
+	rg = make_graph();
+	REQUIRE(compiler.link(std::span{ &rg, 1 }, { .concurrent_sharing = true }));
+	auto& stats = compiler.get_compile_stats();
+	CHECK(stats.chains_shared_concurrently == 1);
+	// the release barrier on the compute queue is gone
+	CHECK(stats.image_barriers == exclusive_barriers - 1);
+}
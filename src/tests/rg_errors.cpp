@@ -29,4 +29,36 @@ TEST_CASE("error: cbuf references unknown resource") {
 	auto ex = compiler.link(std::span{ &rg, 1 }, {});
 	REQUIRE((bool)ex);
 	REQUIRE_THROWS(ex->execute(*test_context.allocator, {}));
-}
\ No newline at end of file
+}
+
+TEST_CASE("error: history image used on another queue") {
+	REQUIRE(test_context.prepare());
+
+	ImageAttachment ia{ .usage = ImageUsageFlagBits::eTransferDst,
+		                  .extent = Dimension3D::absolute(4, 4),
+		                  .format = Format::eR8G8B8A8Unorm,
+		                  .sample_count = Samples::e1,
+		                  .view_type = ImageViewType::e2D,
+		                  .base_level = 0,
+		                  .level_count = 1,
+		                  .base_layer = 0,
+		                  .layer_count = 1 };
+	auto make_rg = [&](DomainFlagBits queue) {
+		std::shared_ptr<RenderGraph> rg = std::make_shared<RenderGraph>("history_queue");
+		REQUIRE(rg->attach_history("hist_queue", ia, *test_context.sfa_resource));
+		rg->add_pass({ .name = "write", .execute_on = queue, .resources = { "hist_queue"_image >> eTransferWrite } });
+		return rg;
+	};
+
+	// both images of the history are written on the transfer queue
+	for (int i = 0; i < 2; i++) {
+		auto rg = make_rg(DomainFlagBits::eTransferQueue);
+		Compiler compiler;
+		auto erg = compiler.link(std::span{ &rg, 1 }, {});
+		REQUIRE(erg);
+		REQUIRE(execute_submit_and_wait(*test_context.allocator, std::move(*erg)));
+	}
+	auto rg = make_rg(DomainFlagBits::eGraphicsQueue);
+	Compiler compiler;
+	REQUIRE_THROWS(compiler.link(std::span{ &rg, 1 }, {}));
+}